@@ -2,4 +2,8 @@ mkdir -p build
 cp Makefile build
 cd build
 make all
+make texcook
+./texcook ../png/*.png
+make sndcook
+./sndcook ../wav/*.wav
 ./PUBG
\ No newline at end of file
@@ -0,0 +1,10 @@
+// per-frame state, uploaded once a frame by FrameData (see framedata.h) and pulled into a shader with
+// #include "framedata.glsl"; this is the only place it is declared, and FrameData::Block has to match it
+layout(std140) uniform FrameData
+{
+	mat4 projection;
+	mat4 view;
+	vec4 cameraPos;			// xyz
+	vec4 sun;				// xyz, direction towards the sun
+	vec4 fogColor;			// rgb, and a is 1.0 while fog is on (0.0 otherwise)
+} frame;
@@ -1,8 +1,6 @@
 #version 150
 
-uniform mat4 u_Projection;
-uniform mat4 u_Model;
-uniform mat4 u_View;
+#include "framedata.glsl"
 
 uniform float u_GrassAreaRadius;
 uniform float u_WaveTime;
@@ -10,15 +8,39 @@ uniform float u_WaveStrength;
 
 in vec3 a_Vertex;
 in vec4 a_Color;
+
+#ifdef CULLED
+// only blades that survived the culling pass are drawn, so each instance looks its blade up by index
+uniform samplerBuffer u_Matrices;		// same layout as the a_InstanceMatrix buffer: columns of every blade in turn
+uniform samplerBuffer u_Brightness;
+uniform samplerBuffer u_ShadowValues;
+uniform int u_NumBlades;
+
+in int a_BladeIndex;
+#else
 in float a_Brightness;
 in float a_ShadowValue;
 in mat4 a_InstanceMatrix;
+#endif
 
 out vec4 v_Color;
 
 void main()
 {
-	mat4 modelview = u_View * a_InstanceMatrix;
+#ifdef CULLED
+	mat4 instanceMatrix = mat4(texelFetch(u_Matrices, a_BladeIndex),
+							   texelFetch(u_Matrices, a_BladeIndex + u_NumBlades),
+							   texelFetch(u_Matrices, a_BladeIndex + u_NumBlades * 2),
+							   texelFetch(u_Matrices, a_BladeIndex + u_NumBlades * 3));
+	float brightness = texelFetch(u_Brightness, a_BladeIndex).r;
+	float shadowValue = texelFetch(u_ShadowValues, a_BladeIndex).r;
+#else
+	mat4 instanceMatrix = a_InstanceMatrix;
+	float brightness = a_Brightness;
+	float shadowValue = a_ShadowValue;
+#endif
+
+	mat4 modelview = frame.view * instanceMatrix;
 
 	// zero out out first column for a cylindrical billboard
 	modelview[0][1] = 0;
@@ -29,7 +51,7 @@ void main()
 	modelview[1][2] = 0;
 
 	// compute a wave amount that is dependent on our position and the height of the current vertex
-	float waveAmount = (-0.5 + sin(u_WaveTime + (a_InstanceMatrix[3][0] + a_InstanceMatrix[3][2]))) * u_WaveStrength * a_Vertex.y;
+	float waveAmount = (-0.5 + sin(u_WaveTime + (instanceMatrix[3][0] + instanceMatrix[3][2]))) * u_WaveStrength * a_Vertex.y;
 	vec4 vertex = vec4(a_Vertex.x + waveAmount, a_Vertex.y, a_Vertex.z + waveAmount, 1.0);
 
 	// now compute the position of this vertex based on the calculated wave and the cylindrical billboard
@@ -39,9 +61,9 @@ void main()
 	float opacity = 1.0 - (-pos.z / u_GrassAreaRadius);
 
 	// assign colour based on brightness and distance
-	v_Color = a_Color * a_Brightness * (1.0 - a_ShadowValue);
+	v_Color = a_Color * brightness * (1.0 - shadowValue);
 	v_Color.a = opacity;
 
 	// assign final vertex position
-	gl_Position = u_Projection * pos;
+	gl_Position = frame.projection * pos;
 }
@@ -0,0 +1,107 @@
+#version 150
+
+#include "framedata.glsl"
+
+uniform vec3 u_CameraRight;
+uniform vec3 u_CameraUp;
+
+// per config: the same ranges ParticleConfig hands to Particle::configure()
+uniform vec3 u_MotionLimits[2];
+uniform vec2 u_SpinLimits;
+uniform bool u_RandomOrientation;
+uniform vec2 u_StartSizeLimits;
+uniform vec2 u_EndSizeLimits;
+uniform vec4 u_StartColorLimits[2];
+uniform vec4 u_EndColorLimits[2];
+uniform vec2 u_LifeLimits;
+uniform vec2 u_InitialGravityLimits;
+uniform vec2 u_GravityRateLimits;
+uniform float u_StepsPerSecond;
+
+// per burst
+uniform vec3 u_Origin;
+uniform int u_Seed;
+uniform float u_Age;
+uniform float u_LifeFactor;
+
+out vec4 v_Color;
+out vec2 v_TexCoord;
+
+const vec2 vertices[] = vec2[4](
+  vec2(-0.5,  0.5),
+  vec2(-0.5, -0.5),
+  vec2(0.5,   0.5),
+  vec2(0.5,  -0.5)
+);
+
+const vec2 texCoords[] = vec2[4](
+  vec2(0.0, 1.0),
+  vec2(0.0, 0.0),
+  vec2(1.0, 1.0),
+  vec2(1.0, 0.0)
+);
+
+// integer hash (lowbias32); good enough to decorrelate neighbouring instance IDs
+uint hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// the k-th random number in [0, 1] of this particle
+float random(uint k)
+{
+	return float(hash(uint(u_Seed) ^ hash(uint(gl_InstanceID) * 32u + k))) / 4294967295.0;
+}
+
+void main()
+{
+	vec2 vertexCoord = vertices[gl_VertexID];
+	vec2 texCoord = texCoords[gl_VertexID];
+
+	// pick this particle's properties, exactly as Particle::configure() would
+	vec3 motion = mix(u_MotionLimits[0], u_MotionLimits[1], vec3(random(0u), random(1u), random(2u)));
+	float spin = mix(u_SpinLimits.x, u_SpinLimits.y, random(3u));
+	float angle = u_RandomOrientation ? mix(-3.14159265, 3.14159265, random(4u)) : 0.0;
+	float startSize = mix(u_StartSizeLimits.x, u_StartSizeLimits.y, random(5u)) * u_LifeFactor;
+	float endSize = mix(u_EndSizeLimits.x, u_EndSizeLimits.y, random(6u)) * u_LifeFactor;
+	vec4 startColor = mix(u_StartColorLimits[0], u_StartColorLimits[1], vec4(random(7u), random(8u), random(9u), random(10u)));
+	vec4 endColor = mix(u_EndColorLimits[0], u_EndColorLimits[1], vec4(random(11u), random(12u), random(13u), random(14u)));
+	float maxLife = mix(u_LifeLimits.x, u_LifeLimits.y, random(15u));
+	float gravity = mix(u_InitialGravityLimits.x, u_InitialGravityLimits.y, random(16u));
+	float gravityRate = mix(u_GravityRateLimits.x, u_GravityRateLimits.y, random(17u));
+
+	// Particle::update() moves by motion + gravity once per step while gravity grows by gravityRate * dt,
+	// so after n steps the drop is the sum of an arithmetic series
+	float n = u_Age * u_StepsPerSecond;
+	vec3 position = u_Origin + motion * n + vec3(0.0, gravity * n + gravityRate * n * (n - 1.0) * 0.5 / u_StepsPerSecond, 0.0);
+	angle += spin * n;
+
+	// interpolate appearance over the particle's life; dead particles shrink to nothing
+	float lifeFactor = clamp(u_Age / maxLife, 0.0, 1.0);
+	float size = u_Age < maxLife ? mix(startSize, endSize, lifeFactor) : 0.0;
+
+	// compute rotated corner points
+	float c = cos(angle);
+	float s = sin(angle);
+	vec3 vertex = vec3(vertexCoord.x * c - vertexCoord.y * s,
+					   vertexCoord.x * s + vertexCoord.y * c,
+					   0.0);
+
+	// apply particle size
+	vertex.x *= size;
+	vertex.y *= size;
+
+	// assign vertex color and texture coordinates
+	v_Color = mix(startColor, endColor, lifeFactor);
+	v_TexCoord = texCoord;
+
+	// assign billboarded position based on camera orientation vectors
+	mat4 viewProjection = frame.projection * frame.view;
+	gl_Position = viewProjection * vec4(position + u_CameraRight * vertex.x +
+												   u_CameraUp * vertex.y, 1.0);
+}
@@ -0,0 +1,62 @@
+#version 150
+
+#include "framedata.glsl"
+
+uniform vec3 u_CameraRight;
+uniform vec3 u_CameraUp;
+
+in vec3 a_Position;
+in float a_Angle;
+in float a_Life;
+in float a_MaxLife;
+in float a_StartSize;
+in float a_EndSize;
+in vec4 a_StartColor;
+in vec4 a_EndColor;
+
+out vec4 v_Color;
+out vec2 v_TexCoord;
+
+const vec2 vertices[] = vec2[4](
+  vec2(-0.5,  0.5),
+  vec2(-0.5, -0.5),
+  vec2(0.5,   0.5),
+  vec2(0.5,  -0.5)
+);
+
+const vec2 texCoords[] = vec2[4](
+  vec2(0.0, 1.0),
+  vec2(0.0, 0.0),
+  vec2(1.0, 1.0),
+  vec2(1.0, 0.0)
+);
+
+void main()
+{
+	vec2 vertexCoord = vertices[gl_VertexID];
+	vec2 texCoord = texCoords[gl_VertexID];
+
+	// interpolate appearance from how far through its life the particle is; dead particles shrink to nothing
+	float lifeFactor = 1.0 - (a_Life / a_MaxLife);
+	float size = a_Life > 0.0 ? mix(a_StartSize, a_EndSize, lifeFactor) : 0.0;
+
+	// compute rotated corner points
+	float c = cos(a_Angle);
+	float s = sin(a_Angle);
+	vec3 vertex = vec3(vertexCoord.x * c - vertexCoord.y * s,
+					   vertexCoord.x * s + vertexCoord.y * c,
+					   0.0);
+
+	// apply particle size
+	vertex.x *= size;
+	vertex.y *= size;
+
+	// assign vertex color and texture coordinates
+	v_Color = mix(a_StartColor, a_EndColor, lifeFactor);
+	v_TexCoord = texCoord;
+
+	// assign billboarded position based on camera orientation vectors
+	mat4 viewProjection = frame.projection * frame.view;
+	gl_Position = viewProjection * vec4(a_Position + u_CameraRight * vertex.x +
+													 u_CameraUp * vertex.y, 1.0);
+}
@@ -0,0 +1,29 @@
+#version 150
+
+uniform float u_DeltaTime;
+
+// state rewritten every frame
+in vec3 a_Position;
+in float a_Gravity;
+in float a_Angle;
+in float a_Life;
+
+// constants chosen at spawn time
+in vec3 a_Motion;
+in float a_GravityRate;
+in float a_Spin;
+
+// captured by transform feedback, interleaved in this order
+out vec3 v_Position;
+out float v_Gravity;
+out float v_Angle;
+out float v_Life;
+
+void main()
+{
+	// same integration as Particle::update()
+	v_Position = a_Position + a_Motion + vec3(0.0, a_Gravity, 0.0);
+	v_Angle = a_Angle + a_Spin;
+	v_Gravity = a_Gravity + a_GravityRate * u_DeltaTime;
+	v_Life = a_Life - u_DeltaTime;
+}
@@ -1,7 +1,7 @@
 #version 150
 
-uniform mat4 u_ProjectionMatrix;
-uniform mat4 u_ViewMatrix;
+#include "framedata.glsl"
+
 uniform vec3 u_CameraRight;
 uniform vec3 u_CameraUp;
 
@@ -48,7 +48,7 @@ void main()
     v_TexCoord = texCoord;
 
 	// assign billboarded position based on camera orientation vectors
-	mat4 viewProjection = u_ProjectionMatrix * u_ViewMatrix;
+	mat4 viewProjection = frame.projection * frame.view;
 	gl_Position = viewProjection * vec4(a_Position + u_CameraRight * vertex.x +
 													 u_CameraUp * vertex.y, 1.0);
 }
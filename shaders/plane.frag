@@ -2,19 +2,20 @@
 
 uniform sampler2D u_Texture;
 
-uniform vec4 u_Color;
-uniform vec3 fogColor;
-uniform bool fogFlag;
+#include "framedata.glsl"
 
 in vec2 v_TexCoord;
+in vec4 v_Color;
 in float visibility;
 
 out vec4 f_FragColor;
 
 void main()
 {
-	f_FragColor = texture(u_Texture, v_TexCoord) * u_Color;
-	if(fogFlag) {
-		f_FragColor = mix(vec4(fogColor, 1.0), f_FragColor, visibility);
+	f_FragColor = texture(u_Texture, v_TexCoord) * v_Color;
+#ifdef FOG
+	if(frame.fogColor.a > 0.0) {
+		f_FragColor = mix(vec4(frame.fogColor.rgb, 1.0), f_FragColor, visibility);
 	}
+#endif
 }
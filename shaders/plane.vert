@@ -1,13 +1,15 @@
 #version 150
 
 uniform mat4 u_Projection;
-uniform mat4 u_Model;
 uniform mat4 u_View;
 
 in vec2 a_Vertex;
 in vec2 a_TexCoord;
+in mat4 a_Model;						// per sprite
+in vec4 a_Color;
 
 out vec2 v_TexCoord;
+out vec4 v_Color;
 out float visibility;
 
 const float density = 0.01;
@@ -16,7 +18,8 @@ const float gradient = 0.6;
 void main()
 {
 	v_TexCoord = a_TexCoord;
-	gl_Position = u_Projection * u_View * u_Model * vec4(a_Vertex, 0.0, 1.0);
+	v_Color = a_Color;
+	gl_Position = u_Projection * u_View * a_Model * vec4(a_Vertex, 0.0, 1.0);
 	
 	float dist = length(gl_Position);
 	visibility = exp(-pow(dist * density, gradient));
@@ -1,8 +1,8 @@
 #version 150
 
 uniform sampler2D u_Texture;
-uniform vec3 fogColor;
-uniform bool fogFlag;
+
+#include "framedata.glsl"
 
 in vec2 v_TexCoord;
 in float visibility;
@@ -12,7 +12,9 @@ out vec4 f_FragColor;
 void main()
 {
 	f_FragColor = texture(u_Texture, v_TexCoord);
-	if(fogFlag) {
-		f_FragColor = mix(vec4(fogColor, 1.0), f_FragColor, visibility);
+#ifdef FOG
+	if(frame.fogColor.a > 0.0) {
+		f_FragColor = mix(vec4(frame.fogColor.rgb, 1.0), f_FragColor, visibility);
 	}
+#endif
 }
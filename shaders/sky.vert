@@ -1,8 +1,8 @@
 #version 150
 
-uniform mat4 u_Projection;
+#include "framedata.glsl"
+
 uniform mat4 u_Model;
-uniform mat4 u_View;
 
 in vec3 a_Vertex;
 in vec3 a_Normal;
@@ -17,7 +17,7 @@ const float gradient = 0.6;
 void main()
 {
 	v_TexCoord = a_TexCoord;
-	gl_Position = u_Projection * u_View * u_Model * vec4(a_Vertex, 1.0);
+	gl_Position = frame.projection * frame.view * u_Model * vec4(a_Vertex, 1.0);
 
 	float dist = length(gl_Position);
 	visibility = exp(-pow(dist * density, gradient));
@@ -1,7 +1,7 @@
 #version 150
 
-uniform mat4 u_Projection;
-uniform mat4 u_View;
+#include "framedata.glsl"
+
 uniform mat3 u_Normal;
 
 in vec3 a_Vertex;
@@ -18,11 +18,11 @@ const float gradient = 0.6;
 
 void main()
 {
-	vec4 v_VertexPos = u_View * a_Model * vec4(a_Vertex, 1.0);
+	vec4 v_VertexPos = frame.view * a_Model * vec4(a_Vertex, 1.0);
     v_Normal = normalize(u_Normal * a_Normal);
     v_TexCoord = a_TexCoord;
 
-    gl_Position = u_Projection * v_VertexPos;
+    gl_Position = frame.projection * v_VertexPos;
     
     float dist = length(gl_Position);
 	visibility = exp(-pow(dist * density, gradient));
@@ -1,21 +1,17 @@
 #version 150
 
-uniform mat4 u_View;
-
 uniform sampler2D u_DiffuseMap;
 uniform sampler2D u_NormalMap;
 uniform sampler2D u_SpecularMap;
 uniform sampler2D u_EmissionMap;
 
-uniform vec3 u_Sun;
-
 uniform vec3 u_MaterialDiffuse;
 uniform vec3 u_MaterialSpecular;
 uniform float u_SpecularIntensity;
 uniform float u_SpecularHardness;
 uniform float u_NormalMapStrength;
-uniform vec3 fogColor;
-uniform bool fogFlag;
+
+#include "framedata.glsl"
 
 in vec2 v_TexCoord;
 in vec3 v_Normal;
@@ -33,12 +29,12 @@ void main()
 	float d = dot(p, p);
 	float f = inversesqrt(d + 1.0);
 
-	vec3 sun = normalize(u_Sun);
+	vec3 sun = normalize(frame.sun.xyz);
 	vec3 normDelta = normalize(v_Normal + (p * u_NormalMapStrength));
 	float diffuse = max(dot(sun, normDelta), 0.1);
 
 	vec3 reflectDir = reflect(normDelta, sun);
-	float spec = max(dot(normalize(u_View[2].xyz), reflectDir), 0.0);
+	float spec = max(dot(normalize(frame.view[2].xyz), reflectDir), 0.0);
 	spec = pow(spec, u_SpecularHardness);
 	spec *= u_SpecularIntensity;
 
@@ -47,7 +43,9 @@ void main()
 	litColor = mix(litColor, texColor, minBrightness);
 
 	f_Color = vec4(litColor, 1.0);
-	if(fogFlag) {
-		f_Color = mix(vec4(fogColor, 1.0), f_Color, visibility);
+#ifdef FOG
+	if(frame.fogColor.a > 0.0) {
+		f_Color = mix(vec4(frame.fogColor.rgb, 1.0), f_Color, visibility);
 	}
+#endif
 }
@@ -1,13 +1,12 @@
 #version 150
 
-uniform mat4 u_Projection;
-uniform mat4 u_View;
-uniform mat4 u_Model;
-uniform mat3 u_Normal;
+#include "framedata.glsl"
 
 in vec3 a_Vertex;
 in vec3 a_Normal;
 in vec2 a_TexCoord;
+in mat4 a_ModelView;				// per draw, from the render queue; not frame.view * model, since the gun and Argon are drawn relative to the camera
+in mat3 a_NormalMatrix;
 
 out vec2 v_TexCoord;
 out vec3 v_Normal;
@@ -19,11 +18,11 @@ const float gradient = 0.6;
 
 void main()
 {
-	v_VertexPos = u_View * u_Model * vec4(a_Vertex, 1.0);
-    v_Normal = normalize(u_Normal * a_Normal);
+	v_VertexPos = a_ModelView * vec4(a_Vertex, 1.0);
+    v_Normal = normalize(a_NormalMatrix * a_Normal);
     v_TexCoord = a_TexCoord;
 
-    gl_Position = u_Projection * v_VertexPos;
+    gl_Position = frame.projection * v_VertexPos;
     float dist = length(gl_Position);
 	visibility = exp(-pow(dist * density, gradient));
 	visibility = clamp(visibility, 0.0, 1.0);
@@ -11,8 +11,8 @@ uniform float u_Region2Max;
 uniform float u_Region2Range;
 uniform float u_Region3Max;
 uniform float u_Region3Range;
-uniform vec3 fogColor;
-uniform bool fogFlag;
+
+#include "framedata.glsl"
 
 in vec2 v_BaseTexCoord;
 in vec4 v_Color;
@@ -34,7 +34,9 @@ void main()
 	vec4 region3Color = (texture(u_Region3Tex, v_BaseTexCoord / 128.0) * 0.75) * region3Contrib + (texture(u_Region3Tex, v_BaseTexCoord / 512.0) * 0.25) * region3Contrib;
 
 	f_FragColor = ((region1Color + region2Color + region3Color) * v_Color) * vec4(shadow, shadow, shadow, 0.0);
-	if(fogFlag) {
-		f_FragColor = mix(vec4(fogColor, 1.0), f_FragColor, visibility);
+#ifdef FOG
+	if(frame.fogColor.a > 0.0) {
+		f_FragColor = mix(vec4(frame.fogColor.rgb, 1.0), f_FragColor, visibility);
 	}
+#endif
 }
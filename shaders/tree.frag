@@ -3,11 +3,10 @@
 uniform sampler2D u_DiffuseMap;
 uniform sampler2D u_NormalMap;
 
-uniform vec3 u_Sun;
-uniform vec3 fogColor;
-uniform bool fogFlag;
 uniform float u_NormalMapStrength;
 
+#include "framedata.glsl"
+
 in vec4 v_VertexPos;
 in vec2 v_TexCoord;
 in vec3 v_Normal;
@@ -20,12 +19,16 @@ void main()
 	f_FragColor = texture(u_DiffuseMap, v_TexCoord);
 	if(f_FragColor.a < 0.6) discard;
 
-	vec3 p = (texture(u_NormalMap, v_TexCoord).rgb - vec3(0.5)) * u_NormalMapStrength;
+	// z is rebuilt from x and y, since cooked (BC5) normal maps only store those two
+	vec2 n = texture(u_NormalMap, v_TexCoord).rg * 2.0 - 1.0;
+	vec3 p = (vec3(n, sqrt(max(1.0 - dot(n, n), 0.0))) * 0.5) * u_NormalMapStrength;
 	vec3 normDelta = normalize(v_Normal + p);
-	float diffuse = max(dot(u_Sun, normDelta), 0.3);
+	float diffuse = max(dot(frame.sun.xyz, normDelta), 0.3);
 
 	f_FragColor.rgb *= diffuse;
-	if(fogFlag) {
-		f_FragColor = mix(vec4(fogColor, 1.0), f_FragColor, visibility);
+#ifdef FOG
+	if(frame.fogColor.a > 0.0) {
+		f_FragColor = mix(vec4(frame.fogColor.rgb, 1.0), f_FragColor, visibility);
 	}
+#endif
 }
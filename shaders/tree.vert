@@ -1,7 +1,6 @@
 #version 150
 
-uniform mat4 u_Projection;
-uniform mat4 u_View;
+#include "framedata.glsl"
 
 in vec3 a_Vertex;
 in vec3 a_Normal;
@@ -18,11 +17,11 @@ const float gradient = 0.6;
 
 void main()
 {
-	v_VertexPos = u_View * a_InstanceMatrix * vec4(a_Vertex, 1.0);;
+	v_VertexPos = frame.view * a_InstanceMatrix * vec4(a_Vertex, 1.0);;
 	v_TexCoord = a_TexCoord;
 	v_Normal = a_Normal;
 
-	gl_Position = u_Projection * v_VertexPos;
+	gl_Position = frame.projection * v_VertexPos;
 	float dist = length(gl_Position);
 	visibility = exp(-pow(dist * density, gradient));
 	visibility = clamp(visibility, 0.0, 1.0);
@@ -1584,13 +1584,52 @@ glmWriteOBJ(GLMmodel* model, char* filename, GLuint mode)
 */
 GLvoid
 glmBuildVBO(GLMmodel *model, int *vertexCount, GLuint *vao, GLuint *vbos)
+{
+    GLfloat *vertices;
+    GLfloat *normals;
+    GLfloat *texCoords;
+
+    glmBuildArrays(model, vertexCount, &vertices, &normals, &texCoords);
+
+    glBindVertexArray(*vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbos[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * model -> numtriangles * 9, vertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbos[1]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * model -> numtriangles * 9, normals, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbos[2]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * model -> numtriangles * 6, texCoords, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+
+    // now delete our storage buffers
+    delete[] vertices;
+    delete[] normals;
+    delete[] texCoords;
+}
+
+/* glmBuildArrays: Flattens the given model into separate, non-indexed arrays
+ *                 of vertices, normals, and texcoords
+ *
+ * model           - initialized GLMmodel structure
+ * vertexCount     - pointer to the number of vertices in this model
+ * vertices        - receives the vertex array
+ * normals         - receives the normal array
+ * texCoords       - receives the tex coord array
+ *
+*/
+GLvoid
+glmBuildArrays(GLMmodel *model, int *vertexCount, GLfloat **vertices, GLfloat **normals, GLfloat **texCoords)
 {
     GLuint i, j, k;
     GLMgroup *group;
 
-    GLfloat *vertices = new GLfloat[sizeof(GLfloat) * model -> numtriangles * 9];
-    GLfloat *normals = new GLfloat[sizeof(GLfloat) * model -> numtriangles * 9];
-    GLfloat *texCoords = new GLfloat[sizeof(GLfloat) * model -> numtriangles * 6];
     int vertexIndex = 0;
     int normalIndex = 0;
     int texCoordIndex = 0;
@@ -1600,21 +1639,25 @@ glmBuildVBO(GLMmodel *model, int *vertexCount, GLuint *vao, GLuint *vbos)
 
 	*vertexCount = 0;
 
+    *vertices = new GLfloat[model -> numtriangles * 9];
+    *normals = new GLfloat[model -> numtriangles * 9];
+    *texCoords = new GLfloat[model -> numtriangles * 6];
+
     group = model -> groups;
     while(group)
     {
-        for(i = 0; i < model -> numtriangles; i ++)
+        for(i = 0; i < group -> numtriangles; i ++)
         {
             for(j = 0; j < 3; j ++)
             {
                 for(k = 0; k < 3; k ++)
                 {
-					vertices[vertexIndex++] = model->vertices[3 * T(group->triangles[i]).vindices[j] + k];
-					normals[normalIndex++] = model->normals[3 * T(group->triangles[i]).nindices[j] + k];
+					(*vertices)[vertexIndex++] = model->vertices[3 * T(group->triangles[i]).vindices[j] + k];
+					(*normals)[normalIndex++] = model->normals[3 * T(group->triangles[i]).nindices[j] + k];
 
 					if(k < 2)
 					{
-						texCoords[texCoordIndex++] = model->texcoords[2 * T(group->triangles[i]).tindices[j] + k];
+						(*texCoords)[texCoordIndex++] = model->texcoords[2 * T(group->triangles[i]).tindices[j] + k];
 					}
                 }
 
@@ -1624,28 +1667,6 @@ glmBuildVBO(GLMmodel *model, int *vertexCount, GLuint *vao, GLuint *vbos)
 
         group = group -> next;
     }
-
-    glBindVertexArray(*vao);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbos[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * model -> numtriangles * 9, vertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbos[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * model -> numtriangles * 9, normals, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbos[2]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * model -> numtriangles * 6, texCoords, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
-
-    // now delete our storage buffers
-    delete[] vertices;
-    delete[] normals;
-    delete[] texCoords;
 }
 
 /* glmWeld: eliminate (weld) vectors that are within an epsilon of
@@ -235,6 +235,20 @@ glmWriteOBJ(GLMmodel* model, char* filename, GLuint mode);
 GLvoid
 glmBuildVBO(GLMmodel *model, int *vertexCount, GLuint *vao, GLuint *vbos);
 
+/* glmBuildArrays: Flattens the given model into separate, non-indexed arrays
+ *                 of vertices (xyz), normals (xyz), and texcoords (uv); the
+ *                 caller delete[]s them
+ *
+ * model           - initialized GLMmodel structure
+ * vertexCount     - pointer to the number of vertices in this model
+ * vertices        - receives the vertex array
+ * normals         - receives the normal array
+ * texCoords       - receives the tex coord array
+ *
+*/
+GLvoid
+glmBuildArrays(GLMmodel *model, int *vertexCount, GLfloat **vertices, GLfloat **normals, GLfloat **texCoords);
+
 /* glmWeld: eliminate (weld) vectors that are within an epsilon of
  * each other.
  *
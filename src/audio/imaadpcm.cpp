@@ -0,0 +1,193 @@
+#include "audio/imaadpcm.h"
+
+#include "glm/glm.hpp"
+
+#include <cstring>
+#include <stdint.h>
+#include <string>
+using namespace std;
+
+// IMA ADPCM step sizes, and how each 4-bit code moves us through them
+static const int IMA_STEP_TABLE[89] =
+{
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060,
+	1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484,
+	7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int IMA_INDEX_TABLE[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+// apply one 4-bit code to a channel's state, exactly as every decoder does
+static void applyCode(int code, int &predictor, int &index)
+{
+	int step = IMA_STEP_TABLE[index];
+	int delta = step >> 3;
+
+	if(code & 1) delta += step >> 2;
+	if(code & 2) delta += step >> 1;
+	if(code & 4) delta += step;
+	predictor = glm::clamp(code & 8 ? predictor - delta : predictor + delta, -32768, 32767);
+	index = glm::clamp(index + IMA_INDEX_TABLE[code], 0, 88);
+}
+
+// where the code for the given sample (counting from the one after the header) of a channel goes in a block
+static int getCodeOffset(int sample, int channel, int numChannels)
+{
+	return 4 * numChannels + (sample / 8) * 4 * numChannels + channel * 4 + (sample % 8) / 2;
+}
+
+int getIMASamplesPerBlock(int blockAlign, int numChannels)
+{
+	// the header holds the first sample, then every other byte holds two more
+	return (blockAlign - 4 * numChannels) * 2 / numChannels + 1;
+}
+
+int getIMANumBlocks(int numFrames, int blockAlign, int numChannels)
+{
+	int samplesPerBlock = getIMASamplesPerBlock(blockAlign, numChannels);
+	return (numFrames + samplesPerBlock - 1) / samplesPerBlock;
+}
+
+int decodeIMA(const unsigned char *data, int numBytes, int blockAlign, int numChannels, int samplesPerBlock, int16_t *samples)
+{
+	const int numBlocks = numBytes / blockAlign;
+	const unsigned char *block;
+	const unsigned char *in;
+	int16_t *out;
+	int predictor;
+	int index;
+	int code;
+	int b;
+	int c;
+	int i;
+
+	for(b = 0; b < numBlocks; b ++)
+	{
+		block = data + b * blockAlign;
+		for(c = 0; c < numChannels; c ++)
+		{
+			// the header gives us the first sample and where to start in the step table
+			predictor = (int16_t)(block[c * 4] | (block[c * 4 + 1] << 8));
+			index = glm::clamp((int)block[c * 4 + 2], 0, 88);
+			out = samples + (b * samplesPerBlock) * numChannels + c;
+			*out = predictor;
+
+			// after that, channels take turns with 4 bytes (8 samples) each
+			for(i = 1; i < samplesPerBlock; i ++)
+			{
+				in = block + getCodeOffset(i - 1, c, numChannels);
+				code = ((i - 1) & 1) ? (*in >> 4) : (*in & 0x0f);
+				applyCode(code, predictor, index);
+
+				out += numChannels;
+				*out = predictor;
+			}
+		}
+	}
+
+	return numBlocks * samplesPerBlock;
+}
+
+int encodeIMA(const int16_t *samples, int numFrames, int blockAlign, int numChannels, unsigned char *out)
+{
+	const int samplesPerBlock = getIMASamplesPerBlock(blockAlign, numChannels);
+	const int numBlocks = getIMANumBlocks(numFrames, blockAlign, numChannels);
+
+	unsigned char *block;
+	int indices[2] = {0, 0};				// step table position of each channel, carried from one block to the next
+	int predictor;
+	int index;
+	int frame;
+	int target;
+	int next;
+	int code;
+	int bestCode;
+	long long error;
+	long long bestError;
+	long long nextError;
+	int trialPredictor, trialIndex;
+	int lookPredictor, lookIndex;
+	int b;
+	int c;
+	int i;
+	int j;
+
+	memset(out, 0, numBlocks * blockAlign);
+
+	for(b = 0; b < numBlocks; b ++)
+	{
+		block = out + b * blockAlign;
+		for(c = 0; c < numChannels; c ++)
+		{
+			// the block starts exactly on its first sample, so errors never carry over from one block to the next
+			frame = b * samplesPerBlock;
+			predictor = frame < numFrames ? samples[frame * numChannels + c] : 0;
+			index = indices[c & 1];
+			block[c * 4] = predictor & 0xff;
+			block[c * 4 + 1] = (predictor >> 8) & 0xff;
+			block[c * 4 + 2] = index;
+
+			for(i = 1; i < samplesPerBlock; i ++)
+			{
+				frame = b * samplesPerBlock + i;
+				target = frame < numFrames ? samples[frame * numChannels + c] : 0;
+				next = frame + 1 < numFrames ? samples[(frame + 1) * numChannels + c] : 0;
+
+				// rather than just rounding the difference to the nearest step, try every code, and judge each one by
+				// its own error plus the smallest error it leaves the next sample with; this keeps the step size from
+				// falling behind on sharp attacks (gunshots, explosions), where plain IMA encoders lose the most
+				bestCode = 0;
+				bestError = -1;
+				for(code = 0; code < 16; code ++)
+				{
+					trialPredictor = predictor;
+					trialIndex = index;
+					applyCode(code, trialPredictor, trialIndex);
+					error = (long long)(trialPredictor - target) * (trialPredictor - target);
+
+					nextError = -1;
+					if(i + 1 < samplesPerBlock)
+					{
+						for(j = 0; j < 16; j ++)
+						{
+							lookPredictor = trialPredictor;
+							lookIndex = trialIndex;
+							applyCode(j, lookPredictor, lookIndex);
+							if(nextError < 0 || (long long)(lookPredictor - next) * (lookPredictor - next) < nextError)
+							{
+								nextError = (long long)(lookPredictor - next) * (lookPredictor - next);
+							}
+						}
+						error += nextError;
+					}
+
+					if(bestError < 0 || error < bestError)
+					{
+						bestError = error;
+						bestCode = code;
+					}
+				}
+
+				applyCode(bestCode, predictor, index);
+				block[getCodeOffset(i - 1, c, numChannels)] |= ((i - 1) & 1) ? (bestCode << 4) : bestCode;
+			}
+
+			indices[c & 1] = index;
+		}
+	}
+
+	return numBlocks * blockAlign;
+}
+
+string getCookedSoundName(const string &wavFilename)
+{
+	size_t dot = wavFilename.rfind('.');
+	size_t slash = wavFilename.rfind('/');
+
+	if(dot == string::npos || (slash != string::npos && dot < slash))
+	{
+		return wavFilename + ".adpcm";
+	}
+
+	return wavFilename.substr(0, dot) + ".adpcm";
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// 4-bit IMA ADPCM in the layout WAV files use (format 0x11): the samples are split into blocks of blockAlign bytes,
+// each starting with a 4-byte header per channel (the block's first sample and where it starts in the step table),
+// after which the channels take turns with 4 bytes (8 samples) each. Shared by SoundManager, which plays these files,
+// and sndcook, which writes them
+
+// sample frames in each block of the given size
+int getIMASamplesPerBlock(int blockAlign, int numChannels);
+
+// decode whole blocks into interleaved 16-bit samples; returns the frames written
+int decodeIMA(const unsigned char *data, int numBytes, int blockAlign, int numChannels, int samplesPerBlock, int16_t *samples);
+
+// encode interleaved 16-bit samples into whole blocks, padding the last one with silence; out must have room for
+// getIMANumBlocks() blocks, and the bytes written are returned
+int encodeIMA(const int16_t *samples, int numFrames, int blockAlign, int numChannels, unsigned char *out);
+int getIMANumBlocks(int numFrames, int blockAlign, int numChannels);
+
+// the cooked version of the named WAV ("../wav/gun-fire.wav" becomes "../wav/gun-fire.adpcm")
+std::string getCookedSoundName(const std::string &wavFilename);
@@ -1,12 +1,27 @@
 #include "audio/soundmanager.h"
+#include "audio/imaadpcm.h"
 
 #include "AL/al.h"
 #include "AL/alc.h"
+#include "AL/alext.h"
+
+#include "pthread.h"
+#include "sched.h"
+#include "sys/stat.h"
 
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <climits>
+#include <cmath>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <cstdlib>
+#include <ctime>
+#include <map>
+#include <vector>
 using namespace std;
 
 // No-Fly Zone owes thanks to the following websites for their usefulness:
@@ -53,15 +68,43 @@ struct WAVE_Data
 	int32_t subChunk2Size; 		// stores the size of the data block
 };
 
+/*
+ * What we need to know about a WAV file once its headers have been parsed; the stream is left at the first sample.
+ * For IMA ADPCM files, format is the 16-bit PCM format the samples decode to, and dataSize covers whole blocks only.
+ */
+struct WAVE_Info
+{
+	ALenum format;
+	ALsizei frequency;
+	int32_t dataSize;
+	int16_t blockAlign;						// bytes per sample frame, or per compressed block
+	int16_t numChannels;
+	bool adpcm;								// IMA ADPCM rather than plain PCM
+	int32_t samplesPerBlock;				// sample frames in each ADPCM block
+	int32_t numFrames;						// sample frames in the whole file
+};
+
+static const int16_t WAVE_FORMAT_PCM = 0x0001;
+static const int16_t WAVE_FORMAT_IMA_ADPCM = 0x0011;
+
 const int SoundManager::MAX_SOURCES = 200;
+const int SoundManager::MAX_VOICES = 1024;
+const int SoundManager::MAX_BUFFERS = 64;
+const float SoundManager::STREAM_CHUNK_SECONDS = 0.25;
+const int SoundManager::COMMAND_QUEUE_SIZE = 4096;
+const long SoundManager::AUDIO_POLL_INTERVAL = 5000000;
+const float SoundManager::BOUND_VOICE_BONUS = 0.05;
 
 SoundManager *SoundManager::instance = NULL;
 
 SoundManager::SoundManager()
 {
+	int i;
+	int j;
+
 	volume = 1.0;											// default full volume
 	sources = new ALuint[MAX_SOURCES];						// how many sounds we can play at once (hardware permitting)
-	nextFreeSourceIndex = 0;								// next index in "sources" is probably free, duh
+	listenerPos = glm::vec3(0.0);
 
 	// open our audio device
     alDevice = alcOpenDevice(NULL);
@@ -80,17 +123,113 @@ SoundManager::SoundManager()
         exit(1);
     }
 
-    // configure our OpenAL model
+    // configure our OpenAL model; this is the last time any thread but the audio thread touches OpenAL until shutdown
     alGenSources(MAX_SOURCES, sources);						// initialize OpenAL source objects (these represent "playable" resources)
     alDistanceModel(AL_INVERSE_DISTANCE_CLAMPED);			// I believe this is the default distance model anyways...
     alDopplerFactor(1.5);									// good for increasing the strength of doppler effects, if velocity is used
+
+    // ADPCM sounds can stay compressed in memory if the driver decodes them itself, block length and all
+    imaSupported = alIsExtensionPresent("AL_EXT_IMA4") && alIsExtensionPresent("AL_SOFT_block_alignment");
+
+    // buffer names are handed out by loadWAV() without having to ask the audio thread for them
+    buffers = new ALuint[MAX_BUFFERS];
+    bufferDurations = new float[MAX_BUFFERS];
+    alGenBuffers(MAX_BUFFERS, buffers);
+    numBuffersUsed = 0;
+
+    // every source starts out free and unmoved
+    sourceStates = new atomic<unsigned int>[MAX_SOURCES];
+    sourceBindings = new unsigned int[MAX_SOURCES];
+    positionSlots = new PositionSlot[MAX_SOURCES];
+    freeSources = new int[MAX_SOURCES];
+    numFreeSources = 0;
+    for(i = MAX_SOURCES - 1; i >= 0; i --)
+    {
+		sourceStates[i] = SOURCE_STOPPED;
+		sourceBindings[i] = 0;
+		freeSources[numFreeSources++] = i;
+		positionSlots[i].sequence = 0;
+		for(j = 0; j < 6; j ++)
+		{
+			positionSlots[i].values[j] = 0.0;
+		}
+		positionSlots[i].lastPos = glm::vec3(0.0);
+		positionSlots[i].lastVelocity = glm::vec3(0.0);
+		positionSlots[i].appliedSequence = 0;
+	}
+
+	// likewise every voice
+	voices = new Voice[MAX_VOICES];
+	freeVoices = new int[MAX_VOICES];
+	numFreeVoices = 0;
+	for(i = MAX_VOICES - 1; i >= 0; i --)
+	{
+		voices[i].generation = 0;
+		voices[i].active = false;
+		freeVoices[numFreeVoices++] = i;
+	}
+	activeVoices.reserve(MAX_VOICES);
+	rankedVoices.reserve(MAX_VOICES);
+
+    commands = new AudioCommand[COMMAND_QUEUE_SIZE];
+    commandHead = 0;
+    commandTail = 0;
+
+    // start the audio thread; it sleeps whenever there's nothing to run, decode, or stream
+    numLoadsInFlight = 0;
+    numUnfinishedLoads = 0;
+    shutdown = false;
+    pthread_mutex_init(&loaderMutex, NULL);
+    pthread_cond_init(&loaderWake, NULL);
+    pthread_cond_init(&loadsDone, NULL);
+    if(pthread_create(&audioThread, NULL, invokeAudioLoop, this) != 0)
+    {
+        cerr << "SoundManager::SoundManager() could not create audio thread" << endl;
+        exit(1);
+    }
 }
 
 SoundManager::~SoundManager()
 {
+	vector<AudioStream*>::iterator i;
+	vector<int>::iterator j;
+
+	// let the audio thread finish whatever it's doing, then shut it down
+	pthread_mutex_lock(&loaderMutex);
+	shutdown = true;
+	pthread_cond_broadcast(&loaderWake);
+	pthread_mutex_unlock(&loaderMutex);
+	pthread_join(audioThread, NULL);
+
+	pthread_cond_destroy(&loadsDone);
+	pthread_cond_destroy(&loaderWake);
+	pthread_mutex_destroy(&loaderMutex);
+
+	for(i = streams.begin(); i != streams.end(); ++i)
+	{
+		destroyStream(*i);
+	}
+	for(j = activeVoices.begin(); j != activeVoices.end(); ++j)
+	{
+		if(voices[*j].priority == SOUND_PRIORITY_STREAM && voices[*j].sourceIndex < 0)
+		{
+			deleteStream(voices[*j].stream);
+		}
+	}
+
 	// deallocate OpenAL resources
     alDeleteSources(MAX_SOURCES, sources);
+    alDeleteBuffers(MAX_BUFFERS, buffers);
 	delete[] sources;
+	delete[] buffers;
+	delete[] bufferDurations;
+	delete[] sourceStates;
+	delete[] sourceBindings;
+	delete[] positionSlots;
+	delete[] freeSources;
+	delete[] voices;
+	delete[] freeVoices;
+	delete[] commands;
 
 	// shut down our context and close the audio device
 	alcMakeContextCurrent(NULL);
@@ -108,27 +247,14 @@ SoundManager *SoundManager::getInstance()
 	return instance;
 }
 
-ALuint SoundManager::loadWAV(string filename)
+// parse the RIFF, fmt and data headers of a WAV file, leaving the file positioned at the first sample
+static void readWAVHeader(ifstream &soundFile, string filename, WAVE_Info &info)
 {
-	ifstream soundFile;
 	struct WAVE_Format wave_format;
 	struct RIFF_Header riff_header;
 	struct WAVE_Data wave_data;
-	unsigned char *data;
-
-	ALsizei size;
-	ALsizei frequency;
-	ALenum format = 0;
-	ALenum error;
-	ALuint buffer;
-
-	// attempt to open the file to see if it exists and is readable
-	soundFile.open(filename.c_str(), ifstream::binary);
-	if(!soundFile.is_open())
-	{
-		cerr << "SoundManager::loadWAV() could not load " << filename << "---does the file exist?" << endl;
-		exit(1);
-	}
+	int16_t extraSize;
+	int16_t samplesPerBlock = 0;
 
 	// read in the first chunk into the struct
     soundFile.read((char*)&riff_header, sizeof(struct RIFF_Header));
@@ -151,55 +277,173 @@ ALuint SoundManager::loadWAV(string filename)
 		exit(1);
 	}
 
-	// check for extra parameters
+	// check for extra parameters; ADPCM files keep their block length there
 	if (wave_format.subChunkSize > 16)
 	{
-        soundFile.seekg(sizeof(int16_t), ios_base::cur);
+		soundFile.read((char*)&extraSize, sizeof(int16_t));
+		if(wave_format.audioFormat == WAVE_FORMAT_IMA_ADPCM && extraSize >= 2)
+		{
+			soundFile.read((char*)&samplesPerBlock, sizeof(int16_t));
+		}
+		soundFile.seekg(wave_format.subChunkSize - 18 - (samplesPerBlock > 0 ? 2 : 0), ios_base::cur);
 	}
 
-	// read in the the last byte of data before the sound file
+	// skip any chunks (fact, LIST, ...) between the format and the sound data
 	soundFile.read((char*)&wave_data, sizeof(struct WAVE_Data));
+	while(soundFile && (wave_data.subChunkID[0] != 'd' || wave_data.subChunkID[1] != 'a' || wave_data.subChunkID[2] != 't' || wave_data.subChunkID[3] != 'a'))
+	{
+		soundFile.seekg(wave_data.subChunk2Size + (wave_data.subChunk2Size & 1), ios_base::cur);
+		soundFile.read((char*)&wave_data, sizeof(struct WAVE_Data));
+	}
 
 	// check for data tag in memory
-	if (wave_data.subChunkID[0] != 'd' || wave_data.subChunkID[1] != 'a' || wave_data.subChunkID[2] != 't' || wave_data.subChunkID[3] != 'a')
+	if (!soundFile)
 	{
 		cerr << "SoundManager::loadWAV() detected invalid data header in " << filename << endl;
 		exit(1);
 	}
 
-	// allocate memory for wave data
-	data = (unsigned char*)malloc(wave_data.subChunk2Size);
-
-	// read in the sound data into the soundData variable
-	if(!soundFile.read((char*)data, wave_data.subChunk2Size))
+	// now we set the variables that we passed in with the data from the structs
+	info.dataSize = wave_data.subChunk2Size;
+	info.frequency = wave_format.sampleRate;
+	info.blockAlign = wave_format.blockAlign;
+	info.numChannels = wave_format.numChannels;
+	info.adpcm = wave_format.audioFormat == WAVE_FORMAT_IMA_ADPCM;
+	info.samplesPerBlock = 1;
+
+	if(info.adpcm)
 	{
-		cerr << "SoundManager::loadWAV() could not load wave data in " << filename << " into struct" << endl;
-		exit(1);
-	}
+		info.samplesPerBlock = samplesPerBlock > 0 ? samplesPerBlock : getIMASamplesPerBlock(info.blockAlign, info.numChannels);
+		if(wave_format.bitsPerSample != 4 || info.blockAlign <= 4 * info.numChannels)
+		{
+			cerr << "SoundManager::loadWAV() cannot read the IMA ADPCM layout of " << filename << endl;
+			exit(1);
+		}
 
-	// now we set the variables that we passed in with the data from the structs
-	size = wave_data.subChunk2Size;
-	frequency = wave_format.sampleRate;
+		// a trailing partial block is dropped, so the data always splits into whole blocks
+		info.dataSize -= info.dataSize % info.blockAlign;
+		wave_format.bitsPerSample = 16;
+	}
+	info.numFrames = info.blockAlign > 0 ? info.dataSize / info.blockAlign * info.samplesPerBlock : 0;
 
 	// the format is worked out by looking at the number of channels and the bits per sample.
+	info.format = 0;
 	if (wave_format.numChannels == 1)
 	{
 		if (wave_format.bitsPerSample == 8 )
-			format = AL_FORMAT_MONO8;
+			info.format = AL_FORMAT_MONO8;
 		else if (wave_format.bitsPerSample == 16)
-			format = AL_FORMAT_MONO16;
+			info.format = AL_FORMAT_MONO16;
 	}
 	else if (wave_format.numChannels == 2)
 	{
 		if (wave_format.bitsPerSample == 8 )
-			format = AL_FORMAT_STEREO8;
+			info.format = AL_FORMAT_STEREO8;
 		else if (wave_format.bitsPerSample == 16)
-			format = AL_FORMAT_STEREO16;
+			info.format = AL_FORMAT_STEREO16;
+	}
+	if(info.format == 0 || (wave_format.audioFormat != WAVE_FORMAT_PCM && !info.adpcm))
+	{
+		cerr << "SoundManager::loadWAV() does not support the sample format of " << filename << endl;
+		exit(1);
+	}
+}
+
+// the file to actually read for the named WAV: its copy cooked by sndcook if there is one, unless it's older than the
+// WAV, which means the master has been edited since sndcook last ran
+static string getSoundFile(const string &filename)
+{
+	string cookedName = getCookedSoundName(filename);
+	struct stat wavInfo;
+	struct stat cookedInfo;
+
+	if(stat(cookedName.c_str(), &cookedInfo) != 0 || (stat(filename.c_str(), &wavInfo) == 0 && wavInfo.st_mtime > cookedInfo.st_mtime))
+	{
+		return filename;
+	}
+
+	return cookedName;
+}
+
+ALuint SoundManager::loadWAV(string filename)
+{
+	PendingLoad load;
+
+	if(numBuffersUsed >= MAX_BUFFERS)
+	{
+		cerr << "SoundManager::loadWAV() cannot load " << filename << " because the maximum of " << MAX_BUFFERS << " sounds has been reached" << endl;
+		exit(1);
+	}
+
+	// the buffer name is handed out now; its contents arrive once the audio thread gets to it
+	load.bufferIndex = numBuffersUsed++;
+	load.filename = filename;
+	bufferIndices[buffers[load.bufferIndex]] = load.bufferIndex;
+
+	pthread_mutex_lock(&loaderMutex);
+	pendingLoads.push_back(load);
+	numUnfinishedLoads ++;
+	pthread_cond_signal(&loaderWake);
+	pthread_mutex_unlock(&loaderMutex);
+
+	return buffers[load.bufferIndex];
+}
+
+void SoundManager::waitForLoads()
+{
+	pthread_mutex_lock(&loaderMutex);
+	while(!pendingLoads.empty() || numLoadsInFlight > 0)
+	{
+		pthread_cond_wait(&loadsDone, &loaderMutex);
 	}
+	pthread_mutex_unlock(&loaderMutex);
+}
+
+void SoundManager::decodeWAV(string filename, int bufferIndex)
+{
+	ifstream soundFile;
+	WAVE_Info info;
+	unsigned char *data;
+	int16_t *samples;
+	ALenum error;
 
-	// now we put our data into the OpenAL buffer and check for an error
-	alGenBuffers(1, &buffer);
-	alBufferData(buffer, format, (void*)data, size, frequency);
+	// attempt to open the file to see if it exists and is readable
+	filename = getSoundFile(filename);
+	soundFile.open(filename.c_str(), ifstream::binary);
+	if(!soundFile.is_open())
+	{
+		cerr << "SoundManager::loadWAV() could not load " << filename << "---does the file exist?" << endl;
+		exit(1);
+	}
+	readWAVHeader(soundFile, filename, info);
+
+	// allocate memory for wave data
+	data = (unsigned char*)malloc(info.dataSize);
+
+	// read in the sound data into the soundData variable
+	if(!soundFile.read((char*)data, info.dataSize))
+	{
+		cerr << "SoundManager::loadWAV() could not load wave data in " << filename << " into struct" << endl;
+		exit(1);
+	}
+
+	// now we put our data into the OpenAL buffer and check for an error; ADPCM stays compressed if the driver can play it
+	if(info.adpcm && imaSupported)
+	{
+		alBufferi(buffers[bufferIndex], AL_UNPACK_BLOCK_ALIGNMENT_SOFT, info.samplesPerBlock);
+		alBufferData(buffers[bufferIndex], info.numChannels == 1 ? AL_FORMAT_MONO_IMA4 : AL_FORMAT_STEREO_IMA4, (void*)data, info.dataSize, info.frequency);
+	}
+	else if(info.adpcm)
+	{
+		samples = new int16_t[info.numFrames * info.numChannels];
+		decodeIMA(data, info.dataSize, info.blockAlign, info.numChannels, info.samplesPerBlock, samples);
+		alBufferData(buffers[bufferIndex], info.format, (void*)samples, info.numFrames * info.numChannels * sizeof(int16_t), info.frequency);
+		delete[] samples;
+	}
+	else
+	{
+		alBufferData(buffers[bufferIndex], info.format, (void*)data, info.dataSize, info.frequency);
+	}
 	error = alGetError();
 	if(error != AL_NO_ERROR)
 	{
@@ -207,294 +451,1019 @@ ALuint SoundManager::loadWAV(string filename)
         exit(1);
 	}
 
-	// clean up
+	// voices need to know how long the sound is so they can keep time while they have no source
+	bufferDurations[bufferIndex] = info.frequency > 0 ? (float)info.numFrames / info.frequency : 0.0;
+
+	// clean up; OpenAL has its own copy now
+	free(data);
 	soundFile.close();
+}
 
-	// finally, return the buffer object
-	return buffer;
+void *SoundManager::invokeAudioLoop(void *arg)
+{
+	SoundManager *manager = (SoundManager*)arg;
+	manager -> audioLoop();
+	return NULL;
 }
 
-ALuint SoundManager::playSound(ALuint buffer)
+void SoundManager::audioLoop()
 {
-    ALuint source = getUnusedSource();								// retrieve a source that is not playing
+	PendingLoad load;
+	struct timespec deadline;
+	unsigned int i;
+	bool busy;
 
-    if(source > 0)
-    {
-        alSourcei(source, AL_BUFFER, buffer);						// assign the source to use the buffered sound
-        alSourcef(source, AL_GAIN, volume);							// assign system volume
-        alSourcei(source, AL_LOOPING, AL_FALSE);					// we want the sound to not loop
-        alSource3f(source, AL_POSITION, 0.0, 0.0, 0.0);				// default 3D sound position
-        alSource3f(source, AL_VELOCITY, 0.0, 0.0, 0.0);				// default 3D sound velocity
-        alSourcei(source, AL_SOURCE_RELATIVE, AL_TRUE);				// no 3D effects
-        alSourcef(source, AL_REFERENCE_DISTANCE, FLT_MAX);			// no 3D effects
-        alSourcef(source, AL_MAX_DISTANCE, FLT_MAX);				// no 3D effects
-        alSourcePlay(source);										// play sound immediately
-    }
+	pthread_mutex_lock(&loaderMutex);
+	while(!shutdown)
+	{
+		pthread_mutex_unlock(&loaderMutex);
 
-    return source;
-}
+		// catch up with the simulation thread, then bring OpenAL up to date with the latest source positions
+		busy = runCommands();
+		applyPositions();
 
-ALuint SoundManager::playSound(ALuint buffer, glm::vec3 pos, double refDist, double maxDist)
-{
-    ALuint source = getUnusedSource();
+		// top up every stream, forgetting the ones that have played to the end
+		i = 0;
+		while(i < streams.size())
+		{
+			if(refillStream(streams[i]))
+			{
+				i ++;
+			}
+			else
+			{
+				destroyStream(streams[i]);
+				streams.erase(streams.begin() + i);
+			}
+		}
 
-    if(source > 0)
-    {
-        alSourcei(source, AL_BUFFER, buffer);
-        alSourcef(source, AL_GAIN, volume);
-        alSourcei(source, AL_LOOPING, AL_FALSE);
-        alSource3f(source, AL_POSITION, pos.x, pos.y, pos.z);
-        alSource3f(source, AL_VELOCITY, 0.0, 0.0, 0.0);
-        alSourcei(source, AL_SOURCE_RELATIVE, AL_FALSE);
-        alSourcef(source, AL_REFERENCE_DISTANCE, refDist);
-        alSourcef(source, AL_MAX_DISTANCE, maxDist);
-        alSourcePlay(source);
-    }
+		// publish which sources have finished, so the simulation thread can reuse them
+		pollSourceStates();
 
-    return source;
+		// decode one file at a time, so commands never wait behind more than one of them
+		pthread_mutex_lock(&loaderMutex);
+		if(!pendingLoads.empty())
+		{
+			load = pendingLoads.front();
+			pendingLoads.pop_front();
+			numLoadsInFlight ++;
+			pthread_mutex_unlock(&loaderMutex);
+
+			decodeWAV(load.filename, load.bufferIndex);
+
+			pthread_mutex_lock(&loaderMutex);
+			numLoadsInFlight --;
+			numUnfinishedLoads --;
+			pthread_cond_broadcast(&loadsDone);
+			busy = true;
+		}
+
+		// nothing happened? then nap for a bit; commands don't wake us, so this bounds their latency
+		if(!busy && pendingLoads.empty() && !shutdown)
+		{
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_nsec += AUDIO_POLL_INTERVAL;
+			if(deadline.tv_nsec >= 1000000000)
+			{
+				deadline.tv_sec ++;
+				deadline.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&loaderWake, &loaderMutex, &deadline);
+		}
+	}
+	pthread_mutex_unlock(&loaderMutex);
 }
 
-ALuint SoundManager::loopSound(ALuint buffer)
+void SoundManager::pushCommand(AudioCommand &command)
 {
-    ALuint source = getUnusedSource();
+	unsigned int tail = commandTail.load(memory_order_relaxed);
 
-    if(source > 0)
-    {
-        alSourcei(source, AL_BUFFER, buffer);
-        alSourcef(source, AL_GAIN, volume);
-        alSourcei(source, AL_LOOPING, AL_TRUE);
-        alSource3f(source, AL_POSITION, 0.0, 0.0, 0.0);
-        alSource3f(source, AL_VELOCITY, 0.0, 0.0, 0.0);
-        alSourcei(source, AL_SOURCE_RELATIVE, AL_FALSE);
-        alSourcef(source, AL_REFERENCE_DISTANCE, FLT_MAX);
-        alSourcef(source, AL_MAX_DISTANCE, FLT_MAX);
-        alSourcePlay(source);
-    }
+	// if the audio thread has fallen a whole queue behind, there's nothing to do but let it catch up
+	while(tail - commandHead.load(memory_order_acquire) >= (unsigned int)COMMAND_QUEUE_SIZE)
+	{
+		sched_yield();
+	}
 
-    return source;
+	commands[tail & (COMMAND_QUEUE_SIZE - 1)] = command;
+	commandTail.store(tail + 1, memory_order_release);
 }
 
-ALuint SoundManager::loopSound(ALuint buffer, glm::vec3 pos, double refDist, double maxDist)
+bool SoundManager::runCommands()
 {
-    ALuint source = getUnusedSource();
+	unsigned int head = commandHead.load(memory_order_relaxed);
+	unsigned int tail = commandTail.load(memory_order_acquire);
+	bool result = head != tail;
 
-    if(source > 0)
-    {
-        alSourcei(source, AL_BUFFER, buffer);
-        alSourcef(source, AL_GAIN, volume);
-        alSourcei(source, AL_LOOPING, AL_TRUE);
-        alSource3f(source, AL_POSITION, pos.x, pos.y, pos.z);
-        alSource3f(source, AL_VELOCITY, 0.0, 0.0, 0.0);
-        alSourcei(source, AL_SOURCE_RELATIVE, AL_FALSE);
-        alSourcef(source, AL_REFERENCE_DISTANCE, refDist);
-        alSourcef(source, AL_MAX_DISTANCE, maxDist);
-        alSourcePlay(source);
-    }
+	while(head != tail)
+	{
+		runCommand(commands[head & (COMMAND_QUEUE_SIZE - 1)]);
+		head ++;
+		commandHead.store(head, memory_order_release);
+	}
 
-    return source;
+	return result;
 }
 
-bool SoundManager::isSoundPlaying(ALuint source)
+void SoundManager::runCommand(AudioCommand &command)
 {
+	ALuint source = command.sourceIndex >= 0 ? sources[command.sourceIndex] : 0;
+	AudioStream *stream;
+	float orientation[6];
+	int numQueued;
 	int state;
-	bool result = false;
+	int i;
 
-	if(source > 0)
+	switch(command.type)
 	{
-		// retrieve the current state of the OpenAL source
-		alGetSourcei(source, AL_SOURCE_STATE, &state);
-		result = state == AL_PLAYING || state == AL_PAUSED;
-	}
+		case COMMAND_PLAY:
+			alSourcei(source, AL_BUFFER, command.buffer);							// assign the source to use the buffered sound
+			alSourcef(source, AL_GAIN, command.value);								// assign system volume
+			alSourcei(source, AL_LOOPING, command.looping ? AL_TRUE : AL_FALSE);
+			alSource3f(source, AL_POSITION, command.vectors[0].x, command.vectors[0].y, command.vectors[0].z);
+			alSource3f(source, AL_VELOCITY, command.vectors[1].x, command.vectors[1].y, command.vectors[1].z);
+			alSourcei(source, AL_SOURCE_RELATIVE, command.relative ? AL_TRUE : AL_FALSE);
+			alSourcef(source, AL_REFERENCE_DISTANCE, command.refDist);
+			alSourcef(source, AL_MAX_DISTANCE, command.maxDist);
+			alSourcef(source, AL_SEC_OFFSET, command.offset);						// pick up where a virtual voice has got to
+			alSourcePlay(source);													// play sound immediately
+			sourceStates[command.sourceIndex].store((command.binding << 2) | SOURCE_PLAYING, memory_order_release);
+			break;
+
+		case COMMAND_START_STREAM:
+			// prime the queue before we start playing
+			stream = command.stream;
+			alGenBuffers(NUM_STREAM_BUFFERS, stream -> buffers);
+			numQueued = 0;
+			for(i = 0; i < NUM_STREAM_BUFFERS; i ++)
+			{
+				if(fillStreamBuffer(stream, stream -> buffers[i]))
+				{
+					numQueued ++;
+				}
+			}
+			alSourcei(source, AL_BUFFER, 0);
+			alSourceQueueBuffers(source, numQueued, stream -> buffers);
+
+			// same settings as loopSound(); looping is up to us, since AL_LOOPING would only repeat the queue
+			alSourcef(source, AL_GAIN, command.value);
+			alSourcei(source, AL_LOOPING, AL_FALSE);
+			alSource3f(source, AL_POSITION, 0.0, 0.0, 0.0);
+			alSource3f(source, AL_VELOCITY, 0.0, 0.0, 0.0);
+			alSourcei(source, AL_SOURCE_RELATIVE, AL_FALSE);
+			alSourcef(source, AL_REFERENCE_DISTANCE, FLT_MAX);
+			alSourcef(source, AL_MAX_DISTANCE, FLT_MAX);
+			alSourcePlay(source);
+			sourceStates[command.sourceIndex].store((command.binding << 2) | SOURCE_PLAYING, memory_order_release);
+
+			// from here on we keep it fed
+			streams.push_back(stream);
+			break;
+
+		case COMMAND_STOP:
+			// only stop if it's currently playing or paused
+			alGetSourcei(source, AL_SOURCE_STATE, &state);
+			if(state == AL_PLAYING || state == AL_PAUSED)
+			{
+				alSourceStop(source);
+			}
 
-	return result;
+			// a stopped stream is finished for good; otherwise we'd just restart it
+			closeStream(source);
+			sourceStates[command.sourceIndex].store((command.binding << 2) | SOURCE_STOPPED, memory_order_release);
+			break;
+
+		case COMMAND_PAUSE:
+			alGetSourcei(source, AL_SOURCE_STATE, &state);
+			if(state == AL_PLAYING)
+			{
+				alSourcePause(source);
+				sourceStates[command.sourceIndex].store((command.binding << 2) | SOURCE_PAUSED, memory_order_release);
+			}
+			break;
+
+		case COMMAND_RESUME:
+			alGetSourcei(source, AL_SOURCE_STATE, &state);
+			if(state == AL_PAUSED)
+			{
+				alSourcePlay(source);
+				sourceStates[command.sourceIndex].store((command.binding << 2) | SOURCE_PLAYING, memory_order_release);
+			}
+			break;
+
+		case COMMAND_SET_VOLUME:
+			// we may need to change the volume of an already playing piece
+			for(i = 0; i < MAX_SOURCES; i ++)
+			{
+				alGetSourcei(sources[i], AL_SOURCE_STATE, &state);
+				if(state == AL_PAUSED || state == AL_PLAYING)
+				{
+					alSourcef(sources[i], AL_GAIN, command.value);
+				}
+			}
+			break;
+
+		case COMMAND_SET_LISTENER_POS:
+			alListener3f(AL_POSITION, command.vectors[0].x, command.vectors[0].y, command.vectors[0].z);
+			break;
+
+		case COMMAND_SET_LISTENER_VELOCITY:
+			alListener3f(AL_VELOCITY, command.vectors[1].x, command.vectors[1].y, command.vectors[1].z);
+			break;
+
+		case COMMAND_SET_LISTENER_ORIENTATION:
+			orientation[0] = command.vectors[0].x;
+			orientation[1] = command.vectors[0].y;
+			orientation[2] = command.vectors[0].z;
+			orientation[3] = command.vectors[1].x;
+			orientation[4] = command.vectors[1].y;
+			orientation[5] = command.vectors[1].z;
+			alListenerfv(AL_ORIENTATION, orientation);
+			break;
+	}
 }
 
-void SoundManager::stop(ALuint source)
+void SoundManager::applyPositions()
 {
-	int state;
+	PositionSlot *slot;
+	float values[6];
+	unsigned int sequence;
+	int i;
+	int j;
 
-    if(source > 0)
-    {
-		// only stop if it's currently playing or paused
-		alGetSourcei(source, AL_SOURCE_STATE, &state);
-        if(state == AL_PLAYING || state == AL_PAUSED)
-        {
-            alSourceStop(source);
+	for(i = 0; i < MAX_SOURCES; i ++)
+	{
+		slot = &positionSlots[i];
+
+		// skip slots with nothing new, and ones the simulation thread is halfway through writing (we'll get them next time)
+		sequence = slot -> sequence.load(memory_order_acquire);
+		if(sequence == slot -> appliedSequence || (sequence & 1))
+		{
+			continue;
+		}
+		for(j = 0; j < 6; j ++)
+		{
+			values[j] = slot -> values[j].load(memory_order_relaxed);
+		}
+		atomic_thread_fence(memory_order_acquire);
+		if(slot -> sequence.load(memory_order_relaxed) != sequence)
+		{
+			continue;
 		}
+
+		alSource3f(sources[i], AL_POSITION, values[0], values[1], values[2]);
+		alSource3f(sources[i], AL_VELOCITY, values[3], values[4], values[5]);
+		slot -> appliedSequence = sequence;
 	}
 }
 
-void SoundManager::setVolume(double volume)
+void SoundManager::pollSourceStates()
 {
-    int state;
-    int i;
-
-    // record the desired volume for later
-    this -> volume = volume;
+	unsigned int published;
+	int state;
+	int i;
 
-	// we may need to change the volume of an already playing piece
+	// we're the only writer of source states, so the binding we publish a stop for is always the current one
 	for(i = 0; i < MAX_SOURCES; i ++)
 	{
-		if(sources[i] > 0)
+		published = sourceStates[i].load(memory_order_relaxed);
+		if((published & 3) == SOURCE_PLAYING)
 		{
 			alGetSourcei(sources[i], AL_SOURCE_STATE, &state);
-			if(state == AL_PAUSED || state == AL_PLAYING)
+			if(state == AL_STOPPED)
 			{
-				alSourcef(sources[i], AL_GAIN, volume);
+				sourceStates[i].store((published & ~3u) | SOURCE_STOPPED, memory_order_release);
 			}
 		}
 	}
 }
 
-double SoundManager::getVolume()
+ALuint SoundManager::streamSound(string filename, bool loop)
 {
-	return volume;
+	AudioStream *stream;
+	WAVE_Info info;
+	Voice settings;
+	ALuint handle;
+	int index;
+
+	// the file is opened here, so a missing file is reported right away; the audio thread does the rest
+	stream = new AudioStream();
+	filename = getSoundFile(filename);
+	stream -> file.open(filename.c_str(), ifstream::binary);
+	if(!stream -> file.is_open())
+	{
+		cerr << "SoundManager::streamSound() could not load " << filename << "---does the file exist?" << endl;
+		exit(1);
+	}
+	readWAVHeader(stream -> file, filename, info);
+	if(info.dataSize <= 0)
+	{
+		cerr << "SoundManager::streamSound() found no wave data in " << filename << endl;
+		exit(1);
+	}
+
+	stream -> dataStart = stream -> file.tellg();
+	stream -> dataSize = info.dataSize;
+	stream -> dataRead = 0;
+	stream -> format = info.format;
+	stream -> frequency = info.frequency;
+	stream -> adpcm = info.adpcm;
+	stream -> blockAlign = info.blockAlign;
+	stream -> numChannels = info.numChannels;
+	stream -> samplesPerBlock = info.samplesPerBlock;
+	stream -> loop = loop;
+
+	// each buffer holds a fixed amount of time, rounded down to whole sample frames (or whole ADPCM blocks)
+	stream -> chunkSize = std::max(1, (int)(info.frequency * STREAM_CHUNK_SECONDS) / info.samplesPerBlock) * info.blockAlign;
+	stream -> chunk = new unsigned char[stream -> chunkSize];
+	stream -> samples = NULL;
+	if(info.adpcm && !imaSupported)
+	{
+		stream -> samples = new int16_t[stream -> chunkSize / info.blockAlign * info.samplesPerBlock * info.numChannels];
+	}
+
+	// streams can't pick up from an arbitrary point later, so they get a source now or not at all
+	settings.looping = loop;
+	settings.relative = false;
+	settings.priority = SOUND_PRIORITY_STREAM;
+	settings.buffer = 0;
+	settings.duration = 0.0;
+	settings.stream = stream;
+	settings.pos = glm::vec3(0.0);
+	settings.velocity = glm::vec3(0.0);
+	settings.refDist = FLT_MAX;
+	settings.maxDist = FLT_MAX;
+	handle = startVoice(settings);
+	index = getVoiceIndex(handle);
+	if(index >= 0 && !stealSourceFor(index))
+	{
+		freeVoice(index);
+		handle = 0;
+	}
+
+	return handle;
 }
 
-void SoundManager::pause(ALuint source)
+bool SoundManager::fillStreamBuffer(AudioStream *stream, ALuint buffer)
 {
-	int state;
+	int numBytes = 0;
+	int numFrames;
+	int toRead;
 
-    if(source != 0)
-    {
-		alGetSourcei(source, AL_SOURCE_STATE, &state);
-        if(state == AL_PLAYING)
-        {
-            alSourcePause(source);
+	while(numBytes < stream -> chunkSize)
+	{
+		toRead = std::min(stream -> chunkSize - numBytes, stream -> dataSize - stream -> dataRead);
+
+		// at the end of the data, either go back to the beginning or make do with what we have
+		if(toRead <= 0)
+		{
+			if(!stream -> loop)
+			{
+				break;
+			}
+			stream -> file.clear();
+			stream -> file.seekg(stream -> dataStart);
+			stream -> dataRead = 0;
+			continue;
 		}
+
+		if(!stream -> file.read((char*)stream -> chunk + numBytes, toRead))
+		{
+			cerr << "SoundManager::fillStreamBuffer() could not read wave data" << endl;
+			exit(1);
+		}
+		stream -> dataRead += toRead;
+		numBytes += toRead;
+	}
+
+	// ADPCM goes to the driver as it is if it can take it, and is decoded here otherwise
+	if(numBytes > 0 && stream -> samples != NULL)
+	{
+		numFrames = decodeIMA(stream -> chunk, numBytes, stream -> blockAlign, stream -> numChannels, stream -> samplesPerBlock, stream -> samples);
+		alBufferData(buffer, stream -> format, stream -> samples, numFrames * stream -> numChannels * sizeof(int16_t), stream -> frequency);
+	}
+	else if(numBytes > 0 && stream -> adpcm)
+	{
+		alBufferi(buffer, AL_UNPACK_BLOCK_ALIGNMENT_SOFT, stream -> samplesPerBlock);
+		alBufferData(buffer, stream -> numChannels == 1 ? AL_FORMAT_MONO_IMA4 : AL_FORMAT_STEREO_IMA4, stream -> chunk, numBytes, stream -> frequency);
 	}
+	else if(numBytes > 0)
+	{
+		alBufferData(buffer, stream -> format, stream -> chunk, numBytes, stream -> frequency);
+	}
+
+	return numBytes > 0;
 }
 
-void SoundManager::resume(ALuint source)
+bool SoundManager::refillStream(AudioStream *stream)
 {
+	ALuint buffer;
+	int numProcessed;
+	int numQueued;
 	int state;
 
-    if(source != 0)
-    {
-		alGetSourcei(source, AL_SOURCE_STATE, &state);
-        if(state == AL_PAUSED)
-        {
-            alSourcePlay(source);
+	// refill whatever the source has finished playing and put it back at the end of the queue
+	alGetSourcei(stream -> source, AL_BUFFERS_PROCESSED, &numProcessed);
+	while(numProcessed > 0)
+	{
+		alSourceUnqueueBuffers(stream -> source, 1, &buffer);
+		if(fillStreamBuffer(stream, buffer))
+		{
+			alSourceQueueBuffers(stream -> source, 1, &buffer);
 		}
+		numProcessed --;
 	}
+
+	// if we fell behind and the source ran dry, get it going again; if there's nothing left, we're done
+	alGetSourcei(stream -> source, AL_SOURCE_STATE, &state);
+	alGetSourcei(stream -> source, AL_BUFFERS_QUEUED, &numQueued);
+	if(state == AL_STOPPED && numQueued > 0)
+	{
+		alSourcePlay(stream -> source);
+	}
+
+	return numQueued > 0;
 }
 
-void SoundManager::pauseAll()
+void SoundManager::destroyStream(AudioStream *stream)
 {
-    ALuint current;
+	// detach our buffers from the source before deleting them, so the source can be reused
+	alSourceStop(stream -> source);
+	alSourcei(stream -> source, AL_BUFFER, 0);
+	alDeleteBuffers(NUM_STREAM_BUFFERS, stream -> buffers);
 
-    int state;
-    int i = 0;
+	deleteStream(stream);
+}
 
-    while(i < MAX_SOURCES)
-    {
-        current = sources[i++];
+void SoundManager::deleteStream(AudioStream *stream)
+{
+	stream -> file.close();
+	delete[] stream -> chunk;
+	delete[] stream -> samples;
+	delete stream;
+}
+
+void SoundManager::closeStream(ALuint source)
+{
+	vector<AudioStream*>::iterator i;
 
-        alGetSourcei(current, AL_SOURCE_STATE, &state);
-        if(state == AL_PLAYING)
-        {
-            alSourcePause(current);
+	for(i = streams.begin(); i != streams.end(); ++i)
+	{
+		if((*i) -> source == source)
+		{
+			destroyStream(*i);
+			streams.erase(i);
+			break;
 		}
-    }
+	}
 }
 
-void SoundManager::resumeAll()
+ALuint SoundManager::startVoice(Voice &settings)
 {
-    ALuint current;
+	Voice *voice;
+	int index;
 
-    int state;
-    int i = 0;
+	if(numFreeVoices == 0)
+	{
+		return 0;
+	}
 
-    while(i < MAX_SOURCES)
-    {
-        current = sources[i++];
+	// take a voice off the free stack and bring it to life as a virtual one
+	index = freeVoices[--numFreeVoices];
+	voice = &voices[index];
+	settings.generation = voice -> generation + 1;
+	*voice = settings;
+	voice -> active = true;
+	voice -> paused = false;
+	voice -> time = 0.0;
+	voice -> score = 0.0;
+	voice -> sourceIndex = -1;
+	voice -> activeIndex = activeVoices.size();
+	activeVoices.push_back(index);
+
+	// handles pack the generation above the index, which is offset by one so that no handle is ever 0
+	return ((voice -> generation & 0xffff) << 16) | (index + 1);
+}
 
-        alGetSourcei(current, AL_SOURCE_STATE, &state);
-        if(state == AL_PAUSED)
-        {
-            alSourcePlay(current);
-		}
-    }
+int SoundManager::getVoiceIndex(ALuint handle)
+{
+	int index = (int)(handle & 0xffff) - 1;
+
+	if(index < 0 || index >= MAX_VOICES || !voices[index].active || (voices[index].generation & 0xffff) != (handle >> 16))
+	{
+		index = -1;
+	}
+
+	return index;
 }
 
-void SoundManager::stopAllPaused()
+void SoundManager::freeVoice(int voiceIndex)
 {
-    ALuint current;
+	Voice *voice = &voices[voiceIndex];
 
-    int state;
-    int i = 0;
+	if(voice -> sourceIndex >= 0)
+	{
+		unbindVoice(voiceIndex);
+	}
+	else if(voice -> priority == SOUND_PRIORITY_STREAM)
+	{
+		// never reached the audio thread, so the stream is still ours
+		deleteStream(voice -> stream);
+	}
 
-    while(i < MAX_SOURCES)
-    {
-        current = sources[i++];
+	// swap the last active voice into our place
+	activeVoices[voice -> activeIndex] = activeVoices.back();
+	voices[activeVoices.back()].activeIndex = voice -> activeIndex;
+	activeVoices.pop_back();
 
-        alGetSourcei(current, AL_SOURCE_STATE, &state);
-        if(state == AL_PAUSED)
-        {
-            alSourceStop(current);
-		}
-    }
+	voice -> active = false;
+	freeVoices[numFreeVoices++] = voiceIndex;
 }
 
-void SoundManager::stopAll()
+void SoundManager::computeScore(Voice *voice)
 {
-    ALuint current;
+	float distance;
+	float audibility = 1.0;
 
-    int state;
-    int i = 0;
+	// streams keep their sources no matter what, and paused voices are happy to give theirs up
+	if(voice -> priority == SOUND_PRIORITY_STREAM)
+	{
+		voice -> score = SOUND_PRIORITY_STREAM + 1.0;
+		return;
+	}
+	if(voice -> paused)
+	{
+		voice -> score = -1.0;
+		return;
+	}
 
-    while(i < MAX_SOURCES)
-    {
-        current = sources[i++];
+	// the gain OpenAL's inverse distance clamped model will give the source (relative sources are at full volume)
+	if(!voice -> relative && voice -> refDist > 0.0 && voice -> refDist < FLT_MAX)
+	{
+		distance = glm::clamp(glm::length(voice -> pos - listenerPos), voice -> refDist, std::max(voice -> refDist, voice -> maxDist));
+		audibility = voice -> refDist / distance;
+	}
 
-        alGetSourcei(current, AL_SOURCE_STATE, &state);
-        if(state == AL_PAUSED || state == AL_PLAYING)
-        {
-            alSourceStop(current);
-		}
-    }
+	// audibility is at most 1, so a higher priority always beats a lower one
+	voice -> score = voice -> priority + audibility * volume;
+	if(voice -> sourceIndex >= 0)
+	{
+		voice -> score += BOUND_VOICE_BONUS;
+	}
 }
 
-void SoundManager::setListenerPos(glm::vec3 pos)
+bool SoundManager::hasFinished(Voice *voice)
 {
-    alListener3f(AL_POSITION, pos.x, pos.y, pos.z);
+	unsigned int published;
+	bool result;
+
+	if(voice -> sourceIndex >= 0)
+	{
+		// the audio thread tells us when the source stops, but only news about our own binding counts
+		published = sourceStates[voice -> sourceIndex].load(memory_order_acquire);
+		result = (published >> 2) == sourceBindings[voice -> sourceIndex] && (published & 3) == SOURCE_STOPPED;
+	}
+	else
+	{
+		// virtual voices just play out their time
+		result = !voice -> looping && !voice -> paused && voice -> priority != SOUND_PRIORITY_STREAM && voice -> time >= voice -> duration;
+	}
+
+	return result;
 }
 
-void SoundManager::setListenerVelocity(glm::vec3 velocity)
+void SoundManager::bindVoice(int voiceIndex, int sourceIndex)
 {
-    alListener3f(AL_VELOCITY, velocity.x, velocity.y, velocity.z);
+	Voice *voice = &voices[voiceIndex];
+	AudioCommand command;
+
+	// a new binding; the state bits of sourceStates sit below it, so it has to fit in what's left
+	sourceBindings[sourceIndex] = (sourceBindings[sourceIndex] + 1) & (UINT_MAX >> 2);
+	voice -> sourceIndex = sourceIndex;
+
+	// whatever the previous owner left in the position slot must not be applied to us
+	writePosition(sourceIndex, voice -> pos, voice -> velocity);
+
+	command.sourceIndex = sourceIndex;
+	command.binding = sourceBindings[sourceIndex];
+	command.value = volume;
+	if(voice -> priority == SOUND_PRIORITY_STREAM)
+	{
+		command.type = COMMAND_START_STREAM;
+		command.stream = voice -> stream;
+		command.stream -> source = sources[sourceIndex];
+	}
+	else
+	{
+		command.type = COMMAND_PLAY;
+		command.buffer = voice -> buffer;
+		command.vectors[0] = voice -> pos;
+		command.vectors[1] = voice -> velocity;
+		command.refDist = voice -> refDist;
+		command.maxDist = voice -> maxDist;
+		command.looping = voice -> looping;
+		command.relative = voice -> relative;
+
+		// start from wherever the voice has got to while it was virtual
+		command.offset = voice -> time;
+		if(voice -> looping && voice -> duration > 0.0)
+		{
+			command.offset = fmod(voice -> time, (double)voice -> duration);
+		}
+	}
+	pushCommand(command);
 }
 
-void SoundManager::setListenerOrientation(glm::vec3 forward, glm::vec3 up)
+void SoundManager::unbindVoice(int voiceIndex)
 {
-    float orientation[] = {forward.x, forward.y, forward.z,
-						   up.x, up.y, up.z};
-    alListenerfv(AL_ORIENTATION, orientation);
+	Voice *voice = &voices[voiceIndex];
+	AudioCommand command;
+
+	command.type = COMMAND_STOP;
+	command.sourceIndex = voice -> sourceIndex;
+	command.binding = sourceBindings[voice -> sourceIndex];
+	pushCommand(command);
+
+	freeSources[numFreeSources++] = voice -> sourceIndex;
+	voice -> sourceIndex = -1;
 }
 
-ALuint SoundManager::getUnusedSource()
+bool SoundManager::stealSourceFor(int voiceIndex)
 {
-	int state;
-	int i = nextFreeSourceIndex;
-	ALuint result = 0;
+	Voice *voice = &voices[voiceIndex];
+	Voice *victim = NULL;
+	vector<int>::iterator i;
+	Voice *curr;
 
-	// start at an index that is an educated guess for a sound that might be free
-	do
+	computeScore(voice);
+
+	// take the least important voice that has a source, if it matters less than we do
+	if(numFreeSources == 0)
 	{
-		// get the state of the next source that might be available
-		alGetSourcei(sources[i], AL_SOURCE_STATE, &state);
-		if(state == AL_STOPPED || state == AL_INITIAL)
+		for(i = activeVoices.begin(); i != activeVoices.end(); ++i)
 		{
-			result = sources[i];
-			nextFreeSourceIndex = (i + 1) % MAX_SOURCES;
+			curr = &voices[*i];
+			if(curr -> sourceIndex >= 0 && curr -> priority != SOUND_PRIORITY_STREAM)
+			{
+				computeScore(curr);
+				if(victim == NULL || curr -> score < victim -> score)
+				{
+					victim = curr;
+				}
+			}
+		}
+		if(victim == NULL || victim -> score >= voice -> score)
+		{
+			return false;
+		}
+		unbindVoice(victim - voices);
+	}
+
+	bindVoice(voiceIndex, freeSources[--numFreeSources]);
+	return true;
+}
+
+void SoundManager::update(float dt)
+{
+	int numSources = MAX_SOURCES;
+	unsigned int i;
+	Voice *voice;
+
+	// move every voice along, retiring the ones that have finished
+	i = 0;
+	while(i < activeVoices.size())
+	{
+		voice = &voices[activeVoices[i]];
+		if(!voice -> paused)
+		{
+			voice -> time += dt;
+		}
+
+		if(hasFinished(voice))
+		{
+			freeVoice(activeVoices[i]);
 		}
 		else
 		{
-			i = (i + 1) % MAX_SOURCES;
+			i ++;
 		}
 	}
-	while(result == 0 && i != nextFreeSourceIndex);
 
-	// return the AL identifier for the free source
-	return result;
+	// rank everything but streams, which keep their sources for as long as they play
+	rankedVoices.clear();
+	for(i = 0; i < activeVoices.size(); i ++)
+	{
+		voice = &voices[activeVoices[i]];
+		if(voice -> priority == SOUND_PRIORITY_STREAM)
+		{
+			numSources --;
+		}
+		else
+		{
+			computeScore(voice);
+			rankedVoices.push_back(make_pair(voice -> score, activeVoices[i]));
+		}
+	}
+
+	// with more voices than sources, only the top ones get to be heard
+	if((int)rankedVoices.size() > numSources)
+	{
+		nth_element(rankedVoices.begin(), rankedVoices.begin() + numSources, rankedVoices.end(), greater<pair<float, int> >());
+		for(i = numSources; i < rankedVoices.size(); i ++)
+		{
+			if(voices[rankedVoices[i].second].sourceIndex >= 0)
+			{
+				unbindVoice(rankedVoices[i].second);
+			}
+		}
+		rankedVoices.resize(numSources);
+	}
+
+	// and the winners that are still virtual take the sources the losers gave up
+	for(i = 0; i < rankedVoices.size(); i ++)
+	{
+		voice = &voices[rankedVoices[i].second];
+		if(voice -> sourceIndex < 0 && !voice -> paused && numFreeSources > 0)
+		{
+			bindVoice(rankedVoices[i].second, freeSources[--numFreeSources]);
+		}
+	}
+}
+
+ALuint SoundManager::startSound(ALuint buffer, glm::vec3 pos, double refDist, double maxDist, bool looping, bool relative, int priority)
+{
+	map<ALuint, int>::iterator i;
+	Voice settings;
+	ALuint handle;
+	int index;
+
+	// the buffer may still be on its way in; this is a no-op once everything has loaded
+	if(numUnfinishedLoads > 0)
+	{
+		waitForLoads();
+	}
+
+	settings.looping = looping;
+	settings.relative = relative;
+	settings.priority = priority;
+	settings.buffer = buffer;
+	i = bufferIndices.find(buffer);
+	settings.duration = i != bufferIndices.end() ? bufferDurations[i -> second] : 0.0;
+	settings.stream = NULL;
+	settings.pos = pos;
+	settings.velocity = glm::vec3(0.0);
+	settings.refDist = refDist;
+	settings.maxDist = maxDist;
+
+	// get a real source straight away if we deserve one, so sounds start on the frame they're played
+	handle = startVoice(settings);
+	index = getVoiceIndex(handle);
+	if(index >= 0)
+	{
+		stealSourceFor(index);
+	}
+
+	return handle;
+}
+
+ALuint SoundManager::playSound(ALuint buffer, int priority)
+{
+	// no 3D effects
+	return startSound(buffer, glm::vec3(0.0), FLT_MAX, FLT_MAX, false, true, priority);
+}
+
+ALuint SoundManager::playSound(ALuint buffer, glm::vec3 pos, double refDist, double maxDist, int priority)
+{
+	return startSound(buffer, pos, refDist, maxDist, false, false, priority);
+}
+
+ALuint SoundManager::loopSound(ALuint buffer, int priority)
+{
+	return startSound(buffer, glm::vec3(0.0), FLT_MAX, FLT_MAX, true, false, priority);
+}
+
+ALuint SoundManager::loopSound(ALuint buffer, glm::vec3 pos, double refDist, double maxDist, int priority)
+{
+	return startSound(buffer, pos, refDist, maxDist, true, false, priority);
+}
+
+void SoundManager::setSourcePos(ALuint handle, glm::vec3 pos, glm::vec3 velocity)
+{
+	int index = getVoiceIndex(handle);
+
+	if(index < 0)
+	{
+		return;
+	}
+
+	// virtual voices only need to remember where they are, for scoring and for when they get a source again
+	voices[index].pos = pos;
+	voices[index].velocity = velocity;
+	if(voices[index].sourceIndex >= 0)
+	{
+		writePosition(voices[index].sourceIndex, pos, velocity);
+	}
+}
+
+void SoundManager::writePosition(int sourceIndex, glm::vec3 pos, glm::vec3 velocity)
+{
+	PositionSlot *slot = &positionSlots[sourceIndex];
+	unsigned int sequence;
+
+	// sources that haven't moved cost nothing at all
+	if(pos == slot -> lastPos && velocity == slot -> lastVelocity)
+	{
+		return;
+	}
+
+	// overwrite the slot; an odd sequence number tells the audio thread to come back later
+	sequence = slot -> sequence.load(memory_order_relaxed);
+	slot -> sequence.store(sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	slot -> values[0].store(pos.x, memory_order_relaxed);
+	slot -> values[1].store(pos.y, memory_order_relaxed);
+	slot -> values[2].store(pos.z, memory_order_relaxed);
+	slot -> values[3].store(velocity.x, memory_order_relaxed);
+	slot -> values[4].store(velocity.y, memory_order_relaxed);
+	slot -> values[5].store(velocity.z, memory_order_relaxed);
+	slot -> sequence.store(sequence + 2, memory_order_release);
+
+	slot -> lastPos = pos;
+	slot -> lastVelocity = velocity;
+}
+
+bool SoundManager::isSoundPlaying(ALuint handle)
+{
+	// voices live until they finish or are stopped, whether or not they can be heard right now
+	return getVoiceIndex(handle) >= 0;
+}
+
+void SoundManager::stop(ALuint handle)
+{
+	int index = getVoiceIndex(handle);
+
+	if(index >= 0)
+	{
+		freeVoice(index);
+	}
+}
+
+void SoundManager::setVolume(double volume)
+{
+	AudioCommand command;
+
+    // record the desired volume for later
+    this -> volume = volume;
+
+	command.type = COMMAND_SET_VOLUME;
+	command.sourceIndex = -1;
+	command.value = volume;
+	pushCommand(command);
+}
+
+double SoundManager::getVolume()
+{
+	return volume;
+}
+
+void SoundManager::pauseVoice(int voiceIndex)
+{
+	Voice *voice = &voices[voiceIndex];
+	AudioCommand command;
+
+	if(voice -> paused)
+	{
+		return;
+	}
+	voice -> paused = true;
+
+	// a source we hold on to for now; update() hands it to someone else if it's needed
+	if(voice -> sourceIndex >= 0)
+	{
+		command.type = COMMAND_PAUSE;
+		command.sourceIndex = voice -> sourceIndex;
+		command.binding = sourceBindings[voice -> sourceIndex];
+		pushCommand(command);
+	}
+}
+
+void SoundManager::resumeVoice(int voiceIndex)
+{
+	Voice *voice = &voices[voiceIndex];
+	AudioCommand command;
+
+	if(!voice -> paused)
+	{
+		return;
+	}
+	voice -> paused = false;
+
+	if(voice -> sourceIndex >= 0)
+	{
+		command.type = COMMAND_RESUME;
+		command.sourceIndex = voice -> sourceIndex;
+		command.binding = sourceBindings[voice -> sourceIndex];
+		pushCommand(command);
+	}
+	else
+	{
+		stealSourceFor(voiceIndex);
+	}
+}
+
+void SoundManager::pause(ALuint handle)
+{
+	int index = getVoiceIndex(handle);
+
+	if(index >= 0)
+	{
+		pauseVoice(index);
+	}
+}
+
+void SoundManager::resume(ALuint handle)
+{
+	int index = getVoiceIndex(handle);
+
+	if(index >= 0)
+	{
+		resumeVoice(index);
+	}
+}
+
+void SoundManager::pauseAll()
+{
+	unsigned int i;
+
+	for(i = 0; i < activeVoices.size(); i ++)
+	{
+		pauseVoice(activeVoices[i]);
+	}
+}
+
+void SoundManager::resumeAll()
+{
+	unsigned int i;
+
+	for(i = 0; i < activeVoices.size(); i ++)
+	{
+		resumeVoice(activeVoices[i]);
+	}
+}
+
+void SoundManager::stopAllPaused()
+{
+	int i;
+
+	// backwards, since freeing a voice moves the last one into its place
+	for(i = activeVoices.size() - 1; i >= 0; i --)
+	{
+		if(voices[activeVoices[i]].paused)
+		{
+			freeVoice(activeVoices[i]);
+		}
+	}
+}
+
+void SoundManager::stopAll()
+{
+	int i;
+
+	for(i = activeVoices.size() - 1; i >= 0; i --)
+	{
+		freeVoice(activeVoices[i]);
+	}
+}
+
+void SoundManager::setListenerPos(glm::vec3 pos)
+{
+	AudioCommand command;
+
+	// kept for scoring voices, too
+	listenerPos = pos;
+
+	command.type = COMMAND_SET_LISTENER_POS;
+	command.sourceIndex = -1;
+	command.vectors[0] = pos;
+	pushCommand(command);
+}
+
+void SoundManager::setListenerVelocity(glm::vec3 velocity)
+{
+	AudioCommand command;
+
+	command.type = COMMAND_SET_LISTENER_VELOCITY;
+	command.sourceIndex = -1;
+	command.vectors[1] = velocity;
+	pushCommand(command);
+}
+
+void SoundManager::setListenerOrientation(glm::vec3 forward, glm::vec3 up)
+{
+	AudioCommand command;
+
+	command.type = COMMAND_SET_LISTENER_ORIENTATION;
+	command.sourceIndex = -1;
+	command.vectors[0] = forward;
+	command.vectors[1] = up;
+	pushCommand(command);
 }
@@ -4,12 +4,151 @@
 #include "AL/al.h"
 #include "AL/alc.h"
 
+#include "pthread.h"
+
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <map>
 #include <string>
+#include <utility>
+#include <vector>
+
+// how much a sound matters when there are more of them than real sources; higher priorities always win
+enum SoundPriority
+{
+	SOUND_PRIORITY_LOW,						// ambient loops that are fine to drop (drone hover)
+	SOUND_PRIORITY_NORMAL,					// ordinary world sounds
+	SOUND_PRIORITY_HIGH,					// sounds the player must hear (their own gun, their death)
+	SOUND_PRIORITY_STREAM					// streamed sounds can't be virtualised, so they always keep their source
+};
 
+// every OpenAL call is made by a dedicated audio thread; the game just pushes commands into a lock-free queue and reads
+// back source states the audio thread publishes. That queue has room for a single producer only, so every public method
+// must be called from one thread: the simulation thread (see SimulationThread), which runs every World::update(), or
+// the thread that creates the world, before the simulation starts and after it has stopped.
+// Sounds are played on virtual voices, and only the most audible ones are given one of the real sources each frame;
+// the handles returned by playSound() and friends identify voices, not OpenAL sources.
 class SoundManager
 {
 private:
 	static const int MAX_SOURCES;
+	static const int MAX_VOICES;				// sounds we can track at once, audible or not
+	static const int MAX_BUFFERS;				// sound effects we can load in total
+	static const int NUM_STREAM_BUFFERS = 4;	// AL buffers queued on each streaming source
+	static const float STREAM_CHUNK_SECONDS;	// length of audio held by each of those buffers
+	static const int COMMAND_QUEUE_SIZE;		// commands in flight between the simulation thread and the audio thread; a power of two
+	static const long AUDIO_POLL_INTERVAL;		// nanoseconds the audio thread sleeps when it has nothing to do
+	static const float BOUND_VOICE_BONUS;		// score bonus for already having a source, so near-ties don't swap back and forth
+
+	// what we know about each source, as published by the audio thread; each state is tagged with the binding it
+	// belongs to (see sourceBindings), so the simulation thread never mistakes news about a source's previous use for its current one
+	enum SourceState
+	{
+		SOURCE_STOPPED,
+		SOURCE_PLAYING,
+		SOURCE_PAUSED
+	};
+
+	enum CommandType
+	{
+		COMMAND_PLAY,						// start buffer on a source with the given 3D settings
+		COMMAND_START_STREAM,				// prime and start a stream on a source
+		COMMAND_STOP,
+		COMMAND_PAUSE,
+		COMMAND_RESUME,
+		COMMAND_SET_VOLUME,
+		COMMAND_SET_LISTENER_POS,
+		COMMAND_SET_LISTENER_VELOCITY,
+		COMMAND_SET_LISTENER_ORIENTATION
+	};
+
+	struct AudioStream;
+
+	// one entry of the command queue; which fields matter depends on type
+	struct AudioCommand
+	{
+		CommandType type;
+		int sourceIndex;
+		unsigned int binding;				// value of sourceBindings[sourceIndex] when the command was issued
+		ALuint buffer;
+		AudioStream *stream;
+		glm::vec3 vectors[2];				// position (or forward), and velocity (or up)
+		float refDist;
+		float maxDist;
+		float value;						// volume
+		float offset;						// seconds into the buffer to start playing from
+		bool looping;
+		bool relative;						// no 3D effects
+	};
+
+	// latest position and velocity of a source; the simulation thread overwrites it as often as it likes and the audio thread
+	// only ever applies the newest values, using the sequence number (odd while being written) to avoid torn reads
+	struct PositionSlot
+	{
+		std::atomic<unsigned int> sequence;
+		std::atomic<float> values[6];		// position xyz, velocity xyz
+
+		glm::vec3 lastPos;					// simulation thread only: what we last wrote, so unmoved sources cost nothing
+		glm::vec3 lastVelocity;
+		unsigned int appliedSequence;		// audio thread only: last sequence handed to OpenAL
+	};
+
+	// a WAV file queued for decoding; the AL buffer already exists so the caller has something to hold on to
+	struct PendingLoad
+	{
+		std::string filename;
+		int bufferIndex;
+	};
+
+	// a sound that is logically playing, whether or not it currently has a real source; simulation thread only
+	struct Voice
+	{
+		unsigned int generation;			// bumped each time the voice is reused, so stale handles do nothing
+		bool active;
+		bool paused;
+		bool looping;
+		bool relative;						// no 3D effects
+		int priority;						// one of SoundPriority
+
+		ALuint buffer;
+		float duration;						// length of the buffer in seconds
+		AudioStream *stream;				// only for streamSound(); owned by the audio thread once bound
+
+		glm::vec3 pos;
+		glm::vec3 velocity;
+		float refDist;
+		float maxDist;
+
+		double time;						// seconds played so far; keeps counting while virtual
+		float score;						// priority plus audibility; the highest scores get real sources
+		int sourceIndex;					// real source we're playing on, or -1 while virtual
+		int activeIndex;					// where we are in activeVoices
+	};
+
+	// a long sound played straight from disk, a chunk at a time, through a few AL buffers that we keep refilling
+	struct AudioStream
+	{
+		std::ifstream file;					// open for as long as the stream plays
+		std::streampos dataStart;			// where the sample data begins in the file
+		int32_t dataSize;					// bytes of sample data in the file
+		int32_t dataRead;					// bytes read since dataStart (wraps around when looping)
+
+		ALenum format;						// what the samples are (or decode to, for ADPCM)
+		ALsizei frequency;
+		bool loop;
+
+		bool adpcm;							// file holds IMA ADPCM blocks, so we read whole blocks at a time
+		int blockAlign;
+		int numChannels;
+		int samplesPerBlock;
+
+		ALuint source;						// source the buffers are queued on
+		ALuint buffers[NUM_STREAM_BUFFERS];
+		unsigned char *chunk;				// staging memory for one buffer's worth of data
+		int chunkSize;
+		int16_t *samples;					// the chunk decoded, when the driver can't take ADPCM itself; NULL otherwise
+	};
 
 	static SoundManager *instance;			// singleton instance
 
@@ -17,40 +156,117 @@ private:
     ALCcontext *alContext;                 // our OpenAL context
 
 	ALuint *sources;						// sources playing or available to be played
-	int nextFreeSourceIndex;				// best guess as to where the next available source is, in "sources"
+	std::atomic<unsigned int> *sourceStates;	// one SourceState per source, in the low two bits, tagged with its binding
+	unsigned int *sourceBindings;			// simulation thread only: bumped every time a source is given to a voice
+	PositionSlot *positionSlots;			// one per source
+	int *freeSources;						// stack of source indices no voice is using
+	int numFreeSources;
+
+	Voice *voices;
+	int *freeVoices;						// stack of voice indices not in use
+	int numFreeVoices;
+	std::vector<int> activeVoices;			// voices in use, in no particular order
+	std::vector<std::pair<float, int> > rankedVoices;	// scratch space for update(): score and voice index
+
+	glm::vec3 listenerPos;					// simulation thread copy, for audibility
+
+	ALuint *buffers;						// buffer names handed out by loadWAV(), generated up front
+	float *bufferDurations;					// written by the audio thread when each buffer is decoded
+	std::map<ALuint, int> bufferIndices;	// simulation thread only: where each handed-out name sits in "buffers"
+	int numBuffersUsed;
 
 	double volume;							// volume of entire sound system
+	bool imaSupported;						// the driver plays IMA ADPCM buffers itself (AL_EXT_IMA4)
+
+	// single-producer (simulation thread), single-consumer (audio thread) ring of commands; a second thread pushing
+	// commands would race on commandTail, which is why only one may ever call in
+	AudioCommand *commands;
+	std::atomic<unsigned int> commandHead;	// next command the audio thread will run
+	std::atomic<unsigned int> commandTail;	// next free slot for the simulation thread
+
+	// the audio thread; it also decodes queued loads and keeps streams topped up
+	pthread_t audioThread;
+	pthread_mutex_t loaderMutex;			// guards pendingLoads, numLoadsInFlight, and shutdown
+	pthread_cond_t loaderWake;				// signalled when there's something new to decode (or on shutdown)
+	pthread_cond_t loadsDone;				// signalled whenever a decode finishes
+	std::deque<PendingLoad> pendingLoads;	// files waiting to be decoded, in the order they were requested
+	int numLoadsInFlight;					// decodes the audio thread has taken off the queue but not finished
+	std::atomic<int> numUnfinishedLoads;	// queued plus in flight; lets playback check for pending loads without locking
+	std::vector<AudioStream*> streams;		// audio thread only: streams being kept topped up
+	bool shutdown;							// tells the audio thread to exit
 
 	SoundManager();							// force use of getInstance()
 
-	ALuint getUnusedSource();				// returns an ALuint from "sources" that is currently unused
+	// simulation thread side
+	void pushCommand(AudioCommand &command);
+	ALuint startSound(ALuint buffer, glm::vec3 pos, double refDist, double maxDist, bool looping, bool relative, int priority);
+	ALuint startVoice(Voice &settings);		// returns the handle, or 0 if every voice is in use
+	int getVoiceIndex(ALuint handle);		// -1 for handles of voices that have since finished
+	void freeVoice(int voiceIndex);
+	void computeScore(Voice *voice);
+	bool hasFinished(Voice *voice);
+	void bindVoice(int voiceIndex, int sourceIndex);
+	void unbindVoice(int voiceIndex);		// virtualise: stop the real source but keep the voice going
+	bool stealSourceFor(int voiceIndex);	// bind to a free source, or take one from a less important voice
+	void pauseVoice(int voiceIndex);
+	void resumeVoice(int voiceIndex);
+	void writePosition(int sourceIndex, glm::vec3 pos, glm::vec3 velocity);
+
+	// audio thread side
+	static void *invokeAudioLoop(void *arg);	// arg is expected to be the SoundManager
+	void audioLoop();
+	bool runCommands();						// true if there were any
+	void runCommand(AudioCommand &command);
+	void applyPositions();
+	void pollSourceStates();
+	void decodeWAV(std::string filename, int bufferIndex);
+
+	bool fillStreamBuffer(AudioStream *stream, ALuint buffer);	// false once a non-looping stream runs out of data
+	bool refillStream(AudioStream *stream);						// false once a non-looping stream has finished playing
+	void destroyStream(AudioStream *stream);
+	void closeStream(ALuint source);							// forget the stream playing on source, if any
+	static void deleteStream(AudioStream *stream);				// free a stream that never reached the audio thread
 
 public:
 	static SoundManager *getInstance();		    // singleton design pattern
 
 	~SoundManager();                            // deallocates OpenAL resources
 
-    ALuint loadWAV(std::string file);           // load a .WAV file and return an OpenAL buffer associated with it
+    // queue a .WAV file (PCM or IMA ADPCM) to be decoded in the background and return the OpenAL buffer it will end up in; playing
+    // the buffer waits for any outstanding loads, so callers can treat it as loaded right away
+    ALuint loadWAV(std::string file);
+    void waitForLoads();                        // block until every queued loadWAV() has finished
+
+    // play a long .WAV file directly from disk, without ever holding all of it in memory; returns a voice handle for
+    // stop(), pause() and the like, just as playSound() does, or 0 if no voice or source could be had. It is not an
+    // OpenAL source, so never hand it to al* functions
+    ALuint streamSound(std::string file, bool loop);
 
 	void setVolume(double volume);			    // sets or gets volume of entire system
 	double getVolume();
 
+	// once per frame: retire finished voices and hand the real sources to the most audible ones
+	void update(float dt);
+
 	// play sound with default settings
-	ALuint playSound(ALuint);
+	ALuint playSound(ALuint, int priority = SOUND_PRIORITY_NORMAL);
 
 	// play sound with specified 3D settings
-	ALuint playSound(ALuint, glm::vec3 pos, double refDist, double maxDist);
+	ALuint playSound(ALuint, glm::vec3 pos, double refDist, double maxDist, int priority = SOUND_PRIORITY_NORMAL);
 
 	// loop sound with default settings
-	ALuint loopSound(ALuint);
+	ALuint loopSound(ALuint, int priority = SOUND_PRIORITY_NORMAL);
 
 	// loop sound with specified 3D settings
-	ALuint loopSound(ALuint, glm::vec3 pos, double refDist, double maxDist);
+	ALuint loopSound(ALuint, glm::vec3 pos, double refDist, double maxDist, int priority = SOUND_PRIORITY_NORMAL);
+
+	// move a playing sound; cheap enough to call every frame, since only the latest values ever reach OpenAL
+	void setSourcePos(ALuint, glm::vec3 pos, glm::vec3 velocity);
 
-	// is the given source currently playing or paused?
+	// is the given sound currently playing or paused (audibly or not)?
 	bool isSoundPlaying(ALuint);
 
-	// sound control---pass in an OpenAL source, get the desired effect
+	// sound control---pass in a sound handle, get the desired effect
 	void stop(ALuint);
 	void pause(ALuint);
 	void resume(ALuint);
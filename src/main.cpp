@@ -1,11 +1,15 @@
+#include "world/benchmark.h"
+#include "world/rendersnapshot.h"
+#include "world/simulationthread.h"
 #include "world/world.h"
 
 #include "util/gldebugging.h"
+#include "util/glstate.h"
+#include "util/inputstate.h"
 #include "util/planerenderer.h"
 #include "util/loadtexture.h"
-
-#include "objects/hud.h"
-extern int hudTime;
+#include "util/streambuffer.h"
+#include "util/textureloader.h"
 
 #include "GL/glew.h"
 
@@ -27,35 +31,41 @@ GLFWwindow *window;
 vec2 windowSize;				// changed by openWindow();
 
 // intialization functions
-void openWindow();
+void openWindow(bool benchmark);
 void prepareOpenGL();
 void showLoadingScreen();
 
-// main function; everything starts here
+// main function; everything starts here; "PUBG --benchmark <output dir> [<golden image dir>]" runs the benchmark
+// (see Benchmark) instead of the game
 int main(int args, char *argv[])
 {
 	const string WORLD_FILE = "../png/world.png";
+	const unsigned int BENCHMARK_SEED = 1;				// the benchmark's frames have to be the same every time
 
 	// some important objects
 	World *world;
-
-	// used to control frame timing
+	SimulationThread *simulation;
+	RenderSnapshot *snapshot;
+	InputState input;
+	Benchmark *benchmark;
+	bool benchmarkMode = args >= 3 && string(argv[1]) == "--benchmark";
+	bool benchmarkPassed;
+
+	// used to control frame timing; the time step updates use is worked out by the simulation thread
 	const double TARGET_FRAME_INTERVAL = 0.016665;		// slightly smaller than 1/60, our desired time (sec.) between frames
-	const double FRAME_TIME_ALPHA = 0.25;				// degree to which previous frame time is used for delta time computation
 
-	// these handle the smooth frame timing
-	double dt;											// time since last cycle through loop (*not* time between update/render steps)
+	// these handle the frame pacing
+	double dt;											// time since last cycle through loop (*not* time between frames)
 	double currentTime;									// current time according to GLFW
 	double oldTime;										// what the value of currentTime was on the last cycle through loop
-	double frameTime = 0.0;								// delta time of the next frame to render to keep things smooth
-	double renderAccum = 0.0;							// accumulated time between update/render steps
-	double smoothFrameTime = TARGET_FRAME_INTERVAL;		// weighted average delta time used to smooth out next frame
+	double renderAccum = 0.0;							// accumulated time between frames
+	int numFrames = 0;									// frames rendered so far, for the occasional debug report
 
 	// reseed with the clock
-	srand(time(NULL));
+	srand(benchmarkMode ? BENCHMARK_SEED : time(NULL));
 
 	// create our OpenGL window and context, and set some rendering options
-	openWindow();
+	openWindow(benchmarkMode);
 	prepareOpenGL();
 	// Quick-and-dirty loading screen while everything is loaded and built this will be cleared the next time the buffers are swapped
 	showLoadingScreen();
@@ -63,49 +73,89 @@ int main(int args, char *argv[])
 	// construct our world using a PNG image that describes how it is built
 	world = new World(window, windowSize, WORLD_FILE);
 
+	// the textures have been decoding in the background while the world was built; get the rest of them in
+	TextureLoader::getInstance() -> finish();
+
+	// the benchmark runs its own loop
+	if(benchmarkMode)
+	{
+		benchmark = new Benchmark(window, world, windowSize.x, windowSize.y, argv[2], args >= 4 ? argv[3] : "");
+		benchmarkPassed = benchmark -> run();
+
+		delete benchmark;
+		delete world;
+		glfwDestroyWindow(window);
+		glfwTerminate();
+
+		return benchmarkPassed ? 0 : 1;
+	}
+
+	// the world is updated on a thread of its own from here on, starting with the input as it is now; this thread
+	// keeps the GL context and the window
+	input.sample(window);
+	input.setProjectionScale(world -> getProjectionScale());
+	simulation = new SimulationThread(world, input);
+
 	// prime our time tracking
 	currentTime = glfwGetTime();
 	oldTime = currentTime;
 
 	// loop until we're done
-	while(!glfwWindowShouldClose(window) && !glfwGetKey(window, GLFW_KEY_ESCAPE) && !world -> isGameDone())
+	while(!glfwWindowShouldClose(window) && !glfwGetKey(window, GLFW_KEY_ESCAPE) && !simulation -> isGameDone())
 	{
-		
-		
-		
-		// compute a time multiplier based on our frame rate
+		// track the time that has passed since the last loop cycle
 		oldTime = currentTime;
 		currentTime = glfwGetTime();
 		dt = currentTime - oldTime;
-		hudTime = currentTime;
-
-		// track the time that has passed since the last loop cycle
 		renderAccum += dt;
-		frameTime += dt;
 
-		// is it time to update the scene and render a new frame?
+		// is it time to render a new frame?
 		if(renderAccum >= TARGET_FRAME_INTERVAL) {
+			// get the last frame the simulation finished; it carries on with the next one while we draw this
+			snapshot = simulation -> acquireSnapshot();
+			if(snapshot == NULL)
+			{
+				break;
+			}
+
 			// clear our colour and depth buffers
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 			// reset the timer for our next frame after this one
 			renderAccum -= TARGET_FRAME_INTERVAL;
 
-			// use our previous frame time to compute a smoother frame time for this update cycle
-			smoothFrameTime = (smoothFrameTime * FRAME_TIME_ALPHA) + (frameTime * (1.0 - FRAME_TIME_ALPHA));
-			frameTime = 0.0;
-
-			// update the world state and render everything
-			world -> update(smoothFrameTime);
-			world -> render();
-
-			// get input events and update our framebuffer
+			// render everything; by the time render() returns, GL has its own copy of whatever it needed from the
+			// snapshot, so the simulation can have it back
+			TextureLoader::getInstance() -> update();
+			world -> render(*snapshot);
+			simulation -> releaseSnapshot();
+
+			// fence off this frame's streamed data so the next frames write elsewhere
+			StreamBuffer::endFrame();
+
+			// about once a second, report how much GL state the last frame really changed, and how big the scene was
+			numFrames ++;
+			#ifdef DEBUG
+				if(numFrames % 60 == 0)
+				{
+					cout << "-- GL state changes: " << GLState::getInstance() -> getNumChanges() << " ("
+						 << GLState::getInstance() -> getNumSkipped() << " redundant ones skipped)" << endl;
+					cout << "-- scene resolution: " << (int)(world -> getResolutionScale() * 100.0) << "%" << endl;
+				}
+			#endif
+
+			// get input events, pass them on to the simulation along with the resolution we just drew at, and update
+			// our framebuffer
 			glfwPollEvents();
+			input.sample(window);
+			input.setProjectionScale(world -> getProjectionScale());
+			simulation -> setInput(input);
 			glfwSwapBuffers(window);
 		}
 	}
 
-	// terminate our world
+	// stop the simulation before the world it's updating goes away, then terminate our world
+	delete simulation;
 	delete world;
 
 	// shut down GLFW
@@ -116,9 +166,11 @@ int main(int args, char *argv[])
 	return 0;
 }
 
-void openWindow()
+void openWindow(bool benchmark)
 {
 	const char *TITLE = "Game Of Drones";
+	const int BENCHMARK_WIDTH = 1280;			// the benchmark's captures have to be the same size as its golden images
+	const int BENCHMARK_HEIGHT = 720;
 
 	int windowWidth;
 	int windowHeight;
@@ -140,18 +192,35 @@ void openWindow()
 		glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
 	#endif
 
-	// use the current desktop mode to decide on a suitable resolution
-	const GLFWvidmode *mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
-	windowWidth = mode -> width;
-	windowHeight = mode -> height;
-
-	// create our OpenGL window using GLFW
-    window = glfwCreateWindow(windowWidth, windowHeight,		// specify width and height
-							  TITLE,							// title of window
-							  glfwGetPrimaryMonitor(),		    // fullscreen mode
-							  NULL);							// not sharing resources across monitors
+	if(benchmark)
+	{
+		// the benchmark never shows anything (it draws into a framebuffer of this size and reads its frames back from
+		// there instead), so the window is only there for the context; it's hidden, and it doesn't wait for vsync
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		windowWidth = BENCHMARK_WIDTH;
+		windowHeight = BENCHMARK_HEIGHT;
+		window = glfwCreateWindow(windowWidth, windowHeight, TITLE, NULL, NULL);
+	}
+	else
+	{
+		// use the current desktop mode to decide on a suitable resolution
+		const GLFWvidmode *mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+		windowWidth = mode -> width;
+		windowHeight = mode -> height;
+
+		// create our OpenGL window using GLFW
+		window = glfwCreateWindow(windowWidth, windowHeight,		// specify width and height
+								  TITLE,							// title of window
+								  glfwGetPrimaryMonitor(),		    // fullscreen mode
+								  NULL);							// not sharing resources across monitors
+	}
+	if(window == NULL)
+	{
+		cerr << "openWindow() could not create a window" << endl;
+		exit(1);
+	}
 	glfwMakeContextCurrent(window);
-	glfwSwapInterval(1);
+	glfwSwapInterval(benchmark ? 0 : 1);
 
 	// disable the cursor
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -188,10 +257,12 @@ void openWindow()
 
 void prepareOpenGL()
 {
+	GLState *gl = GLState::getInstance();
+
 	// turn on depth testing and enable blending
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	gl -> enable(GL_DEPTH_TEST);
+	gl -> enable(GL_BLEND);
+	gl -> blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// sky blue-ish in background
 	glClearColor(0.529, 0.808, 0.922, 0.0);
@@ -211,8 +282,9 @@ void showLoadingScreen()
 	// this handles our rendering efficiently
 	PlaneRenderer *planes = PlaneRenderer::getInstance();
 
-	// load the "no drones" texture and the "loading" texture
+	// load the "no drones" texture and the "loading" texture; we need it right away, so wait for it
 	GLuint logo = loadPNG("../png/no-drones.png");
+	TextureLoader::getInstance() -> finish();
 
 	// compute the plane renderer's viewing params
 	mat4 orthoProjection = ortho(0.0f, (float)windowSize.x, 0.0f, (float)windowSize.y, ORTHO_NEAR_RANGE, ORTHO_FAR_RANGE);
@@ -229,7 +301,7 @@ void showLoadingScreen()
 	planes -> setViewMatrix(orthoView);
 
 	// draw "no drones" logo
-	glBindTexture(GL_TEXTURE_2D, logo);
+	GLState::getInstance() -> bindTexture(0, logo);
 	model = mat4(1.0);
 	model = translate(model, LOGO_POSITION);
 	model = scale(model, LOGO_SIZE);
@@ -1,6 +1,6 @@
 #include "objects/complexcollider.h"
 
-#include "glmmodel/glmmodel.h"
+#include "util/mesh.h"
 
 #include "claudette/collision_model_3d.h"		// a really nice open-source, minimal collision library based on coldet that
 #include "claudette/ray_collision_test.h"		// I stumbled upon rather late in NFZ's development
@@ -13,7 +13,7 @@ using namespace glm;
 #include <iostream>
 using namespace std;
 
-ComplexCollider::ComplexCollider(GLMmodel *geometry)
+ComplexCollider::ComplexCollider(Mesh *geometry)
 {
 	transform = mat4(1.0);
 	setGeometry(geometry);
@@ -30,10 +30,11 @@ void ComplexCollider::setTransform(mat4 &transform)
 	geometry -> setTransform(value_ptr(transform));
 }
 
-void ComplexCollider::setGeometry(GLMmodel *model)
+void ComplexCollider::setGeometry(Mesh *mesh)
 {
-    GLMgroup *groups = model -> groups;					// multi-group meshes not supported (yet)...I'm lazy
-    int numTriangles = model -> numtriangles;
+    const Mesh::Vertex *meshVertices = mesh -> getVertices();
+    const GLushort *indices = mesh -> getIndices();
+    int numTriangles = mesh -> getNumIndices() / 3;
 
     float vertices[3][3];
     int i, j, k;
@@ -51,7 +52,7 @@ void ComplexCollider::setGeometry(GLMmodel *model)
 			// this loop forms one vertex
 			for(k = 0; k < 3; k ++)
 			{
-				vertices[j][k] = model -> vertices[3 * model -> triangles[(groups[0].triangles[i])].vindices[j] + k];
+				vertices[j][k] = meshVertices[indices[3 * i + j]].position[k];
 			}
         }
 
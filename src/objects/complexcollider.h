@@ -5,12 +5,12 @@
 #include "glm/glm.hpp"
 
 class CollisionModel3D;
-typedef struct _GLMmodel GLMmodel;
+class Mesh;
 
 class ComplexCollider
 {
 public:
-	ComplexCollider(GLMmodel *geometry);				// requires Wavefront .OBJ geometry
+	ComplexCollider(Mesh *geometry);					// only the positions and indices are used
 	~ComplexCollider();
 
 	void setTransform(glm::mat4 &transform);			// model matrix
@@ -20,7 +20,7 @@ public:
 
 private:
 	glm::mat4 transform;								// model matrix---global model position and orientation
-	Claudette::CollisionModel3D *geometry;				// Claudette representation of .OBJ geometry
+	Claudette::CollisionModel3D *geometry;				// Claudette representation of the mesh
 
-	void setGeometry(GLMmodel *geometry);				// build Claudette representation
+	void setGeometry(Mesh *geometry);					// build Claudette representation
 };
@@ -187,12 +187,11 @@ void Drone::controlHoverSound()
 			// no hover source active, so start one
 			if(hoverSource == 0)
 			{
-				hoverSource = soundManager -> loopSound(hoverBuffer, pos, HOVER_REF_HEAR_DIST, HOVER_MAX_HEAR_DIST);
+				hoverSource = soundManager -> loopSound(hoverBuffer, pos, HOVER_REF_HEAR_DIST, HOVER_MAX_HEAR_DIST, SOUND_PRIORITY_LOW);
 			}
 
-			// position the sound where the drone is
-			alSource3f(hoverSource, AL_POSITION, pos.x, pos.y, pos.z);
-			alSource3f(hoverSource, AL_VELOCITY, velocity.x, velocity.y, velocity.z);
+			// position the sound where the drone is; this is only queued, and dropped if we haven't moved
+			soundManager -> setSourcePos(hoverSource, pos, velocity);
 		}
     }
     else
@@ -267,8 +266,5 @@ void Drone::explode()
 	}
 
 	// small burst of sparks
-	for(i = 0; i < NUM_SPARKS; i ++)
-	{
-		world -> addParticle(spark, pos, 1.0);
-	}
+	world -> addParticleBurst(spark, pos, NUM_SPARKS, 1.0);
 }
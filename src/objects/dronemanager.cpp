@@ -2,19 +2,22 @@
 #include "objects/drone.h"
 #include "objects/complexcollider.h"
 #include "objects/player.h"
-extern bool fogFlag;
 #include "objects/hud.h"
 
+#include "util/glstate.h"
+#include "util/mesh.h"
+#include "util/renderqueue.h"
 #include "util/shader.h"
+#include "util/shadercache.h"
 #include "util/loadtexture.h"
 #include "util/math.h"
+#include "util/occlusionculler.h"
+#include "util/streambuffer.h"
 
 #include "world/world.h"
 
 #include "audio/soundmanager.h"
 
-#include "glmmodel/glmmodel.h"
-
 #include "GL/glew.h"
 
 #include "glm/glm.hpp"
@@ -35,9 +38,9 @@ DroneManager::DroneManager(World *world, int maxDrones) {
 	this -> maxDrones = maxDrones;
 	numDrones = 0;
 	numDronesAlive = 0;
+	numDronesVisible = 0;
 
 	drones = new Drone[maxDrones];
-	modelMats = new mat4[maxDrones];
 
 	initTemporalPartitioning();
 	loadModels();
@@ -47,20 +50,16 @@ DroneManager::DroneManager(World *world, int maxDrones) {
 }
 
 DroneManager::~DroneManager() {
-	glmDelete(droneColliderModel);
-	glmDelete(droneBladeModel);
-	glmDelete(droneBodyModel);
+	delete droneColliderModel;
 
-	glDeleteBuffers(4, bodyVBOs);
+	glDeleteBuffers(1, &bodyVBO);
 	glDeleteVertexArrays(1, &bodyVAO);
-	delete bodyShader;
 
-	glDeleteBuffers(4, bladesVBOs);
+	glDeleteBuffers(1, &bladesVBO);
 	glDeleteVertexArrays(1, &bladesVAO);
-	delete bladesShader;
 
+	delete instanceStream;
 	delete[] drones;
-	delete[] modelMats;
 }
 
 void DroneManager::initTemporalPartitioning() {
@@ -73,70 +72,71 @@ void DroneManager::initTemporalPartitioning() {
 }
 
 void DroneManager::loadModels() {
-	// attempt to read the body file; glmReadObj() will just quit if we can't
-    droneBodyModel = glmReadOBJ((char*)"../mesh/drone-body.obj");
-    if(droneBodyModel)
-    {
-		glmScale(droneBodyModel, 1.0);
-
-		// build our buffer objects and then fill them with the geometry data we loaded
-		glGenVertexArrays(1, &bodyVAO);
-		glBindVertexArray(bodyVAO);
-		glGenBuffers(4, bodyVBOs);
-		glmBuildVBO(droneBodyModel, &numBodyVertices, &bodyVAO, bodyVBOs);
-
-		// set aside some memory for our drone model matrices (i.e., prepare for instanced rendering)
-		glBindBuffer(GL_ARRAY_BUFFER, bodyVBOs[3]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(mat4) * maxDrones, NULL, GL_DYNAMIC_DRAW);
-		glEnableVertexAttribArray(3);
-		glEnableVertexAttribArray(4);
-		glEnableVertexAttribArray(5);
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)0);
-		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)sizeof(vec4));
-		glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)(sizeof(vec4) * 2));
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)(sizeof(vec4) * 3));
-		glVertexAttribDivisor(3, 1);
-		glVertexAttribDivisor(4, 1);
-		glVertexAttribDivisor(5, 1);
-		glVertexAttribDivisor(6, 1);
-	}
-
-	// attempt to read the blades file; glmReadObj() will just quit if we can;t
-	droneBladeModel = glmReadOBJ((char*)"../mesh/drone-blades.obj");
-	if(droneBladeModel)
-	{
-		glmScale(droneBladeModel, 1.0);
-
-		// build out buffer objects and then fill them with the geometry data we loaded
-		glGenVertexArrays(1, &bladesVAO);
-		glBindVertexArray(bladesVAO);
-		glGenBuffers(4, bladesVBOs);
-		glmBuildVBO(droneBladeModel, &numBladesVertices, &bladesVAO, bladesVBOs);
-
-		// set aside some memory for our blade model matrices (i.e., prepare for instanced rendering)
-		glBindBuffer(GL_ARRAY_BUFFER, bladesVBOs[3]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(mat4) * maxDrones, NULL, GL_DYNAMIC_DRAW);
-		glEnableVertexAttribArray(3);
-		glEnableVertexAttribArray(4);
-		glEnableVertexAttribArray(5);
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)0);
-		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)sizeof(vec4));
-		glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)(sizeof(vec4) * 2));
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)(sizeof(vec4) * 3));
-		glVertexAttribDivisor(3, 1);
-		glVertexAttribDivisor(4, 1);
-		glVertexAttribDivisor(5, 1);
-		glVertexAttribDivisor(6, 1);
-	}
+	// room for one set of model matrices per frame; the stream buffer handles keeping frames in flight apart
+	instanceStream = new StreamBuffer(GL_ARRAY_BUFFER, sizeof(mat4) * maxDrones);
+
+	Mesh *geometry;
+	vec3 boundsMin, boundsMax;
+
+	// read the body file (the mesh will just quit if we can't), then build our buffer objects and fill them with it
+	geometry = new Mesh("../mesh/drone-body.obj");
+	glGenVertexArrays(1, &bodyVAO);
+	glGenBuffers(1, &bodyVBO);
+	geometry -> upload(bodyVAO, bodyVBO);
+	firstBodyIndex = geometry -> getFirstIndex();
+	numBodyIndices = geometry -> getNumIndices();
+	boundsMin = geometry -> getBoundsMin();
+	boundsMax = geometry -> getBoundsMax();
+	delete geometry;
+
+	// model matrices come from the instance stream (i.e., prepare for instanced rendering)
+	setupInstanceAttribs(0);
+	glEnableVertexAttribArray(3);
+	glEnableVertexAttribArray(4);
+	glEnableVertexAttribArray(5);
+	glEnableVertexAttribArray(6);
+	glVertexAttribDivisor(3, 1);
+	glVertexAttribDivisor(4, 1);
+	glVertexAttribDivisor(5, 1);
+	glVertexAttribDivisor(6, 1);
+
+	// same for the blades file
+	geometry = new Mesh("../mesh/drone-blades.obj");
+	glGenVertexArrays(1, &bladesVAO);
+	glGenBuffers(1, &bladesVBO);
+	geometry -> upload(bladesVAO, bladesVBO);
+	firstBladesIndex = geometry -> getFirstIndex();
+	numBladesIndices = geometry -> getNumIndices();
+	boundsMin = min(boundsMin, geometry -> getBoundsMin());
+	boundsMax = max(boundsMax, geometry -> getBoundsMax());
+	delete geometry;
+
+	// culling only needs a sphere around the whole thing
+	droneCenter = (boundsMin + boundsMax) * 0.5f;
+	droneRadius = length(boundsMax - droneCenter);
+
+	// the blades share the body's model matrices (i.e., prepare for instanced rendering)
+	setupInstanceAttribs(0);
+	glEnableVertexAttribArray(3);
+	glEnableVertexAttribArray(4);
+	glEnableVertexAttribArray(5);
+	glEnableVertexAttribArray(6);
+	glVertexAttribDivisor(3, 1);
+	glVertexAttribDivisor(4, 1);
+	glVertexAttribDivisor(5, 1);
+	glVertexAttribDivisor(6, 1);
+
+	// read the collision geometry
+	droneColliderModel = new Mesh("../mesh/drone-collider.obj");
+}
 
-	// attempt to read the collision geometry; glmReadObj() will just quit if we can't
-	droneColliderModel = glmReadOBJ((char*)"../mesh/drone-collider.obj");
-	if(droneColliderModel)
-	{
-		glmScale(droneColliderModel, 1.0);
-	}
+void DroneManager::setupInstanceAttribs(GLintptr offset)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, instanceStream -> getBuffer());
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)offset);
+	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)(offset + sizeof(vec4)));
+	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)(offset + sizeof(vec4) * 2));
+	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)(offset + sizeof(vec4) * 3));
 }
 
 void DroneManager::loadTextures()
@@ -151,39 +151,45 @@ void DroneManager::loadTextures()
 void DroneManager::loadShader()
 {
 	// Dronemanager::render takes care of lighting
-	bodyShader = new Shader("../shaders/solid-instanced.vert", "../shaders/solid.frag");
+	bodyShader = ShaderCache::getInstance() -> get("../shaders/solid-instanced.vert", "../shaders/solid.frag", "FOG");
 	bodyShader -> bindAttrib("a_Vertex", 0);
 	bodyShader -> bindAttrib("a_Normal", 1);
 	bodyShader -> bindAttrib("a_TexCoord", 2);
 	bodyShader -> bindAttrib("a_Model", 3);
-	bodyShader -> link();
+	bodyShader -> startLink();
+
+	// shader for the drone blades
+	bladesShader = ShaderCache::getInstance() -> get("../shaders/solid-instanced.vert", "../shaders/plane.frag", "FOG");
+	bladesShader -> bindAttrib("a_Vertex", 0);
+	bladesShader -> bindAttrib("a_Normal", 1);
+	bladesShader -> bindAttrib("a_TexCoord", 2);
+	bladesShader -> bindAttrib("a_Model", 3);
+	bladesShader -> startLink();
+}
+
+void DroneManager::finishShader()
+{
+	mat3 normal(1.0);
+
 	bodyShader -> bind();
 	bodyShader -> uniform1i("u_DiffuseMap", 0);
 	bodyShader -> uniform1i("u_NormalMap", 1);
 	bodyShader -> uniform1i("u_SpecularMap", 2);
 	bodyShader -> uniform1i("u_EmissionMap", 3);
-	bodyShader -> uniformVec3("u_Sun", World::SUN_DIRECTION);
 	bodyShader -> uniformVec3("u_MaterialDiffuse", vec3(1.0, 1.0, 1.0));
 	bodyShader -> uniformVec3("u_MaterialSpecular", vec3(1.0, 1.0, 1.0));
 	bodyShader -> uniform1f("u_SpecularIntensity", 6.0);
 	bodyShader -> uniform1f("u_SpecularHardness", 16.0);
 	bodyShader -> uniform1f("u_NormalMapStrength", 2.0);
-	bodyShader -> uniformVec3("fogColor", vec3(0.65, 0.65, 0.65));
-	bodyShader -> uniform1i("fogFlag", fogFlag);
+
+	// the drones are never rotated, so their normals never need transforming; this should really be passed in per
+	// instance, not per program, if that ever changes
+	bodyShader -> uniformMatrix3fv("u_Normal", 1, value_ptr(normal));
 	bodyShader -> unbind();
 
-	// shader for the drone blades
-	bladesShader = new Shader("../shaders/solid-instanced.vert", "../shaders/plane.frag");
-	bladesShader -> bindAttrib("a_Vertex", 0);
-	bladesShader -> bindAttrib("a_Normal", 1);
-	bladesShader -> bindAttrib("a_TexCoord", 2);
-	bladesShader -> bindAttrib("a_Model", 3);
-	bladesShader -> link();
 	bladesShader -> bind();
 	bladesShader -> uniform1i("u_Texture", 0);
 	bladesShader -> uniformVec4("u_Color", vec4(0.0, 0.0, 0.0, 1.0));
-	bladesShader -> uniformVec3("fogColor", vec3(0.65, 0.65, 0.65));
-	bladesShader -> uniform1i("fogFlag", fogFlag);
 	bladesShader -> unbind();
 }
 
@@ -220,13 +226,11 @@ void DroneManager::update(float dt)
 	float *cylinderTimer = cylinderTestTimers;
 	float closestDist;
 
-	mat4 *modelMatPtr;
 	vec3 pos;
 	vec3 newPos;
 	int i;
 
 	// update the active drones and update how many of them we track for rendering
-	modelMatPtr = modelMats;
 	numDronesAlive = 0;
 	for(i = 0; i < numDrones; i ++)
 	{
@@ -270,88 +274,116 @@ void DroneManager::update(float dt)
 				}
 			}
 
-			// save the drone's model matrix for rendering later
-			curr -> getModelMat(modelMatPtr);
-			modelMatPtr++;
 			numDronesAlive ++;
 		}
 		curr ++;
 		cylinderTimer ++;
 	}
 
-	// now send the data to the graphics card (the body geometry)
-	glBindVertexArray(bodyVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, bodyVBOs[3]);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(mat4) * numDrones, modelMats);
-
-	// now send the data to the graphics card (the blades geometry)
-	glBindVertexArray(bladesVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, bladesVBOs[3]);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(mat4) * numDrones, modelMats);
 	hudDrones = numDronesAlive;
 }
 
-void DroneManager::render(mat4 &projection, mat4 &view) {	
-	// compute our normal matrix for lighting
-	mat4 modelMatrix(1.0);
-	mat3 normal = inverseTranspose(mat3(modelMatrix));		// this does actually do anything, and should be passed in per
-															// instance, not per rendering call
+void DroneManager::snapshot(Snapshot &snapshot)
+{
+	Drone *curr = drones;
+	mat4 modelMat;
+	int i;
+
+	// the vector keeps its memory from one snapshot to the next, so this only allocates the first time around
+	snapshot.modelMats.clear();
+	for(i = 0; i < numDrones; i ++)
+	{
+		if(curr -> getAlive())
+		{
+			curr -> getModelMat(&modelMat);
+			snapshot.modelMats.push_back(modelMat);
+		}
+		curr ++;
+	}
+}
+
+void DroneManager::render(Snapshot &snapshot, OcclusionCuller *occlusion) {
+	GLState *gl = GLState::getInstance();
+
+	mat4 *modelMatPtr;
+	GLintptr instanceOffset;
+	int numToDraw = instanceStream -> clampCount(snapshot.modelMats.size(), sizeof(mat4), sizeof(vec4));
+	int i;
+
+	// nothing to draw once every drone is dead
+	if(numToDraw == 0)
+	{
+		return;
+	}
+
+	// model matrices of the drones that aren't off screen or behind a hill are written straight into this frame's
+	// region of the instance stream; drones turn but are never scaled, so their spheres only need moving
+	modelMatPtr = (mat4*)instanceStream -> allocate(sizeof(mat4) * numToDraw, sizeof(vec4), instanceOffset);
+	numDronesVisible = 0;
+	for(i = 0; i < numToDraw; i ++)
+	{
+		if(occlusion -> isVisible(vec3(snapshot.modelMats[i] * vec4(droneCenter, 1.0)), droneRadius))
+		{
+			modelMatPtr[numDronesVisible ++] = snapshot.modelMats[i];
+		}
+	}
+	instanceStream -> commit();
 
-	// OpenGL rendering settings common to blades and body
-	glDisable(GL_CULL_FACE);
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	if(numDronesVisible == 0)
+	{
+		return;
+	}
+
+	// point both the body and the blades at this frame's matrices; nothing needs to be copied
+	gl -> bindVertexArray(bodyVAO);
+	setupInstanceAttribs(instanceOffset);
+	gl -> bindVertexArray(bladesVAO);
+	setupInstanceAttribs(instanceOffset);
 
 	// drone blades and bodies are rendered separately
-	renderBodies(projection, view, normal);
-	renderBlades(projection, view, normal);
+	renderBodies();
+	renderBlades();
 }
 
-void DroneManager::renderBodies(mat4 &projection, mat4 &view, mat3 &normal)
+void DroneManager::renderBodies()
 {
+	DrawPacket packet;
+
 	// send in the cavalry
-	bodyShader -> bind();
-	bodyShader -> uniformMatrix4fv("u_Projection", 1, value_ptr(projection));
-	bodyShader -> uniformMatrix4fv("u_View", 1, value_ptr(view));
-	bodyShader -> uniformMatrix3fv("u_Normal", 1, value_ptr(normal));
+	packet.pass = RENDER_PASS_OPAQUE;
+	packet.shader = bodyShader;
 
 	// we use diffuse, normal, specular, and emission texture maps when rendering for a really nice effect
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, diffuseMap);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, normalMap);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, specularMap);
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, emissionMap);
-
-	// finally, render the drone bodies
-	glBindVertexArray(bodyVAO);
-	glDrawArraysInstanced(GL_TRIANGLES, 0, numBodyVertices, numDronesAlive);
+	packet.textures[0] = diffuseMap;
+	packet.textures[1] = normalMap;
+	packet.textures[2] = specularMap;
+	packet.textures[3] = emissionMap;
+
+	// finally, queue up the drone bodies
+	packet.vao = bodyVAO;
+	packet.first = firstBodyIndex;
+	packet.count = numBodyIndices;
+	packet.instanceCount = numDronesVisible;
+	RenderQueue::getInstance() -> submit(packet);
 }
 
-void DroneManager::renderBlades(mat4 &projection, mat4 &view, mat3 &normal)
+void DroneManager::renderBlades()
 {
-	// send in the cavalry
-	bladesShader -> bind();
-	bladesShader -> uniformMatrix4fv("u_Projection", 1, value_ptr(projection));
-	bladesShader -> uniformMatrix4fv("u_View", 1, value_ptr(view));
-	//bladesShader -> uniformMatrix3fv("u_Normal", 1, value_ptr(normal));
-
-	// we use diffuse, normal, specular, and emission texture maps when rendering for a really nice effect
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, bladesTexture);
+	DrawPacket packet;
 
 	// we want these transparent and not writing to the depth buffer
-	glEnable(GL_BLEND);
-	glDepthMask(GL_FALSE);
-
-	// finally, render the drone bodies
-	glBindVertexArray(bladesVAO);
-	glDrawArraysInstanced(GL_TRIANGLES, 0, numBladesVertices, numDronesAlive);
-
-	// restore opacity
-	glDepthMask(GL_TRUE);
-	glDisable(GL_BLEND);
+	packet.pass = RENDER_PASS_TRANSPARENT;
+	packet.shader = bladesShader;
+
+	// only one texture is needed for the blades
+	packet.textures[0] = bladesTexture;
+
+	// finally, queue up the drone blades
+	packet.vao = bladesVAO;
+	packet.first = firstBladesIndex;
+	packet.count = numBladesIndices;
+	packet.instanceCount = numDronesVisible;
+	RenderQueue::getInstance() -> submit(packet);
 }
 
 bool DroneManager::isDroneCloseTo(vec3 pos, float distance)
@@ -5,30 +5,43 @@
 
 #include "audio/soundmanager.h"
 
-typedef struct _GLMmodel GLMmodel;
+#include <vector>
 
 class World;
+class Mesh;
 class Shader;
 class Drone;
+class StreamBuffer;
+class OcclusionCuller;
 
 class DroneManager
 {
+public:
+	// model matrices of the drones that are alive, copied out at the end of an update
+	struct Snapshot
+	{
+		std::vector<glm::mat4> modelMats;
+	};
+
 private:
 	World *world;						// handle to world for collision checks and anything else we need
 	Shader *bodyShader;					// shader program used when rendering drone body
 	Shader *bladesShader;				// shader program used when rendering drone blades
 
-	GLMmodel *droneBodyModel;			// geometry for body
-	GLMmodel *droneBladeModel;			// geometry for blades (just four quads at each rotor with a blurred blade texture)
-	GLMmodel *droneColliderModel;		// collision geometry for the entire drone
+	Mesh *droneColliderModel;			// collision geometry for the entire drone
 
 	GLuint bodyVAO;						// GL state for rendering body
-	GLuint bodyVBOs[4];					// GL vertex buffer objects for vertex position, tex coords, normals, and instance model matrices
-	int numBodyVertices;				// required for GL rendering call
+	GLuint bodyVBO;						// GL buffer object for the body's vertices and indices
+	int firstBodyIndex;					// required for GL rendering call
+	int numBodyIndices;
+
+	GLuint bladesVAO;					// GL state for rendering blades (just four quads at each rotor with a blurred blade texture)
+	GLuint bladesVBO;					// GL buffer object for the blades' vertices and indices
+	int firstBladesIndex;				// required for GL rendering call
+	int numBladesIndices;
 
-	GLuint bladesVAO;					// GL state for rendering blades
-	GLuint bladesVBOs[4];				// GL vertex buffer objects for vertex position, tex coords, normals, and instance model matrices
-	int numBladesVertices;				// required for GL rendering call
+	glm::vec3 droneCenter;				// bounding sphere around the body and blades, before the drone is placed
+	float droneRadius;
 
 	GLuint diffuseMap;					// body diffuse texture
 	GLuint normalMap;					// body normal map texture
@@ -40,11 +53,12 @@ private:
 	ALuint warningSound;				// AL buffer object for the warning buzz
 	ALuint explodeSound;				// AL buffer object for the explosion sound
 
-	glm::mat4 *modelMats;				// list of instance model matrices
+	StreamBuffer *instanceStream;		// per-frame instance model matrices, shared by the body and blades
 
 	int maxDrones;						// we must know the max number of drones in advance so we can work more efficiently with OpenGL
 	int numDrones;						// number of drones actually present in the game (including ones that have been killed)
 	int numDronesAlive;					// how many drones are still alive
+	int numDronesVisible;				// how many of those made it past culling this frame
 
 	Drone *drones;						// array of drone objects
 	float *cylinderTestTimers;			// used for temporal partitioning when doing collision checks against cylinders
@@ -55,9 +69,12 @@ private:
     void loadTextures();
     void loadSounds();
 
+	// point the instance model matrix attributes of the bound VAO at the given offset of the instance stream
+	void setupInstanceAttribs(GLintptr offset);
+
     // batch-rendering the entire group of drones requires only two rendering calls: one for the body, one for the blades
-    void renderBodies(glm::mat4 &projection, glm::mat4 &view, glm::mat3 &normal);
-    void renderBlades(glm::mat4 &projection, glm::mat4 &view, glm::mat3 &normal);
+    void renderBodies();
+    void renderBlades();
 
 public:
 	DroneManager(World *world, int maxDrones);		// for simplicity's (and OpenGL's) sake, we must know the max number of drones
@@ -68,10 +85,15 @@ public:
 
 	// update all drones
 	void update(float dt);
-    void loadShader();
+    void loadShader();						// only starts linking; World finishes every program together
+	void finishShader();					// set the uniforms that never change, once the programs are linked
+
+	// copy out where every live drone is, for render()
+	void snapshot(Snapshot &snapshot);
 
-	// render all drones
-	void render(glm::mat4 &projection, glm::mat4 &view);
+	// render the drones in the snapshot (by submitting them to the render queue), leaving out any the occlusion culler
+	// says are hidden
+	void render(Snapshot &snapshot, OcclusionCuller *occlusion);
 
 	// true iff a drone is within the specified distance of the given point; used for player collision
 	bool isDroneCloseTo(glm::vec3 pos, float distance);
@@ -2,10 +2,12 @@
 #include "objects/player.h"
 #include "objects/dronemanager.h"
 
+#include "util/glstate.h"
 #include "util/planerenderer.h"
 #include "util/loadtexture.h"
 #include "util/shader.h"
 #include "util/planerenderer.h"
+#include "util/streambuffer.h"
 
 #include "GL/glew.h"
 #include "GLFW/glfw3.h"
@@ -15,39 +17,123 @@
 #include "glm/gtc/type_ptr.hpp"
 using namespace glm;
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
-#include <map>
+#include <string>
+#include <vector>
 #include <ft2build.h>
 #include FT_FREETYPE_H  
 
 extern vec2 windowSize;	
 const int HUD::NUM_BLOOD_SPLATTERS = 5;
+const int HUD::MAX_GLYPHS_PER_FRAME = 1024;
 
+// where a glyph is in the text atlas, and how to place it
 struct Character {
-    unsigned int TextureID;  // ID handle of the glyph texture
+    glm::vec4    AtlasRect;  // tex coords of the glyph's top left and bottom right corners in the atlas
     glm::ivec2   Size;       // Size of glyph
     glm::ivec2   Bearing;    // Offset from baseline to left/top of glyph
     unsigned int Advance;    // Offset to advance to next glyph
 };
 
-std::map<char, Character> Characters;
-unsigned int VAO, VBO;
+// printable ASCII only; anything else in a string is skipped
+static const unsigned char FIRST_CHARACTER = 32;
+static const unsigned char LAST_CHARACTER = 126;
+static Character Characters[LAST_CHARACTER + 1];
 
-HUD::HUD(Player *player, mat4 &orthoProjection, mat4 &orthoView, vec2 windowSize) {
+HUD::HUD(Player *player, vec2 windowSize) {
 
 	
 	// Text shader
 	textShader = new Shader("../shaders/text.vert", "../shaders/text.frag");
+	textShader -> startLink();
+	
+	
+	// every glyph goes into one texture, so that all of the HUD's text can be drawn in a single call
+	loadFont();
+
+	// Configure VAO for text quads; the vertices come from the stream
+	glGenVertexArrays(1, &textVAO);
+	glBindVertexArray(textVAO);
+	textStream = new StreamBuffer(GL_ARRAY_BUFFER, sizeof(TextVertex) * 6 * MAX_GLYPHS_PER_FRAME);
+	glBindBuffer(GL_ARRAY_BUFFER, textStream -> getBuffer());
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (GLvoid*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (GLvoid*)sizeof(vec4));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	cacheTextLayout = true;
+	numTextLayouts = 0;
+
+	this -> player = player;
+
+	// Save our screen characteristics
+	orthoSize = windowSize;
+	orthoCenter = orthoSize / 2.0f;
+
+	// its shader is only started here; finishShaders() sends it what it needs
+	plane = PlaneRenderer::getInstance();
+
+	// Turn off blood effect for now, and don't fade out yet
+	enableBlood(false);
+	setFade(0.0);
+
+	// Load up any resources we need
+	loadTextures();
+	setupBlood();
+}
+
+void HUD::finishShaders(mat4 &orthoProjection, mat4 &orthoView)
+{
 	const GLFWvidmode *mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
 	int windowWidth = mode -> width;
 	int windowHeight = mode -> height;
 	glm::mat4 projection = glm::ortho(0.0f, static_cast<float>(windowWidth), 0.0f, static_cast<float>(windowHeight));
-	textShader -> link();
+
 	textShader -> bind();
 	textShader -> uniformMatrix4fv("projection", 1, value_ptr(projection));
 	textShader -> unbind();
-	
-	
+
+	// We only need to send this once, so let's do it now
+	plane -> finishShader();
+	plane -> bindShader();
+	plane -> setProjectionMatrix(orthoProjection);				// Projection mat never changes
+	plane -> setViewMatrix(orthoView);							// Ortho mat never changes
+}
+
+HUD::~HUD() {
+	delete textStream;
+	glDeleteVertexArrays(1, &textVAO);
+	glDeleteTextures(1, &textAtlas);
+	delete plane;
+	delete[] bloodSplatters;
+}
+
+void HUD::loadTextures() {
+	reticleTexture = loadPNG("../png/reticle.png");
+	bulletIconTexture = loadPNG("../png/bullet-icon.png");
+	bloodTexture = loadPNG("../png/blood.png");
+	blackTexture = loadPNG("../png/black.png");
+}
+
+void HUD::loadFont() {
+	const int ATLAS_WIDTH = 512;						// the 48 pixel glyphs of Lato Bold fit in 512x256
+	const int GLYPH_PADDING = 1;						// keeps linear filtering from picking up the neighbours
+
+	std::vector<unsigned char> bitmaps[LAST_CHARACTER + 1];
+	std::vector<unsigned char> pixels;
+	ivec2 atlasPos[LAST_CHARACTER + 1];
+	int penX = GLYPH_PADDING;
+	int penY = GLYPH_PADDING;
+	int rowHeight = 0;
+	int atlasHeight = 1;
+	int c, row;
+
+	textAtlas = 0;
+
 	// FreeType BitMap and Glyph processing
 	FT_Library ft;
 	if (FT_Init_FreeType(&ft))
@@ -63,101 +149,71 @@ HUD::HUD(Player *player, mat4 &orthoProjection, mat4 &orthoView, vec2 windowSize
 		return;
 	}
 
-	FT_Set_Pixel_Sizes(face, 0, 48);  
-	if (FT_Load_Char(face, 'X', FT_LOAD_RENDER))
-	{
-		fprintf(stderr, "FreeType: Failed to load Glyph\n");
-		return;
-	}
+	FT_Set_Pixel_Sizes(face, 0, 48);
 
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // disable byte-alignment restriction
-  
-	for (unsigned char c = 0; c < 128; c++)
+	// rasterize each glyph and find it a place in the atlas, filling it a row at a time
+	for (c = FIRST_CHARACTER; c <= LAST_CHARACTER; c++)
 	{
-		// load character glyph 
+		Characters[c].Size = ivec2(0);
+		Characters[c].Bearing = ivec2(0);
+		Characters[c].Advance = 0;
+		atlasPos[c] = ivec2(0);
 		if (FT_Load_Char(face, c, FT_LOAD_RENDER))
 		{
 			fprintf(stderr, "FreeType: Failed to load Glyph\n");
 			continue;
 		}
-		// Generate texture
-		unsigned int texture;
-		glGenTextures(1, &texture);
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_RED,
-			face->glyph->bitmap.width,
-			face->glyph->bitmap.rows,
-			0,
-			GL_RED,
-			GL_UNSIGNED_BYTE,
-			face->glyph->bitmap.buffer
-		);
-		// set texture options
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		// now store character for later use
-		Character character = {
-			texture, 
-			glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-			glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-			(unsigned int) face->glyph->advance.x
-		};
-		Characters.insert(std::pair<char, Character>(c, character));
-	}
-
-	glBindTexture(GL_TEXTURE_2D, 0);
-	// Destroy FreeType once we're finished
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft);
-
-	// Configure VAO/VBO for texture quads
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
-	
 
-	this -> player = player;
+		Characters[c].Size = ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows);
+		Characters[c].Bearing = ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top);
+		Characters[c].Advance = face->glyph->advance.x;
 
-	// Save our screen characteristics
-	orthoSize = windowSize;
-	orthoCenter = orthoSize / 2.0f;
-
-	// We only need to send this once, so let's do it now
-	plane = PlaneRenderer::getInstance();
-	plane -> bindShader();
-	plane -> setProjectionMatrix(orthoProjection);				// Projection mat never changes
-	plane -> setViewMatrix(orthoView);							// Ortho mat never changes
+		// FreeType's rows may be padded, so copy them out one at a time
+		for (row = 0; row < (int)face->glyph->bitmap.rows; row++)
+		{
+			bitmaps[c].insert(bitmaps[c].end(), face->glyph->bitmap.buffer + row * face->glyph->bitmap.pitch,
+							  face->glyph->bitmap.buffer + row * face->glyph->bitmap.pitch + face->glyph->bitmap.width);
+		}
 
-	// Turn off blood effect for now
-	enableBlood(false);
+		if (penX + Characters[c].Size.x + GLYPH_PADDING > ATLAS_WIDTH)
+		{
+			penX = GLYPH_PADDING;
+			penY += rowHeight + GLYPH_PADDING;
+			rowHeight = 0;
+		}
+		atlasPos[c] = ivec2(penX, penY);
+		penX += Characters[c].Size.x + GLYPH_PADDING;
+		rowHeight = std::max(rowHeight, Characters[c].Size.y);
+	}
 
-	// Load up any resources we need
-	loadTextures();
-	setupBlood();
-}
+	// Destroy FreeType once we're finished
+	FT_Done_Face(face);
+	FT_Done_FreeType(ft);
 
-HUD::~HUD() {
-	delete plane;
-	delete[] bloodSplatters;
-}
+	// copy the glyphs into place, top row first like the bitmaps (so v runs down the atlas)
+	while (atlasHeight < penY + rowHeight + GLYPH_PADDING)
+	{
+		atlasHeight *= 2;
+	}
+	pixels.assign(ATLAS_WIDTH * atlasHeight, 0);
+	for (c = FIRST_CHARACTER; c <= LAST_CHARACTER; c++)
+	{
+		for (row = 0; row < Characters[c].Size.y; row++)
+		{
+			memcpy(&pixels[(atlasPos[c].y + row) * ATLAS_WIDTH + atlasPos[c].x], &bitmaps[c][row * Characters[c].Size.x], Characters[c].Size.x);
+		}
+		Characters[c].AtlasRect = vec4((float)atlasPos[c].x / ATLAS_WIDTH, (float)atlasPos[c].y / atlasHeight,
+									   (float)(atlasPos[c].x + Characters[c].Size.x) / ATLAS_WIDTH, (float)(atlasPos[c].y + Characters[c].Size.y) / atlasHeight);
+	}
 
-void HUD::loadTextures() {
-	reticleTexture = loadPNG("../png/reticle.png");
-	bulletIconTexture = loadPNG("../png/bullet-icon.png");
-	bloodTexture = loadPNG("../png/blood.png");
-	blackTexture = loadPNG("../png/black.png");
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // disable byte-alignment restriction
+	glGenTextures(1, &textAtlas);
+	GLState::getInstance() -> bindTexture(0, textAtlas);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, atlasHeight, 0, GL_RED, GL_UNSIGNED_BYTE, &pixels[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 }
 
 void HUD::setupBlood() {
@@ -176,53 +232,60 @@ void HUD::setupBlood() {
 }
 
 
-void HUD::render() {
+void HUD::snapshot(Snapshot &snapshot) {
+	snapshot.time = hudTime;
+	snapshot.score = hudScore;
+	snapshot.numDrones = hudDrones;
+	snapshot.numShotsInClip = player -> getNumShotsInClip();
+	snapshot.numReloads = player -> getNumReloads();
+	snapshot.bloodEnabled = bloodEnabled;
+	snapshot.fade = fade;
+}
 
-	glDisable(GL_DEPTH_TEST);								// never occluded, always visible
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_ONE,GL_ONE);
+void HUD::render(Snapshot &snapshot) {
+	GLState *gl = GLState::getInstance();
+
+	gl -> disable(GL_DEPTH_TEST);								// never occluded, always visible
+	gl -> enable(GL_BLEND);
+	gl -> blendFunc(GL_ONE, GL_ONE);
 	glBlendEquation(GL_FUNC_REVERSE_SUBTRACT);				// makes the HUD a bit easier to see
-	glActiveTexture(GL_TEXTURE0);
 	plane -> bindShader();
 
 	// player aiming reticle and ammo stats
 	renderReticle();
-	renderAmmo();
+	renderAmmo(snapshot.numShotsInClip);
+	plane -> flush();										// one draw per texture, before the blending changes
 
 	// blood (and everything else afterwards) uses standard blending
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	gl -> blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glBlendEquation(GL_FUNC_ADD);
 
 	// render the blood if enabled
-	if(bloodEnabled) {
+	if(snapshot.bloodEnabled) {
 		renderBlood();
 	}
-	renderFade();
+	renderFade(snapshot.fade);
+	plane -> flush();
 
 	char buffer[20];
 
-	snprintf(buffer, 20, "TIME  %d", 1000 - hudTime);
+	snprintf(buffer, 20, "TIME  %d", 1000 - snapshot.time);
 	RenderText(buffer, 30.0f,  windowSize.y - 80.0f, 0.7f, glm::vec3(0.996, 0.113, 0.043));
-	snprintf(buffer, 20, "SCORE  %d", hudScore);
+	snprintf(buffer, 20, "SCORE  %d", snapshot.score);
 	RenderText(buffer, 30.0f, windowSize.y - 120.0f, 0.7f, glm::vec3(0.996, 0.529, 0.003));
-	int numShotsInClip = player -> getNumShotsInClip();
-	snprintf(buffer, 20, "BULLETS  %d", numShotsInClip);
+	snprintf(buffer, 20, "BULLETS  %d", snapshot.numShotsInClip);
 	RenderText(buffer, windowSize.x - 240.0f, windowSize.y - 120.0f, 0.7f, glm::vec3(0.301, 0.301, 0.301));
-	snprintf(buffer, 20, "DRONES  %d", hudDrones);
+	snprintf(buffer, 20, "DRONES  %d", snapshot.numDrones);
 	RenderText(buffer, windowSize.x - 240.0f, windowSize.y - 160.0f, 0.7f, glm::vec3(0.301, 0.301, 0.301));
-	int numReloads = player -> getNumReloads();
-	snprintf(buffer, 20, "HEALTH  %d", numReloads);
+	snprintf(buffer, 20, "HEALTH  %d", snapshot.numReloads);
 	RenderText(buffer, windowSize.x - 240.0f, windowSize.y - 80.0f, 0.7f, glm::vec3(0.003, 0.996, 0.615));
 
+	renderText();
 
-
-
-	glEnable(GL_DEPTH_TEST);
+	gl -> enable(GL_DEPTH_TEST);
 }
 
 void HUD::renderReticle() {
-
-
 	mat4 modelMatrix = mat4(1.0);
 	vec4 color = vec4(0.1, 0.1, 0.1, 1.0);
 	
@@ -230,24 +293,16 @@ void HUD::renderReticle() {
 	modelMatrix = translate(modelMatrix, vec3(orthoCenter, 0.0));
 	modelMatrix = scale(modelMatrix, vec3(32.0f));
 
-	glBindTexture(GL_TEXTURE_2D, reticleTexture);
-	plane -> setModelMatrix(modelMatrix);
-	plane -> setColor(color);
-	plane -> render();
+	plane -> addSprite(modelMatrix, color, reticleTexture);
 
 }
 
-void HUD::renderAmmo() {
-	int numShotsInClip = player -> getNumShotsInClip();
-
+void HUD::renderAmmo(int numShotsInClip) {
 	mat4 modelMatrix = mat4(1.0);
 	vec4 color = vec4(0.3, 0.3, 0.3, 1.0);
 	int i;
 
-	glBindTexture(GL_TEXTURE_2D, bulletIconTexture);
-	plane -> setColor(color);
-
-	// Expensive
+	// queued, then drawn together with the reticle
 	for(i = 0; i < numShotsInClip; i ++) {
 		modelMatrix = mat4(1.0);
 		modelMatrix = translate(modelMatrix, vec3(orthoCenter, 0.0));
@@ -255,41 +310,30 @@ void HUD::renderAmmo() {
 		modelMatrix = translate(modelMatrix, vec3(0.0, 45.0, 0.0));
 		modelMatrix = scale(modelMatrix, vec3(6.0, 6.0, 1.0));
 
-		plane -> setModelMatrix(modelMatrix);
-		plane -> render();
+		plane -> addSprite(modelMatrix, color, bulletIconTexture);
 	}
-
-
 }
 
 void HUD::renderBlood() {
 	int i;
 	vec4 BLOOD_COLOR(0.55, 0.03, 0.03, 1.0);
 
-	glBindTexture(GL_TEXTURE_2D, bloodTexture);
-	plane -> setColor(BLOOD_COLOR);
-
 	for(i = 0; i < NUM_BLOOD_SPLATTERS; i ++) {
-		plane -> setModelMatrix(bloodSplatters[i]);
-		plane -> render();
+		plane -> addSprite(bloodSplatters[i], BLOOD_COLOR, bloodTexture);
 	}
 }
 
-void HUD::renderFade() {
+void HUD::renderFade(float fade) {
 	vec4 BLACK_COLOR(0.0, 0.0, 0.0, fade);
 	mat4 modelMatrix;
 
 	// don't render anything if the fade is practically invisible
 	if(fade > 0.001) {
-        glBindTexture(GL_TEXTURE_2D, blackTexture);
-
 		modelMatrix = mat4(1.0);
 		modelMatrix = translate(modelMatrix, vec3(orthoCenter, 0.0));
 		modelMatrix = scale(modelMatrix, vec3(orthoSize.x, orthoSize.y, 1.0));
 
-		plane -> setModelMatrix(modelMatrix);
-		plane -> setColor(BLACK_COLOR);
-		plane -> render();
+		plane -> addSprite(modelMatrix, BLACK_COLOR, blackTexture);
 	}
 }
 
@@ -301,48 +345,107 @@ void HUD::setFade(float fade)  {
 	this -> fade = fade;
 }
 
+void HUD::setCacheTextLayout(bool cacheTextLayout) {
+	this -> cacheTextLayout = cacheTextLayout;
+}
+
 void HUD::RenderText(std::string text, float x, float y, float scale, glm::vec3 color) {
+	TextLayout *layout;
 
-    // Activate corresponding render state	
-    textShader -> bind();
-	textShader -> uniformVec3("textColor", color);
-    glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(VAO);
+	if (numTextLayouts == textLayouts.size())
+	{
+		textLayouts.push_back(TextLayout());
+		textLayouts.back().scale = -1.0;			// never matches, so it's always laid out the first time
+	}
+	layout = &textLayouts[numTextLayouts++];
+
+	// the dashboard mostly says the same thing as last frame, in which case the quads we have are still right
+	if (cacheTextLayout && layout -> text == text && layout -> pos == vec2(x, y) && layout -> scale == scale && layout -> color == color)
+	{
+		return;
+	}
+	layout -> text = text;
+	layout -> pos = vec2(x, y);
+	layout -> scale = scale;
+	layout -> color = color;
+	layout -> vertices.clear();
 
     // Iterate through all characters
     std::string::const_iterator c;
     for (c = text.begin(); c != text.end(); c++) 
     {
-        Character ch = Characters[*c];
+        if ((unsigned char)*c < FIRST_CHARACTER || (unsigned char)*c > LAST_CHARACTER)
+        {
+            continue;
+        }
+        Character &ch = Characters[(unsigned char)*c];
 
         float xpos = x + ch.Bearing.x * scale;
         float ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
 
         float w = ch.Size.x * scale;
         float h = ch.Size.y * scale;
-        // update VBO for each character
-        float vertices[6][4] = {
-            { xpos,     ypos + h,   0.0f, 0.0f },            
-            { xpos,     ypos,       0.0f, 1.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-            { xpos + w, ypos + h,   1.0f, 0.0f }           
+
+        // quad for this character, picking the glyph out of the atlas
+        vec4 r = ch.AtlasRect;
+        TextVertex quad[6] = {
+            { vec4(xpos,     ypos + h,   r.x, r.y), color },
+            { vec4(xpos,     ypos,       r.x, r.w), color },
+            { vec4(xpos + w, ypos,       r.z, r.w), color },
+
+            { vec4(xpos,     ypos + h,   r.x, r.y), color },
+            { vec4(xpos + w, ypos,       r.z, r.w), color },
+            { vec4(xpos + w, ypos + h,   r.z, r.y), color }
         };
-        // render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-        // update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); // be sure to use glBufferSubData and not glBufferData
-
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        // render quad
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        layout -> vertices.insert(layout -> vertices.end(), quad, quad + 6);
+
         // now advance cursors for next glyph (note that advance is number of 1/64 pixels)
         x += (ch.Advance >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
     }
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+void HUD::renderText() {
+	GLState *gl = GLState::getInstance();
+	TextVertex *vertices;
+	GLintptr offset;
+	size_t numVertices = 0;
+	size_t spaceLeft;
+	size_t count;
+	unsigned int i;
+
+	for (i = 0; i < numTextLayouts; i++)
+	{
+		numVertices += textLayouts[i].vertices.size();
+	}
+	numVertices = std::min(numVertices, (size_t)(6 * MAX_GLYPHS_PER_FRAME));
+	numVertices = textStream -> clampCount(numVertices, sizeof(TextVertex), sizeof(TextVertex));
+	numVertices -= numVertices % 6;
+
+	// every string's quads go into the stream back to back, and are drawn with one call from one texture; since each
+	// vertex is a whole TextVertex, the offset converts directly into the index of the first one
+	if (numVertices > 0)
+	{
+		vertices = (TextVertex*)textStream -> allocate(sizeof(TextVertex) * numVertices, sizeof(TextVertex), offset);
+		spaceLeft = numVertices;
+		for (i = 0; i < numTextLayouts && spaceLeft > 0; i++)
+		{
+			count = std::min(textLayouts[i].vertices.size(), spaceLeft);
+			if (count > 0)
+			{
+				memcpy(vertices, &textLayouts[i].vertices[0], sizeof(TextVertex) * count);
+				vertices += count;
+				spaceLeft -= count;
+			}
+		}
+		textStream -> commit();
+
+		textShader -> bind();
+		gl -> bindTexture(0, textAtlas);
+		gl -> bindVertexArray(textVAO);
+		glDrawArrays(GL_TRIANGLES, offset / sizeof(TextVertex), numVertices);
+	}
+
+	// strings are matched up with last frame's by the order they're given in
+	textLayouts.resize(numTextLayouts);
+	numTextLayouts = 0;
+}
@@ -4,16 +4,32 @@
 #include "glm/glm.hpp"
 
 #include<iostream>
+#include <string>
+#include <vector>
 
 class Shader;
 class Player;
 class PlaneRenderer;
+class StreamBuffer;
 
 extern int hudDrones;
 extern int hudScore;
 extern int hudTime;
 
 class HUD {
+public:
+	// everything the HUD shows, copied out of the game at the end of an update so it can be drawn while the next one runs
+	struct Snapshot
+	{
+		int time;										// seconds played
+		int score;
+		int numDrones;									// drones still alive
+		int numShotsInClip;
+		int numReloads;
+		bool bloodEnabled;
+		float fade;
+	};
+
 private:
 	static const int NUM_BLOOD_SPLATTERS;				// how many splatter instances we want when the player dies
 
@@ -34,30 +50,66 @@ private:
 
 	float fade;											// strength of black fade plane (0 is transparent, 1 is opaque)
 
-	Shader *textShader;	
+	// one corner of a glyph quad; sizeof() is the stride of the text vertex array
+	struct TextVertex
+	{
+		glm::vec4 vertex;								// position, then atlas tex coords
+		glm::vec3 color;
+	};
+
+	// one RenderText() call, with the quads it was last laid out as
+	struct TextLayout
+	{
+		std::string text;
+		glm::vec2 pos;
+		float scale;
+		glm::vec3 color;
+		std::vector<TextVertex> vertices;
+	};
+
+	static const int MAX_GLYPHS_PER_FRAME;				// glyph quads the text stream has room for each frame
+
+	Shader *textShader;
+	GLuint textAtlas;									// every glyph of the font, packed into a single texture
+	GLuint textVAO;
+	StreamBuffer *textStream;							// every glyph quad drawn this frame is written in here
+
+	bool cacheTextLayout;								// only lay out strings again when they've changed?
+	std::vector<TextLayout> textLayouts;				// this frame's RenderText() calls, in order
+	unsigned int numTextLayouts;						// how many of them there have been so far
 
 	// load up our resources
 	void loadTextures();
+	void loadFont();
 	void setupBlood();
 
 	// render whatever assets we need
 	void renderReticle();
-	void renderAmmo();
+	void renderAmmo(int numShotsInClip);
 	void renderBlood();
-	void renderFade();
+	void renderFade(float fade);
 	void renderDashboard();
+	void renderText();									// draw everything RenderText() was given this frame
 
 public:
-	HUD(Player *player, glm::mat4 &orthoProjection, glm::mat4 &orthoView, glm::vec2 windowSize);
+	HUD(Player *player, glm::vec2 windowSize);
 	~HUD();
 
+	// set the uniforms that never change, in the text program and the plane renderer's, once World has linked them
+	void finishShaders(glm::mat4 &orthoProjection, glm::mat4 &orthoView);
+
 	// turn on blood splatters or render a black fade-out
 	void enableBlood(bool bloodEnabled);
 	void setFade(float fade);
 
-	// usual update and render routines
+	// usual update and render routines; render() only draws what snapshot() copied out
 	void update(float dt);
-	void render();
+	void snapshot(Snapshot &snapshot);
+	void render(Snapshot &snapshot);
 
+	// queue a string, with its baseline starting at (x, y); all of the frame's text is drawn together at the end of
+	// render(), and unless setCacheTextLayout(false) has been called, a string is only laid out again when it (or
+	// where and how it's drawn) differs from the same call last frame
 	void RenderText(std::string text, float x, float y, float scale, glm::vec3 color);
+	void setCacheTextLayout(bool cacheTextLayout);
 };
@@ -8,13 +8,15 @@ extern int hudDrones;
 #include "particles/particleconfig.h"
 #include "particles/particlelist.h"
 
+#include "util/inputstate.h"
 #include "util/loadtexture.h"
+#include "util/mesh.h"
+#include "util/mesharena.h"
+#include "util/renderqueue.h"
 #include "util/shader.h"
 
 #include "audio/soundmanager.h"
 
-#include "glmmodel/glmmodel.h"
-
 #include "GL/glew.h"
 
 #include "GLFW/glfw3.h"
@@ -99,43 +101,25 @@ Player::Player(GLFWwindow *window, World* world, vec3 pos) {
 }
 
 Player::~Player() {
-	glDeleteBuffers(3, vbosGun);
-	glDeleteVertexArrays(1, &vaoGun);
 	delete shader;
 }
 
 void Player::loadGun()
 {
-	GLMmodel *geometry;
-
-    // attempt to read the file; glmReadObj() will just quit if we can't
-    geometry = glmReadOBJ((char*)"../mesh/gun.obj");
-    if(geometry)
-    {
-		glmScale(geometry, 1.0);
-
-		// build our buffer objects and then fill them with the geometry data we loaded
-		glGenVertexArrays(1, &vaoGun);
-		glBindVertexArray(vaoGun);
-		glGenBuffers(3, vbosGun);
-		glmBuildVBO(geometry, &numGunVertices, &vaoGun, vbosGun);
-	}
+	Mesh *geometry;
 
+	// read the file (the mesh will just quit if we can't); the gun lives in the mesh arena, so it can be drawn in the
+	// same call as Argon
+	geometry = new Mesh("../mesh/gun.obj");
+	gunRange = MeshArena::getInstance() -> add(geometry);
+	delete geometry;
 
-	GLMmodel *argonGeometry;
+	Mesh *argonGeometry;
 
-    // attempt to read the file; glmReadObj() will just quit if we can't
-    argonGeometry = glmReadOBJ((char*)"../mesh/Argon.obj");
-    if(argonGeometry)
-    {
-		glmScale(argonGeometry, 1.0);
-
-		// build our buffer objects and then fill them with the argonGeometry data loaded
-		glGenVertexArrays(1, &vaoArgon);
-		glBindVertexArray(vaoArgon);
-		glGenBuffers(3, vbosArgon);
-		glmBuildVBO(argonGeometry, &numArgonVertices, &vaoArgon, vbosArgon);
-	}
+	// add the argonGeometry to the mesh arena too
+	argonGeometry = new Mesh("../mesh/Argon.obj");
+	argonRange = MeshArena::getInstance() -> add(argonGeometry);
+	delete argonGeometry;
 }
 
 void Player::loadTextures()
@@ -152,13 +136,18 @@ void Player::loadShader()
 	shader -> bindAttrib("a_Vertex", 0);
 	shader -> bindAttrib("a_Normal", 1);
 	shader -> bindAttrib("a_TexCoord", 2);
-	shader -> link();
+	shader -> bindAttrib("a_ModelView", 3);
+	shader -> bindAttrib("a_NormalMatrix", 7);
+	shader -> startLink();
+}
+
+void Player::finishShader()
+{
 	shader -> bind();
 	shader -> uniform1i("u_DiffuseMap", 0);
 	shader -> uniform1i("u_NormalMap", 1);
 	shader -> uniform1i("u_SpecularMap", 2);
 	shader -> uniform1i("u_EmissionMap", 3);
-	shader -> uniformVec3("u_Sun", World::SUN_DIRECTION);
 	shader -> uniformVec3("u_MaterialDiffuse", vec3(1.0, 0.95, 0.85));
 	shader -> uniformVec3("u_MaterialSpecular", vec3(1.0, 0.95, 0.85));
 	shader -> uniform1f("u_SpecularIntensity", 8.0);
@@ -175,7 +164,7 @@ void Player::loadSounds()
 	deathSound = soundManager -> loadWAV("../wav/squishy-death.wav");
 }
 
-void Player::update(float dt)
+void Player::update(float dt, InputState &input)
 {
 	// Id time is up!
 	if(1000 - hudTime == 0) die();
@@ -188,9 +177,9 @@ void Player::update(float dt)
 	// player can only do things if they're alive
 	if(isAlive())
 	{
-		controlMouseInput(dt);
+		controlMouseInput(dt, input);
 		computeWalkingVectors();
-		controlMovingAndFiring(dt);
+		controlMovingAndFiring(dt, input);
 		controlGunBobbing(dt);
 		controlGunRecoil(dt);
 		controlGunReloading(dt);
@@ -201,103 +190,99 @@ void Player::update(float dt)
 
 }
 
-void Player::renderGun(mat4 &projection, mat4 &view)
+void Player::snapshot(Snapshot &snapshot)
 {
 	const vec3 GUN_SIZE(-0.225, 0.225, 0.225);
 	const float GUN_RECOIL_ROTATE_STRENGTH = -4.0;
 	const float GUN_RELOAD_ROTATE_AMOUNT = M_PI_2;
-
-	mat4 gunMat;						// model matrix for gun when rendering
-	mat4 viewLocalMat;					// view matrix with positional information removed 
-	mat4 normalMat;						// inverse transpose of model matrix---used so that the gun lighting is computed correctly
+	const vec3 ARGON_SIZE(-0.225, 0.225, 0.225);
 
 	// orient the gun in the same direction as the camera (with the recoil and reloading offsets applied)
-	gunMat[0] = vec4(cameraSide, 0.0);
-	gunMat[1] = vec4(cameraUp, 0.0);
-	gunMat[2] = vec4(cameraForward, 0.0);
-	gunMat[3] = vec4(gunPos, 1.0);
-	gunMat = scale(gunMat, GUN_SIZE);
-	gunMat = rotate(gunMat, (gunRecoilAmount * GUN_RECOIL_ROTATE_STRENGTH) + (gunReloadOffsetAmount * GUN_RELOAD_ROTATE_AMOUNT), vec3(1.0, 0.0, 0.0));
+	snapshot.gunMat[0] = vec4(cameraSide, 0.0);
+	snapshot.gunMat[1] = vec4(cameraUp, 0.0);
+	snapshot.gunMat[2] = vec4(cameraForward, 0.0);
+	snapshot.gunMat[3] = vec4(gunPos, 1.0);
+	snapshot.gunMat = scale(snapshot.gunMat, GUN_SIZE);
+	snapshot.gunMat = rotate(snapshot.gunMat, (gunRecoilAmount * GUN_RECOIL_ROTATE_STRENGTH) + (gunReloadOffsetAmount * GUN_RELOAD_ROTATE_AMOUNT), vec3(1.0, 0.0, 0.0));
+
+	// orient Argon the same way, without the gun's animations
+	snapshot.argonMat[0] = vec4(cameraSide, 0.0);
+	snapshot.argonMat[1] = vec4(cameraUp, 0.0);
+	snapshot.argonMat[2] = vec4(cameraForward, 0.0);
+	snapshot.argonMat[3] = vec4(argonPos, 1.0);
+	snapshot.argonMat = scale(snapshot.argonMat, ARGON_SIZE);
+}
+
+void Player::renderGun(Snapshot &snapshot, mat4 &view)
+{
+	mat4 viewLocalMat;					// view matrix with positional information removed 
+	mat4 modelView;						// the two combined, since that's all the shader needs
+	mat3 normalMat;						// inverse transpose of model matrix---used so that the gun lighting is computed correctly
+	DrawPacket packet;
 
 	// the gun is pretty small relative to the world, so it's probably a good idea to render it relative to the player
 	// rather than relative to the world; this is really only necessary in really large environments where precision
 	// becomes a problem for objects close up
 	viewLocalMat = view;
 	viewLocalMat[3] = vec4(0.0, 0.0, 0.0, 1.0);
+	modelView = viewLocalMat * snapshot.gunMat;
 
 	// compute our normal matrix for lighting
-	normalMat = inverseTranspose(mat3(gunMat));
+	normalMat = inverseTranspose(mat3(snapshot.gunMat));
 
-	// send in the cavalry
-	shader -> bind();
-	shader -> uniformMatrix4fv("u_Projection", 1, value_ptr(projection));
-	shader -> uniformMatrix4fv("u_View", 1, value_ptr(viewLocalMat));
-	shader -> uniformMatrix4fv("u_Model", 1, value_ptr(gunMat));
-	shader -> uniformMatrix3fv("u_Normal", 1, value_ptr(normalMat));
+	// send in the cavalry; we don't want this gun transparent
+	packet.pass = RENDER_PASS_OPAQUE;
+	packet.depth = length(vec3(modelView[3]));
+	packet.shader = shader;
+	packet.modelView = modelView;
+	packet.normal = normalMat;
 
 	// we use diffuse, normal, specular, and emission texture maps when rendering for a really nice effect
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gunDiffuseMap);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gunNormalMap);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, gunSpecularMap);
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, gunEmissionMap);
-
-	// we don't want this gun transparent
-	glDisable(GL_BLEND);
+	packet.textures[0] = gunDiffuseMap;
+	packet.textures[1] = gunNormalMap;
+	packet.textures[2] = gunSpecularMap;
+	packet.textures[3] = gunEmissionMap;
 
-	// finally, render it
-	glBindVertexArray(vaoGun);
-	glDrawArrays(GL_TRIANGLES, 0, numGunVertices);
+	// finally, queue it up
+	packet.baseVertex = gunRange.baseVertex;
+	packet.first = gunRange.firstIndex;
+	packet.count = gunRange.numIndices;
+	RenderQueue::getInstance() -> submit(packet);
 }
 
-void Player::renderArgon(mat4 &projection, mat4 &view)
+void Player::renderArgon(Snapshot &snapshot, mat4 &view)
 {
-	const vec3 ARGON_SIZE(-0.225, 0.225, 0.225);
-
-	mat4 ArgonMat;						// model matrix for Argon when rendering
 	mat4 viewLocalMat;					// view matrix with positional information removed 
-	mat4 normalMat;						// inverse transpose of model matrix used so that the Argon lighting is computed correctly
-
-	// orient the gun in the same direction as the camera 
-	ArgonMat[0] = vec4(cameraSide, 0.0);
-	ArgonMat[1] = vec4(cameraUp, 0.0);
-	ArgonMat[2] = vec4(cameraForward, 0.0);
-	ArgonMat[3] = vec4(argonPos, 1.0);
-	ArgonMat = scale(ArgonMat, ARGON_SIZE);
+	mat4 modelView;						// the two combined, since that's all the shader needs
+	mat3 normalMat;						// inverse transpose of model matrix used so that the Argon lighting is computed correctly
+	DrawPacket packet;
 
 	// Argon is pretty small relative to the world
 	viewLocalMat = view;
 	viewLocalMat[3] = vec4(0.0, 0.0, 0.0, 1.0);
+	modelView = viewLocalMat * snapshot.argonMat;
 
 	// Normal matrix for lighting
-	normalMat = inverseTranspose(mat3(ArgonMat));
+	normalMat = inverseTranspose(mat3(snapshot.argonMat));
 
-	// Yeeeeee!
-	shader -> bind();
-	shader -> uniformMatrix4fv("u_Projection", 1, value_ptr(projection));
-	shader -> uniformMatrix4fv("u_View", 1, value_ptr(viewLocalMat));
-	shader -> uniformMatrix4fv("u_Model", 1, value_ptr(ArgonMat));
-	shader -> uniformMatrix3fv("u_Normal", 1, value_ptr(normalMat));
-
-	// Use diffuse, normal, specular, and emission texture maps when rendering for nice effects
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gunDiffuseMap);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, gunNormalMap);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, gunSpecularMap);
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, gunEmissionMap);
+	// Yeeeeee! We don't want Argon transparent either
+	packet.pass = RENDER_PASS_OPAQUE;
+	packet.depth = length(vec3(modelView[3]));
+	packet.shader = shader;
+	packet.modelView = modelView;
+	packet.normal = normalMat;
 
-	// we don't want Argon transparent
-	glDisable(GL_BLEND);
+	// Same shader and maps as the gun, so the two end up in the same draw call
+	packet.textures[0] = gunDiffuseMap;
+	packet.textures[1] = gunNormalMap;
+	packet.textures[2] = gunSpecularMap;
+	packet.textures[3] = gunEmissionMap;
 
-	// Finally, render it
-	glBindVertexArray(vaoArgon);
-	glDrawArrays(GL_TRIANGLES, 0, numArgonVertices);
+	// Finally, queue it up
+	packet.baseVertex = argonRange.baseVertex;
+	packet.first = argonRange.firstIndex;
+	packet.count = argonRange.numIndices;
+	RenderQueue::getInstance() -> submit(packet);
 }
 
 void Player::controlDeathImpact(float dt)
@@ -317,12 +302,10 @@ void Player::controlDeathImpact(float dt)
 	deathImpactAmount = -((impactFactor * impactFactor) - impactFactor) * pow(abs(impactFactor - 1.0), 10);
 }
 
-void Player::controlMouseInput(float dt)
+void Player::controlMouseInput(float dt, InputState &input)
 {
-	double mouseX, mouseY;
-
-	// always update our mouse position
-	glfwGetCursorPos(window, &mouseX, &mouseY);
+	double mouseX = input.getMouseX();
+	double mouseY = input.getMouseY();
 
 	// compute a smooth look direction based on the mouse motion
 	targetLookAngleX -= (mouseY - oldMouseY) * 0.002;
@@ -335,7 +318,7 @@ void Player::controlMouseInput(float dt)
 	oldMouseY = mouseY;
 }
 
-void Player::controlMovingAndFiring(float dt)
+void Player::controlMovingAndFiring(float dt, InputState &input)
 {
 	const float JUMP_ACCEL_TIME = 0.10;				// player jump acceleration control
 	const float JUMP_STRENGTH = 60.0;				// maximum jump acceleration experienced by player
@@ -351,41 +334,41 @@ void Player::controlMovingAndFiring(float dt)
 	isMoving = false;
 
 	// W or the right mouse button cause us to move forwards
-	if(glfwGetKey(window, 'W') == GLFW_PRESS || glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT))
+	if(input.isKeyDown('W') || input.isMouseButtonDown(GLFW_MOUSE_BUTTON_RIGHT))
 	{
 		targetVelocity += vec3(0.0, 0.0, MOVE_SPEED);
 		isMoving = true;
 	}
 
 	// A will move us to the left
-	if(glfwGetKey(window, 'A') == GLFW_PRESS)
+	if(input.isKeyDown('A'))
 	{
 		targetVelocity += vec3(-MOVE_SPEED, 0.0, 0.0);
 		isMoving = true;
 	}
 
 	// D will move us to the right
-	if(glfwGetKey(window, 'D') == GLFW_PRESS)
+	if(input.isKeyDown('D'))
 	{
 		targetVelocity += vec3(MOVE_SPEED, 0.0, 0.0);
 		isMoving = true;
 	}
 
 	// S will move us backwards
-	if(glfwGetKey(window, 'S') == GLFW_PRESS)
+	if(input.isKeyDown('S'))
 	{
 		targetVelocity += vec3(0.0, 0.0, -MOVE_SPEED);
 		isMoving = true;
 	}
 
 	// space bar will start the player's jump acceleration
-	if(glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS && touchingGround)
+	if(input.isKeyDown(GLFW_KEY_SPACE) && touchingGround)
 	{
 		jumpTimer = JUMP_ACCEL_TIME;
 	}
 
 	// F will toggle Fog
-	if(glfwGetKey(window, 'F') == GLFW_PRESS)
+	if(input.isKeyDown('F'))
 	{		
 		if (!fogFlag) {
 			fogFlag = true;
@@ -393,7 +376,7 @@ void Player::controlMovingAndFiring(float dt)
 	}	
 
 
-	if(glfwGetKey(window, 'C') == GLFW_PRESS) {
+	if(input.isKeyDown('C')) {
 		
 		if(fogFlag) {
 			fogFlag = false;
@@ -401,7 +384,7 @@ void Player::controlMovingAndFiring(float dt)
 	}
 
 	// left mouse button will fire the gun
-	if(glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS && gunReloadState == STATE_LOADED)
+	if(input.isMouseButtonDown(GLFW_MOUSE_BUTTON_LEFT) && gunReloadState == STATE_LOADED)
 	{
 		// we can only fire again if we've already released the trigger and the recoil animation is finished
 		if(!triggerPressed && gunRecoilFinished)
@@ -416,7 +399,7 @@ void Player::controlMovingAndFiring(float dt)
 				if(numShotsInClip == 0 && numReloads == 0) die();
 
 				// play the gun sound
-				soundManager -> playSound(gunFireSound);
+				soundManager -> playSound(gunFireSound, SOUND_PRIORITY_HIGH);
 
 				// compute the bullet direction and fire
 				bulletDir = normalize(cameraForward + linearRand(vec3(-GUN_INACCURACY), vec3(GUN_INACCURACY)));
@@ -439,7 +422,7 @@ void Player::controlMovingAndFiring(float dt)
 	}
 
 	// V or R will reload our gun, but it will also happen automatically if needed
-	if(((glfwGetKey(window, 'V') == GLFW_PRESS || glfwGetKey(window, 'R') == GLFW_PRESS) && gunReloadState == STATE_LOADED && numShotsInClip < MAX_ROUNDS_PER_CLIP) ||
+	if(((input.isKeyDown('V') || input.isKeyDown('R')) && gunReloadState == STATE_LOADED && numShotsInClip < MAX_ROUNDS_PER_CLIP) ||
 	   (numShotsInClip == 0 && gunRecoilFinished == true && gunReloadState == STATE_LOADED))
 	{
 		if(numReloads > 0) {
@@ -529,7 +512,7 @@ void Player::controlGunReloading(float dt)
 		gunReloadState = STATE_MOVING_DOWN;
 		gunReloadTimer = GUN_RELOAD_MOVE_DOWN_TIME;
 
-		soundManager -> playSound(gunReloadSound);
+		soundManager -> playSound(gunReloadSound, SOUND_PRIORITY_HIGH);
 	}
 	else if(gunReloadState == STATE_MOVING_DOWN)
 	{
@@ -662,6 +645,12 @@ void Player::setPos(vec3 pos)
 	this -> pos = pos;
 }
 
+void Player::setLookAngles(float pitch, float yaw)
+{
+	targetLookAngleX = lookAngleX = pitch;
+	targetLookAngleY = lookAngleY = yaw;
+}
+
 vec3 Player::getCameraLook()
 {
 	return cameraLook;
@@ -703,7 +692,7 @@ void Player::die()
 		deathImpactTimer = 0.0;
 
 		// Death sound
-		soundManager -> playSound(deathSound);
+		soundManager -> playSound(deathSound, SOUND_PRIORITY_HIGH);
 	}
 }
 
@@ -2,16 +2,27 @@
 
 #include "AL/al.h"
 
+#include "util/mesharena.h"
+
 #include "GL/glew.h"
 #include "glm/glm.hpp"
 
 class GLFWwindow;
+class InputState;
 class World;
 class Shader;
 class SoundManager;
 
 class Player
 {
+public:
+	// what rendering needs to know about the player's gun and Argon, copied out at the end of an update
+	struct Snapshot
+	{
+		glm::mat4 gunMat;					// model matrices, relative to the player
+		glm::mat4 argonMat;
+	};
+
 private:
 	typedef enum RELOADSTATE
 	{
@@ -29,7 +40,7 @@ private:
 
 	// handles to important world objects //
 
-	GLFWwindow *window;						// required for mouse input
+	GLFWwindow *window;						// required for the initial mouse position
 	World *world;							// required for sun position, and creating world elements (bullets, particles, etc.)
 	SoundManager *soundManager;				// required for various sound effecys
 
@@ -91,14 +102,9 @@ private:
 
 	Shader *shader;							// the "solid" shader program we use when rendering the gun
 
-	GLuint vaoGun;							// vertex array object (i.e., GL state) for the gun
-	GLuint vbosGun[3];						// vertex buffer objects (i.e., vertex, tex coords, normals) for the gun
-
-	GLuint vaoArgon;						// vertex array object (i.e., GL state) for Argon
-	GLuint vbosArgon[3];					// vertex buffer objects (i.e., vertex, tex coords, normals) for Argon
-	int numArgonVertices;					// number of vertices, required for GL rendering call
+	MeshArena::Range argonRange;			// where Argon is in the mesh arena, required for GL rendering call
 
-	int numGunVertices;						// number of vertices, required for GL rendering call
+	MeshArena::Range gunRange;				// where the gun is in the mesh arena, required for GL rendering call
 	GLuint gunDiffuseMap;					// plain texture used on the gun
 	GLuint gunNormalMap;					// normal mapping used for nice per-fragment lighting
 	GLuint gunSpecularMap;					// a nice effect is to vary the amount of specular highlighting to give the appearance of dirt
@@ -108,16 +114,16 @@ private:
 
 	void loadGun();							// load gun geometry
 	void loadTextures();					// load gun diffuse, normal, specular, and emission maps
-	void loadShader();						// load up and compile the shader for the gun
+	void loadShader();						// load up the shader for the gun, and start it compiling
 	void loadSounds();						// load up any sound effects
 
 	// update routines //
 
 	void controlDeathImpact(float dt);		// handles death animation
-	void controlMouseInput(float dt);		// turns mouse motion into camera angles
+	void controlMouseInput(float dt, InputState &input);	// turns mouse motion into camera angles
 	void computeWalkingVectors();			// computes the vectors used for walking
 	void controlLooking(float dt);			// places limits on the player's viewing angles
-	void controlMovingAndFiring(float dt);	// controls player motion, firing, and reloading
+	void controlMovingAndFiring(float dt, InputState &input);	// controls player motion, firing, and reloading
 	void controlGunBobbing(float dt);		// gun bobs as the player walks; this controls that effect
 	void controlGunRecoil(float dt);		// gun recoils when the player fires; this controls that effect
 	void controlGunReloading(float dt);		// gun dips down and becomes unusable when reloading; this controls that effect
@@ -133,11 +139,14 @@ public:
 	Player(GLFWwindow *window, World* world, glm::vec3 pos);
 	~Player();
 
+	void finishShader();					// set the uniforms that never change, once World has linked every program
+
 	// update routines //
 
-	void update(float dt);
-	void renderGun(glm::mat4 &projection, glm::mat4 &view);
-	void renderArgon(glm::mat4 &projection, glm::mat4 &view);
+	void update(float dt, InputState &input);
+	void snapshot(Snapshot &snapshot);
+	void renderGun(Snapshot &snapshot, glm::mat4 &view);
+	void renderArgon(Snapshot &snapshot, glm::mat4 &view);
 
 	// these are called externally by the game world, although they probably don't
 	void computeCameraOrientation();
@@ -150,6 +159,7 @@ public:
 	glm::vec3 getArgonPos();				// used for drone collision
 
 	void setPos(glm::vec3 pos);
+	void setLookAngles(float pitch, float yaw);	// point the camera somewhere, right away rather than smoothly
 
 	glm::vec3 getCameraLook();				// used for a few shaders
 	glm::vec3 getCameraSide();
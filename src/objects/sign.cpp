@@ -4,10 +4,11 @@
 #include "world/world.h"
 
 #include "util/loadtexture.h"
+#include "util/mesh.h"
+#include "util/mesharena.h"
+#include "util/renderqueue.h"
 #include "util/shader.h"
 
-#include "glmmodel/glmmodel.h"
-
 #include "GL/glew.h"
 
 #include "glm/glm.hpp"
@@ -32,9 +33,8 @@ Sign::Sign(World *world, vec3 pos, float angle)
 
 Sign::~Sign()
 {
-	glDeleteBuffers(3, vbos);
-	glDeleteVertexArrays(1, &vao);
 	delete shader;
+	delete collider;
 }
 
 void Sign::setupModelMatrix(vec3 pos, float angle)
@@ -55,27 +55,16 @@ void Sign::setupModelMatrix(vec3 pos, float angle)
 
 void Sign::loadMesh()
 {
-	GLMmodel *geometry;
-
-    // attempt to read the file; glmReadObj() will just quit if we can't
-    geometry = glmReadOBJ((char*)"../mesh/sign.obj");
-    if(geometry)
-    {
-		glmScale(geometry, 1.0);
-
-		// build our buffer objects and then fill them with the geometry data we loaded
-		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
-		glGenBuffers(3, vbos);
-		glmBuildVBO(geometry, &numVertices, &vao, vbos);
-	}
-
-	// attempt to read the collision geometry; glmReadObj() will just quit if we can't
-	collider = glmReadOBJ((char*)"../mesh/sign-collider.obj");
-	if(collider)
-	{
-		glmScale(collider, 1.0);
-	}
+	Mesh *geometry;
+
+	// read the file (the mesh will just quit if we can't); the geometry goes into the mesh arena with everything else
+	// drawn the same way
+	geometry = new Mesh("../mesh/sign.obj");
+	range = MeshArena::getInstance() -> add(geometry);
+	delete geometry;
+
+	// read the collision geometry
+	collider = new Mesh("../mesh/sign-collider.obj");
 }
 
 void Sign::loadTextures()
@@ -92,13 +81,18 @@ void Sign::loadShader()
 	shader -> bindAttrib("a_Vertex", 0);
 	shader -> bindAttrib("a_Normal", 1);
 	shader -> bindAttrib("a_TexCoord", 2);
-	shader -> link();
+	shader -> bindAttrib("a_ModelView", 3);
+	shader -> bindAttrib("a_NormalMatrix", 7);
+	shader -> startLink();
+}
+
+void Sign::finishShader()
+{
 	shader -> bind();
 	shader -> uniform1i("u_DiffuseMap", 0);
 	shader -> uniform1i("u_NormalMap", 1);
 	shader -> uniform1i("u_SpecularMap", 2);
 	shader -> uniform1i("u_EmissionMap", 3);
-	shader -> uniformVec3("u_Sun", World::SUN_DIRECTION);
 	shader -> uniformVec3("u_MaterialDiffuse", vec3(1.0, 1.0, 1.0));
 	shader -> uniformVec3("u_MaterialSpecular", vec3(1.0, 1.0, 1.0));
 	shader -> uniform1f("u_SpecularIntensity", 6.0);
@@ -107,36 +101,30 @@ void Sign::loadShader()
 	shader -> unbind();
 }
 
-void Sign::render(mat4 &projection, mat4 &view)
+void Sign::render(mat4 &view)
 {
 	mat4 modelMatrix;
-	mat3 normal;
+	DrawPacket packet;
 
 	// compute our normal matrix for lighting
 	getModelMat(&modelMatrix);
-	normal = inverseTranspose(mat3(modelMatrix));
+	packet.modelView = view * modelMatrix;
+	packet.normal = inverseTranspose(mat3(modelMatrix));
 
-	// send in the cavalry
-	shader -> bind();
-	shader -> uniformMatrix4fv("u_Projection", 1, value_ptr(projection));
-	shader -> uniformMatrix4fv("u_View", 1, value_ptr(view));
-	shader -> uniformMatrix4fv("u_Model", 1, value_ptr(modelMatrix));
-	shader -> uniformMatrix3fv("u_Normal", 1, value_ptr(normal));
+	// send in the cavalry; we don't want this transparent
+	packet.pass = RENDER_PASS_OPAQUE;
+	packet.depth = length(vec3(packet.modelView[3]));
+	packet.shader = shader;
 
 	// we use diffuse, normal, specular, and emission texture maps when rendering for a really nice effect
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, diffuseMap);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, normalMap);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, specularMap);
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, emissionMap);
-
-	// we don't want this transparent
-	glDisable(GL_BLEND);
-
-	// finally, render it
-	glBindVertexArray(vao);
-	glDrawArrays(GL_TRIANGLES, 0, numVertices);
+	packet.textures[0] = diffuseMap;
+	packet.textures[1] = normalMap;
+	packet.textures[2] = specularMap;
+	packet.textures[3] = emissionMap;
+
+	// finally, queue it up
+	packet.baseVertex = range.baseVertex;
+	packet.first = range.firstIndex;
+	packet.count = range.numIndices;
+	RenderQueue::getInstance() -> submit(packet);
 }
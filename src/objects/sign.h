@@ -2,13 +2,14 @@
 
 #include "objects/object.h"
 
+#include "util/mesharena.h"
+
 #include "GL/glew.h"
 #include "glm/glm.hpp"
 
 class World;
 class Shader;
-
-typedef struct _GLMmodel GLMmodel;
+class Mesh;
 
 class Sign : public Object
 {
@@ -17,12 +18,9 @@ private:
 
 	Shader *shader;					// shader program used to render the sign
 
-	GLMmodel *collider;				// the collision geometry used by the sign to intercept bullet hits
-
-	GLuint vao;						// OpenGL rendering state used when rendering this object
-	GLuint vbos[3];					// vertex buffer objects referencing vertex positions, tex coords, and normals
+	Mesh *collider;					// the collision geometry used by the sign to intercept bullet hits
 
-	int numVertices;				// required for GL render call
+	MeshArena::Range range;			// where the sign is in the mesh arena, required for GL render call
 	GLuint diffuseMap;				// plain sign texture
 	GLuint normalMap;				// normal map for per-fragment lighting
 	GLuint specularMap;				// used to simulate the presence of dust or dirt
@@ -38,5 +36,6 @@ public:
 	Sign(World *world, glm::vec3 pos, float angle);
 	~Sign();
 
-	void render(glm::mat4 &projection, glm::mat4 &view);
+	void finishShader();			// set the uniforms that never change, once World has linked every program
+	void render(glm::mat4 &view);		// submits the sign to the render queue
 };
@@ -2,14 +2,17 @@
 #include "objects/tree.h"
 #include "objects/complexcollider.h"
 #include "objects/player.h"
-extern bool fogFlag;
 
 #include "world/world.h"
 
+#include "util/glstate.h"
 #include "util/loadtexture.h"
+#include "util/mesh.h"
+#include "util/occlusionculler.h"
+#include "util/renderqueue.h"
 #include "util/shader.h"
-
-#include "glmmodel/glmmodel.h"
+#include "util/shadercache.h"
+#include "util/streambuffer.h"
 
 #include "GL/glew.h"
 
@@ -30,9 +33,11 @@ TreeManager::TreeManager(World *world, int maxTrees)
 	this -> maxTrees = maxTrees;
 	numTrees = 0;
 	treePlacementFinalized = false;
-	numVerticesPerTree = 0;
+	firstTreeIndex = 0;
+	numIndicesPerTree = 0;
 
 	modelMats = new mat4[maxTrees];
+	spheres = new vec4[maxTrees];
 	modelMatPtr = modelMats;
 
     loadTree();
@@ -43,51 +48,53 @@ TreeManager::TreeManager(World *world, int maxTrees)
 TreeManager::~TreeManager()
 {
 	delete[] modelMats;
+	delete[] spheres;
+
+	delete collider;
 
-	glDeleteBuffers(4, vbos);
+	delete instanceStream;
+	glDeleteBuffers(1, &vbo);
 	glDeleteVertexArrays(1, &vao);
-	delete treeShader;
 }
 
 void TreeManager::loadTree()
 {
-	GLMmodel *geometry;
-
-    // attempt to read the file; glmReadObj() will just quit if we can't
-    geometry = glmReadOBJ((char*)"../mesh/tree.obj");
-    if(geometry)
-    {
-		glmScale(geometry, 1.0);
-
-		// build our buffer objects and then fill them with the geometry data we loaded
-		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
-		glGenBuffers(4, vbos);
-		glmBuildVBO(geometry, &numVerticesPerTree, &vao, vbos);
-
-		// set aside some memory for our tree modelviews (i.e., prepare for instanced rendering)
-		glBindBuffer(GL_ARRAY_BUFFER, vbos[3]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(mat4) * maxTrees, NULL, GL_STATIC_DRAW);
-		glEnableVertexAttribArray(3);
-		glEnableVertexAttribArray(4);
-		glEnableVertexAttribArray(5);
-		glEnableVertexAttribArray(6);
-		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)0);
-		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)sizeof(vec4));
-		glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)(sizeof(vec4) * 2));
-		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)(sizeof(vec4) * 3));
-		glVertexAttribDivisor(3, 1);
-		glVertexAttribDivisor(4, 1);
-		glVertexAttribDivisor(5, 1);
-		glVertexAttribDivisor(6, 1);
-    }
-
-	// attempt to read the collision geometry; glmReadObj() will just quit if we can't
-	collider = glmReadOBJ((char*)"../mesh/tree-collider.obj");
-	if(collider)
-	{
-		glmScale(collider, 1.0);
-	}
+	Mesh *geometry;
+
+	// read the file (the mesh will just quit if we can't), then build our buffer objects and fill them with it
+	geometry = new Mesh("../mesh/tree.obj");
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	geometry -> upload(vao, vbo);
+	firstTreeIndex = geometry -> getFirstIndex();
+	numIndicesPerTree = geometry -> getNumIndices();
+	treeCenter = (geometry -> getBoundsMin() + geometry -> getBoundsMax()) * 0.5f;
+	treeRadius = length(geometry -> getBoundsMax() - treeCenter);
+	delete geometry;
+
+	// the model matrices of whichever trees are visible are streamed in every frame (i.e., prepare for instanced rendering)
+	instanceStream = new StreamBuffer(GL_ARRAY_BUFFER, sizeof(mat4) * maxTrees);
+	setupInstanceAttribs(0);
+	glEnableVertexAttribArray(3);
+	glEnableVertexAttribArray(4);
+	glEnableVertexAttribArray(5);
+	glEnableVertexAttribArray(6);
+	glVertexAttribDivisor(3, 1);
+	glVertexAttribDivisor(4, 1);
+	glVertexAttribDivisor(5, 1);
+	glVertexAttribDivisor(6, 1);
+
+	// read the collision geometry
+	collider = new Mesh("../mesh/tree-collider.obj");
+}
+
+void TreeManager::setupInstanceAttribs(GLintptr offset)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, instanceStream -> getBuffer());
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)offset);
+	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)(offset + sizeof(vec4)));
+	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)(offset + sizeof(vec4) * 2));
+	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4), (GLvoid*)(offset + sizeof(vec4) * 3));
 }
 
 void TreeManager::loadTextures()
@@ -98,19 +105,20 @@ void TreeManager::loadTextures()
 
 void TreeManager::loadShaders()
 {
-	treeShader = new Shader("../shaders/tree.vert", "../shaders/tree.frag");
+	treeShader = ShaderCache::getInstance() -> get("../shaders/tree.vert", "../shaders/tree.frag", "FOG");
 	treeShader -> bindAttrib("a_Vertex", 0);
 	treeShader -> bindAttrib("a_Normal", 1);
 	treeShader -> bindAttrib("a_TexCoord", 2);
 	treeShader -> bindAttrib("a_InstanceMatrix", 3);
-	treeShader -> link();
+	treeShader -> startLink();
+}
+
+void TreeManager::finishShaders()
+{
 	treeShader -> bind();
 	treeShader -> uniform1i("u_DiffuseMap", 0);
 	treeShader -> uniform1i("u_NormalMap", 1);
 	treeShader -> uniform1f("u_NormalMapStrength", 2.0);
-	treeShader -> uniformVec3("u_Sun", World::SUN_DIRECTION);
-	treeShader -> uniformVec3("fogColor", vec3(0.65, 0.65, 0.65));
-	treeShader -> uniform1i("fogFlag", fogFlag);
 	treeShader -> unbind();
 }
 
@@ -122,6 +130,7 @@ Tree *TreeManager::addTree(vec3 pos)
 	Tree *result;
 
 	mat4 modelMat;
+	float size;
 
 	// disallow tree adding if we've already thrown everything on the GPU
 	if(!treePlacementFinalized)
@@ -136,10 +145,12 @@ Tree *TreeManager::addTree(vec3 pos)
 			modelMat = mat4(1.0);
 			modelMat = translate(modelMat, pos);
 			//modelMat = rotate(modelMat, (float)linearRand(-M_PI, M_PI), vec3(0.0, 1.0, 0.0));
-			modelMat = scale(modelMat, vec3(linearRand(MIN_TREE_SIZE, MAX_TREE_SIZE)));
+			size = linearRand(MIN_TREE_SIZE, MAX_TREE_SIZE);
+			modelMat = scale(modelMat, vec3(size));
 
 			// set the position and orientation of the tree and track the number of trees we have
 			*modelMatPtr++ = modelMat;
+			spheres[numTrees] = vec4(pos + treeCenter * size, treeRadius * size);
 
 			// assign a collision object and assign it's model matrix
 			result = new Tree();
@@ -167,15 +178,10 @@ Tree *TreeManager::addTree(vec3 pos)
 
 void TreeManager::finalizeTreePlacement()
 {
-	// we need this method because we would prefer to send all of the tree positions to the GPU all at once,
-	// rather than individually...this is much faster
+	// the trees go to the GPU a frame at a time now (only the ones that can be seen), but we still want to know
+	// that nothing else will be planted once the world is under way
 	if(!treePlacementFinalized)
 	{
-		// store the tree positions in the GPU
-		glBindVertexArray(vao);
-		glBindBuffer(GL_ARRAY_BUFFER, vbos[3]);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(mat4) * numTrees, modelMats);
-
 		// prevent any trees from being added after this point forward
 		treePlacementFinalized = true;
 	}
@@ -186,32 +192,54 @@ void TreeManager::finalizeTreePlacement()
 	}
 }
 
-void TreeManager::render(mat4 &projection, mat4 &view, mat4 &model)
+void TreeManager::render(OcclusionCuller *occlusion)
 {
+	DrawPacket packet;
+
+	mat4 *modelMatPtr;
+	GLintptr instanceOffset;
+	int numToCull = instanceStream -> clampCount(numTrees, sizeof(mat4), sizeof(vec4));
+	int numVisible = 0;
+	int i;
+
 	// importantly, the trees suffer from the same lighting problem as the drones do;
 	// (see dronemananger.cpp for more details) to get around this, we just don't
 	// rotate the trees at all; a full solution will use the mat3 inverse transpose
 	// of the instance matrices and pass those in as well...I'll probably get to that
 	// another time when I feel like it
-	if(treePlacementFinalized && numTrees > 0)
+	if(treePlacementFinalized && numToCull > 0)
 	{
-		treeShader -> bind();
-		treeShader -> uniformMatrix4fv("u_Projection", 1, value_ptr(projection));
-		treeShader -> uniformMatrix4fv("u_View", 1, value_ptr(view));
+		// only the trees that aren't off screen or behind a hill make it into this frame's instance matrices
+		modelMatPtr = (mat4*)instanceStream -> allocate(sizeof(mat4) * numToCull, sizeof(vec4), instanceOffset);
+		for(i = 0; i < numToCull; i ++)
+		{
+			if(occlusion -> isVisible(vec3(spheres[i]), spheres[i].w))
+			{
+				modelMatPtr[numVisible ++] = modelMats[i];
+			}
+		}
+		instanceStream -> commit();
 
-		// render the trees
+		if(numVisible == 0)
+		{
+			return;
+		}
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseMap);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, normalMap);
+		GLState::getInstance() -> bindVertexArray(vao);
+		setupInstanceAttribs(instanceOffset);
 
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glDisable(GL_CULL_FACE);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		// the leaves are blended, but still need to write depth so they hide what's behind them
+		packet.pass = RENDER_PASS_CUTOUT;
+		packet.shader = treeShader;
 
-		glBindVertexArray(vao);
-		glDrawArraysInstanced(GL_TRIANGLES, 0, numVerticesPerTree, numTrees);
+		// render the trees
+		packet.textures[0] = diffuseMap;
+		packet.textures[1] = normalMap;
+
+		packet.vao = vao;
+		packet.first = firstTreeIndex;
+		packet.count = numIndicesPerTree;
+		packet.instanceCount = numVisible;
+		RenderQueue::getInstance() -> submit(packet);
 	}
 }
@@ -8,8 +8,9 @@
 class World;
 class Shader;
 class Tree;
-
-typedef struct _GLMmodel GLMmodel;
+class Mesh;
+class OcclusionCuller;
+class StreamBuffer;
 
 class TreeManager
 {
@@ -18,17 +19,23 @@ private:
 
 	Shader *treeShader;						// shader program used when rendering trees
 
-	GLMmodel *collider;						// complex collider geometry for tree
+	Mesh *collider;							// complex collider geometry for tree
 
 	GLuint vao;								// GL state used when rendering trees
-	GLuint vbos[4];							// GL vertex buffer object for vertex coords, tex coords, normals, and instance model matrices
+	GLuint vbo;								// GL buffer object for the tree's vertices and indices
+	StreamBuffer *instanceStream;			// per-frame model matrices of the trees that survive culling
 
-	int numVerticesPerTree;					// required for GL call to render trees
+	int firstTreeIndex;						// required for GL call to render trees
+	int numIndicesPerTree;
 
 	GLuint diffuseMap;						// diffuse texture
 	GLuint normalMap;						// how the texture will be lit
 
-	glm::mat4 *modelMats;					// model matrices of trees, passed to GPU when all trees are added
+	glm::vec3 treeCenter;					// bounding sphere of the tree mesh, before it's placed
+	float treeRadius;
+
+	glm::mat4 *modelMats;					// model matrices of trees; the visible ones are passed to the GPU each frame
+	glm::vec4 *spheres;						// world-space bounding sphere of each tree (xyz centre, w radius)
 	glm::mat4 *modelMatPtr;					// used to track current model matrix we're updating when calling addTree()
 
 	bool treePlacementFinalized;			// have we called finalizeTreePlacement()?
@@ -40,6 +47,9 @@ private:
 	void loadTree();
 	void loadTextures();
 
+	// point the instance model matrix attributes at the given offset of the instance stream
+	void setupInstanceAttribs(GLintptr offset);
+
 public:
 	// technically, in this case, there's no reason we can't just use a std::vector or something rather than specifying a silly
 	// limit on the number of trees we're allowed...I may fix this in the future
@@ -47,9 +57,10 @@ public:
 	~TreeManager();
 
 	Tree *addTree(glm::vec3 pos);			// we cannot exceed maxTrees when adding trees, otherwise we get in trouble
-	void finalizeTreePlacement();			// called to send data to GPU, when we've called addTree() enough and won't need to call it ever again
-	void loadShaders();
+	void finalizeTreePlacement();			// called when we've called addTree() enough and won't need to call it ever again
+	void loadShaders();						// only starts linking; World finishes every program together
+	void finishShaders();					// set the uniforms that never change, once the program is linked
 
-	// render the trees and their leaves
-	void render(glm::mat4 &projection, glm::mat4 &view, glm::mat4 &model);
+	// render the trees and their leaves, leaving out any the occlusion culler says are hidden
+	void render(OcclusionCuller *occlusion);
 };
@@ -0,0 +1,151 @@
+#include "particles/analyticparticlesystem.h"
+#include "particles/particleconfig.h"
+
+#include "util/glstate.h"
+#include "util/shader.h"
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/type_ptr.hpp"
+using namespace glm;
+
+#include <map>
+#include <vector>
+using namespace std;
+
+const float AnalyticParticleSystem::STEPS_PER_SECOND = 60.0;
+
+AnalyticParticleSystem::AnalyticParticleSystem(int maxBursts)
+{
+	this -> maxBursts = maxBursts;
+	time = 0.0;
+
+	// core profile still wants a vertex array bound, even with no attributes in it
+	glGenVertexArrays(1, &vao);
+	loadShader();
+}
+
+AnalyticParticleSystem::~AnalyticParticleSystem()
+{
+	glDeleteVertexArrays(1, &vao);
+	delete shader;
+}
+
+void AnalyticParticleSystem::loadShader()
+{
+	shader = new Shader("../shaders/particle-analytic.vert", "../shaders/particle.frag");
+	shader -> startLink();
+}
+
+void AnalyticParticleSystem::finishShader()
+{
+	shader -> bind();
+	shader -> uniform1i("u_Texture", 0);
+	shader -> uniform1f("u_StepsPerSecond", STEPS_PER_SECOND);
+	shader -> unbind();
+
+	originLoc = shader -> getUniLoc("u_Origin");
+	seedLoc = shader -> getUniLoc("u_Seed");
+	ageLoc = shader -> getUniLoc("u_Age");
+	lifeFactorLoc = shader -> getUniLoc("u_LifeFactor");
+}
+
+void AnalyticParticleSystem::addBurst(ParticleConfig *config, vec3 pos, int count, float lifeFactor, uint32_t seed)
+{
+	vector<Burst> &list = bursts[config];
+	Burst burst;
+
+	if(count <= 0)
+	{
+		return;
+	}
+
+	burst.origin = pos;
+	burst.seed = seed;
+	burst.spawnTime = time;
+	burst.count = count;
+	burst.lifeFactor = lifeFactor;
+
+	// bursts are kept in spawn order, so when we're full the front is always the oldest
+	if((int)list.size() >= maxBursts)
+	{
+		list.erase(list.begin());
+	}
+	list.push_back(burst);
+}
+
+void AnalyticParticleSystem::update(float dt)
+{
+	map<ParticleConfig*, vector<Burst> >::iterator i;
+	vector<Burst>::iterator firstAlive;
+	double maxLife;
+
+	time += dt;
+
+	// a burst is done once even its longest-living particle would have died
+	for(i = bursts.begin(); i != bursts.end(); ++i)
+	{
+		maxLife = i -> first -> lifeLimits[1];
+		firstAlive = i -> second.begin();
+		while(firstAlive != i -> second.end() && time - firstAlive -> spawnTime > maxLife)
+		{
+			++firstAlive;
+		}
+		i -> second.erase(i -> second.begin(), firstAlive);
+	}
+}
+
+void AnalyticParticleSystem::snapshot(Snapshot &snapshot)
+{
+	snapshot.time = time;
+	snapshot.bursts = bursts;
+}
+
+void AnalyticParticleSystem::setConfigUniforms(ParticleConfig *config)
+{
+	shader -> uniform3fv("u_MotionLimits", 2, value_ptr(config -> motionLimits[0]));
+	shader -> uniform2f("u_SpinLimits", config -> spinLimits[0], config -> spinLimits[1]);
+	shader -> uniform1i("u_RandomOrientation", config -> randomOrientation);
+	shader -> uniform2f("u_StartSizeLimits", config -> startSizeLimits[0], config -> startSizeLimits[1]);
+	shader -> uniform2f("u_EndSizeLimits", config -> endSizeLimits[0], config -> endSizeLimits[1]);
+	shader -> uniform4fv("u_StartColorLimits", 2, value_ptr(config -> startColorLimits[0]));
+	shader -> uniform4fv("u_EndColorLimits", 2, value_ptr(config -> endColorLimits[0]));
+	shader -> uniform2f("u_LifeLimits", config -> lifeLimits[0], config -> lifeLimits[1]);
+	shader -> uniform2f("u_InitialGravityLimits", config -> initialGravityLimits[0], config -> initialGravityLimits[1]);
+	shader -> uniform2f("u_GravityRateLimits", config -> gravityRateLimits[0], config -> gravityRateLimits[1]);
+}
+
+void AnalyticParticleSystem::render(Snapshot &snapshot, vec3 &cameraRight, vec3 &cameraUp)
+{
+	GLState *gl = GLState::getInstance();
+
+	map<ParticleConfig*, vector<Burst> >::iterator i;
+	vector<Burst>::iterator j;
+
+	shader -> bind();
+	shader -> uniformVec3("u_CameraRight", cameraRight);
+	shader -> uniformVec3("u_CameraUp", cameraUp);
+
+	gl -> bindVertexArray(vao);
+
+	// one instanced draw per burst; each burst only costs us a handful of uniforms
+	for(i = snapshot.bursts.begin(); i != snapshot.bursts.end(); ++i)
+	{
+		if(!i -> second.empty())
+		{
+			setConfigUniforms(i -> first);
+			gl -> bindTexture(0, i -> first -> texture);
+
+			for(j = i -> second.begin(); j != i -> second.end(); ++j)
+			{
+				shader -> uniformVec3(originLoc, j -> origin);
+				shader -> uniform1i(seedLoc, (int)j -> seed);
+				shader -> uniform1f(ageLoc, (float)(snapshot.time - j -> spawnTime));
+				shader -> uniform1f(lifeFactorLoc, j -> lifeFactor);
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, j -> count);
+			}
+		}
+	}
+
+	gl -> bindVertexArray(0);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+class ParticleConfig;
+class Shader;
+
+// stateless particles: a burst is stored as a single record and every particle in it is evaluated in closed form by
+// the vertex shader from its instance ID, the burst's seed and the burst's age, so nothing is stepped on the CPU
+class AnalyticParticleSystem
+{
+private:
+	static const float STEPS_PER_SECOND;				// rate Particle::update() is called at; motion values are per step
+
+	// everything we need to reproduce a burst; which config it uses is the key it is stored under
+	struct Burst
+	{
+		glm::vec3 origin;								// where every particle of the burst starts out
+		uint32_t seed;									// hashed with the instance ID to pick each particle's properties
+		double spawnTime;								// value of time when the burst was added
+		int count;										// number of particles (instances) in the burst
+		float lifeFactor;								// scales particle size, like ParticleManager::add()
+	};
+
+public:
+	// the clock and every live burst, copied out at the end of an update; a few kilobytes at most
+	struct Snapshot
+	{
+		double time;
+		std::map<ParticleConfig*, std::vector<Burst> > bursts;
+	};
+
+private:
+	int maxBursts;										// bursts we keep alive per config; the oldest are replaced first
+
+	Shader *shader;										// evaluates particles from a burst record
+	GLuint vao;											// empty; the shader needs no vertex attributes
+
+	GLint originLoc;									// locations of the uniforms we set for every burst
+	GLint seedLoc;
+	GLint ageLoc;
+	GLint lifeFactorLoc;
+
+	double time;										// seconds of simulation so far
+
+	std::map<ParticleConfig*, std::vector<Burst> > bursts;	// live bursts, grouped by config so its uniforms are set once
+
+	void loadShader();
+	void setConfigUniforms(ParticleConfig *config);
+
+public:
+	AnalyticParticleSystem(int maxBursts);
+	~AnalyticParticleSystem();
+
+	// set the uniforms that never change and look up the per-burst ones, once the program is linked
+	void finishShader();
+
+	// record a burst of count particles; seed decides what every one of them looks like
+	void addBurst(ParticleConfig *config, glm::vec3 pos, int count, float lifeFactor, uint32_t seed);
+
+	// advance the clock and forget bursts whose particles have all died
+	void update(float dt);
+	void snapshot(Snapshot &snapshot);
+
+	// render all bursts in the snapshot; expects blending and depth state to already be set up by ParticleManager
+	void render(Snapshot &snapshot, glm::vec3 &cameraRight, glm::vec3 &cameraUp);
+};
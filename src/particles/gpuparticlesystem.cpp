@@ -0,0 +1,468 @@
+#include "particles/gpuparticlesystem.h"
+#include "particles/particleconfig.h"
+
+#include "util/glstate.h"
+#include "util/random.h"
+#include "util/shader.h"
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/type_ptr.hpp"
+using namespace glm;
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <vector>
+using namespace std;
+
+// layout of the per-particle state that transform feedback rewrites every frame:
+// position (3), gravity (1), angle (1), life (1)
+static const int DYNAMIC_FLOATS = 6;
+
+// layout of the per-particle constants written once at spawn time:
+// motion (3), gravity rate (1), spin (1), max life (1), start size (1), end size (1), start colour (4), end colour (4)
+static const int STATIC_FLOATS = 16;
+
+GPUParticleSystem::GPUParticleSystem()
+{
+	pendingDT = 0.0;
+	loadShaders();
+}
+
+GPUParticleSystem::~GPUParticleSystem()
+{
+	map<GLuint, Pool*>::iterator i;
+
+	for(i = pools.begin(); i != pools.end(); ++i)
+	{
+		destroyPool(i -> second);
+	}
+
+	delete updateShader;
+	delete renderShader;
+}
+
+void GPUParticleSystem::reserve(ParticleConfig *config)
+{
+	poolSizes[config -> texture] += config -> gpuBudget;
+}
+
+void GPUParticleSystem::loadShaders()
+{
+	// the order of these must match the dynamic record layout above, since they are written back interleaved
+	const char *VARYINGS[] = { "v_Position", "v_Gravity", "v_Angle", "v_Life" };
+
+	updateShader = new Shader("../shaders/particle-update.vert");
+	updateShader -> bindAttrib("a_Position", 0);
+	updateShader -> bindAttrib("a_Gravity", 1);
+	updateShader -> bindAttrib("a_Angle", 2);
+	updateShader -> bindAttrib("a_Life", 3);
+	updateShader -> bindAttrib("a_Motion", 4);
+	updateShader -> bindAttrib("a_GravityRate", 5);
+	updateShader -> bindAttrib("a_Spin", 6);
+	updateShader -> transformFeedbackVaryings(VARYINGS, 4);
+	updateShader -> startLink();
+
+	renderShader = new Shader("../shaders/particle-gpu.vert", "../shaders/particle.frag");
+	renderShader -> bindAttrib("a_Position", 0);
+	renderShader -> bindAttrib("a_Angle", 1);
+	renderShader -> bindAttrib("a_Life", 2);
+	renderShader -> bindAttrib("a_MaxLife", 3);
+	renderShader -> bindAttrib("a_StartSize", 4);
+	renderShader -> bindAttrib("a_EndSize", 5);
+	renderShader -> bindAttrib("a_StartColor", 6);
+	renderShader -> bindAttrib("a_EndColor", 7);
+	renderShader -> startLink();
+}
+
+void GPUParticleSystem::finishShaders()
+{
+	renderShader -> bind();
+	renderShader -> uniform1i("u_Texture", 0);
+	renderShader -> unbind();
+}
+
+GPUParticleSystem::Pool *GPUParticleSystem::createPool(GLuint texture)
+{
+	GLState *gl = GLState::getInstance();
+
+	const GLsizei DYNAMIC_STRIDE = sizeof(GLfloat) * DYNAMIC_FLOATS;
+	const GLsizei STATIC_STRIDE = sizeof(GLfloat) * STATIC_FLOATS;
+
+	Pool *pool = new Pool();
+	int i, j;
+
+	pool -> texture = texture;
+	pool -> size = poolSizes[texture];
+	pool -> current = 0;
+	pool -> head = 0;
+	pool -> numLive = 0;
+	pool -> time = 0.0;
+
+	// a texture nobody reserved room for still gets a (one-slot) pool, rather than taking the game down mid-frame
+	if(pool -> size <= 0)
+	{
+		cerr << "GPUParticleSystem::createPool() no GPU particle budget reserved for texture " << texture << endl;
+		pool -> size = 1;
+	}
+
+	// allocate GPU memory for the whole ring up front; nothing is drawn from a slot until it has been written
+	glGenBuffers(1, &pool -> staticVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, pool -> staticVBO);
+	glBufferData(GL_ARRAY_BUFFER, STATIC_STRIDE * pool -> size, NULL, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(2, pool -> dynamicVBOs);
+	for(i = 0; i < 2; i ++)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, pool -> dynamicVBOs[i]);
+		glBufferData(GL_ARRAY_BUFFER, DYNAMIC_STRIDE * pool -> size, NULL, GL_DYNAMIC_COPY);
+	}
+
+	glGenVertexArrays(2, pool -> updateVAOs);
+	glGenVertexArrays(2, pool -> renderVAOs);
+
+	for(i = 0; i < 2; i ++)
+	{
+		// transform feedback pass: one point per particle, reading the dynamic state and the constants that drive it
+		gl -> bindVertexArray(pool -> updateVAOs[i]);
+
+		glBindBuffer(GL_ARRAY_BUFFER, pool -> dynamicVBOs[i]);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, DYNAMIC_STRIDE, (GLvoid*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, DYNAMIC_STRIDE, (GLvoid*)(sizeof(GLfloat) * 3));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, DYNAMIC_STRIDE, (GLvoid*)(sizeof(GLfloat) * 4));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, DYNAMIC_STRIDE, (GLvoid*)(sizeof(GLfloat) * 5));
+
+		glBindBuffer(GL_ARRAY_BUFFER, pool -> staticVBO);
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, STATIC_STRIDE, (GLvoid*)0);
+		glEnableVertexAttribArray(5);
+		glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, STATIC_STRIDE, (GLvoid*)(sizeof(GLfloat) * 3));
+		glEnableVertexAttribArray(6);
+		glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, STATIC_STRIDE, (GLvoid*)(sizeof(GLfloat) * 4));
+
+		// render pass: a four-vertex strip per particle, with every attribute advancing once per instance
+		gl -> bindVertexArray(pool -> renderVAOs[i]);
+		for(j = 0; j < 8; j ++)
+		{
+			glEnableVertexAttribArray(j);
+			glVertexAttribDivisor(j, 1);
+		}
+		pointRenderAttribs(pool, i, 0);
+	}
+
+	gl -> bindVertexArray(0);
+
+	pools[texture] = pool;
+	return pool;
+}
+
+void GPUParticleSystem::pointRenderAttribs(Pool *pool, int buffer, int firstSlot)
+{
+	GLState *gl = GLState::getInstance();
+
+	const GLsizei DYNAMIC_STRIDE = sizeof(GLfloat) * DYNAMIC_FLOATS;
+	const GLsizei STATIC_STRIDE = sizeof(GLfloat) * STATIC_FLOATS;
+
+	// without base instances (GL 4.2), the only way to start an instanced draw part way into the ring is to offset
+	// the attributes themselves
+	const GLsizeiptr DYNAMIC_BASE = DYNAMIC_STRIDE * firstSlot;
+	const GLsizeiptr STATIC_BASE = STATIC_STRIDE * firstSlot;
+
+	gl -> bindVertexArray(pool -> renderVAOs[buffer]);
+
+	glBindBuffer(GL_ARRAY_BUFFER, pool -> dynamicVBOs[buffer]);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, DYNAMIC_STRIDE, (GLvoid*)(DYNAMIC_BASE));
+	glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, DYNAMIC_STRIDE, (GLvoid*)(DYNAMIC_BASE + sizeof(GLfloat) * 4));
+	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, DYNAMIC_STRIDE, (GLvoid*)(DYNAMIC_BASE + sizeof(GLfloat) * 5));
+
+	glBindBuffer(GL_ARRAY_BUFFER, pool -> staticVBO);
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, STATIC_STRIDE, (GLvoid*)(STATIC_BASE + sizeof(GLfloat) * 5));
+	glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, STATIC_STRIDE, (GLvoid*)(STATIC_BASE + sizeof(GLfloat) * 6));
+	glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, STATIC_STRIDE, (GLvoid*)(STATIC_BASE + sizeof(GLfloat) * 7));
+	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, STATIC_STRIDE, (GLvoid*)(STATIC_BASE + sizeof(GLfloat) * 8));
+	glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, STATIC_STRIDE, (GLvoid*)(STATIC_BASE + sizeof(GLfloat) * 12));
+}
+
+int GPUParticleSystem::getLiveRuns(Pool *pool, int firstSlot[2], int count[2])
+{
+	int first = (pool -> head - pool -> numLive + pool -> size) % pool -> size;
+
+	if(pool -> numLive == 0)
+	{
+		return 0;
+	}
+
+	// the live slots end just before head; if they start after it, they run off the end of the ring and wrap around
+	firstSlot[0] = first;
+	if(first + pool -> numLive <= pool -> size)
+	{
+		count[0] = pool -> numLive;
+		return 1;
+	}
+
+	count[0] = pool -> size - first;
+	firstSlot[1] = 0;
+	count[1] = pool -> numLive - count[0];
+	return 2;
+}
+
+void GPUParticleSystem::destroyPool(Pool *pool)
+{
+	glDeleteVertexArrays(2, pool -> updateVAOs);
+	glDeleteVertexArrays(2, pool -> renderVAOs);
+	glDeleteBuffers(2, pool -> dynamicVBOs);
+	glDeleteBuffers(1, &pool -> staticVBO);
+	delete pool;
+}
+
+void GPUParticleSystem::add(ParticleConfig *config, vec3 pos, float lifeFactor, Random &rng)
+{
+	Spawns &spawns = pending[config -> texture];
+
+	vec3 motion;
+	vec4 startColor;
+	vec4 endColor;
+	float maxLife;
+
+	// pick the random properties exactly as Particle::configure() does
+	motion = rng.range(config -> motionLimits[0], config -> motionLimits[1]);
+	startColor = rng.range(config -> startColorLimits[0], config -> startColorLimits[1]);
+	endColor = rng.range(config -> endColorLimits[0], config -> endColorLimits[1]);
+	maxLife = rng.range(config -> lifeLimits[0], config -> lifeLimits[1]);
+
+	// dynamic state, in DYNAMIC_FLOATS layout
+	spawns.dynamicData.push_back(pos.x);
+	spawns.dynamicData.push_back(pos.y);
+	spawns.dynamicData.push_back(pos.z);
+	spawns.dynamicData.push_back(rng.range(config -> initialGravityLimits[0], config -> initialGravityLimits[1]));
+	spawns.dynamicData.push_back(config -> randomOrientation ? rng.range(-(float)M_PI, (float)M_PI) : 0.0);
+	spawns.dynamicData.push_back(maxLife);
+
+	// constants, in STATIC_FLOATS layout
+	spawns.staticData.push_back(motion.x);
+	spawns.staticData.push_back(motion.y);
+	spawns.staticData.push_back(motion.z);
+	spawns.staticData.push_back(rng.range(config -> gravityRateLimits[0], config -> gravityRateLimits[1]));
+	spawns.staticData.push_back(rng.range(config -> spinLimits[0], config -> spinLimits[1]));
+	spawns.staticData.push_back(maxLife);
+	spawns.staticData.push_back(rng.range(config -> startSizeLimits[0], config -> startSizeLimits[1]) * lifeFactor);
+	spawns.staticData.push_back(rng.range(config -> endSizeLimits[0], config -> endSizeLimits[1]) * lifeFactor);
+	spawns.staticData.insert(spawns.staticData.end(), value_ptr(startColor), value_ptr(startColor) + 4);
+	spawns.staticData.insert(spawns.staticData.end(), value_ptr(endColor), value_ptr(endColor) + 4);
+
+	// the pool must keep simulating at least until this particle dies
+	if(maxLife > spawns.maxLife)
+	{
+		spawns.maxLife = maxLife;
+	}
+}
+
+void GPUParticleSystem::uploadRange(Pool *pool, Spawns &spawns, int firstSlot, int firstPending, int count)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, pool -> staticVBO);
+	glBufferSubData(GL_ARRAY_BUFFER,
+					sizeof(GLfloat) * STATIC_FLOATS * firstSlot,
+					sizeof(GLfloat) * STATIC_FLOATS * count,
+					&spawns.staticData[STATIC_FLOATS * firstPending]);
+
+	// new particles go into the buffer the next transform feedback pass reads from
+	glBindBuffer(GL_ARRAY_BUFFER, pool -> dynamicVBOs[pool -> current]);
+	glBufferSubData(GL_ARRAY_BUFFER,
+					sizeof(GLfloat) * DYNAMIC_FLOATS * firstSlot,
+					sizeof(GLfloat) * DYNAMIC_FLOATS * count,
+					&spawns.dynamicData[DYNAMIC_FLOATS * firstPending]);
+}
+
+void GPUParticleSystem::uploadSpawned(Pool *pool, Spawns &spawns)
+{
+	int numPending = spawns.staticData.size() / STATIC_FLOATS;
+	int firstPending = 0;
+	int count;
+	int excess;
+	Batch batch;
+
+	// if more was spawned than fits, only the newest requests survive anyway
+	if(numPending > pool -> size)
+	{
+		firstPending = numPending - pool -> size;
+		numPending = pool -> size;
+	}
+
+	// they all end up behind head, after whatever is already live there
+	batch.count = numPending;
+	batch.deathTime = pool -> time + spawns.maxLife;
+	pool -> batches.push_back(batch);
+	pool -> numLive += numPending;
+
+	while(numPending > 0)
+	{
+		// write up to the end of the ring, then wrap around and overwrite the oldest slots
+		count = std::min(numPending, pool -> size - pool -> head);
+		uploadRange(pool, spawns, pool -> head, firstPending, count);
+
+		pool -> head = (pool -> head + count) % pool -> size;
+		firstPending += count;
+		numPending -= count;
+	}
+
+	// whatever was overwritten is gone, so forget the oldest batches as far as it reached
+	excess = pool -> numLive - pool -> size;
+	while(excess > 0)
+	{
+		count = std::min(excess, pool -> batches.front().count);
+		pool -> batches.front().count -= count;
+		if(pool -> batches.front().count == 0)
+		{
+			pool -> batches.pop_front();
+		}
+		pool -> numLive -= count;
+		excess -= count;
+	}
+}
+
+void GPUParticleSystem::update(float dt)
+{
+	pendingDT += dt;
+}
+
+void GPUParticleSystem::snapshot(Snapshot &snapshot)
+{
+	map<GLuint, Spawns>::iterator i;
+	Spawns *spawns;
+
+	snapshot.dt = pendingDT;
+	pendingDT = 0.0;
+
+	// swap the queued requests with the snapshot's old ones, which were uploaded long ago; both sides hold on to their
+	// memory, so once every texture has been seen nothing is allocated here. Textures are never dropped from pending,
+	// so every one the snapshot has heard of is overwritten
+	for(i = pending.begin(); i != pending.end(); ++i)
+	{
+		spawns = &snapshot.spawns[i -> first];
+		spawns -> staticData.swap(i -> second.staticData);
+		spawns -> dynamicData.swap(i -> second.dynamicData);
+		spawns -> maxLife = i -> second.maxLife;
+
+		i -> second.staticData.clear();
+		i -> second.dynamicData.clear();
+		i -> second.maxLife = 0.0;
+	}
+}
+
+void GPUParticleSystem::step(Snapshot &snapshot)
+{
+	GLState *gl = GLState::getInstance();
+
+	map<GLuint, Spawns>::iterator i;
+	map<GLuint, Pool*>::iterator j;
+	Pool *pool;
+	int next;
+	int firstSlot[2];
+	int count[2];
+	int numRuns;
+	int k;
+
+	// write the new particles into their rings, creating any ring we haven't needed before
+	for(i = snapshot.spawns.begin(); i != snapshot.spawns.end(); ++i)
+	{
+		if(!i -> second.staticData.empty())
+		{
+			j = pools.find(i -> first);
+			pool = (j == pools.end()) ? createPool(i -> first) : j -> second;
+			uploadSpawned(pool, i -> second);
+		}
+	}
+
+	// integrate all pools with the rasterizer switched off; nothing but the feedback buffers is written
+	updateShader -> bind();
+	updateShader -> uniform1f("u_DeltaTime", snapshot.dt);
+	gl -> enable(GL_RASTERIZER_DISCARD);
+
+	for(j = pools.begin(); j != pools.end(); ++j)
+	{
+		pool = j -> second;
+
+		// batches are in slot order, so retiring the oldest ones once they've all died keeps the live slots in one run
+		// behind head; a younger batch that dies first just waits its turn
+		pool -> time += snapshot.dt;
+		while(!pool -> batches.empty() && pool -> batches.front().deathTime <= pool -> time)
+		{
+			pool -> numLive -= pool -> batches.front().count;
+			pool -> batches.pop_front();
+		}
+
+		// once every particle in the ring has died there is nothing left to simulate or draw
+		if(pool -> numLive == 0)
+		{
+			pool -> time = 0.0;
+			continue;
+		}
+
+		// read the live slots from the current buffer and capture their integrated state into the same slots of the
+		// other one; dead slots are neither read nor written
+		next = 1 - pool -> current;
+		gl -> bindVertexArray(pool -> updateVAOs[pool -> current]);
+
+		numRuns = getLiveRuns(pool, firstSlot, count);
+		for(k = 0; k < numRuns; k ++)
+		{
+			glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, pool -> dynamicVBOs[next],
+							  sizeof(GLfloat) * DYNAMIC_FLOATS * firstSlot[k],
+							  sizeof(GLfloat) * DYNAMIC_FLOATS * count[k]);
+
+			glBeginTransformFeedback(GL_POINTS);
+			glDrawArrays(GL_POINTS, firstSlot[k], count[k]);
+			glEndTransformFeedback();
+		}
+
+		pool -> current = next;
+	}
+
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	gl -> disable(GL_RASTERIZER_DISCARD);
+	gl -> bindVertexArray(0);
+	Shader::unbind();
+}
+
+void GPUParticleSystem::render(Snapshot &snapshot, vec3 &cameraRight, vec3 &cameraUp)
+{
+	GLState *gl = GLState::getInstance();
+
+	map<GLuint, Pool*>::iterator i;
+	Pool *pool;
+	int firstSlot[2];
+	int count[2];
+	int numRuns;
+	int k;
+
+	step(snapshot);
+
+	renderShader -> bind();
+	renderShader -> uniformVec3("u_CameraRight", cameraRight);
+	renderShader -> uniformVec3("u_CameraUp", cameraUp);
+
+	// draw the live slots straight out of the buffer transform feedback just wrote; the odd dead particle among them
+	// (one that died before the rest of its batch) collapses to nothing in the shader
+	for(i = pools.begin(); i != pools.end(); ++i)
+	{
+		pool = i -> second;
+		numRuns = getLiveRuns(pool, firstSlot, count);
+		if(numRuns > 0)
+		{
+			gl -> bindTexture(0, pool -> texture);
+		}
+		for(k = 0; k < numRuns; k ++)
+		{
+			pointRenderAttribs(pool, pool -> current, firstSlot[k]);
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count[k]);
+		}
+	}
+
+	gl -> bindVertexArray(0);
+}
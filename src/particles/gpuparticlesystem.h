@@ -0,0 +1,108 @@
+#pragma once
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+class ParticleConfig;
+class Random;
+class Shader;
+
+// GPU-resident particle simulation: particle state lives in video memory and is integrated by a vertex shader through
+// transform feedback, so hundreds of thousands of particles can be kept alive without the CPU ever touching them again
+class GPUParticleSystem
+{
+public:
+	// spawn requests for one texture's pool, in the layouts its buffers use
+	struct Spawns
+	{
+		std::vector<float> staticData;
+		std::vector<float> dynamicData;
+		float maxLife;										// longest life of any of them
+	};
+
+	// everything the pools need to catch up with the simulation: what was spawned since the last snapshot, and how far
+	// to step them afterwards
+	struct Snapshot
+	{
+		float dt;
+		std::map<GLuint, Spawns> spawns;					// indexed by texture object
+	};
+
+private:
+	// particles uploaded together; they sit in consecutive slots and are all dead by deathTime
+	struct Batch
+	{
+		int count;
+		float deathTime;									// pool time at which the longest-living of them has died
+	};
+
+	// one ring of particle slots per texture, so that each ring can be drawn with a single instanced call
+	struct Pool
+	{
+		GLuint texture;										// texture every particle in this pool is drawn with
+		int size;											// slot count of the ring, from the budgets of the configs using it
+
+		GLuint staticVBO;									// per-particle constants written once at spawn time
+		GLuint dynamicVBOs[2];								// ping-pong buffers holding the state we integrate each frame
+		GLuint updateVAOs[2];								// vertex states for the transform feedback pass reading dynamicVBOs[i]
+		GLuint renderVAOs[2];								// vertex states for rendering from dynamicVBOs[i]
+		int current;										// which dynamic buffer holds the latest state
+
+		int head;											// next slot to write a spawned particle to (oldest slots are overwritten first)
+		int numLive;										// slots just behind head that may still hold a live particle
+		std::deque<Batch> batches;							// what those slots were filled with, oldest first
+		float time;											// seconds simulated since the pool was last empty
+	};
+
+	std::map<GLuint, int> poolSizes;						// slot count each texture's pool gets, summed from reserve()
+
+	Shader *updateShader;									// transform feedback program that integrates particle state
+	Shader *renderShader;									// billboarding program that reads the same buffers
+
+	std::map<GLuint, Pool*> pools;							// pools, indexed by texture object (only touched by render())
+
+	std::map<GLuint, Spawns> pending;						// spawn requests queued since the last snapshot
+	float pendingDT;										// time simulated since the last snapshot
+
+	// load resources
+	void loadShaders();
+	Pool *createPool(GLuint texture);
+	void destroyPool(Pool *pool);
+	void pointRenderAttribs(Pool *pool, int buffer, int firstSlot);		// aim renderVAOs[buffer]'s first instance at firstSlot
+
+	// the live slots of a ring as at most two runs of slots (two when they wrap around the end); returns the run count
+	int getLiveRuns(Pool *pool, int firstSlot[2], int count[2]);
+
+	// write a snapshot's spawn requests into the ring, splitting the upload where it wraps around
+	void uploadSpawned(Pool *pool, Spawns &spawns);
+	void uploadRange(Pool *pool, Spawns &spawns, int firstSlot, int firstPending, int count);
+
+	// upload a snapshot's spawn requests and advance every pool by its time step
+	void step(Snapshot &snapshot);
+
+public:
+	GPUParticleSystem();
+	~GPUParticleSystem();
+
+	void finishShaders();									// set the uniforms that never change, once the programs are linked
+
+	// make room in the pool for config's texture for its gpuBudget particles; call once for every GPU-simulated config,
+	// before anything is added
+	void reserve(ParticleConfig *config);
+
+	// queue a particle to be spawned on the GPU; same semantics as ParticleManager::add()
+	void add(ParticleConfig *config, glm::vec3 pos, float lifeFactor, Random &rng);
+
+	// the simulation side never touches GL: update() just counts time, and snapshot() hands that and the queued spawn
+	// requests over to the next render()
+	void update(float dt);
+	void snapshot(Snapshot &snapshot);
+
+	// bring the pools up to date with the snapshot, then render them; expects blending and depth state to already be
+	// set up by ParticleManager
+	void render(Snapshot &snapshot, glm::vec3 &cameraRight, glm::vec3 &cameraUp);
+};
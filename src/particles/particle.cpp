@@ -1,10 +1,10 @@
 #include "particles/particle.h"
 #include "particles/particleconfig.h"
-#include "particles/particlemanager.h"
+
+#include "util/random.h"
 
 #include "GL/glew.h"
 #include "glm/glm.hpp"
-#include "glm/gtc/random.hpp"
 using namespace glm;
 
 #include <vector>
@@ -19,49 +19,54 @@ Particle::Particle()
 
 Particle::~Particle() { }
 
-void Particle::configure(ParticleConfig *config, vec3 pos, float lifeFactor, ParticleManager *particleManager)
+void Particle::configure(ParticleConfig *config, vec3 pos, float lifeFactor, Random &rng)
 {
 	this -> pos = pos;
 
 	// pick a random motion based on config params
-	motion = linearRand(config -> motionLimits[0], config -> motionLimits[1]);
+	motion = rng.range(config -> motionLimits[0], config -> motionLimits[1]);
 
 	// randomize spin if requested
-	spin = linearRand(config -> spinLimits[0], config -> spinLimits[1]);
+	spin = rng.range(config -> spinLimits[0], config -> spinLimits[1]);
 	if(config -> randomOrientation)
-		angle = linearRand(-M_PI, M_PI);
+		angle = rng.range(-(float)M_PI, (float)M_PI);
 	else
 		angle = 0.0;
 
 	// pick a random start and end size for the particle
-    startSize = linearRand(config -> startSizeLimits[0], config -> startSizeLimits[1]) * lifeFactor;
-    endSize = linearRand(config -> endSizeLimits[0], config -> endSizeLimits[1]) * lifeFactor;
+    startSize = rng.range(config -> startSizeLimits[0], config -> startSizeLimits[1]) * lifeFactor;
+    endSize = rng.range(config -> endSizeLimits[0], config -> endSizeLimits[1]) * lifeFactor;
 
     // pick a random start and end colour for the particle
-    startColor = linearRand(config -> startColorLimits[0], config -> startColorLimits[1]);
-    endColor = linearRand(config -> endColorLimits[0], config -> endColorLimits[1]);
+    startColor = rng.range(config -> startColorLimits[0], config -> startColorLimits[1]);
+    endColor = rng.range(config -> endColorLimits[0], config -> endColorLimits[1]);
 
     // pick a random life value for the particle
-    maxLife = linearRand(config -> lifeLimits[0], config -> lifeLimits[1]);
+    maxLife = rng.range(config -> lifeLimits[0], config -> lifeLimits[1]);
     life = maxLife;
 
+    // a new particle may be drawn before its first update, so start it off with a sensible appearance
+    size = startSize;
+    color = startColor;
+
     // same with gravity strength
-    gravity = linearRand(config -> initialGravityLimits[0], config -> initialGravityLimits[1]);
-    gravityRate = linearRand(config -> gravityRateLimits[0], config -> gravityRateLimits[1]);
+    gravity = rng.range(config -> initialGravityLimits[0], config -> initialGravityLimits[1]);
+    gravityRate = rng.range(config -> gravityRateLimits[0], config -> gravityRateLimits[1]);
 
     additiveBlending = config -> additiveBlending;			// unused, I think...
     texture = config -> texture;							// assign desired texture
 
+    // remember how expensive and important we are, for the particle budget
+    priority = config -> priority;
+    cost = config -> cost;
+
     // configure child particle emission
     childEmissionInterval = config -> childEmissionInterval;
-    children = config -> children;
     childEmissionTimer = 0.0;
-
-    // assign our parent/owner
-    this -> particleManager = particleManager;
+    this -> config = config;
 }
 
-void Particle::update(float dt)
+void Particle::update(float dt, vector<ParticleSpawn> &spawns)
 {
 	float lifeFactor = 1.0 - (life / maxLife);
 
@@ -81,19 +86,23 @@ void Particle::update(float dt)
 	if(childEmissionTimer <= 0.0)
 	{
 		childEmissionTimer = childEmissionInterval;
-		emitChildren(pos, 1.0 - lifeFactor);
+		emitChildren(pos, 1.0 - lifeFactor, spawns);
 	}
 
 	life -= dt;
 }
 
-void Particle::emitChildren(vec3 pos, float lifeFactor)
+void Particle::emitChildren(vec3 pos, float lifeFactor, vector<ParticleSpawn> &spawns)
 {
 	vector<ParticleConfig*>::iterator i;
+	ParticleSpawn spawn;
 
-	for(i = children.begin(); i != children.end(); ++i)
+	spawn.pos = pos;
+	spawn.lifeFactor = lifeFactor;
+	for(i = config -> children.begin(); i != config -> children.end(); ++i)
 	{
-		particleManager -> add(*i, pos, lifeFactor);
+		spawn.config = *i;
+		spawns.push_back(spawn);
 	}
 }
 
@@ -131,3 +140,33 @@ GLuint Particle::getTexture()
 {
 	return texture;
 }
+
+vec3 Particle::getPosition()
+{
+	return pos;
+}
+
+ParticleConfig *Particle::getConfig()
+{
+	return config;
+}
+
+int Particle::getPriority()
+{
+	return priority;
+}
+
+float Particle::getCost()
+{
+	return cost;
+}
+
+float Particle::getLifeFraction()
+{
+	return 1.0 - (life / maxLife);
+}
+
+void Particle::kill()
+{
+	life = 0.0;
+}
@@ -7,7 +7,15 @@
 #include <vector>
 
 class ParticleConfig;
-class ParticleManager;
+class Random;
+
+// a request to emit a particle, recorded during a (possibly multi-threaded) update and fulfilled afterwards
+struct ParticleSpawn
+{
+	ParticleConfig *config;
+	glm::vec3 pos;
+	float lifeFactor;
+};
 
 class Particle
 {
@@ -15,9 +23,11 @@ public:
 	Particle();
 	~Particle();
 
-	void configure(ParticleConfig *config, glm::vec3 pos, float lifeFactor, ParticleManager *particleManager);
+	// random choices come from the given generator, so this is safe to call from any thread that owns one
+	void configure(ParticleConfig *config, glm::vec3 pos, float lifeFactor, Random &rng);
 
-	void update(float dt);
+	// children emitted during the update are appended to spawns rather than added directly, keeping this thread-safe
+	void update(float dt, std::vector<ParticleSpawn> &spawns);
 	// no render() is supplied; ParticleManager renders everything in batches according to texture
 
 	// retrieve current properties of particle; needed by ParticleManager to send to GPU
@@ -28,6 +38,15 @@ public:
 	bool getDead();
 	GLuint getTexture();
 
+	// used by ParticleManager's budget to decide which particles to evict first
+	glm::vec3 getPosition();
+	ParticleConfig *getConfig();
+	int getPriority();
+	float getCost();
+	float getLifeFraction();
+
+	void kill();							// immediately end this particle's life (eviction)
+
 private:
 	// -- properties received from ParticleConfig -- //
 
@@ -49,13 +68,14 @@ private:
 
     GLuint texture;										// texture used when rendering this particle
 
+    int priority;										// eviction priority and budget cost this particle was spawned with
+    float cost;
+
     float childEmissionInterval;						// how often to emit children particles
-    std::vector<ParticleConfig*> children;				// the children particles to emit
+    ParticleConfig *config;								// where we get the list of children particles to emit from
 
     // -- current real-time properties -- //
 
-    ParticleManager *particleManager;					// owner of this particle, used to add children
-
     glm::vec3 pos;										// current world position of particle
     float angle;										// current angle of particle (roll, after billboarding)
 
@@ -71,5 +91,5 @@ private:
 
     // -- functions -- //
 
-    void emitChildren(glm::vec3 pos, float lifeFactor);
+    void emitChildren(glm::vec3 pos, float lifeFactor, std::vector<ParticleSpawn> &spawns);
 };
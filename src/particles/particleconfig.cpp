@@ -37,6 +37,13 @@ ParticleConfig::ParticleConfig()
 	texture = 0;
 
 	childEmissionInterval = 0.0;
+
+	priority = PARTICLE_PRIORITY_NORMAL;
+	cost = 1.0;
+
+	gpuSimulated = false;
+	gpuBudget = 0;
+	analytic = false;
 }
 
 ParticleConfig::~ParticleConfig() { }
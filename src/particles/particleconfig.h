@@ -5,6 +5,15 @@
 
 #include <vector>
 
+// how important an effect is when the particle budget runs out; higher priorities evict lower ones, never the reverse
+enum ParticlePriority
+{
+	PARTICLE_PRIORITY_LOW,						// ambient, purely cosmetic (smoke)
+	PARTICLE_PRIORITY_NORMAL,					// regular effects (sparks, dirt)
+	PARTICLE_PRIORITY_HIGH,						// feedback the player relies on (impact flares, explosions)
+	PARTICLE_PRIORITY_CRITICAL					// gameplay-critical; never thinned out and only ever evicts others
+};
+
 class ParticleConfig
 {
 public:
@@ -34,6 +43,13 @@ public:
 	float childEmissionInterval;				// how often to emit other particles and what to emit
 	std::vector<ParticleConfig*> children;
 
+	int priority;								// one of ParticlePriority; decides who gets evicted when the pool is saturated
+	float cost;									// relative rendering cost (fill rate) of one particle, charged against the budget
+
+	bool gpuSimulated;							// simulate on the GPU via transform feedback (no child emission on that path)
+	int gpuBudget;								// most GPU-simulated particles of this type alive at once; sizes its texture's pool
+	bool analytic;								// stateless: evaluated in closed form by the vertex shader (no children, no budget)
+
 	ParticleConfig();
 	~ParticleConfig();
 };
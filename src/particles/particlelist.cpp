@@ -39,6 +39,8 @@ void initParticleList()
     muzzleFlash -> gravityRateLimits[1] = 0.0;
     muzzleFlash -> additiveBlending = false;
     muzzleFlash -> texture = loadPNG("../png/muzzle-flash.png", true);
+    muzzleFlash -> priority = PARTICLE_PRIORITY_CRITICAL;
+    muzzleFlash -> analytic = true;
 
 	smoke = new ParticleConfig();
 	smoke -> motionLimits[0] = vec3(-0.008, 0.003, -0.008);
@@ -61,6 +63,8 @@ void initParticleList()
     smoke -> gravityRateLimits[1] = 0.0;
     smoke -> additiveBlending = false;
     smoke -> texture = loadPNG("../png/smoke.png", true);
+    smoke -> priority = PARTICLE_PRIORITY_LOW;
+    smoke -> cost = 2.0;
 
 	spark = new ParticleConfig();
 	spark -> motionLimits[0] = vec3(-0.07, 0.0, -0.07);
@@ -83,6 +87,8 @@ void initParticleList()
     spark -> gravityRateLimits[1] = -0.3;
     spark -> additiveBlending = false;
     spark -> texture = loadPNG("../png/spark.png", false);
+    spark -> priority = PARTICLE_PRIORITY_NORMAL;
+    spark -> analytic = true;
 
 	impactFlare = new ParticleConfig();
 	impactFlare -> motionLimits[0] = vec3(0.0);
@@ -105,6 +111,8 @@ void initParticleList()
     impactFlare -> gravityRateLimits[1] = 0.0;
     impactFlare -> additiveBlending = false;
     impactFlare -> texture = loadPNG("../png/flare.png", true);
+    impactFlare -> priority = PARTICLE_PRIORITY_HIGH;
+    impactFlare -> analytic = true;
 
 	dirtSpray = new ParticleConfig();
 	dirtSpray -> motionLimits[0] = vec3(-0.025, 0.0, -0.025);
@@ -127,6 +135,9 @@ void initParticleList()
     dirtSpray -> gravityRateLimits[1] = -0.3;
     dirtSpray -> additiveBlending = false;
     dirtSpray -> texture = loadPNG("../png/dirt-spray.png", true);
+    dirtSpray -> priority = PARTICLE_PRIORITY_NORMAL;
+    dirtSpray -> cost = 1.5;
+    dirtSpray -> analytic = true;
 
 	trailSmoke = new ParticleConfig();
 	trailSmoke -> motionLimits[0] = vec3(-0.001, 0.001, -0.001);
@@ -149,6 +160,10 @@ void initParticleList()
     trailSmoke -> gravityRateLimits[1] = 0.0;
     trailSmoke -> additiveBlending = false;
     trailSmoke -> texture = loadPNG("../png/smoke.png", true);
+    trailSmoke -> gpuSimulated = true;
+    trailSmoke -> gpuBudget = 16384;				// a fireball trails up to 120 puffs that last up to 3.5s; room for ~25 of them
+    trailSmoke -> priority = PARTICLE_PRIORITY_LOW;
+    trailSmoke -> cost = 2.0;
 
 	trailFire = new ParticleConfig();
 	trailFire -> motionLimits[0] = vec3(-0.001, 0.001, -0.001);
@@ -172,6 +187,9 @@ void initParticleList()
     trailFire -> gravityRateLimits[1] = 0.3;
     trailFire -> additiveBlending = false;
     trailFire -> texture = loadPNG("../png/flame.png", true);
+    trailFire -> gpuSimulated = true;
+    trailFire -> gpuBudget = 4096;				// the flames die within 0.4s, so only the last 40 of each trail are ever alive
+    trailFire -> priority = PARTICLE_PRIORITY_NORMAL;
 
     explodeEmitter = new ParticleConfig();
     explodeEmitter -> motionLimits[0] = vec3(-0.06, 0.0, -0.06);
@@ -185,6 +203,8 @@ void initParticleList()
     explodeEmitter -> gravityRateLimits[0] = -0.25;
     explodeEmitter -> gravityRateLimits[1] = -0.25;
     explodeEmitter -> childEmissionInterval = 0.01;
+    explodeEmitter -> priority = PARTICLE_PRIORITY_HIGH;
+    explodeEmitter -> cost = 0.0;					// invisible; it only emits trails
     explodeEmitter -> children.push_back(trailFire);
     explodeEmitter -> children.push_back(trailSmoke);
 }
@@ -1,25 +1,49 @@
 #include "particles/particlemanager.h"
 #include "particles/particleconfig.h"
 #include "particles/particle.h"
+#include "particles/gpuparticlesystem.h"
+#include "particles/analyticparticlesystem.h"
 
+#include "util/glstate.h"
+#include "util/random.h"
 #include "util/shader.h"
+#include "util/streambuffer.h"
+#include "util/threadpool.h"
 
 #include "GL/glew.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/type_ptr.hpp"
 using namespace glm;
 
+#include <algorithm>
 #include <cstring>
 #include <vector>
 #include <iostream>
 using namespace std;
 
-ParticleManager::ParticleManager(int maxParticles)
+const int ParticleManager::PARTICLES_PER_CHUNK = 256;
+
+ParticleManager::ParticleManager(int maxParticles, int maxBurstsPerConfig)
 {
 	numInActivePool = 0;
+	numToRecycle = 0;
     freeParticleIndex = 0;
     this -> maxParticles = maxParticles;
 
+    // one unit of cost is one ordinary particle, so a pool full of them exactly meets the budget
+    maxCost = maxParticles;
+    activeCost = 0.0;
+
+    // no camera information yet; emit everything at full detail until we get some
+    viewerPos = vec3(0.0);
+    projectionScale = 0.0;
+    nextEvictionCandidate = 0;
+
+    // fixed seeds, so a replay of the same inputs produces the same effects
+    rng.seed(0);
+    numUpdates = 0;
+    chunkDT = 0.0;
+
     // allocate space for our particles
 	particlePool = new Particle[maxParticles];
 	activeParticles = new Particle*[maxParticles];
@@ -27,56 +51,56 @@ ParticleManager::ParticleManager(int maxParticles)
 	// setup our GPU memory and shader programs
 	setupVBOs();
 	loadShader();
+
+	// large effects are simulated entirely on the graphics card
+	gpuParticles = new GPUParticleSystem();
+
+	// and simple ballistic ones are never simulated at all
+	analyticParticles = new AnalyticParticleSystem(maxBurstsPerConfig);
 }
 
 ParticleManager::~ParticleManager()
 {
 	// free OpenGL memory
-	glDeleteBuffers(1, &vbo);
+	delete stream;
 	glDeleteVertexArrays(1, &vao);
+	delete gpuParticles;
+	delete analyticParticles;
 
 	// free particle data
 	delete[] particlePool;					// de-allocates particle dynamic memory (the actual memory used by all particles)
 	delete[] activeParticles;				// de-allocates our array of pointers (what they point to was freed in the line above)
-	delete[] vertexAttribData;				// free the data associated with our vertex attributes
 }
 
 void ParticleManager::setupVBOs()
 {
-	// initialize buffer store for generic vertex attributes that we pass to the shader
-    vertexAttribData = new float[maxParticles * 9];
-
 	// set up our vertex buffers
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
-    glGenBuffers(1, &vbo);
 
-	// we store all vertex attributes inside a single vertex buffer for increased efficiency (fewer calls to glBufferSubData() later on)
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER,							// target should always be GL_ARRAY_BUFFER here
-				 sizeof(GLfloat) * maxParticles * 9,		// 9 floats (3 for pos, 4 for color, 1 each for size and angle) per particle
-				 NULL,										// no data currently
-				 GL_DYNAMIC_DRAW);							// performance hint for "written and drawn frequently"
+	// we store all vertex attributes inside a single stream buffer: 9 floats (3 for pos, 4 for color, 1 each for size and angle)
+	// per particle, rewritten every frame into a region the GPU is no longer reading from
+	stream = new StreamBuffer(GL_ARRAY_BUFFER, sizeof(GLfloat) * maxParticles * 9);
 
-	// set up generic vertex attributes for particle positions
+	// every attribute advances only once per primitive
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 9, (GLvoid*)0);
-	glVertexAttribDivisor(0, 1);		// positions advance only once per primitive
-
-	// set up generic vertex attributes for particle colour
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 9, (GLvoid*)(sizeof(GLfloat) * 3));
-	glVertexAttribDivisor(1, 1);		// colours advance only once per primitive
-
-	// set up generic vertex attributes for particle size
 	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 9, (GLvoid*)(sizeof(GLfloat) * 7));
-	glVertexAttribDivisor(2, 1);		// sizes advance only once per primitive
-
-	// set up generic vertex attributes for particle angle
 	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 9, (GLvoid*)(sizeof(GLfloat) * 8));
-	glVertexAttribDivisor(3, 1);		// angles advance only once per primitive
+	glVertexAttribDivisor(0, 1);
+	glVertexAttribDivisor(1, 1);
+	glVertexAttribDivisor(2, 1);
+	glVertexAttribDivisor(3, 1);
+	setupAttribs(0);
+}
+
+void ParticleManager::setupAttribs(GLintptr offset)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, stream -> getBuffer());
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 9, (GLvoid*)offset);								// position
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 9, (GLvoid*)(offset + sizeof(GLfloat) * 3));		// colour
+	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 9, (GLvoid*)(offset + sizeof(GLfloat) * 7));		// size
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 9, (GLvoid*)(offset + sizeof(GLfloat) * 8));		// angle
 }
 
 void ParticleManager::loadShader()
@@ -86,57 +110,373 @@ void ParticleManager::loadShader()
 	shader -> bindAttrib("a_Color", 1);
 	shader -> bindAttrib("a_Size", 2);
 	shader -> bindAttrib("a_Angle", 3);
-	shader -> link();
+	shader -> startLink();
+}
+
+void ParticleManager::finishShaders()
+{
 	shader -> bind();
 	shader -> uniform1i("u_Texture", 0);
 	shader -> unbind();
+
+	gpuParticles -> finishShaders();
+	analyticParticles -> finishShader();
+}
+
+void ParticleManager::reserveGPUParticles(ParticleConfig *config)
+{
+	gpuParticles -> reserve(config);
 }
 
 void ParticleManager::add(ParticleConfig *config, vec3 pos, float lifeFactor)
 {
-	Particle *toAdd = getFreeParticle();
+	Particle *toAdd;
+	float emissionFraction = getEmissionFraction(config, pos);
+
+	// far away and small on screen? then only keep a fraction of what was asked for
+	if(emissionFraction < 1.0 && rng.nextFloat() >= emissionFraction)
+	{
+		return;
+	}
+
+	// analytic particles are just a burst of one
+	if(config -> analytic)
+	{
+		analyticParticles -> addBurst(config, pos, 1, lifeFactor, rng.next());
+		return;
+	}
+
+	// GPU particles never come back to the CPU; hand them off and we're done
+	if(config -> gpuSimulated)
+	{
+		gpuParticles -> add(config, pos, lifeFactor, rng);
+		return;
+	}
+
+	toAdd = acquireParticle(config);
 	if(toAdd)
 	{
 		// success, configure the particle and add it to the list of active particles in the system
-		toAdd -> configure(config, pos, lifeFactor, this);
+		toAdd -> configure(config, pos, lifeFactor, rng);
 		insertIntoActivePool(toAdd);
+		activeCost += config -> cost;
+	}
+}
+
+void ParticleManager::addBurst(ParticleConfig *config, vec3 pos, int count, float lifeFactor)
+{
+	int i;
+
+	// anything with state has to go through the regular path, one particle at a time
+	if(!config -> analytic)
+	{
+		for(i = 0; i < count; i ++)
+		{
+			add(config, pos, lifeFactor);
+		}
+		return;
+	}
+
+	// thin out distant bursts by dropping part of them, rather than all-or-nothing like a single add()
+	count = (int)(count * getEmissionFraction(config, pos) + rng.nextFloat());
+	analyticParticles -> addBurst(config, pos, count, lifeFactor, rng.next());
+}
+
+Particle *ParticleManager::acquireParticle(ParticleConfig *config)
+{
+	Particle *result = NULL;
+
+	// use a free slot if the budget allows, otherwise try to push out something less important
+	if(!isSaturated(config -> cost))
+	{
+		result = getFreeParticle();
+	}
+	if(!result)
+	{
+		result = evictFor(config);
 	}
+
+	return result;
+}
+
+void ParticleManager::setViewerPos(vec3 pos)
+{
+	viewerPos = pos;
+}
+
+void ParticleManager::setProjectionScale(float projectionScale)
+{
+	this -> projectionScale = projectionScale;
+}
+
+float ParticleManager::getEmissionFraction(ParticleConfig *config, vec3 pos)
+{
+	const float FULL_DETAIL_SCREEN_SIZE = 24.0;			// particles at least this many pixels across are always emitted in full
+	const float CULL_SCREEN_SIZE = 0.75;				// sub-pixel particles aren't worth emitting at all...
+	const float MIN_EMISSION_FRACTION = 0.1;			// ...otherwise we always keep at least this much of an effect
+
+	float dist;
+	float screenSize;
+
+	// gameplay-critical effects are never thinned out, and we can't judge anything until we know the projection
+	if(config -> priority >= PARTICLE_PRIORITY_CRITICAL || projectionScale <= 0.0)
+	{
+		return 1.0;
+	}
+
+	// approximate how many pixels this effect will cover
+	dist = distance(viewerPos, pos);
+	if(dist < 1.0)
+	{
+		return 1.0;
+	}
+	screenSize = getVisualSize(config) * projectionScale / dist;
+
+	if(screenSize < CULL_SCREEN_SIZE && config -> priority < PARTICLE_PRIORITY_HIGH)
+	{
+		return 0.0;
+	}
+
+	return glm::clamp(screenSize / FULL_DETAIL_SCREEN_SIZE, MIN_EMISSION_FRACTION, 1.0f);
+}
+
+float ParticleManager::getVisualSize(ParticleConfig *config)
+{
+	vector<ParticleConfig*>::iterator i;
+	float size = std::max(config -> startSizeLimits[1], config -> endSizeLimits[1]);
+
+	// emitters are usually invisible themselves, so judge them by what they emit
+	for(i = config -> children.begin(); i != config -> children.end(); ++i)
+	{
+		size = std::max(size, std::max((*i) -> startSizeLimits[1], (*i) -> endSizeLimits[1]));
+	}
+
+	return size;
+}
+
+bool ParticleManager::isSaturated(float cost)
+{
+	return numInActivePool >= maxParticles || activeCost + cost > maxCost;
+}
+
+bool ParticleManager::EvictionCandidate::operator<(const EvictionCandidate &other) const
+{
+	// lowest priority first; among equals, the farthest/oldest goes first
+	if(priority != other.priority)
+	{
+		return priority < other.priority;
+	}
+	return score > other.score;
+}
+
+void ParticleManager::gatherEvictionCandidates()
+{
+	const float SATURATION_THRESHOLD = 0.9;				// only bother ranking particles when we're this close to the budget
+	const int MAX_EVICTION_CANDIDATES = 256;			// enough victims to cover a burst of high-priority emissions per frame
+	const float EVICTION_DISTANCE_SCALE = 100.0;		// every 100m of distance counts as much as a whole lifetime of age
+
+	EvictionCandidate candidate;
+	int i;
+
+	evictionCandidates.clear();
+	nextEvictionCandidate = 0;
+
+	if(numInActivePool < maxParticles * SATURATION_THRESHOLD && activeCost < maxCost * SATURATION_THRESHOLD)
+	{
+		return;
+	}
+
+	// score every living particle...
+	for(i = 0; i < numInActivePool; i ++)
+	{
+		if(!activeParticles[i] -> getDead())
+		{
+			candidate.particle = activeParticles[i];
+			candidate.priority = activeParticles[i] -> getPriority();
+			candidate.score = distance(viewerPos, activeParticles[i] -> getPosition()) / EVICTION_DISTANCE_SCALE +
+							  activeParticles[i] -> getLifeFraction();
+			evictionCandidates.push_back(candidate);
+		}
+	}
+
+	// ...but only keep the best victims, in order
+	if((int)evictionCandidates.size() > MAX_EVICTION_CANDIDATES)
+	{
+		nth_element(evictionCandidates.begin(), evictionCandidates.begin() + MAX_EVICTION_CANDIDATES, evictionCandidates.end());
+		evictionCandidates.resize(MAX_EVICTION_CANDIDATES);
+	}
+	sort(evictionCandidates.begin(), evictionCandidates.end());
+}
+
+Particle *ParticleManager::evictFor(ParticleConfig *config)
+{
+	Particle *victim = NULL;
+	EvictionCandidate *candidate;
+
+	while(isSaturated(config -> cost) && nextEvictionCandidate < (int)evictionCandidates.size())
+	{
+		candidate = &evictionCandidates[nextEvictionCandidate];
+
+		// candidates are ranked by priority, so once we reach something more important than us we're done
+		if(candidate -> priority > config -> priority)
+		{
+			break;
+		}
+		nextEvictionCandidate ++;
+
+		// it may have died or been evicted since we ranked it
+		if(candidate -> particle -> getDead())
+		{
+			continue;
+		}
+
+		victim = candidate -> particle;
+		removeFromActivePool(victim);
+		activeCost -= victim -> getCost();
+		victim -> kill();
+	}
+
+	// the last particle we evicted is free for re-use, as long as we actually made enough room
+	return isSaturated(config -> cost) ? NULL : victim;
 }
 
 void ParticleManager::update(double dt)
 {
-	GLuint currentTexture = 0;
-	Particle **curr = &activeParticles[0];
-	int i = 0;
+	int numChunks = (numInActivePool + PARTICLES_PER_CHUNK - 1) / PARTICLES_PER_CHUNK;
+	int i;
 
-	// clear the texture index dividers
-	textureIndices.clear();
+	// make sure every chunk has somewhere to put its results
+	if((int)chunks.size() < numChunks)
+	{
+		chunks.resize(numChunks);
+	}
+
+	// update all particles, spread across every core
+	chunkDT = dt;
+	ThreadPool::getInstance() -> parallelFor(numChunks, invokeUpdateChunk, this);
+	numUpdates ++;
 
-	// reset the recycle count (how many particles the recycling routine should cover)
+	// take out the particles that just died, so their slots can take the children emitted above
 	numToRecycle = 0;
+	for(i = 0; i < numChunks; i ++)
+	{
+		numToRecycle += chunks[i].numDead;
+	}
+	recycle();
+
+	// if we're close to the budget, rank the particles we'd be willing to give up this frame, then add the children
+	gatherEvictionCandidates();
+	mergeChunkSpawns();
+
+	// the active pool won't change again before rendering, so we can work out the texture groups now
+	buildTextureIndices();
+
+	// GPU particles emitted this frame (including children of the CPU particles above) are spawned and stepped when the
+	// snapshot is rendered; here, they only count the time
+	gpuParticles -> update(dt);
+	analyticParticles -> update(dt);
+}
+
+void ParticleManager::invokeUpdateChunk(void *manager, int chunkIndex)
+{
+	((ParticleManager*)manager) -> updateChunk(chunkIndex);
+}
 
-	// iterate through all particles
-	while(i < numInActivePool)
+void ParticleManager::updateChunk(int chunkIndex)
+{
+	UpdateChunk &chunk = chunks[chunkIndex];
+	int start = chunkIndex * PARTICLES_PER_CHUNK;
+	int end = std::min(start + PARTICLES_PER_CHUNK, numInActivePool);
+	float emissionFraction;
+	vector<ParticleSpawn>::iterator i;
+	int j;
+
+	chunk.rng.seed(numUpdates, chunkIndex);
+	chunk.requests.clear();
+	chunk.spawned.clear();
+	chunk.gpuSpawns.clear();
+	chunk.numDead = 0;
+
+	// update our slice of the pool; this only touches the particles themselves and the chunk's own lists
+	for(j = start; j < end; j ++)
 	{
-		// track texture object used by particle to determine how to divide rendering by texture
-		if(currentTexture != (*curr) -> getTexture())
-        {
-            currentTexture = (*curr) -> getTexture();
-            textureIndices.push_back(i);
-        }
+		activeParticles[j] -> update(chunkDT, chunk.requests);
+		if(activeParticles[j] -> getDead())
+		{
+			chunk.numDead ++;
+		}
+	}
 
-		// update the particle
-		(*curr) -> update(dt);
+	// thin out and configure whatever our particles emitted, using this chunk's own generator
+	for(i = chunk.requests.begin(); i != chunk.requests.end(); ++i)
+	{
+		emissionFraction = getEmissionFraction(i -> config, i -> pos);
+		if(emissionFraction < 1.0 && chunk.rng.nextFloat() >= emissionFraction)
+		{
+			continue;
+		}
 
-		// if this particle is expected to die, increase the recycle count
-		if((*curr) -> getDead())
+		if(i -> config -> gpuSimulated)
 		{
-			numToRecycle ++;
+			chunk.gpuSpawns.push_back(*i);
 		}
+		else
+		{
+			chunk.spawned.push_back(Particle());
+			chunk.spawned.back().configure(i -> config, i -> pos, i -> lifeFactor, chunk.rng);
+		}
+	}
+}
 
-		// advance to next particle
-		curr ++;
-		i ++;
+void ParticleManager::mergeChunkSpawns()
+{
+	int numChunks = (int)chunks.size();
+	vector<Particle>::iterator j;
+	vector<ParticleSpawn>::iterator k;
+	Particle *toAdd;
+	int i;
+
+	// always merge in chunk order, so the outcome under a full budget doesn't depend on which thread finished first
+	for(i = 0; i < numChunks; i ++)
+	{
+		for(j = chunks[i].spawned.begin(); j != chunks[i].spawned.end(); ++j)
+		{
+			// the particle is fully configured already; we just need to find it a home
+			toAdd = acquireParticle(j -> getConfig());
+			if(toAdd)
+			{
+				*toAdd = *j;
+				insertIntoActivePool(toAdd);
+				activeCost += toAdd -> getCost();
+			}
+		}
+
+		for(k = chunks[i].gpuSpawns.begin(); k != chunks[i].gpuSpawns.end(); ++k)
+		{
+			gpuParticles -> add(k -> config, k -> pos, k -> lifeFactor, chunks[i].rng);
+		}
+
+		chunks[i].spawned.clear();
+		chunks[i].gpuSpawns.clear();
+	}
+}
+
+void ParticleManager::buildTextureIndices()
+{
+	GLuint currentTexture = 0;
+	int i;
+
+	// clear the texture index dividers
+	textureIndices.clear();
+
+	// note where each texture group begins (the active pool is sorted by texture)
+	for(i = 0; i < numInActivePool; i ++)
+	{
+		if(currentTexture != activeParticles[i] -> getTexture())
+		{
+			currentTexture = activeParticles[i] -> getTexture();
+			textureIndices.push_back(i);
+		}
 	}
 
 	// add a final texture index divider to indicate the end of the last texture group
@@ -157,6 +497,8 @@ void ParticleManager::recycle()
     {
         if((*curr) -> getDead())
         {
+            activeCost -= (*curr) -> getCost();
+
             // shift memory over dead particle---this places the next particle at our current iterator position
             memmove(&activeParticles[i], &activeParticles[i + 1], sizeof(Particle*) * (numInActivePool - i - 1));
             numInActivePool --;
@@ -169,79 +511,114 @@ void ParticleManager::recycle()
 			i ++;
         }
     }
+
+    numToRecycle = 0;
+
+    // don't let rounding errors accumulate over a long session
+    if(numInActivePool == 0)
+    {
+		activeCost = 0.0;
+    }
 }
 
-void ParticleManager::render(mat4 &projection, mat4 &view, vec3 &cameraRight, vec3 &cameraUp)
+void ParticleManager::snapshot(Snapshot &snapshot)
 {
-	Particle **curr;			// allows easy iteration over particles we want to render
-	float *attribPtr;			// allows easy iteration over the array containing vertex attributes we want to send to GL
+	Particle **curr = activeParticles;		// allows easy iteration over particles we want to render
+	float *attribPtr;						// allows easy iteration over the attributes we'll send to GL
+	int i;
+
+	// the vectors keep their memory from one snapshot to the next, so this only allocates while the pool is growing
+	snapshot.attribs.resize(numInActivePool * 9);
+	attribPtr = snapshot.attribs.empty() ? NULL : &snapshot.attribs[0];
+	for(i = 0; i < numInActivePool; i ++)
+	{
+		// insert particle position and color attributes into the appropriate slots
+		(*curr) -> getPos(attribPtr);
+		attribPtr += 3;
+		(*curr) -> getColor(attribPtr);
+		attribPtr += 4;
+
+		// lastly, insert particle size and rotation
+		(*attribPtr++) = (*curr) -> getSize();
+		(*attribPtr++) = (*curr) -> getAngle();
+
+		// advance to next particle
+		curr ++;
+	}
 
-	int groupStartIndex;		// index into the active pool where the current particle group starts
+	// the active pool is sorted by texture, so the groups carry over as they are
+	snapshot.textureIndices = textureIndices;
+	snapshot.textures.clear();
+	for(i = 0; i < (int)textureIndices.size() - 1; i ++)
+	{
+		snapshot.textures.push_back(activeParticles[textureIndices[i]] -> getTexture());
+	}
+
+	gpuParticles -> snapshot(snapshot.gpu);
+	analyticParticles -> snapshot(snapshot.analytic);
+}
+
+void ParticleManager::render(Snapshot &snapshot, vec3 &cameraRight, vec3 &cameraUp)
+{
+	GLState *gl = GLState::getInstance();
+
+	float *attribPtr;			// the stream memory holding the vertex attributes we send to GL
+	GLintptr groupOffset;		// where the current group's attributes live inside the stream buffer
+
+	int groupStartIndex;		// index into the snapshot where the current particle group starts
 	int groupSize;				// number of particles in our current particle group
 
 	int i;
-	int j;
 
 	// turn on the appropriate blending mode
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl -> enable(GL_BLEND);
+    gl -> blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	// make sure the first texture unit is the one we bind to
-    glActiveTexture(GL_TEXTURE0);
-    glDisable(GL_CULL_FACE);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	// particles face the camera, so we want both sides drawn filled
+    gl -> disable(GL_CULL_FACE);
+    gl -> polygonMode(GL_FILL);
 
 	// set up appropriate rendering options for point sprites
-	glDepthMask(GL_FALSE);
+	gl -> depthMask(false);
 
 	// enable our shader
     shader -> bind();
-    shader -> uniformMatrix4fv("u_ProjectionMatrix", 1, value_ptr(projection));
-    shader -> uniformMatrix4fv("u_ViewMatrix", 1, value_ptr(view));
 	shader -> uniformVec3("u_CameraRight", cameraRight);
 	shader -> uniformVec3("u_CameraUp", cameraUp);
 
 	// bring in our vertex object states
-	glBindVertexArray(vao);
+	gl -> bindVertexArray(vao);
 
-	// render our particles according to texture group (particles have already been sorted by texture group by this time)
-    for(i = 0; i < (int)textureIndices.size() - 1; i ++)
+	// render our particles according to texture group (particles were sorted by texture group before the snapshot)
+    for(i = 0; i < (int)snapshot.textureIndices.size() - 1; i ++)
     {
-		// get the first and last indices of where this particle group appears in our pool of active particles
-		groupStartIndex = textureIndices[i];
-		groupSize = textureIndices[i + 1] - groupStartIndex;
-
-		// iterate through the members of this group and retrieve their state for transmission to the graphics card
-		curr = &activeParticles[groupStartIndex];
-		attribPtr = vertexAttribData;
-		for(j = 0; j < groupSize; j ++)
-		{
-			// insert particle position attribute into appropriate slot in buffer we'll be sending to the graphics card
-			(*curr) -> getPos(attribPtr);
-			attribPtr += 3;
-
-			// insert particle color attribute into appropriate slot in buffer we'll be sending to the graphics card
-			(*curr) -> getColor(attribPtr);
-			attribPtr += 4;
+		// get the first and last indices of where this particle group appears in the snapshot
+		groupStartIndex = snapshot.textureIndices[i];
+		groupSize = snapshot.textureIndices[i + 1] - groupStartIndex;
 
-			// lastly, insert particle size and rotation
-			(*attribPtr++) = (*curr) -> getSize();
-			(*attribPtr++) = (*curr) -> getAngle();
-
-			// advance to next particle
-			curr ++;
+		// the attributes are already laid out the way GL wants them; copy as many as the stream has room for into it
+		groupSize = stream -> clampCount(groupSize, sizeof(GLfloat) * 9, sizeof(GLfloat));
+		if(groupSize == 0)
+		{
+			continue;
 		}
+		attribPtr = (float*)stream -> allocate(sizeof(GLfloat) * groupSize * 9, sizeof(GLfloat), groupOffset);
+		memcpy(attribPtr, &snapshot.attribs[groupStartIndex * 9], sizeof(GLfloat) * groupSize * 9);
 
-		// pass attribs along to graphics card for this texture group; this is more efficient than making separate calls for each attribute
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * groupSize * 9, &vertexAttribData[0]);
+		// no further copy is needed; just point the attributes at this group's slice of the stream
+		stream -> commit();
+		setupAttribs(groupOffset);
 
 		// bind the texture we need and draw the group of particles
-        glBindTexture(GL_TEXTURE_2D, activeParticles[groupStartIndex] -> getTexture());
+        gl -> bindTexture(0, snapshot.textures[i]);
         glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, groupSize);
     }
 
-    glDepthMask(GL_TRUE);
+    // GPU-simulated and analytic particles share the same blending and depth state
+    gpuParticles -> render(snapshot.gpu, cameraRight, cameraUp);
+    analyticParticles -> render(snapshot.analytic, cameraRight, cameraUp);
+
+    gl -> depthMask(true);
 }
 
 void ParticleManager::insertIntoActivePool(Particle *particle)
@@ -281,6 +658,40 @@ void ParticleManager::insertIntoActivePool(Particle *particle)
     numInActivePool ++;
 }
 
+void ParticleManager::removeFromActivePool(Particle *particle)
+{
+	GLuint tex = particle -> getTexture();
+	int start = 0;
+	int end = numInActivePool;
+	int mid;
+	int i;
+
+	// binary search for the first particle using the same texture, since the pool is sorted by texture...
+	while(start < end)
+	{
+		mid = start + (end - start) / 2;
+		if(activeParticles[mid] -> getTexture() < tex)
+		{
+			start = mid + 1;
+		}
+		else
+		{
+			end = mid;
+		}
+	}
+
+	// ...then scan that texture group for the particle itself
+	for(i = start; i < numInActivePool && activeParticles[i] -> getTexture() == tex; i ++)
+	{
+		if(activeParticles[i] == particle)
+		{
+			memmove(&activeParticles[i], &activeParticles[i + 1], sizeof(Particle*) * (numInActivePool - i - 1));
+			numInActivePool --;
+			return;
+		}
+	}
+}
+
 Particle *ParticleManager::getFreeParticle()
 {
 	int i = freeParticleIndex;
@@ -3,16 +3,58 @@
 #include "GL/glew.h"
 #include "glm/glm.hpp"
 
+#include "particles/particle.h"
+#include "particles/gpuparticlesystem.h"
+#include "particles/analyticparticlesystem.h"
+
+#include "util/random.h"
+
+#include <stdint.h>
 #include <vector>
 
 class ParticleConfig;
-class Particle;
 class Shader;
+class StreamBuffer;
 
 class ParticleManager
 {
+public:
+	// everything needed to draw this frame's particles, copied out at the end of an update
+	struct Snapshot
+	{
+		std::vector<float> attribs;							// vertex attributes of every CPU particle, in stream layout and texture order
+		std::vector<int> textureIndices;					// where each texture group begins in there, plus where the last one ends
+		std::vector<GLuint> textures;						// the texture each group is drawn with
+		GPUParticleSystem::Snapshot gpu;
+		AnalyticParticleSystem::Snapshot analytic;
+	};
+
 private:
+	// a particle we may evict when the budget is exhausted, ranked by priority first and then by distance and age
+	struct EvictionCandidate
+	{
+		Particle *particle;
+		int priority;
+		float score;										// larger means farther away and/or older, i.e. a better victim
+
+		bool operator<(const EvictionCandidate &other) const;
+	};
+
+	// a contiguous slice of the active pool, updated by one thread; everything it produces stays local until the merge
+	struct UpdateChunk
+	{
+		Random rng;											// re-seeded from (update count, chunk index) so results never depend on scheduling
+		std::vector<ParticleSpawn> requests;				// children emitted by this chunk's particles
+		std::vector<Particle> spawned;						// ...those that go on the CPU, already configured
+		std::vector<ParticleSpawn> gpuSpawns;				// ...and those handed to the GPU system during the merge
+		int numDead;										// particles in this chunk that died during the update
+	};
+
+	static const int PARTICLES_PER_CHUNK;					// granularity of the parallel update
+
 	int maxParticles;										// number of active particles we allow at one time
+	float maxCost;											// total rendering cost we allow at one time (see ParticleConfig::cost)
+	float activeCost;										// rendering cost of all particles currently in the active pool
 	int freeParticleIndex;									// decent guess as to where the next unused particle is located in our pool
 
 	int numInActivePool;									// how many particles are active in our active particle list
@@ -21,36 +63,78 @@ private:
 	Shader *shader;											// shader program used when rendering particles
 
 	GLuint vao;												// vertex array that encapsulates vertex buffer states
-	GLuint vbo;												// vertex buffer object
+	StreamBuffer *stream;									// per-frame vertex attributes, written directly by render()
+
+	Random rng;												// used for everything added from outside update()
+	uint64_t numUpdates;									// seeds each chunk's generator
+
+	std::vector<UpdateChunk> chunks;						// per-chunk results of the last parallel update
+	double chunkDT;											// time step handed to the chunk tasks
 
 	Particle *particlePool;									// we allocate a large pool of particles and draw from it/replace as necessary
 	Particle **activeParticles;								// only contains the particles that are currently active
 	std::vector<int> textureIndices;						// where each texture index begins inside the sorted (by texture) list of active particles
-	std::vector<ParticleConfig*> buffered;					// particles waiting to be inserted into the active particle list
 
-	float *vertexAttribData;								// where we store the vertex attributes for each particle texture group
+	GPUParticleSystem *gpuParticles;						// handles every ParticleConfig flagged as gpuSimulated
+	AnalyticParticleSystem *analyticParticles;				// handles every ParticleConfig flagged as analytic
+
+	glm::vec3 viewerPos;									// where the camera is, for emission LOD and eviction
+	float projectionScale;									// pixels covered by a 1m object at 1m distance
+
+	std::vector<EvictionCandidate> evictionCandidates;		// best victims, rebuilt each update() while the pool is nearly saturated
+	int nextEvictionCandidate;								// next entry of evictionCandidates to try
 
 	// load resources
 	void setupVBOs();
+	void setupAttribs(GLintptr offset);						// point the bound VAO's attributes at a texture group inside the stream
 	void loadShader();
 
 	// some misc. methods for efficiently handling our particles
 	void insertIntoActivePool(Particle *particle);
+	void removeFromActivePool(Particle *particle);
 	Particle *getFreeParticle();
+	Particle *acquireParticle(ParticleConfig *config);		// a free particle if the budget allows, else an evicted one, else NULL
+
+	// parallel update; each task covers PARTICLES_PER_CHUNK particles of the active pool
+	static void invokeUpdateChunk(void *manager, int chunkIndex);
+	void updateChunk(int chunkIndex);
+	void mergeChunkSpawns();
+	void buildTextureIndices();
+
+	// budget control
+	float getEmissionFraction(ParticleConfig *config, glm::vec3 pos);		// 0..1, how much of an emission we keep at this distance
+	float getVisualSize(ParticleConfig *config);							// largest size a config (or its children) is drawn at
+	bool isSaturated(float cost);											// would adding something of this cost exceed the budget?
+	void gatherEvictionCandidates();
+	Particle *evictFor(ParticleConfig *config);								// make room for the given config, if priorities allow it
 
 public:
-	ParticleManager(int maxParticles);
+	ParticleManager(int maxParticles, int maxBurstsPerConfig);
 	~ParticleManager();
 
-	// insert a particle at the given position, with a life factor varying from 0 to 1 (useful for particles emitting children particles)
+	// set the uniforms that never change, in every particle system's programs, once World has linked them all
+	void finishShaders();
+
+	// size the GPU pool of a GPU-simulated config's texture to fit its gpuBudget; call for each of them before adding any
+	void reserveGPUParticles(ParticleConfig *config);
+
+	// insert a particle at the given position, with a life factor varying from 0 to 1 (useful for particles emitting children particles);
+	// distant emissions are thinned out, and a saturated pool evicts lower-priority particles to make room
 	void add(ParticleConfig *particle, glm::vec3 pos, float lifeFactor);
 
-	void insertBuffered();				// required to update the system with particles inserted via add()
-	void update(double dt);				// updates all active particles in the system
-	void recycle();						// removes dead particles from active service
+	// insert count particles of the same config at once; analytic configs store this as a single burst record
+	void addBurst(ParticleConfig *particle, glm::vec3 pos, int count, float lifeFactor);
+
+	// camera information used for emission LOD; projectionScale is projection[1][1] * viewport height / 2
+	void setViewerPos(glm::vec3 pos);
+	void setProjectionScale(float projectionScale);
+
+	void update(double dt);				// updates all active particles in the system, in parallel, then adds any children they emitted
+	void recycle();						// removes dead particles from active service (update() also does this itself)
+	void snapshot(Snapshot &snapshot);	// copies out what render() needs, so the next update can go ahead while it draws
 
-	// batch render our particles by texture object
-	void render(glm::mat4 &projection, glm::mat4 &view, glm::vec3 &cameraRight, glm::vec3 &cameraUp);
+	// batch render the particles in the snapshot by texture object
+	void render(Snapshot &snapshot, glm::vec3 &cameraRight, glm::vec3 &cameraUp);
 
 	// how many particles are currently active?
 	int getNumActiveParticles();
@@ -0,0 +1,238 @@
+// sndcook: offline sound cooker. Turns each 16-bit PCM WAV named on the command line into a 4-bit IMA ADPCM WAV beside
+// it (see getCookedSoundName()), a quarter of the size, which SoundManager then plays instead: handed to OpenAL still
+// compressed where the driver takes it (AL_EXT_IMA4), and decoded when it's loaded otherwise.
+//
+// ADPCM is lossy, so the PCM files stay the masters and the cooked ones are never checked in; every file is decoded
+// again and compared with its master, and one that comes back with less than MIN_SNR dB signal-to-noise ratio (broad,
+// noisy sounds such as gunshots do badly at 4 bits) gets no cooked version at all, so the game keeps playing the PCM.
+// Blocks are 1024 bytes per channel. Files whose cooked version is already newer than the master are skipped unless
+// -f is given
+//
+//	usage: sndcook [-f] file.wav...
+
+#include "audio/imaadpcm.h"
+
+#include "sys/stat.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+static const int16_t WAVE_FORMAT_PCM = 0x0001;
+static const int16_t WAVE_FORMAT_IMA_ADPCM = 0x0011;
+static const int BLOCK_BYTES_PER_CHANNEL = 1024;
+static const double MIN_SNR = 25.0;					// dB
+
+// what we need to know about a master
+struct Sound
+{
+	int numChannels;
+	int frequency;
+	vector<int16_t> samples;			// interleaved
+	int numFrames;
+};
+
+// is the file older than its cooked version (which means there's nothing to do)?
+static bool isUpToDate(const string &wavFilename, const string &cookedFilename)
+{
+	struct stat wavInfo;
+	struct stat cookedInfo;
+
+	return stat(wavFilename.c_str(), &wavInfo) == 0 && stat(cookedFilename.c_str(), &cookedInfo) == 0 && cookedInfo.st_mtime >= wavInfo.st_mtime;
+}
+
+static void writeTag(ofstream &file, const char *tag)
+{
+	file.write(tag, 4);
+}
+
+static void write32(ofstream &file, int32_t value)
+{
+	file.write((const char*)&value, sizeof(value));
+}
+
+static void write16(ofstream &file, int16_t value)
+{
+	file.write((const char*)&value, sizeof(value));
+}
+
+// read a 16-bit PCM WAV, mono or stereo, skipping any chunks we don't need; false if it's anything else
+static bool loadPCM(const string &filename, Sound &sound)
+{
+	ifstream file(filename.c_str(), ifstream::binary);
+	char tag[4];
+	int32_t size;
+	int16_t audioFormat = 0;
+	int16_t numChannels = 0;
+	int32_t frequency = 0;
+	int16_t bitsPerSample = 0;
+	bool haveFormat = false;
+
+	file.read(tag, 4);
+	file.read((char*)&size, sizeof(size));
+	if(!file || strncmp(tag, "RIFF", 4) != 0 || !file.read(tag, 4) || strncmp(tag, "WAVE", 4) != 0)
+	{
+		cerr << "sndcook did not detect the RIFF/WAVE header combination in " << filename << endl;
+		return false;
+	}
+
+	while(file.read(tag, 4) && file.read((char*)&size, sizeof(size)))
+	{
+		if(strncmp(tag, "fmt ", 4) == 0)
+		{
+			file.read((char*)&audioFormat, sizeof(audioFormat));
+			file.read((char*)&numChannels, sizeof(numChannels));
+			file.read((char*)&frequency, sizeof(frequency));
+			file.seekg(6, ios_base::cur);					// byte rate and block align follow from the rest
+			file.read((char*)&bitsPerSample, sizeof(bitsPerSample));
+			file.seekg(size - 16 + (size & 1), ios_base::cur);
+			haveFormat = true;
+		}
+		else if(strncmp(tag, "data", 4) == 0)
+		{
+			if(!haveFormat || audioFormat != WAVE_FORMAT_PCM || bitsPerSample != 16 || numChannels < 1 || numChannels > 2)
+			{
+				cerr << "sndcook can only cook 16-bit PCM WAVs with one or two channels, which " << filename << " is not" << endl;
+				return false;
+			}
+
+			sound.numChannels = numChannels;
+			sound.frequency = frequency;
+			sound.numFrames = size / (2 * numChannels);
+			sound.samples.resize(sound.numFrames * numChannels);
+			if(!file.read((char*)&sound.samples[0], sound.samples.size() * sizeof(int16_t)))
+			{
+				cerr << "sndcook could not read the samples in " << filename << endl;
+				return false;
+			}
+			return sound.numFrames > 0;
+		}
+		else
+		{
+			file.seekg(size + (size & 1), ios_base::cur);
+		}
+	}
+
+	cerr << "sndcook found no wave data in " << filename << endl;
+	return false;
+}
+
+// write blocks of ADPCM as a WAV file, with the fact chunk compressed formats are supposed to have
+static bool saveADPCM(const string &filename, const Sound &sound, const vector<unsigned char> &blocks, int blockAlign)
+{
+	const int samplesPerBlock = getIMASamplesPerBlock(blockAlign, sound.numChannels);
+	const int32_t FMT_SIZE = 20;			// the usual 16, then the extra size (2) and the samples per block
+	const int32_t FACT_SIZE = 4;
+
+	ofstream file(filename.c_str(), ofstream::binary);
+
+	writeTag(file, "RIFF");
+	write32(file, 4 + (8 + FMT_SIZE) + (8 + FACT_SIZE) + (8 + blocks.size()));
+	writeTag(file, "WAVE");
+
+	writeTag(file, "fmt ");
+	write32(file, FMT_SIZE);
+	write16(file, WAVE_FORMAT_IMA_ADPCM);
+	write16(file, sound.numChannels);
+	write32(file, sound.frequency);
+	write32(file, (int32_t)((int64_t)sound.frequency * blockAlign / samplesPerBlock));
+	write16(file, blockAlign);
+	write16(file, 4);
+	write16(file, 2);
+	write16(file, samplesPerBlock);
+
+	writeTag(file, "fact");
+	write32(file, FACT_SIZE);
+	write32(file, sound.numFrames);
+
+	writeTag(file, "data");
+	write32(file, blocks.size());
+	file.write((const char*)&blocks[0], blocks.size());
+
+	return (bool)file;
+}
+
+static bool cook(const string &wavFilename, const string &cookedFilename)
+{
+	Sound sound;
+	vector<unsigned char> blocks;
+	vector<int16_t> decoded;
+	int blockAlign;
+	double signal = 0.0;
+	double noise = 0.0;
+	double difference;
+	double snr;
+	size_t i;
+
+	if(!loadPCM(wavFilename, sound))
+	{
+		return false;
+	}
+
+	blockAlign = BLOCK_BYTES_PER_CHANNEL * sound.numChannels;
+	blocks.resize(getIMANumBlocks(sound.numFrames, blockAlign, sound.numChannels) * blockAlign);
+	encodeIMA(&sound.samples[0], sound.numFrames, blockAlign, sound.numChannels, &blocks[0]);
+
+	// decode it the way the game will, and see how far it strays from the master
+	decoded.resize(blocks.size() / blockAlign * getIMASamplesPerBlock(blockAlign, sound.numChannels) * sound.numChannels);
+	decodeIMA(&blocks[0], blocks.size(), blockAlign, sound.numChannels, getIMASamplesPerBlock(blockAlign, sound.numChannels), &decoded[0]);
+	for(i = 0; i < sound.samples.size(); i ++)
+	{
+		difference = (double)decoded[i] - sound.samples[i];
+		signal += (double)sound.samples[i] * sound.samples[i];
+		noise += difference * difference;
+	}
+	snr = noise > 0.0 ? 10.0 * log10(signal / noise) : INFINITY;
+
+	// too lossy; an old cooked version mustn't stay behind either, or the game would go on playing it
+	if(snr < MIN_SNR)
+	{
+		remove(cookedFilename.c_str());
+		cout << "-- kept " << wavFilename << " as PCM (IMA ADPCM would only reach " << snr << " dB SNR)" << endl;
+		return true;
+	}
+
+	if(!saveADPCM(cookedFilename, sound, blocks, blockAlign))
+	{
+		cerr << "sndcook could not write " << cookedFilename << endl;
+		return false;
+	}
+
+	cout << "-- cooked " << wavFilename << " (" << sound.samples.size() * sizeof(int16_t) / 1024 << " KB as PCM -> "
+		 << blocks.size() / 1024 << " KB as IMA ADPCM, " << snr << " dB SNR)" << endl;
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	bool force = false;
+	bool ok = true;
+	string cookedFilename;
+	int i;
+
+	for(i = 1; i < argc; i ++)
+	{
+		if(strcmp(argv[i], "-f") == 0)
+		{
+			force = true;
+			continue;
+		}
+
+		cookedFilename = getCookedSoundName(argv[i]);
+		if(!force && isUpToDate(argv[i], cookedFilename))
+		{
+			continue;
+		}
+
+		ok = cook(argv[i], cookedFilename) && ok;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,442 @@
+// texcook: offline texture cooker. Turns each PNG named on the command line into a KTX file beside it (see getCookedName())
+// holding a block-compressed image with its whole mip chain already built, which TextureLoader then uploads as it is:
+//
+//	normal maps ("*normal-map*")	BC5 (two channels, the shaders only read x and y)
+//	anything with transparency		BC3
+//	everything else					BC1
+//
+// Mips are filtered here rather than by glGenerateMipmap(): colours are averaged in linear light (weighted by alpha, so
+// cut-outs don't pick up dark fringes) and normals are averaged as vectors and renormalised. Files whose KTX is already
+// newer than the PNG are skipped unless -f is given
+//
+//	usage: texcook [-f] file.png...
+
+#include "util/ktx.h"
+
+#include "lodepng/lodepng.h"
+
+#include "GL/glew.h"
+
+#include "glm/glm.hpp"
+using namespace glm;
+
+#include "sys/stat.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+// one mip level, in the space we filter in: linear colour and alpha, or a unit normal in xyz
+struct Level
+{
+	unsigned int width;
+	unsigned int height;
+	vector<vec4> texels;				// bottom row first
+};
+
+static float srgbToLinear(float value)
+{
+	return value <= 0.04045f ? value / 12.92f : pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float value)
+{
+	return value <= 0.0031308f ? value * 12.92f : 1.055f * pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+static unsigned char toByte(float value)
+{
+	return (unsigned char)(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// is the file older than its cooked version (which means there's nothing to do)?
+static bool isUpToDate(const string &pngFilename, const string &ktxFilename)
+{
+	struct stat pngInfo;
+	struct stat ktxInfo;
+
+	return stat(pngFilename.c_str(), &pngInfo) == 0 && stat(ktxFilename.c_str(), &ktxInfo) == 0 && ktxInfo.st_mtime >= pngInfo.st_mtime;
+}
+
+// halve the last level in the chain until we get to 1x1
+static void buildMipChain(vector<Level> &levels, bool normalMap)
+{
+	unsigned int x, y;
+	unsigned int x0, x1, y0, y1;
+	vec4 sum;
+	vec3 colour;
+	float alpha;
+	int i;
+
+	while(levels.back().width > 1 || levels.back().height > 1)
+	{
+		Level &src = levels.back();
+		Level dst;
+
+		dst.width = std::max(src.width / 2, 1u);
+		dst.height = std::max(src.height / 2, 1u);
+		dst.texels.resize(dst.width * dst.height);
+
+		for(y = 0; y < dst.height; y ++)
+		{
+			for(x = 0; x < dst.width; x ++)
+			{
+				// a 2x2 box; on odd sizes the last row or column just gets counted twice
+				x0 = std::min(x * 2, src.width - 1);
+				x1 = std::min(x * 2 + 1, src.width - 1);
+				y0 = std::min(y * 2, src.height - 1);
+				y1 = std::min(y * 2 + 1, src.height - 1);
+				vec4 box[4] = {src.texels[y0 * src.width + x0], src.texels[y0 * src.width + x1],
+							   src.texels[y1 * src.width + x0], src.texels[y1 * src.width + x1]};
+
+				sum = vec4(0.0);
+				colour = vec3(0.0);
+				alpha = 0.0;
+				for(i = 0; i < 4; i ++)
+				{
+					sum += box[i];
+					colour += vec3(box[i]) * box[i].a;
+					alpha += box[i].a;
+				}
+
+				if(normalMap)
+				{
+					dst.texels[y * dst.width + x] = vec4(length(vec3(sum)) > 0.0f ? normalize(vec3(sum)) : vec3(0.0, 0.0, 1.0), sum.a / 4.0f);
+				}
+				else
+				{
+					dst.texels[y * dst.width + x] = vec4(alpha > 0.0f ? colour / alpha : vec3(sum) / 4.0f, alpha / 4.0f);
+				}
+			}
+		}
+
+		levels.push_back(dst);
+	}
+}
+
+static uint16_t packRGB565(vec3 colour)
+{
+	return (uint16_t)(((int)(colour.r * 31.0f / 255.0f + 0.5f) << 11) | ((int)(colour.g * 63.0f / 255.0f + 0.5f) << 5) | (int)(colour.b * 31.0f / 255.0f + 0.5f));
+}
+
+static vec3 unpackRGB565(uint16_t packed)
+{
+	int r = (packed >> 11) & 31;
+	int g = (packed >> 5) & 63;
+	int b = packed & 31;
+
+	return vec3((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+// BC1 colour block from 16 RGBA texels: endpoints at the extremes of the principal axis, then the nearest of the four
+// palette entries for each texel; always the four-colour mode, which is also all BC3 understands
+static void encodeColourBlock(const unsigned char *rgba, unsigned char *out)
+{
+	const int NUM_POWER_ITERATIONS = 8;
+
+	vec3 colours[16];
+	vec3 mean(0.0);
+	mat3 covariance(0.0);
+	vec3 axis(1.0, 1.0, 1.0);
+	vec3 diff;
+	vec3 minColour, maxColour;
+	float minProj, maxProj, proj;
+	vec3 palette[4];
+	uint16_t endpoints[2];
+	uint32_t indices = 0;
+	float bestDist, dist;
+	int best;
+	int i, j;
+
+	for(i = 0; i < 16; i ++)
+	{
+		colours[i] = vec3(rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2]);
+		mean += colours[i];
+	}
+	mean /= 16.0f;
+
+	// the direction the colours spread out along the most
+	for(i = 0; i < 16; i ++)
+	{
+		diff = colours[i] - mean;
+		covariance += outerProduct(diff, diff);
+	}
+	for(i = 0; i < NUM_POWER_ITERATIONS; i ++)
+	{
+		axis = covariance * axis;
+		if(length(axis) < 1e-6f)
+		{
+			axis = vec3(1.0, 1.0, 1.0);
+			break;
+		}
+		axis = normalize(axis);
+	}
+
+	minProj = maxProj = dot(colours[0] - mean, axis);
+	minColour = maxColour = colours[0];
+	for(i = 1; i < 16; i ++)
+	{
+		proj = dot(colours[i] - mean, axis);
+		if(proj < minProj)
+		{
+			minProj = proj;
+			minColour = colours[i];
+		}
+		if(proj > maxProj)
+		{
+			maxProj = proj;
+			maxColour = colours[i];
+		}
+	}
+
+	// four-colour mode needs the first endpoint to be the larger
+	endpoints[0] = packRGB565(maxColour);
+	endpoints[1] = packRGB565(minColour);
+	if(endpoints[0] < endpoints[1])
+	{
+		std::swap(endpoints[0], endpoints[1]);
+	}
+
+	if(endpoints[0] != endpoints[1])
+	{
+		palette[0] = unpackRGB565(endpoints[0]);
+		palette[1] = unpackRGB565(endpoints[1]);
+		palette[2] = (palette[0] * 2.0f + palette[1]) / 3.0f;
+		palette[3] = (palette[0] + palette[1] * 2.0f) / 3.0f;
+
+		for(i = 0; i < 16; i ++)
+		{
+			best = 0;
+			bestDist = 1e30f;
+			for(j = 0; j < 4; j ++)
+			{
+				diff = colours[i] - palette[j];
+				dist = dot(diff, diff);
+				if(dist < bestDist)
+				{
+					bestDist = dist;
+					best = j;
+				}
+			}
+			indices |= (uint32_t)best << (i * 2);
+		}
+	}
+
+	out[0] = endpoints[0] & 0xff;
+	out[1] = endpoints[0] >> 8;
+	out[2] = endpoints[1] & 0xff;
+	out[3] = endpoints[1] >> 8;
+	for(i = 0; i < 4; i ++)
+	{
+		out[4 + i] = (indices >> (i * 8)) & 0xff;
+	}
+}
+
+// BC4 block (one channel, used for BC3 alpha and both halves of BC5) from 16 values; endpoints are the min and max,
+// in the eight-value mode
+static void encodeValueBlock(const unsigned char *values, int stride, unsigned char *out)
+{
+	unsigned char minValue = 255;
+	unsigned char maxValue = 0;
+	uint64_t indices = 0;
+	int step;
+	int index;
+	int i;
+
+	for(i = 0; i < 16; i ++)
+	{
+		minValue = std::min(minValue, values[i * stride]);
+		maxValue = std::max(maxValue, values[i * stride]);
+	}
+
+	if(maxValue > minValue)
+	{
+		for(i = 0; i < 16; i ++)
+		{
+			// step 0 is the min and step 7 the max; indices 0 and 1 are the endpoints, 2 to 7 run from max to min
+			step = (int)((values[i * stride] - minValue) * 7.0f / (maxValue - minValue) + 0.5f);
+			index = (step == 7) ? 0 : (step == 0) ? 1 : 8 - step;
+			indices |= (uint64_t)index << (i * 3);
+		}
+	}
+
+	out[0] = maxValue;
+	out[1] = minValue;
+	for(i = 0; i < 6; i ++)
+	{
+		out[2 + i] = (indices >> (i * 8)) & 0xff;
+	}
+}
+
+// compress one level into image, in the given format
+static void encodeLevel(const Level &level, GLenum format, bool normalMap, KTXImage &image)
+{
+	unsigned int blocksWide = (level.width + 3) / 4;
+	unsigned int blocksHigh = (level.height + 3) / 4;
+	size_t blockSize = (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16;
+	unsigned char block[64];
+	unsigned char *out;
+	unsigned int bx, by;
+	unsigned int x, y;
+	vec4 texel;
+	int i;
+
+	image.levelOffsets.push_back(image.data.size());
+	image.levelSizes.push_back(blocksWide * blocksHigh * blockSize);
+	image.data.resize(image.data.size() + image.levelSizes.back());
+	out = &image.data[image.levelOffsets.back()];
+
+	for(by = 0; by < blocksHigh; by ++)
+	{
+		for(bx = 0; bx < blocksWide; bx ++)
+		{
+			// gather the block back into bytes; blocks hanging off the edge repeat the last row and column
+			for(i = 0; i < 16; i ++)
+			{
+				x = std::min(bx * 4 + (i % 4), level.width - 1);
+				y = std::min(by * 4 + (i / 4), level.height - 1);
+				texel = level.texels[y * level.width + x];
+
+				if(normalMap)
+				{
+					texel = vec4(vec3(texel) * 0.5f + 0.5f, texel.a);
+				}
+				else
+				{
+					texel = vec4(linearToSrgb(texel.r), linearToSrgb(texel.g), linearToSrgb(texel.b), texel.a);
+				}
+
+				block[i * 4] = toByte(texel.r);
+				block[i * 4 + 1] = toByte(texel.g);
+				block[i * 4 + 2] = toByte(texel.b);
+				block[i * 4 + 3] = toByte(texel.a);
+			}
+
+			if(format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+			{
+				encodeColourBlock(block, out);
+			}
+			else if(format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+			{
+				encodeValueBlock(&block[3], 4, out);
+				encodeColourBlock(block, out + 8);
+			}
+			else
+			{
+				encodeValueBlock(&block[0], 4, out);
+				encodeValueBlock(&block[1], 4, out + 8);
+			}
+			out += blockSize;
+		}
+	}
+}
+
+static bool cook(const string &pngFilename, const string &ktxFilename)
+{
+	unsigned char *pixels;
+	unsigned int width, height;
+	unsigned int x, y;
+	const unsigned char *pixel;
+	bool normalMap = pngFilename.find("normal-map") != string::npos;
+	bool translucent = false;
+	vector<Level> levels(1);
+	KTXImage image;
+	unsigned int i;
+
+	if(lodepng_decode32_file(&pixels, &width, &height, pngFilename.c_str()) != 0)
+	{
+		cerr << "texcook could not load " << pngFilename << endl;
+		free(pixels);
+		return false;
+	}
+
+	// PNGs store the top row first and GL wants the bottom one, so flip as we go
+	levels[0].width = width;
+	levels[0].height = height;
+	levels[0].texels.resize(width * height);
+	for(y = 0; y < height; y ++)
+	{
+		for(x = 0; x < width; x ++)
+		{
+			pixel = &pixels[((height - y - 1) * width + x) * 4];
+			if(normalMap)
+			{
+				levels[0].texels[y * width + x] = vec4(vec3(pixel[0], pixel[1], pixel[2]) / 255.0f * 2.0f - 1.0f, pixel[3] / 255.0f);
+			}
+			else
+			{
+				levels[0].texels[y * width + x] = vec4(srgbToLinear(pixel[0] / 255.0f), srgbToLinear(pixel[1] / 255.0f), srgbToLinear(pixel[2] / 255.0f), pixel[3] / 255.0f);
+			}
+			translucent = translucent || pixel[3] < 255;
+		}
+	}
+	free(pixels);
+
+	buildMipChain(levels, normalMap);
+
+	if(normalMap)
+	{
+		image.internalFormat = GL_COMPRESSED_RG_RGTC2;
+		image.baseInternalFormat = GL_RG;
+	}
+	else if(translucent)
+	{
+		image.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		image.baseInternalFormat = GL_RGBA;
+	}
+	else
+	{
+		image.internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		image.baseInternalFormat = GL_RGB;
+	}
+	image.width = width;
+	image.height = height;
+
+	for(i = 0; i < levels.size(); i ++)
+	{
+		encodeLevel(levels[i], image.internalFormat, normalMap, image);
+	}
+
+	if(!saveKTX(ktxFilename, image))
+	{
+		cerr << "texcook could not write " << ktxFilename << endl;
+		return false;
+	}
+
+	cout << "-- cooked " << pngFilename << " (" << (normalMap ? "BC5" : translucent ? "BC3" : "BC1") << ", " << levels.size() << " levels, "
+		 << width * height * 4 / 1024 << " KB as RGBA8 -> " << image.data.size() / 1024 << " KB with mips)" << endl;
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	bool force = false;
+	bool ok = true;
+	string ktxFilename;
+	int i;
+
+	for(i = 1; i < argc; i ++)
+	{
+		if(strcmp(argv[i], "-f") == 0)
+		{
+			force = true;
+			continue;
+		}
+
+		ktxFilename = getCookedName(argv[i]);
+		if(!force && isUpToDate(argv[i], ktxFilename))
+		{
+			continue;
+		}
+
+		ok = cook(argv[i], ktxFilename) && ok;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+#include "util/dynamicresolution.h"
+
+#include "GL/glew.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+using namespace std;
+
+const float DynamicResolution::TARGET_TIME = 0.012;			// most of a 60Hz frame, leaving room for the HUD and upscale
+const float DynamicResolution::RAISE_THRESHOLD = 0.8;
+const float DynamicResolution::TIME_ALPHA = 0.75;
+const float DynamicResolution::MIN_SCALE = 0.5;				// a quarter of the pixels
+const float DynamicResolution::MAX_STEP = 0.1;
+
+DynamicResolution::DynamicResolution(int windowWidth, int windowHeight)
+{
+	int i;
+
+	this -> windowWidth = windowWidth;
+	this -> windowHeight = windowHeight;
+	width = windowWidth;
+	height = windowHeight;
+	scale = 1.0;
+	output = 0;
+
+	// the target is as big as the window; a smaller scene just uses its bottom-left corner
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, windowWidth, windowHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, windowWidth, windowHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		cerr << "DynamicResolution::DynamicResolution() could not create a " << windowWidth << "x" << windowHeight << " scene target" << endl;
+		exit(1);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenQueries(NUM_QUERIES, queries);
+	for(i = 0; i < NUM_QUERIES; i ++)
+	{
+		queryIssued[i] = false;
+	}
+	currentQuery = 0;
+
+	sceneTime = 0.0;
+	cooldown = 0;
+	locked = false;
+}
+
+DynamicResolution::~DynamicResolution()
+{
+	glDeleteQueries(NUM_QUERIES, queries);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(2, renderbuffers);
+}
+
+void DynamicResolution::beginScene()
+{
+	GLint available;
+	GLuint64 elapsed;
+
+	// this query was last used NUM_QUERIES frames ago, which is almost always long enough for its result to be in; if
+	// it isn't, we'd rather go without that one than wait for it
+	if(queryIssued[currentQuery])
+	{
+		glGetQueryObjectiv(queries[currentQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+		if(available)
+		{
+			glGetQueryObjectui64v(queries[currentQuery], GL_QUERY_RESULT, &elapsed);
+			addSceneTime(elapsed / 1.0e9);
+		}
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+
+	// only clear what we're going to use; at a low scale, clearing the rest would cost a good part of what we saved
+	glScissor(0, 0, width, height);
+	glEnable(GL_SCISSOR_TEST);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+
+	glBeginQuery(GL_TIME_ELAPSED, queries[currentQuery]);
+}
+
+void DynamicResolution::endScene()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	queryIssued[currentQuery] = true;
+	currentQuery = (currentQuery + 1) % NUM_QUERIES;
+
+	// stretch the scene over the whole window
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, output);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, output);
+	glViewport(0, 0, windowWidth, windowHeight);
+}
+
+void DynamicResolution::addSceneTime(float time)
+{
+	float newScale;
+
+	if(sceneTime == 0.0)
+	{
+		sceneTime = time;
+	}
+	else
+	{
+		sceneTime = (sceneTime * TIME_ALPHA) + (time * (1.0 - TIME_ALPHA));
+	}
+
+	if(locked)
+	{
+		return;
+	}
+
+	// results from before the last change say nothing about the current size
+	if(cooldown > 0)
+	{
+		cooldown --;
+		return;
+	}
+
+	// inside the band between the raise threshold and the target, leave things be
+	if(sceneTime <= TARGET_TIME && (sceneTime >= TARGET_TIME * RAISE_THRESHOLD || scale >= 1.0))
+	{
+		return;
+	}
+
+	// the scene is fill-bound, so its time goes with the number of pixels, the square of the scale; aim for the middle
+	// of the band, so the next correction isn't due straight away
+	newScale = scale * sqrt(TARGET_TIME * (1.0 + RAISE_THRESHOLD) * 0.5 / sceneTime);
+	newScale = std::max(newScale, scale - MAX_STEP);
+	newScale = std::min(newScale, scale + MAX_STEP);
+	newScale = std::max(std::min(newScale, 1.0f), MIN_SCALE);
+
+	if(newScale != scale)
+	{
+		// until results at the new size come in, assume the time scales like the pixel count does
+		sceneTime *= (newScale * newScale) / (scale * scale);
+		scale = newScale;
+		width = std::max((int)(windowWidth * scale), 1);
+		height = std::max((int)(windowHeight * scale), 1);
+		cooldown = NUM_QUERIES;
+	}
+}
+
+void DynamicResolution::setOutput(GLuint output)
+{
+	this -> output = output;
+}
+
+void DynamicResolution::lockScale(float scale)
+{
+	this -> scale = scale;
+	width = std::max((int)(windowWidth * scale), 1);
+	height = std::max((int)(windowHeight * scale), 1);
+	locked = true;
+}
+
+int DynamicResolution::getWidth()
+{
+	return width;
+}
+
+int DynamicResolution::getHeight()
+{
+	return height;
+}
+
+float DynamicResolution::getScale()
+{
+	return scale;
+}
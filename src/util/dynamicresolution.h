@@ -0,0 +1,67 @@
+#pragma once
+
+#include "GL/glew.h"
+
+// dynamic resolution for the 3D scene: everything between beginScene() and endScene() is drawn into an offscreen
+// target whose size follows how long the GPU took to draw the last few scenes, then stretched over the whole window;
+// anything drawn after endScene() (the HUD) goes straight to the window at full resolution. The "window" can be swapped
+// for a framebuffer of the same size (see setOutput()).
+//
+// Scene times come from GL_TIME_ELAPSED queries, a few frames old so that reading them never stalls. The scale only
+// drops when the smoothed time goes over the target, and only climbs back up once it is comfortably under it, so it
+// doesn't flicker between two sizes around the target.
+class DynamicResolution
+{
+private:
+	static const int NUM_QUERIES = 4;				// timer queries in flight; results are this many frames late at most
+
+	static const float TARGET_TIME;					// GPU time (sec.) we want the scene to take
+	static const float RAISE_THRESHOLD;				// fraction of the target time the scene must be under to scale up
+	static const float TIME_ALPHA;					// weight of the previous smoothed time when a new one comes in
+	static const float MIN_SCALE;					// smallest fraction of the window size we'll render at
+	static const float MAX_STEP;					// largest change to the scale in one go
+
+	int windowWidth;								// size of the backbuffer, and of the offscreen target
+	int windowHeight;
+	int width;										// part of the offscreen target the scene is currently drawn into
+	int height;
+	float scale;									// width and height as a fraction of the window's
+
+	GLuint framebuffer;								// offscreen target; allocated at full size so changing scale is free
+	GLuint output;									// where the scene ends up; 0 for the window
+	GLuint renderbuffers[2];						// colour, depth
+
+	GLuint queries[NUM_QUERIES];					// ring of GL_TIME_ELAPSED queries, one per frame
+	bool queryIssued[NUM_QUERIES];					// whether each query has a result coming
+	int currentQuery;								// the one this frame's scene is timed with
+
+	float sceneTime;								// smoothed GPU time of the scene; 0 until the first result is in
+	bool locked;									// whether the scale is fixed (see lockScale())
+	int cooldown;									// results to ignore after a change, since they were timed at the old size
+
+	// feed the controller a new scene time, and resize the scene if it's out of bounds
+	void addSceneTime(float time);
+
+public:
+	DynamicResolution(int windowWidth, int windowHeight);
+	~DynamicResolution();
+
+	// start drawing the scene: bind and clear the offscreen target at its current size, and start timing
+	void beginScene();
+
+	// stop timing, upscale the scene into the window, and leave the window bound for whatever comes next
+	void endScene();
+
+	// upscale into this framebuffer instead of the window from now on (0 to go back to the window); it must be as big
+	// as the window
+	void setOutput(GLuint output);
+
+	// stop adapting and draw the scene at the given scale from now on; used by benchmarks, which need every run to
+	// draw the same pixels
+	void lockScale(float scale);
+
+	// the size the scene is currently drawn at
+	int getWidth();
+	int getHeight();
+	float getScale();
+};
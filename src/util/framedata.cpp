@@ -0,0 +1,46 @@
+#include "util/framedata.h"
+
+#include "GL/glew.h"
+
+#include "glm/glm.hpp"
+#include "glm/gtc/type_ptr.hpp"
+using namespace glm;
+
+const char *FrameData::BLOCK_NAME = "FrameData";
+const GLuint FrameData::BINDING_POINT = 0;
+
+FrameData::FrameData(vec3 sunDirection, vec3 fogColor)
+{
+	// the sun and fog never change, so they only need to go up with the first frame
+	block.projection = mat4(1.0);
+	block.view = mat4(1.0);
+	block.cameraPos = vec4(0.0);
+	block.sun = vec4(sunDirection, 0.0);
+	block.fogColor = vec4(fogColor, 0.0);
+
+	glGenBuffers(1, &ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), &block, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// every shader that declares the block has it hooked up to this binding point when it is linked (see Shader::finishLink())
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_POINT, ubo);
+}
+
+FrameData::~FrameData()
+{
+	glDeleteBuffers(1, &ubo);
+}
+
+void FrameData::update(mat4 &projection, mat4 &view, vec3 cameraPos, bool fog)
+{
+	block.projection = projection;
+	block.view = view;
+	block.cameraPos = vec4(cameraPos, 1.0);
+	block.fogColor.a = fog ? 1.0 : 0.0;
+
+	// the block is tiny, so re-sending all of it costs less than working out what changed
+	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+// per-frame state every shader can read from the std140 "FrameData" uniform block: camera matrices and position, the
+// sun, and the fog colour and whether fog is on. It is uploaded once per frame and stays bound to the same binding
+// point, so render() calls no longer have to send any of it themselves. The block is declared once, in
+// shaders/framedata.glsl, which shaders pull in with #include "framedata.glsl" (see Shader::loadSource()); Block below
+// has to match it
+class FrameData
+{
+private:
+	// CPU-side copy of the block in framedata.glsl; std140 lays it out exactly like this, since every member is a multiple
+	// of a vec4
+	struct Block
+	{
+		glm::mat4 projection;
+		glm::mat4 view;
+		glm::vec4 cameraPos;
+		glm::vec4 sun;
+		glm::vec4 fogColor;
+	};
+
+	Block block;
+	GLuint ubo;											// the uniform buffer holding the block
+
+public:
+	static const char *BLOCK_NAME;						// what shaders call the block
+	static const GLuint BINDING_POINT;					// uniform buffer binding point it is always bound to
+
+	FrameData(glm::vec3 sunDirection, glm::vec3 fogColor);
+	~FrameData();
+
+	// upload this frame's camera and fog setting; called once per frame, before anything is rendered
+	void update(glm::mat4 &projection, glm::mat4 &view, glm::vec3 cameraPos, bool fog);
+};
@@ -0,0 +1,215 @@
+#include "util/glstate.h"
+
+#include "GL/glew.h"
+
+#include <cstdlib>
+using namespace std;
+
+GLState *GLState::instance = NULL;
+
+GLState::GLState()
+{
+	numChanges = 0;
+	numSkipped = 0;
+	lastFrameChanges = 0;
+	lastFrameSkipped = 0;
+
+	beginFrame();
+}
+
+GLState::~GLState()
+{
+	instance = NULL;
+}
+
+GLState *GLState::getInstance()
+{
+	if(!instance)
+	{
+		instance = new GLState();
+	}
+
+	return instance;
+}
+
+void GLState::beginFrame()
+{
+	int i;
+
+	lastFrameChanges = numChanges;
+	lastFrameSkipped = numSkipped;
+	numChanges = 0;
+	numSkipped = 0;
+
+	for(i = 0; i < NUM_CAPABILITIES; i ++)
+	{
+		capabilities[i] = -1;
+	}
+	blendSource = -1;
+	blendDestination = -1;
+	depthWrites = -1;
+	polygonFillMode = -1;
+	activeTextureUnit = -1;
+	for(i = 0; i < MAX_TEXTURE_UNITS; i ++)
+	{
+		textures[i] = -1;
+	}
+	program = -1;
+	vertexArray = -1;
+}
+
+int GLState::getCapabilityIndex(GLenum cap)
+{
+	int result = -1;
+
+	switch(cap)
+	{
+		case GL_BLEND:
+			result = CAPABILITY_BLEND;
+			break;
+		case GL_DEPTH_TEST:
+			result = CAPABILITY_DEPTH_TEST;
+			break;
+		case GL_CULL_FACE:
+			result = CAPABILITY_CULL_FACE;
+			break;
+		case GL_RASTERIZER_DISCARD:
+			result = CAPABILITY_RASTERIZER_DISCARD;
+			break;
+	}
+
+	return result;
+}
+
+bool GLState::changed(GLint &current, GLint value)
+{
+	bool result = current != value;
+
+	if(result)
+	{
+		current = value;
+		numChanges ++;
+	}
+	else
+	{
+		numSkipped ++;
+	}
+
+	return result;
+}
+
+void GLState::setCapability(GLenum cap, int enabled)
+{
+	int index = getCapabilityIndex(cap);
+
+	if(index == -1 || changed(capabilities[index], enabled))
+	{
+		if(enabled)
+		{
+			glEnable(cap);
+		}
+		else
+		{
+			glDisable(cap);
+		}
+	}
+}
+
+void GLState::enable(GLenum cap)
+{
+	setCapability(cap, 1);
+}
+
+void GLState::disable(GLenum cap)
+{
+	setCapability(cap, 0);
+}
+
+void GLState::blendFunc(GLenum source, GLenum destination)
+{
+	// both halves have to be checked, so count this as a single change either way
+	if(blendSource != (GLint)source || blendDestination != (GLint)destination)
+	{
+		blendSource = source;
+		blendDestination = destination;
+		glBlendFunc(source, destination);
+		numChanges ++;
+	}
+	else
+	{
+		numSkipped ++;
+	}
+}
+
+void GLState::depthMask(bool enabled)
+{
+	if(changed(depthWrites, enabled ? 1 : 0))
+	{
+		glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+	}
+}
+
+void GLState::polygonMode(GLenum mode)
+{
+	if(changed(polygonFillMode, mode))
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, mode);
+	}
+}
+
+void GLState::bindTexture(int unit, GLuint texture)
+{
+	// units we don't track always go through
+	if(unit >= MAX_TEXTURE_UNITS)
+	{
+		activeTextureUnit = unit;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		numChanges += 2;
+	}
+	else if(changed(textures[unit], texture))
+	{
+		if(changed(activeTextureUnit, unit))
+		{
+			glActiveTexture(GL_TEXTURE0 + unit);
+		}
+		glBindTexture(GL_TEXTURE_2D, texture);
+	}
+}
+
+void GLState::bindTextureBuffer(int unit, GLuint texture)
+{
+	// buffer textures are rare enough not to track; the unit still has to be, since bindTexture() relies on it
+	if(changed(activeTextureUnit, unit))
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, texture);
+	numChanges ++;
+}
+
+void GLState::useProgram(GLuint program)
+{
+	if(changed(this -> program, program))
+	{
+		glUseProgram(program);
+	}
+}
+
+void GLState::bindVertexArray(GLuint vertexArray)
+{
+	if(changed(this -> vertexArray, vertexArray))
+	{
+		glBindVertexArray(vertexArray);
+	}
+}
+
+int GLState::getNumChanges()
+{
+	return lastFrameChanges;
+}
+
+int GLState::getNumSkipped()
+{
+	return lastFrameSkipped;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "GL/glew.h"
+
+// thin cache in front of the GL state that rendering code changes all the time (capabilities, blending, depth writes,
+// polygon mode, texture bindings, the current program and vertex array); anything set to what it already is never
+// reaches the driver. Render paths should make these changes through here rather than calling GL directly. One-off
+// setup code (buffer building, texture loading) is free to call GL itself, since beginFrame() forgets everything we
+// think we know anyway
+class GLState
+{
+private:
+	static const int MAX_TEXTURE_UNITS = 8;		// texture units we track; binds to any others go straight through
+
+	// capabilities we track; any others passed to enable() and disable() go straight through
+	enum Capability
+	{
+		CAPABILITY_BLEND,
+		CAPABILITY_DEPTH_TEST,
+		CAPABILITY_CULL_FACE,
+		CAPABILITY_RASTERIZER_DISCARD,
+		NUM_CAPABILITIES
+	};
+
+	static GLState *instance;					// singleton instance
+
+	// what we believe the GL state to be; -1 means we don't know, so the next change always goes through
+	int capabilities[NUM_CAPABILITIES];
+	GLint blendSource;
+	GLint blendDestination;
+	int depthWrites;
+	GLint polygonFillMode;
+	GLint activeTextureUnit;
+	GLint textures[MAX_TEXTURE_UNITS];			// GL_TEXTURE_2D binding of each unit
+	GLint program;
+	GLint vertexArray;
+
+	// instrumentation
+	int numChanges;								// state changes sent to GL so far this frame
+	int numSkipped;								// redundant changes we filtered out so far this frame
+	int lastFrameChanges;						// the same, for the last complete frame
+	int lastFrameSkipped;
+
+	GLState();									// force use of getInstance()
+
+	int getCapabilityIndex(GLenum cap);			// -1 for capabilities we don't track
+	void setCapability(GLenum cap, int enabled);
+	bool changed(GLint &current, GLint value);	// records value; true (and counted) if it differs from current
+
+public:
+	static GLState *getInstance();				// singleton design pattern
+
+	~GLState();
+
+	// called at the start of every frame: forget the cached state (so GL calls made outside of here between frames
+	// can't leave us out of sync) and roll the counters over
+	void beginFrame();
+
+	void enable(GLenum cap);
+	void disable(GLenum cap);
+	void blendFunc(GLenum source, GLenum destination);
+	void depthMask(bool enabled);
+	void polygonMode(GLenum mode);				// for both front and back faces
+	void bindTexture(int unit, GLuint texture);	// GL_TEXTURE_2D on the given unit, activating it only if need be
+	void bindTextureBuffer(int unit, GLuint texture);	// GL_TEXTURE_BUFFER on the given unit; only the unit is cached
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vertexArray);
+
+	// state changes made and skipped during the last complete frame
+	int getNumChanges();
+	int getNumSkipped();
+};
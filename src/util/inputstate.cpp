@@ -0,0 +1,70 @@
+#include "util/inputstate.h"
+
+#include "GL/glew.h"
+
+#include "GLFW/glfw3.h"
+
+InputState::InputState()
+{
+	int i;
+
+	for(i = 0; i <= GLFW_KEY_LAST; i ++)
+	{
+		keys[i] = false;
+	}
+	for(i = 0; i <= GLFW_MOUSE_BUTTON_LAST; i ++)
+	{
+		mouseButtons[i] = false;
+	}
+
+	mouseX = 0.0;
+	mouseY = 0.0;
+	projectionScale = 0.0;
+}
+
+void InputState::sample(GLFWwindow *window)
+{
+	int i;
+
+	// key codes start at GLFW_KEY_SPACE; everything below that isn't a key
+	for(i = GLFW_KEY_SPACE; i <= GLFW_KEY_LAST; i ++)
+	{
+		keys[i] = glfwGetKey(window, i) == GLFW_PRESS;
+	}
+	for(i = 0; i <= GLFW_MOUSE_BUTTON_LAST; i ++)
+	{
+		mouseButtons[i] = glfwGetMouseButton(window, i) == GLFW_PRESS;
+	}
+
+	glfwGetCursorPos(window, &mouseX, &mouseY);
+}
+
+bool InputState::isKeyDown(int key)
+{
+	return key >= 0 && key <= GLFW_KEY_LAST && keys[key];
+}
+
+bool InputState::isMouseButtonDown(int button)
+{
+	return button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST && mouseButtons[button];
+}
+
+double InputState::getMouseX()
+{
+	return mouseX;
+}
+
+double InputState::getMouseY()
+{
+	return mouseY;
+}
+
+void InputState::setProjectionScale(float projectionScale)
+{
+	this -> projectionScale = projectionScale;
+}
+
+float InputState::getProjectionScale()
+{
+	return projectionScale;
+}
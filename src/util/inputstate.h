@@ -0,0 +1,33 @@
+#pragma once
+
+#include "GL/glew.h"
+
+#include "GLFW/glfw3.h"
+
+// a copy of the keyboard and mouse as they were at one moment. GLFW only lets the thread that owns the window ask about
+// input, so that thread samples it once a frame and the simulation, wherever it runs, reads the copy instead. The same
+// thread draws the scene, so the little the simulation needs to know about the drawing comes along with it
+class InputState
+{
+private:
+	bool keys[GLFW_KEY_LAST + 1];						// whether each key was down
+	bool mouseButtons[GLFW_MOUSE_BUTTON_LAST + 1];		// whether each mouse button was down
+	double mouseX;										// where the cursor was
+	double mouseY;
+	float projectionScale;								// projection[1][1] * scene height / 2, as last drawn
+
+public:
+	InputState();										// nothing pressed, cursor at the origin
+
+	// take a copy of the window's input; only call this from the thread that created the window
+	void sample(GLFWwindow *window);
+
+	bool isKeyDown(int key);
+	bool isMouseButtonDown(int button);
+	double getMouseX();
+	double getMouseY();
+
+	// set by the thread that draws, so the simulation never has to look at the renderer itself; 0 until the first frame
+	void setProjectionScale(float projectionScale);
+	float getProjectionScale();
+};
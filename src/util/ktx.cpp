@@ -0,0 +1,137 @@
+#include "util/ktx.h"
+
+#include "GL/glew.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+// every KTX 1.1 file starts with these bytes
+static const unsigned char KTX_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+static const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+// the fixed part of the file after the identifier
+struct KTXHeader
+{
+	uint32_t endianness;
+	uint32_t glType;					// 0 for compressed formats
+	uint32_t glTypeSize;
+	uint32_t glFormat;					// 0 for compressed formats
+	uint32_t glInternalFormat;
+	uint32_t glBaseInternalFormat;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t numberOfArrayElements;
+	uint32_t numberOfFaces;
+	uint32_t numberOfMipmapLevels;
+	uint32_t bytesOfKeyValueData;
+};
+
+bool loadKTX(const string &filename, KTXImage &image)
+{
+	ifstream file(filename.c_str(), ios::in | ios::binary);
+	unsigned char identifier[12];
+	KTXHeader header;
+	uint32_t imageSize;
+	unsigned int i;
+
+	if(!file.is_open())
+	{
+		return false;
+	}
+
+	// we only ever read files we wrote ourselves, so anything unusual just means "not cooked"
+	file.read((char*)identifier, sizeof(identifier));
+	file.read((char*)&header, sizeof(header));
+	if(!file || !equal(identifier, identifier + sizeof(identifier), KTX_IDENTIFIER) || header.endianness != KTX_ENDIANNESS ||
+	   header.glType != 0 || header.glFormat != 0 || header.pixelDepth != 0 || header.numberOfFaces != 1 ||
+	   header.numberOfArrayElements != 0 || header.numberOfMipmapLevels == 0)
+	{
+		return false;
+	}
+	file.seekg(header.bytesOfKeyValueData, ios::cur);
+
+	image.internalFormat = header.glInternalFormat;
+	image.baseInternalFormat = header.glBaseInternalFormat;
+	image.width = header.pixelWidth;
+	image.height = header.pixelHeight;
+	image.data.clear();
+	image.levelOffsets.clear();
+	image.levelSizes.clear();
+
+	// each level is its size followed by its blocks, padded out to four bytes (which block sizes always are)
+	for(i = 0; i < header.numberOfMipmapLevels; i ++)
+	{
+		file.read((char*)&imageSize, sizeof(imageSize));
+		if(!file)
+		{
+			return false;
+		}
+
+		image.levelOffsets.push_back(image.data.size());
+		image.levelSizes.push_back(imageSize);
+		image.data.resize(image.data.size() + imageSize);
+		file.read((char*)&image.data[image.levelOffsets.back()], imageSize);
+		if(!file)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool saveKTX(const string &filename, const KTXImage &image)
+{
+	ofstream file(filename.c_str(), ios::out | ios::binary | ios::trunc);
+	KTXHeader header;
+	uint32_t imageSize;
+	unsigned int i;
+
+	if(!file.is_open())
+	{
+		return false;
+	}
+
+	header.endianness = KTX_ENDIANNESS;
+	header.glType = 0;
+	header.glTypeSize = 1;
+	header.glFormat = 0;
+	header.glInternalFormat = image.internalFormat;
+	header.glBaseInternalFormat = image.baseInternalFormat;
+	header.pixelWidth = image.width;
+	header.pixelHeight = image.height;
+	header.pixelDepth = 0;
+	header.numberOfArrayElements = 0;
+	header.numberOfFaces = 1;
+	header.numberOfMipmapLevels = image.levelSizes.size();
+	header.bytesOfKeyValueData = 0;
+
+	file.write((const char*)KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+	file.write((const char*)&header, sizeof(header));
+	for(i = 0; i < image.levelSizes.size(); i ++)
+	{
+		imageSize = image.levelSizes[i];
+		file.write((const char*)&imageSize, sizeof(imageSize));
+		file.write((const char*)&image.data[image.levelOffsets[i]], imageSize);
+	}
+
+	return (bool)file;
+}
+
+string getCookedName(const string &pngFilename)
+{
+	size_t dot = pngFilename.rfind('.');
+	size_t slash = pngFilename.rfind('/');
+
+	if(dot == string::npos || (slash != string::npos && dot < slash))
+	{
+		return pngFilename + ".ktx";
+	}
+
+	return pngFilename.substr(0, dot) + ".ktx";
+}
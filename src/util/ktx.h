@@ -0,0 +1,29 @@
+#pragma once
+
+#include "GL/glew.h"
+
+#include <string>
+#include <vector>
+
+// a 2D texture with its whole mip chain, as stored in a KTX (version 1.1) file; only compressed formats are written
+// or read, so every level is just a run of blocks. Rows run bottom to top, the way GL expects them
+struct KTXImage
+{
+	GLenum internalFormat;				// e.g. GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+	GLenum baseInternalFormat;			// GL_RGB, GL_RGBA, or GL_RG
+	unsigned int width;					// of the top level
+	unsigned int height;
+
+	std::vector<unsigned char> data;	// every level's blocks, largest first, back to back
+	std::vector<size_t> levelOffsets;	// where each level starts in data
+	std::vector<size_t> levelSizes;		// and how many bytes it has
+};
+
+// read a KTX file written by saveKTX(); false if it's missing or isn't one we understand
+bool loadKTX(const std::string &filename, KTXImage &image);
+
+// write image as a KTX file; false if the file can't be written
+bool saveKTX(const std::string &filename, const KTXImage &image);
+
+// the cooked version of the named PNG ("../png/rock.png" becomes "../png/rock.ktx")
+std::string getCookedName(const std::string &pngFilename);
@@ -4,5 +4,6 @@
 
 // returns a GL texture ID associated with the data in the named image file;
 // NOTE: I've removed SOIL as a dependency and use LodePNG instead, so this
-// function can only load PNGs now
+// function can only load PNGs now. It returns straight away: the texture holds
+// a placeholder until TextureLoader has decoded and uploaded the image
 GLuint loadPNG(const char *name, bool highQualityMipmaps = true);
@@ -0,0 +1,327 @@
+#include "util/mesh.h"
+#include "util/meshoptimizer.h"
+
+#include "glmmodel/glmmodel.h"
+
+#include "GL/glew.h"
+
+#include "fcntl.h"
+#include "unistd.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+
+#include "glm/glm.hpp"
+using namespace glm;
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+const int Mesh::MAX_VERTICES = 65536;
+const int Mesh::ACMR_CACHE_SIZE = 16;
+const float Mesh::OVERDRAW_THRESHOLD = 1.05;
+
+const char Mesh::MAGIC[4] = {'M', 'E', 'S', 'H'};
+const GLuint Mesh::VERSION = 2;
+
+// a unit vector as GL_INT_2_10_10_10_REV: x in the lowest ten bits, then y and z, each a signed fraction of 511
+static GLuint packNormal(const vec3 &normal)
+{
+	GLuint packed = 0;
+	int component;
+	int i;
+
+	for(i = 0; i < 3; i ++)
+	{
+		component = (int)round(glm::clamp(normal[i], -1.0f, 1.0f) * 511.0f);
+		packed |= ((GLuint)component & 0x3ff) << (10 * i);
+	}
+
+	return packed;
+}
+
+Mesh::Mesh(const char *filename)
+{
+	string cookedName = filename;
+	GLMmodel *model;
+
+	data = NULL;
+	dataSize = 0;
+	mapped = false;
+
+	// "../mesh/tree.obj" is cooked into "../mesh/tree.mesh"
+	if(cookedName.rfind('.') != string::npos && cookedName.rfind('.') > cookedName.rfind('/') + 1)
+	{
+		cookedName = cookedName.substr(0, cookedName.rfind('.'));
+	}
+	cookedName += ".mesh";
+
+	if(!loadCooked(cookedName, filename))
+	{
+		// glmReadOBJ() will just quit if it can't read the file
+		model = glmReadOBJ((char*)filename);
+		cook(model);
+		glmDelete(model);
+
+		// failing to save only means we parse the .OBJ again next time
+		saveCooked(cookedName);
+	}
+
+	setPointers();
+}
+
+Mesh::~Mesh()
+{
+	if(mapped)
+	{
+		munmap(data, dataSize);
+	}
+	else
+	{
+		delete[] data;
+	}
+}
+
+int Mesh::getNumVertices()
+{
+	return header -> numVertices;
+}
+
+int Mesh::getNumIndices()
+{
+	return header -> numIndices;
+}
+
+const Mesh::Vertex *Mesh::getVertices()
+{
+	return vertices;
+}
+
+const GLushort *Mesh::getIndices()
+{
+	return indices;
+}
+
+vec3 Mesh::getBoundsMin()
+{
+	return vec3(header -> boundsMin[0], header -> boundsMin[1], header -> boundsMin[2]);
+}
+
+vec3 Mesh::getBoundsMax()
+{
+	return vec3(header -> boundsMax[0], header -> boundsMax[1], header -> boundsMax[2]);
+}
+
+void Mesh::upload(GLuint vao, GLuint buffer)
+{
+	// vertices and indices sit back to back after the header, so the whole lot goes up in one call
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, dataSize - sizeof(Header), data + sizeof(Header), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+	setupVertexAttribs(0);
+}
+
+int Mesh::getFirstIndex()
+{
+	// a Vertex is a whole number of indices long, so this always divides exactly
+	return sizeof(Vertex) * header -> numVertices / sizeof(GLushort);
+}
+
+void Mesh::setupVertexAttribs(GLintptr offset)
+{
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(offset + offsetof(Vertex, position)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), (GLvoid*)(offset + offsetof(Vertex, normal)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(offset + offsetof(Vertex, texCoord)));
+}
+
+bool Mesh::loadCooked(const string &cookedName, const string &filename)
+{
+	struct stat objInfo;
+	struct stat cookedInfo;
+	const Header *fileHeader;
+	void *mapping;
+	int file;
+
+	// a cooked file older than its .OBJ is stale; the model has been edited since we last cooked it
+	if(stat(cookedName.c_str(), &cookedInfo) != 0 || (stat(filename.c_str(), &objInfo) == 0 && objInfo.st_mtime > cookedInfo.st_mtime) ||
+	   (size_t)cookedInfo.st_size < sizeof(Header))
+	{
+		return false;
+	}
+
+	file = open(cookedName.c_str(), O_RDONLY);
+	if(file < 0)
+	{
+		return false;
+	}
+	mapping = mmap(NULL, cookedInfo.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if(mapping == MAP_FAILED)
+	{
+		return false;
+	}
+
+	// anything that doesn't add up just means we cook it again
+	fileHeader = (const Header*)mapping;
+	if(memcmp(fileHeader -> magic, MAGIC, sizeof(MAGIC)) != 0 || fileHeader -> version != VERSION ||
+	   (int)fileHeader -> numVertices > MAX_VERTICES ||
+	   (size_t)cookedInfo.st_size != sizeof(Header) + sizeof(Vertex) * fileHeader -> numVertices + sizeof(GLushort) * fileHeader -> numIndices)
+	{
+		munmap(mapping, cookedInfo.st_size);
+		return false;
+	}
+
+	data = (unsigned char*)mapping;
+	dataSize = cookedInfo.st_size;
+	mapped = true;
+
+	return true;
+}
+
+void Mesh::cook(GLMmodel *model)
+{
+	map<vector<GLuint>, GLushort> vertexIndices;		// a vertex's bits to its index
+	map<vector<GLuint>, GLushort>::iterator found;
+	vector<Vertex> newVertices;
+	vector<Vertex> orderedVertices;
+	vector<GLushort> newIndices;
+	vector<vec3> positions;
+	vector<int> newOrder;
+	vector<GLuint> key(sizeof(Vertex) / sizeof(GLuint));
+	Header newHeader;
+	GLMtriangle *triangle;
+	GLMgroup *group;
+	Vertex vertex;
+	vec3 normal;
+	float fileOrderACMR;
+	float optimizedACMR;
+	GLuint i, j, k;
+
+	// .OBJ faces pick their position, normal, and tex coord separately, and the same combination can turn up under
+	// different indices too, so each distinct vertex is only stored the first time its exact bits come up; every other
+	// time, we just repeat its index
+	for(group = model -> groups; group; group = group -> next)
+	{
+		for(i = 0; i < group -> numtriangles; i ++)
+		{
+			triangle = &model -> triangles[group -> triangles[i]];
+			for(j = 0; j < 3; j ++)
+			{
+				// collision meshes come without normals or tex coords, so those are left at zero
+				normal = vec3(0.0);
+				vertex.texCoord[0] = 0.0;
+				vertex.texCoord[1] = 0.0;
+				for(k = 0; k < 3; k ++)
+				{
+					vertex.position[k] = model -> vertices[3 * triangle -> vindices[j] + k];
+					if(model -> normals)
+					{
+						normal[k] = model -> normals[3 * triangle -> nindices[j] + k];
+					}
+				}
+				if(model -> texcoords)
+				{
+					vertex.texCoord[0] = model -> texcoords[2 * triangle -> tindices[j]];
+					vertex.texCoord[1] = model -> texcoords[2 * triangle -> tindices[j] + 1];
+				}
+				vertex.normal = packNormal(normal);
+
+				memcpy(&key[0], &vertex, sizeof(Vertex));
+				found = vertexIndices.find(key);
+				if(found != vertexIndices.end())
+				{
+					newIndices.push_back(found -> second);
+					continue;
+				}
+
+				if((int)newVertices.size() == MAX_VERTICES)
+				{
+					cerr << "Mesh::cook() cannot index " << model -> pathname << " because it has more than " << MAX_VERTICES << " distinct vertices" << endl;
+					exit(1);
+				}
+
+				vertexIndices[key] = newVertices.size();
+				newIndices.push_back(newVertices.size());
+				newVertices.push_back(vertex);
+			}
+		}
+	}
+
+	// reorder the triangles for the post-transform cache and then for overdraw, and the vertices for fetching
+	fileOrderACMR = computeACMR(newIndices, newVertices.size(), ACMR_CACHE_SIZE);
+	optimizeVertexCache(newIndices, newVertices.size());
+	for(i = 0; i < newVertices.size(); i ++)
+	{
+		positions.push_back(vec3(newVertices[i].position[0], newVertices[i].position[1], newVertices[i].position[2]));
+	}
+	optimizeOverdraw(newIndices, positions, OVERDRAW_THRESHOLD);
+	optimizeVertexFetch(newIndices, newVertices.size(), newOrder);
+	for(i = 0; i < newOrder.size(); i ++)
+	{
+		orderedVertices.push_back(newVertices[newOrder[i]]);
+	}
+	newVertices.swap(orderedVertices);
+	optimizedACMR = computeACMR(newIndices, newVertices.size(), ACMR_CACHE_SIZE);
+
+	cout << "-- cooked " << model -> pathname << " (" << newVertices.size() << " vertices, " << newIndices.size() / 3 << " triangles, ACMR "
+		 << fileOrderACMR << " in file order, " << optimizedACMR << " optimised)" << endl;
+
+	memcpy(newHeader.magic, MAGIC, sizeof(MAGIC));
+	newHeader.version = VERSION;
+	newHeader.numVertices = newVertices.size();
+	newHeader.numIndices = newIndices.size();
+	for(k = 0; k < 3; k ++)
+	{
+		newHeader.boundsMin[k] = newVertices.empty() ? 0.0 : FLT_MAX;
+		newHeader.boundsMax[k] = newVertices.empty() ? 0.0 : -FLT_MAX;
+		for(i = 0; i < newVertices.size(); i ++)
+		{
+			newHeader.boundsMin[k] = std::min(newHeader.boundsMin[k], newVertices[i].position[k]);
+			newHeader.boundsMax[k] = std::max(newHeader.boundsMax[k], newVertices[i].position[k]);
+		}
+	}
+
+	// lay everything out exactly as the cooked file has it
+	dataSize = sizeof(Header) + sizeof(Vertex) * newVertices.size() + sizeof(GLushort) * newIndices.size();
+	data = new unsigned char[dataSize];
+	memcpy(data, &newHeader, sizeof(Header));
+	if(!newVertices.empty())
+	{
+		memcpy(data + sizeof(Header), &newVertices[0], sizeof(Vertex) * newVertices.size());
+		memcpy(data + sizeof(Header) + sizeof(Vertex) * newVertices.size(), &newIndices[0], sizeof(GLushort) * newIndices.size());
+	}
+}
+
+void Mesh::saveCooked(const string &cookedName)
+{
+	ofstream file(cookedName.c_str(), ios::out | ios::binary | ios::trunc);
+
+	if(file.is_open())
+	{
+		file.write((const char*)data, dataSize);
+	}
+	if(!file)
+	{
+		cerr << "Mesh::saveCooked() could not write " << cookedName << endl;
+	}
+}
+
+void Mesh::setPointers()
+{
+	header = (const Header*)data;
+	vertices = (const Vertex*)(data + sizeof(Header));
+	indices = (const GLushort*)(data + sizeof(Header) + sizeof(Vertex) * header -> numVertices);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+#include <string>
+
+typedef struct _GLMmodel GLMmodel;
+
+// a triangle mesh laid out the way the GPU wants it: each distinct vertex stored once, interleaved, and drawn through
+// 16-bit indices. The first time a Wavefront .OBJ file is asked for, it's parsed, its triangles and vertices are put in
+// the order the vertex cache likes best (see meshoptimizer.h), and it's cooked into a binary ".mesh" file beside it;
+// after that (until the .OBJ is edited) the cooked file is just mapped into memory, and its vertices and indices can go
+// to a buffer object in a single upload
+class Mesh
+{
+public:
+	// one vertex; sizeof() is the stride of attributes 0 to 2
+	struct Vertex
+	{
+		GLfloat position[3];					// attribute 0
+		GLuint normal;							// attribute 1, packed as GL_INT_2_10_10_10_REV
+		GLfloat texCoord[2];					// attribute 2
+	};
+
+	static const int MAX_VERTICES;				// as many as a 16-bit index can reach
+
+	Mesh(const char *filename);					// the .OBJ; quits if it can't be read
+	~Mesh();
+
+	int getNumVertices();
+	int getNumIndices();
+	const Vertex *getVertices();
+	const GLushort *getIndices();
+
+	glm::vec3 getBoundsMin();					// corners of the axis-aligned box around every vertex
+	glm::vec3 getBoundsMax();
+
+	// put the mesh in buffer (vertices first, then indices) and set up vao to draw it from there, with the vertex
+	// attributes in 0 to 2 and the buffer as its element array buffer too
+	void upload(GLuint vao, GLuint buffer);
+	int getFirstIndex();						// where the indices start in that buffer, counted in indices
+
+	// point attributes 0 to 2 at Vertex data starting at offset in the bound array buffer
+	static void setupVertexAttribs(GLintptr offset);
+
+private:
+	// the start of a .mesh file, which is followed by the vertices and then the indices
+	struct Header
+	{
+		char magic[4];							// "MESH"
+		GLuint version;
+		GLuint numVertices;
+		GLuint numIndices;
+		GLfloat boundsMin[3];
+		GLfloat boundsMax[3];
+	};
+
+	static const char MAGIC[4];
+	static const GLuint VERSION;
+
+	static const int ACMR_CACHE_SIZE;			// cache size the ACMRs we report when cooking are measured with
+	static const float OVERDRAW_THRESHOLD;		// how much of the cache optimisation we give back for less overdraw
+
+	unsigned char *data;						// the whole file image: header, vertices, and indices
+	size_t dataSize;
+	bool mapped;								// data is a mapping of the cooked file, rather than ours to delete[]
+
+	const Header *header;
+	const Vertex *vertices;
+	const GLushort *indices;
+
+	bool loadCooked(const std::string &cookedName, const std::string &filename);
+	void cook(GLMmodel *model);					// build the file image from a parsed .OBJ
+	void saveCooked(const std::string &cookedName);
+	void setPointers();
+};
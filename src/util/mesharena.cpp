@@ -0,0 +1,136 @@
+#include "util/mesharena.h"
+#include "util/mesh.h"
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+using namespace glm;
+
+#include <cstdlib>
+using namespace std;
+
+const int MeshArena::INITIAL_VERTEX_CAPACITY = 65536;
+const int MeshArena::INITIAL_INDEX_CAPACITY = 262144;
+
+MeshArena *MeshArena::instance = NULL;
+
+MeshArena::MeshArena()
+{
+	int i;
+
+	vertexCapacity = INITIAL_VERTEX_CAPACITY;
+	indexCapacity = INITIAL_INDEX_CAPACITY;
+	numVertices = 0;
+	numIndices = 0;
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(Mesh::Vertex) * vertexCapacity, NULL, GL_STATIC_DRAW);
+	Mesh::setupVertexAttribs(0);
+
+	glGenBuffers(1, &ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indexCapacity, NULL, GL_STATIC_DRAW);
+
+	// the transforms come one per draw, which the render queue selects with the base instance (or by rebinding)
+	for(i = 3; i <= 9; i ++)
+	{
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
+	}
+}
+
+MeshArena::~MeshArena()
+{
+	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ibo);
+	glDeleteVertexArrays(1, &vao);
+
+	instance = NULL;
+}
+
+MeshArena *MeshArena::getInstance()
+{
+	if(!instance)
+	{
+		instance = new MeshArena();
+	}
+
+	return instance;
+}
+
+void MeshArena::grow(GLuint *buffer, GLsizeiptr usedBytes, GLsizeiptr newBytes)
+{
+	GLuint newBuffer;
+
+	// copy into a bigger buffer on the GPU; the old contents never come back to us
+	glGenBuffers(1, &newBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newBytes, NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, *buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+	glDeleteBuffers(1, buffer);
+
+	*buffer = newBuffer;
+}
+
+MeshArena::Range MeshArena::add(Mesh *mesh)
+{
+	Range range;
+
+	range.baseVertex = numVertices;
+	range.firstIndex = numIndices;
+	range.numIndices = mesh -> getNumIndices();
+
+	glBindVertexArray(vao);
+
+	if(numVertices + mesh -> getNumVertices() > vertexCapacity)
+	{
+		while(numVertices + mesh -> getNumVertices() > vertexCapacity)
+		{
+			vertexCapacity *= 2;
+		}
+		grow(&vbo, sizeof(Mesh::Vertex) * numVertices, sizeof(Mesh::Vertex) * vertexCapacity);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		Mesh::setupVertexAttribs(0);
+	}
+	if(numIndices + mesh -> getNumIndices() > indexCapacity)
+	{
+		while(numIndices + mesh -> getNumIndices() > indexCapacity)
+		{
+			indexCapacity *= 2;
+		}
+		grow(&ibo, sizeof(GLushort) * numIndices, sizeof(GLushort) * indexCapacity);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	}
+
+	// append the mesh after everything already in the arena; its indices stay 16-bit since each draw adds its base vertex
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(Mesh::Vertex) * numVertices, sizeof(Mesh::Vertex) * mesh -> getNumVertices(), mesh -> getVertices());
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * numIndices, sizeof(GLushort) * mesh -> getNumIndices(), mesh -> getIndices());
+	numVertices += mesh -> getNumVertices();
+	numIndices += mesh -> getNumIndices();
+
+	return range;
+}
+
+GLuint MeshArena::getVAO()
+{
+	return vao;
+}
+
+void MeshArena::bindTransforms(GLuint buffer, GLintptr offset)
+{
+	const GLsizei STRIDE = sizeof(DrawTransform);
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, STRIDE, (GLvoid*)offset);
+	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, STRIDE, (GLvoid*)(offset + sizeof(vec4)));
+	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, STRIDE, (GLvoid*)(offset + sizeof(vec4) * 2));
+	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, STRIDE, (GLvoid*)(offset + sizeof(vec4) * 3));
+	glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, STRIDE, (GLvoid*)(offset + sizeof(mat4)));
+	glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, STRIDE, (GLvoid*)(offset + sizeof(mat4) + sizeof(vec3)));
+	glVertexAttribPointer(9, 3, GL_FLOAT, GL_FALSE, STRIDE, (GLvoid*)(offset + sizeof(mat4) + sizeof(vec3) * 2));
+}
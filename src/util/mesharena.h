@@ -0,0 +1,61 @@
+#pragma once
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+class Mesh;
+
+// one vertex buffer (Mesh::Vertex; attributes 0 to 2) and one index buffer that every static mesh sharing that vertex
+// format is appended to, so they can all be drawn from the same vertex array object. Since nothing needs to be rebound
+// between them, the render queue can submit consecutive draws of different meshes as a single multi-draw.
+// Each draw's transform is read from instanced attributes 3 to 9 (see DrawTransform), which the render queue points at
+// its own per-frame buffer
+class MeshArena
+{
+private:
+	static const int INITIAL_VERTEX_CAPACITY;	// vertices we make room for up front
+	static const int INITIAL_INDEX_CAPACITY;	// and indices
+
+	static MeshArena *instance;					// singleton instance
+
+	GLuint vao;									// vertex state every mesh in the arena is drawn with
+	GLuint vbo;									// vertices of every mesh, back to back
+	GLuint ibo;									// their indices, each relative to its own mesh's first vertex
+	int vertexCapacity;							// vertices the buffers have room for
+	int indexCapacity;
+	int numVertices;							// vertices used so far
+	int numIndices;
+
+	MeshArena();								// force use of getInstance()
+
+	// reallocate a buffer, copying over the bytes already in it
+	void grow(GLuint *buffer, GLsizeiptr usedBytes, GLsizeiptr newBytes);
+
+public:
+	// per-draw transform; sizeof() is the stride of the instanced attributes
+	struct DrawTransform
+	{
+		glm::mat4 modelView;					// attributes 3 to 6
+		glm::mat3 normal;						// attributes 7 to 9
+	};
+
+	// where a mesh ended up; draw it with these as the base vertex, first index, and index count
+	struct Range
+	{
+		int baseVertex;
+		int firstIndex;
+		int numIndices;
+	};
+
+	static MeshArena *getInstance();			// singleton design pattern
+
+	~MeshArena();
+
+	// append the given mesh and say where it went
+	Range add(Mesh *mesh);
+
+	GLuint getVAO();
+
+	// point the transform attributes at an array of DrawTransforms starting at offset in buffer; expects getVAO() bound
+	void bindTransforms(GLuint buffer, GLintptr offset);
+};
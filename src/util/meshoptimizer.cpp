@@ -0,0 +1,360 @@
+#include "util/meshoptimizer.h"
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+using namespace glm;
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+// the cache Forsyth's scores model: the vertices of the last few triangles, most recently used first
+static const int FORSYTH_CACHE_SIZE = 32;
+static const float FORSYTH_CACHE_DECAY_POWER = 1.5;
+static const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75;
+static const float FORSYTH_VALENCE_BOOST_SCALE = 2.0;
+static const float FORSYTH_VALENCE_BOOST_POWER = 0.5;
+
+// the cache we measure against when splitting clusters; most hardware is at least this good
+static const int OVERDRAW_CACHE_SIZE = 16;
+
+// run the given triangles through a FIFO cache, where a vertex is cached if fewer than cacheSize misses have happened
+// since it was last loaded; returns the number of misses. Adding cacheSize to time flushes the cache
+static int simulateCache(const GLushort *indices, int numIndices, int cacheSize, vector<int> &loadTimes, int &time)
+{
+	int misses = 0;
+	int i;
+
+	for(i = 0; i < numIndices; i ++)
+	{
+		if(time - loadTimes[indices[i]] >= cacheSize)
+		{
+			loadTimes[indices[i]] = time;
+			time ++;
+			misses ++;
+		}
+	}
+
+	return misses;
+}
+
+float computeACMR(const vector<GLushort> &indices, int numVertices, int cacheSize)
+{
+	vector<int> loadTimes(numVertices, -cacheSize);
+	int time = 0;
+
+	if(indices.empty())
+	{
+		return 0.0;
+	}
+
+	return (float)simulateCache(&indices[0], indices.size(), cacheSize, loadTimes, time) / (indices.size() / 3);
+}
+
+// how much we want to use a vertex next, given where it is in the cache (-1 for not at all) and how many triangles
+// still need it; vertices with few triangles left get a boost, so that we finish them off rather than leave them stranded
+static float getForsythScore(int cachePosition, int numTrianglesLeft)
+{
+	float score = 0.0;
+
+	if(numTrianglesLeft == 0)
+	{
+		return -1.0;
+	}
+
+	if(cachePosition >= 0)
+	{
+		// the last triangle's vertices get a fixed score, so we don't just keep going back and forth between two
+		if(cachePosition < 3)
+		{
+			score = FORSYTH_LAST_TRIANGLE_SCORE;
+		}
+		else
+		{
+			score = pow(1.0f - (float)(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY_POWER);
+		}
+	}
+
+	return score + FORSYTH_VALENCE_BOOST_SCALE * pow((float)numTrianglesLeft, -FORSYTH_VALENCE_BOOST_POWER);
+}
+
+void optimizeVertexCache(vector<GLushort> &indices, int numVertices)
+{
+	int numTriangles = indices.size() / 3;
+	vector<int> firstTriangle(numVertices + 1, 0);	// where each vertex's triangles start in vertexTriangles
+	vector<int> numTrianglesLeft(numVertices, 0);	// how many of them haven't been added yet (they're kept first)
+	vector<int> vertexTriangles(indices.size());
+	vector<int> cachePositions(numVertices, -1);
+	vector<float> vertexScores(numVertices);
+	vector<float> triangleScores(numTriangles);
+	vector<bool> triangleAdded(numTriangles, false);
+	vector<GLushort> newIndices;
+	vector<int> cache;
+	vector<int> newCache;
+	int nextUnadded = 0;							// where we look for a triangle when none in the cache are left
+	int bestTriangle;
+	float bestScore;
+	int triangle;
+	int vertex;
+	int i, j, k;
+
+	newIndices.reserve(indices.size());
+
+	// triangles using each vertex
+	for(i = 0; i < (int)indices.size(); i ++)
+	{
+		numTrianglesLeft[indices[i]] ++;
+	}
+	for(i = 0; i < numVertices; i ++)
+	{
+		firstTriangle[i + 1] = firstTriangle[i] + numTrianglesLeft[i];
+		numTrianglesLeft[i] = 0;
+	}
+	for(i = 0; i < (int)indices.size(); i ++)
+	{
+		vertex = indices[i];
+		vertexTriangles[firstTriangle[vertex] + numTrianglesLeft[vertex]] = i / 3;
+		numTrianglesLeft[vertex] ++;
+	}
+
+	// start from the best triangle of all
+	for(i = 0; i < numVertices; i ++)
+	{
+		vertexScores[i] = getForsythScore(-1, numTrianglesLeft[i]);
+	}
+	bestTriangle = -1;
+	bestScore = -1.0;
+	for(i = 0; i < numTriangles; i ++)
+	{
+		triangleScores[i] = vertexScores[indices[3 * i]] + vertexScores[indices[3 * i + 1]] + vertexScores[indices[3 * i + 2]];
+		if(triangleScores[i] > bestScore)
+		{
+			bestTriangle = i;
+			bestScore = triangleScores[i];
+		}
+	}
+
+	while((int)newIndices.size() < numTriangles * 3)
+	{
+		// nothing in the cache has triangles left, so carry on from the next one the file has
+		if(bestTriangle < 0)
+		{
+			while(triangleAdded[nextUnadded])
+			{
+				nextUnadded ++;
+			}
+			bestTriangle = nextUnadded;
+		}
+
+		triangleAdded[bestTriangle] = true;
+		newCache.clear();
+		for(i = 0; i < 3; i ++)
+		{
+			vertex = indices[3 * bestTriangle + i];
+			newIndices.push_back(vertex);
+			newCache.push_back(vertex);
+
+			// move the triangle out of the vertex's remaining ones
+			for(j = firstTriangle[vertex]; vertexTriangles[j] != bestTriangle; j ++);
+			numTrianglesLeft[vertex] --;
+			swap(vertexTriangles[j], vertexTriangles[firstTriangle[vertex] + numTrianglesLeft[vertex]]);
+		}
+
+		// the triangle's vertices go to the front of the cache, pushing the rest back
+		for(i = 0; i < (int)cache.size(); i ++)
+		{
+			if(cache[i] != newCache[0] && cache[i] != newCache[1] && cache[i] != newCache[2])
+			{
+				newCache.push_back(cache[i]);
+			}
+		}
+		for(i = 0; i < (int)newCache.size(); i ++)
+		{
+			cachePositions[newCache[i]] = (i < FORSYTH_CACHE_SIZE ? i : -1);
+			vertexScores[newCache[i]] = getForsythScore(cachePositions[newCache[i]], numTrianglesLeft[newCache[i]]);
+		}
+
+		// only triangles touching the cache (or that just fell out of it) have changed score, and the best of those
+		// is almost always the best of all
+		bestTriangle = -1;
+		bestScore = -1.0;
+		for(i = 0; i < (int)newCache.size(); i ++)
+		{
+			vertex = newCache[i];
+			for(j = firstTriangle[vertex]; j < firstTriangle[vertex] + numTrianglesLeft[vertex]; j ++)
+			{
+				triangle = vertexTriangles[j];
+				triangleScores[triangle] = 0.0;
+				for(k = 0; k < 3; k ++)
+				{
+					triangleScores[triangle] += vertexScores[indices[3 * triangle + k]];
+				}
+
+				if(triangleScores[triangle] > bestScore)
+				{
+					bestTriangle = triangle;
+					bestScore = triangleScores[triangle];
+				}
+			}
+		}
+
+		if((int)newCache.size() > FORSYTH_CACHE_SIZE)
+		{
+			newCache.resize(FORSYTH_CACHE_SIZE);
+		}
+		cache.swap(newCache);
+	}
+
+	indices.swap(newIndices);
+}
+
+// one run of consecutive triangles that's drawn as a whole
+struct OverdrawCluster
+{
+	int firstIndex;
+	int numIndices;
+	float sortKey;									// how far out and facing out the cluster is; biggest first
+};
+
+static bool compareOverdrawClusters(const OverdrawCluster &a, const OverdrawCluster &b)
+{
+	return a.sortKey > b.sortKey;
+}
+
+void optimizeOverdraw(vector<GLushort> &indices, const vector<vec3> &positions, float threshold)
+{
+	int numTriangles = indices.size() / 3;
+	vector<int> loadTimes(positions.size(), -OVERDRAW_CACHE_SIZE);
+	vector<int> hardBoundaries;						// first triangle of each run that starts with a cold cache
+	vector<OverdrawCluster> clusters;
+	vector<GLushort> newIndices;
+	OverdrawCluster cluster;
+	vec3 meshCentroid(0.0);
+	vec3 centroid;
+	vec3 normal;
+	vec3 areaNormal;
+	float meshArea = 0.0;
+	float area;
+	float clusterACMR;
+	int time = 0;
+	int misses;
+	int start, end;
+	int i, j;
+
+	if(numTriangles == 0)
+	{
+		return;
+	}
+
+	// wherever a triangle misses on all three vertices, the cache optimiser had nothing better to offer, so the
+	// triangles after it can go anywhere at no extra cost
+	for(i = 0; i < numTriangles; i ++)
+	{
+		if(simulateCache(&indices[3 * i], 3, OVERDRAW_CACHE_SIZE, loadTimes, time) == 3)
+		{
+			hardBoundaries.push_back(i);
+		}
+	}
+	hardBoundaries.push_back(numTriangles);
+	if(hardBoundaries[0] != 0)
+	{
+		hardBoundaries.insert(hardBoundaries.begin(), 0);
+	}
+
+	// within each of those runs, split again wherever what's been drawn since the last split has done nearly as well
+	// out of the cache as the run as a whole
+	for(i = 0; i + 1 < (int)hardBoundaries.size(); i ++)
+	{
+		start = hardBoundaries[i];
+		end = hardBoundaries[i + 1];
+
+		time += OVERDRAW_CACHE_SIZE;
+		clusterACMR = (float)simulateCache(&indices[3 * start], 3 * (end - start), OVERDRAW_CACHE_SIZE, loadTimes, time) / (end - start);
+
+		time += OVERDRAW_CACHE_SIZE;
+		cluster.firstIndex = 3 * start;
+		misses = 0;
+		for(j = start; j < end; j ++)
+		{
+			misses += simulateCache(&indices[3 * j], 3, OVERDRAW_CACHE_SIZE, loadTimes, time);
+			if(j + 1 == end || (float)misses / (j + 1 - cluster.firstIndex / 3) <= threshold * clusterACMR)
+			{
+				cluster.numIndices = 3 * (j + 1) - cluster.firstIndex;
+				clusters.push_back(cluster);
+
+				time += OVERDRAW_CACHE_SIZE;
+				cluster.firstIndex = 3 * (j + 1);
+				misses = 0;
+			}
+		}
+	}
+
+	// the middle of the mesh, weighting each triangle by its area
+	for(i = 0; i < numTriangles; i ++)
+	{
+		area = length(cross(positions[indices[3 * i + 1]] - positions[indices[3 * i]], positions[indices[3 * i + 2]] - positions[indices[3 * i]]));
+		meshCentroid += area * (positions[indices[3 * i]] + positions[indices[3 * i + 1]] + positions[indices[3 * i + 2]]) / 3.0f;
+		meshArea += area;
+	}
+	if(meshArea > 0.0)
+	{
+		meshCentroid /= meshArea;
+	}
+
+	// clusters out on the surface facing away from the middle are the ones that hide others
+	for(i = 0; i < (int)clusters.size(); i ++)
+	{
+		centroid = vec3(0.0);
+		normal = vec3(0.0);
+		area = 0.0;
+		for(j = clusters[i].firstIndex; j < clusters[i].firstIndex + clusters[i].numIndices; j += 3)
+		{
+			areaNormal = cross(positions[indices[j + 1]] - positions[indices[j]], positions[indices[j + 2]] - positions[indices[j]]);
+			centroid += length(areaNormal) * (positions[indices[j]] + positions[indices[j + 1]] + positions[indices[j + 2]]) / 3.0f;
+			normal += areaNormal;
+			area += length(areaNormal);
+		}
+
+		clusters[i].sortKey = 0.0;
+		if(area > 0.0 && length(normal) > 0.0)
+		{
+			clusters[i].sortKey = dot(centroid / area - meshCentroid, normalize(normal));
+		}
+	}
+	stable_sort(clusters.begin(), clusters.end(), compareOverdrawClusters);
+
+	newIndices.reserve(indices.size());
+	for(i = 0; i < (int)clusters.size(); i ++)
+	{
+		newIndices.insert(newIndices.end(), indices.begin() + clusters[i].firstIndex, indices.begin() + clusters[i].firstIndex + clusters[i].numIndices);
+	}
+	indices.swap(newIndices);
+}
+
+void optimizeVertexFetch(vector<GLushort> &indices, int numVertices, vector<int> &newOrder)
+{
+	vector<int> newIndex(numVertices, -1);
+	int i;
+
+	newOrder.clear();
+	for(i = 0; i < (int)indices.size(); i ++)
+	{
+		if(newIndex[indices[i]] < 0)
+		{
+			newIndex[indices[i]] = newOrder.size();
+			newOrder.push_back(indices[i]);
+		}
+		indices[i] = newIndex[indices[i]];
+	}
+
+	// anything no triangle uses goes at the end
+	for(i = 0; i < numVertices; i ++)
+	{
+		if(newIndex[i] < 0)
+		{
+			newIndex[i] = newOrder.size();
+			newOrder.push_back(i);
+		}
+	}
+}
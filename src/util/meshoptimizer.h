@@ -0,0 +1,28 @@
+#pragma once
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+// the passes Mesh runs over a freshly indexed mesh before cooking it, so that every draw of it (and there are thousands
+// of trees and drones) gets as much out of the GPU's post-transform vertex cache as it can. All of them just reorder:
+// the triangles drawn and the vertices they use stay exactly the same
+
+// average cache misses per triangle (ACMR) when the indices are drawn through a FIFO post-transform cache of the
+// given size; 3.0 means no vertex is ever reused, 0.5 is about the best a regular grid can do
+float computeACMR(const std::vector<GLushort> &indices, int numVertices, int cacheSize);
+
+// reorder triangles so each one reuses vertices the last few transformed, after Tom Forsyth's "Linear-Speed Vertex
+// Cache Optimisation" (https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html)
+void optimizeVertexCache(std::vector<GLushort> &indices, int numVertices);
+
+// split the (cache-optimised) triangles into clusters and draw the ones facing out from the middle of the mesh first,
+// since they are the likeliest to hide the rest, after Sander, Nehab, and Barczak's "Fast Triangle Reordering for
+// Vertex Locality and Reduced Overdraw". Clusters are only split where their ACMR stays within threshold (e.g. 1.05)
+// of what it was, so little of the cache optimisation is given back
+void optimizeOverdraw(std::vector<GLushort> &indices, const std::vector<glm::vec3> &positions, float threshold);
+
+// renumber the vertices in the order the indices first use them, so that vertex fetches walk through memory;
+// newOrder receives the old index of each vertex in its new place
+void optimizeVertexFetch(std::vector<GLushort> &indices, int numVertices, std::vector<int> &newOrder);
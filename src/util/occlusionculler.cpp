@@ -0,0 +1,362 @@
+#include "util/occlusionculler.h"
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+using namespace glm;
+
+#include <emmintrin.h>									// SSE2
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+const int OcclusionCuller::WIDTH = 256;
+const int OcclusionCuller::HEIGHT = 128;
+const float OcclusionCuller::MIN_W = 0.1;				// the camera's near plane
+const float OcclusionCuller::GUARD_BAND = 2.0;			// twice the width and height of the screen
+
+OcclusionCuller::OcclusionCuller(vector<vec3> &vertices, vector<GLuint> &indices)
+{
+	int width = WIDTH;
+	int height = HEIGHT;
+
+	this -> vertices = vertices;
+	this -> indices = indices;
+	clipVertices.resize(vertices.size());
+
+	// the pyramid goes all the way up to the level that is a single texel high
+	levels.push_back(vector<float>(width * height, 0.0f));
+	while(width > 1 && height > 1)
+	{
+		width /= 2;
+		height /= 2;
+		levels.push_back(vector<float>(width * height, 0.0f));
+	}
+
+	viewProjection = mat4(1.0);
+}
+
+void OcclusionCuller::render(mat4 &projection, mat4 &view)
+{
+	const vec4 *a, *b, *c;
+	unsigned int i;
+
+	viewProjection = projection * view;
+
+	// nothing is in front of anything until we draw it
+	fill(levels[0].begin(), levels[0].end(), 0.0f);
+
+	for(i = 0; i < vertices.size(); i ++)
+	{
+		clipVertices[i] = viewProjection * vec4(vertices[i], 1.0);
+	}
+
+	for(i = 0; i + 2 < indices.size(); i += 3)
+	{
+		a = &clipVertices[indices[i]];
+		b = &clipVertices[indices[i + 1]];
+		c = &clipVertices[indices[i + 2]];
+
+		// most of the occluder is off to the side or behind us, and those triangles can be thrown away right here
+		if((a -> x > a -> w && b -> x > b -> w && c -> x > c -> w) ||
+		   (a -> x < -a -> w && b -> x < -b -> w && c -> x < -c -> w) ||
+		   (a -> y > a -> w && b -> y > b -> w && c -> y > c -> w) ||
+		   (a -> y < -a -> w && b -> y < -b -> w && c -> y < -c -> w) ||
+		   (a -> w < MIN_W && b -> w < MIN_W && c -> w < MIN_W))
+		{
+			continue;
+		}
+
+		clipTriangle(*a, *b, *c);
+	}
+
+	buildPyramid();
+}
+
+void OcclusionCuller::clipTriangle(const vec4 &a, const vec4 &b, const vec4 &c)
+{
+	// the near plane, then the sides of the guard band; each is inside where dot(plane, vertex) >= 0, except that the
+	// near plane is w >= MIN_W, which needs an offset as well
+	const vec4 PLANES[] = {vec4(0.0, 0.0, 0.0, 1.0),
+						   vec4(-1.0, 0.0, 0.0, GUARD_BAND),
+						   vec4(1.0, 0.0, 0.0, GUARD_BAND),
+						   vec4(0.0, -1.0, 0.0, GUARD_BAND),
+						   vec4(0.0, 1.0, 0.0, GUARD_BAND)};
+	const int NUM_PLANES = 5;
+	const int MAX_VERTICES = 3 + NUM_PLANES;
+
+	vec4 polygons[2][MAX_VERTICES];
+	vec4 *in, *out;
+	float distance[MAX_VERTICES];
+	int numVertices;
+	int i, j, k;
+
+	// most triangles are well inside all of them
+	if(a.w >= MIN_W && b.w >= MIN_W && c.w >= MIN_W &&
+	   abs(a.x) <= a.w * GUARD_BAND && abs(b.x) <= b.w * GUARD_BAND && abs(c.x) <= c.w * GUARD_BAND &&
+	   abs(a.y) <= a.w * GUARD_BAND && abs(b.y) <= b.w * GUARD_BAND && abs(c.y) <= c.w * GUARD_BAND)
+	{
+		rasterizeTriangle(a, b, c);
+		return;
+	}
+
+	// otherwise, Sutherland-Hodgman one plane at a time. Without the guard band, a triangle just past the near plane
+	// can reach thousands of screens across, and the edge functions lose so much precision that it covers texels it
+	// shouldn't
+	polygons[0][0] = a;
+	polygons[0][1] = b;
+	polygons[0][2] = c;
+	numVertices = 3;
+
+	for(i = 0; i < NUM_PLANES; i ++)
+	{
+		in = polygons[i % 2];
+		out = polygons[(i + 1) % 2];
+
+		for(j = 0; j < numVertices; j ++)
+		{
+			distance[j] = dot(PLANES[i], in[j]) - (i == 0 ? MIN_W : 0.0f);
+		}
+
+		k = numVertices;
+		numVertices = 0;
+		for(j = 0; j < k; j ++)
+		{
+			if(distance[j] >= 0.0f)
+			{
+				out[numVertices ++] = in[j];
+			}
+			if((distance[j] >= 0.0f) != (distance[(j + 1) % k] >= 0.0f))
+			{
+				out[numVertices ++] = mix(in[j], in[(j + 1) % k], distance[j] / (distance[j] - distance[(j + 1) % k]));
+			}
+		}
+
+		if(numVertices < 3)
+		{
+			return;
+		}
+	}
+
+	out = polygons[NUM_PLANES % 2];
+	for(i = 2; i < numVertices; i ++)
+	{
+		rasterizeTriangle(out[0], out[i - 1], out[i]);
+	}
+}
+
+void OcclusionCuller::rasterizeTriangle(const vec4 &a, const vec4 &b, const vec4 &c)
+{
+	const vec4 *in[3] = {&a, &b, &c};
+	vec3 p[3];											// screen x and y, and 1/w
+	float edgeA[3], edgeB[3], edgeC[3];					// edge i is opposite p[i], and is positive on the inside
+	float area;
+	float depthA, depthB, depthC;						// 1/w as a plane over the screen
+	int minX, maxX, minY, maxY;
+	int x, y;
+	int i, j, k;
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 columns = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	__m128 e0, e1, e2, depth;
+	__m128 e0Step, e1Step, e2Step, depthStep;
+	__m128 mask, stored;
+	float *row;
+
+	// project to the depth buffer
+	for(i = 0; i < 3; i ++)
+	{
+		p[i].z = 1.0f / in[i] -> w;
+		p[i].x = (in[i] -> x * p[i].z * 0.5f + 0.5f) * WIDTH;
+		p[i].y = (in[i] -> y * p[i].z * 0.5f + 0.5f) * HEIGHT;
+	}
+
+	// the occluder is drawn from both sides, so wind every triangle the same way
+	area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+	if(area < 0.0f)
+	{
+		swap(p[1], p[2]);
+		area = -area;
+	}
+	if(area < 1e-6f)
+	{
+		return;
+	}
+
+	minX = std::max(0, (int)floor(std::min(p[0].x, std::min(p[1].x, p[2].x)))) & ~3;
+	maxX = std::min(WIDTH - 1, (int)ceil(std::max(p[0].x, std::max(p[1].x, p[2].x))));
+	minY = std::max(0, (int)floor(std::min(p[0].y, std::min(p[1].y, p[2].y))));
+	maxY = std::min(HEIGHT - 1, (int)ceil(std::max(p[0].y, std::max(p[1].y, p[2].y))));
+	if(minX > maxX || minY > maxY)
+	{
+		return;
+	}
+
+	// edge functions, as edgeA * x + edgeB * y + edgeC
+	for(i = 0; i < 3; i ++)
+	{
+		j = (i + 1) % 3;
+		k = (i + 2) % 3;
+		edgeA[i] = p[j].y - p[k].y;
+		edgeB[i] = p[k].x - p[j].x;
+		edgeC[i] = -(edgeA[i] * p[j].x + edgeB[i] * p[j].y);
+	}
+
+	// the barycentric weights are the edge functions over the area, which makes 1/w a plane too
+	depthA = (edgeA[0] * p[0].z + edgeA[1] * p[1].z + edgeA[2] * p[2].z) / area;
+	depthB = (edgeB[0] * p[0].z + edgeB[1] * p[1].z + edgeB[2] * p[2].z) / area;
+	depthC = (edgeC[0] * p[0].z + edgeC[1] * p[1].z + edgeC[2] * p[2].z) / area;
+
+	e0Step = _mm_set1_ps(edgeA[0] * 4.0f);
+	e1Step = _mm_set1_ps(edgeA[1] * 4.0f);
+	e2Step = _mm_set1_ps(edgeA[2] * 4.0f);
+	depthStep = _mm_set1_ps(depthA * 4.0f);
+	columns = _mm_add_ps(columns, _mm_set1_ps((float)minX));
+
+	// four texel centres at a time; rows are a multiple of four wide, so we never run off the end of one
+	for(y = minY; y <= maxY; y ++)
+	{
+		e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[0]), columns), _mm_set1_ps(edgeB[0] * (y + 0.5f) + edgeC[0]));
+		e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[1]), columns), _mm_set1_ps(edgeB[1] * (y + 0.5f) + edgeC[1]));
+		e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[2]), columns), _mm_set1_ps(edgeB[2] * (y + 0.5f) + edgeC[2]));
+		depth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(depthA), columns), _mm_set1_ps(depthB * (y + 0.5f) + depthC));
+		row = &levels[0][y * WIDTH];
+
+		for(x = minX; x <= maxX; x += 4)
+		{
+			mask = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+			if(_mm_movemask_ps(mask))
+			{
+				// keep the nearer of what's there and the triangle, but only where the triangle covers
+				stored = _mm_loadu_ps(row + x);
+				stored = _mm_or_ps(_mm_and_ps(mask, _mm_max_ps(stored, depth)), _mm_andnot_ps(mask, stored));
+				_mm_storeu_ps(row + x, stored);
+			}
+
+			e0 = _mm_add_ps(e0, e0Step);
+			e1 = _mm_add_ps(e1, e1Step);
+			e2 = _mm_add_ps(e2, e2Step);
+			depth = _mm_add_ps(depth, depthStep);
+		}
+	}
+}
+
+void OcclusionCuller::buildPyramid()
+{
+	const float *src0, *src1;
+	float *dst;
+	__m128 m0, m1;
+	int srcWidth, width, height;
+	unsigned int level;
+	int x, y;
+
+	for(level = 1; level < levels.size(); level ++)
+	{
+		srcWidth = WIDTH >> (level - 1);
+		width = WIDTH >> level;
+		height = HEIGHT >> level;
+
+		// each texel keeps the farthest of the four beneath it
+		for(y = 0; y < height; y ++)
+		{
+			src0 = &levels[level - 1][(y * 2) * srcWidth];
+			src1 = src0 + srcWidth;
+			dst = &levels[level][y * width];
+
+			for(x = 0; x + 4 <= width; x += 4)
+			{
+				m0 = _mm_min_ps(_mm_loadu_ps(src0 + x * 2), _mm_loadu_ps(src1 + x * 2));
+				m1 = _mm_min_ps(_mm_loadu_ps(src0 + x * 2 + 4), _mm_loadu_ps(src1 + x * 2 + 4));
+				_mm_storeu_ps(dst + x, _mm_min_ps(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(2, 0, 2, 0)),
+												  _mm_shuffle_ps(m0, m1, _MM_SHUFFLE(3, 1, 3, 1))));
+			}
+			for(; x < width; x ++)
+			{
+				dst[x] = std::min(std::min(src0[x * 2], src0[x * 2 + 1]), std::min(src1[x * 2], src1[x * 2 + 1]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::isVisible(vec3 center, float radius)
+{
+	vec4 corner;
+	float invW, x, y;
+	float minX = INFINITY, maxX = -INFINITY, minY = INFINITY, maxY = -INFINITY;
+	float nearest = 0.0;
+	int numBehind = 0;
+	int x0, x1, y0, y1;
+	int width;
+	unsigned int level;
+	int i, j;
+
+	// the screen rectangle and nearest depth of the box around the sphere; w is linear over the box, so the nearest
+	// point is one of its corners
+	for(i = 0; i < 8; i ++)
+	{
+		corner = viewProjection * vec4(center + vec3((i & 1) ? radius : -radius,
+													  (i & 2) ? radius : -radius,
+													  (i & 4) ? radius : -radius), 1.0);
+
+		if(corner.w < MIN_W)
+		{
+			numBehind ++;
+			continue;
+		}
+
+		invW = 1.0f / corner.w;
+		x = (corner.x * invW * 0.5f + 0.5f) * WIDTH;
+		y = (corner.y * invW * 0.5f + 0.5f) * HEIGHT;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearest = std::max(nearest, invW);
+	}
+
+	// anything wholly behind the camera can't be seen, and anything reaching through the near plane is too close to
+	// bother with
+	if(numBehind == 8)
+	{
+		return false;
+	}
+	if(numBehind > 0)
+	{
+		return true;
+	}
+
+	if(maxX < 0.0f || minX > WIDTH || maxY < 0.0f || minY > HEIGHT)
+	{
+		return false;
+	}
+
+	// texels are filled wherever their centres are covered, so the occluder can reach up to half a texel past its real
+	// edge; taking in one more texel all round keeps whatever peeks just over a ridge from being lost to that
+	x0 = std::max(0, (int)floor(minX) - 1);
+	x1 = std::min(WIDTH - 1, (int)floor(maxX) + 1);
+	y0 = std::max(0, (int)floor(minY) - 1);
+	y1 = std::min(HEIGHT - 1, (int)floor(maxY) + 1);
+
+	// go up the pyramid until the rectangle covers no more than two texels each way
+	level = 0;
+	while(level < levels.size() - 1 && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+	{
+		level ++;
+	}
+
+	// the sphere shows if it's nearer than the occluder anywhere in there
+	width = WIDTH >> level;
+	for(i = y0 >> level; i <= y1 >> level; i ++)
+	{
+		for(j = x0 >> level; j <= x1 >> level; j ++)
+		{
+			if(nearest >= levels[level][i * width + j])
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
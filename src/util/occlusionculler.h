@@ -0,0 +1,43 @@
+#pragma once
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+// CPU occlusion culling against a fixed occluder mesh (in practice, a coarse version of the terrain that never pokes
+// above the real thing). Once a frame, render() rasterises the occluder into a small depth buffer with a SIMD software
+// rasteriser and builds a hierarchical-Z pyramid from it; after that, isVisible() can tell whether a bounding sphere
+// is hidden behind the occluder (or off screen) by looking at no more than a few texels of the pyramid.
+//
+// Depth is stored as 1/w, which interpolates linearly across the screen and needs no near or far plane; 0 is infinitely
+// far away. Each pyramid level keeps the farthest (smallest) depth of the four texels below it.
+class OcclusionCuller
+{
+private:
+	static const int WIDTH;								// depth buffer size; a multiple of 8 so rows can be processed 4 texels at a time
+	static const int HEIGHT;
+	static const float MIN_W;							// clip-space w nothing is rasterised or tested in front of
+	static const float GUARD_BAND;						// how far past the edges of the screen triangles may reach before they're clipped
+
+	std::vector<glm::vec3> vertices;					// the occluder mesh, in world space
+	std::vector<GLuint> indices;
+
+	std::vector<glm::vec4> clipVertices;				// occluder vertices transformed this frame
+	std::vector<std::vector<float> > levels;			// hierarchical-Z pyramid; levels[0] is the depth buffer itself
+	glm::mat4 viewProjection;							// camera used for the last render()
+
+	// the clip-space triangle is first clipped against w = MIN_W and the guard band, then rasterised
+	void clipTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+	void rasterizeTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+	void buildPyramid();
+
+public:
+	OcclusionCuller(std::vector<glm::vec3> &vertices, std::vector<GLuint> &indices);
+
+	// rasterise the occluder for this frame's camera; must be called before isVisible()
+	void render(glm::mat4 &projection, glm::mat4 &view);
+
+	// false iff the sphere is entirely off screen or entirely behind the occluder
+	bool isVisible(glm::vec3 center, float radius);
+};
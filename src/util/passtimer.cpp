@@ -0,0 +1,176 @@
+#include "util/passtimer.h"
+
+#include "GL/glew.h"
+
+#include "GLFW/glfw3.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+PassTimer *PassTimer::instance = NULL;
+
+PassTimer::PassTimer()
+{
+	enabled = false;
+	numMarks = 0;
+	resetStats();
+
+	glGenQueries(MAX_MARKS, queries);
+}
+
+PassTimer::~PassTimer()
+{
+	glDeleteQueries(MAX_MARKS, queries);
+	instance = NULL;
+}
+
+PassTimer *PassTimer::getInstance()
+{
+	if(instance == NULL)
+	{
+		instance = new PassTimer();
+	}
+
+	return instance;
+}
+
+void PassTimer::setEnabled(bool enabled)
+{
+	this -> enabled = enabled;
+}
+
+bool PassTimer::isEnabled()
+{
+	return enabled;
+}
+
+int PassTimer::findPass(const char *name)
+{
+	PassStats stats;
+	unsigned int i;
+
+	for(i = 0; i < passes.size(); i ++)
+	{
+		if(passes[i].name == name)
+		{
+			return i;
+		}
+	}
+
+	stats.name = name;
+	stats.cpuTotal = stats.cpuMax = 0.0;
+	stats.gpuTotal = stats.gpuMax = 0.0;
+	stats.numFrames = 0;
+	passes.push_back(stats);
+
+	return passes.size() - 1;
+}
+
+void PassTimer::mark(int pass)
+{
+	// the last mark is always kept free for the end of the frame
+	if(numMarks >= MAX_MARKS - (pass >= 0 ? 1 : 0))
+	{
+		return;
+	}
+
+	markPasses[numMarks] = pass;
+	markTimes[numMarks] = glfwGetTime();
+	glQueryCounter(queries[numMarks], GL_TIMESTAMP);
+	numMarks ++;
+}
+
+void PassTimer::addSample(PassStats &stats, double cpu, double gpu)
+{
+	stats.cpuTotal += cpu;
+	stats.cpuMax = std::max(stats.cpuMax, cpu);
+	stats.gpuTotal += gpu;
+	stats.gpuMax = std::max(stats.gpuMax, gpu);
+	stats.numFrames ++;
+}
+
+void PassTimer::beginFrame()
+{
+	numMarks = 0;
+}
+
+void PassTimer::beginPass(const char *name)
+{
+	if(enabled)
+	{
+		mark(findPass(name));
+	}
+}
+
+void PassTimer::endFrame()
+{
+	GLuint64 timestamps[MAX_MARKS];
+	vector<double> cpu;
+	vector<double> gpu;
+	int i;
+
+	if(!enabled || numMarks == 0)
+	{
+		return;
+	}
+
+	mark(-1);
+
+	// this waits for the GPU to get through the whole frame
+	for(i = 0; i < numMarks; i ++)
+	{
+		glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &timestamps[i]);
+	}
+
+	// a pass that shows up more than once in a frame counts as one pass taking as long as all of them together
+	cpu.resize(passes.size(), 0.0);
+	gpu.resize(passes.size(), 0.0);
+	for(i = 0; i + 1 < numMarks; i ++)
+	{
+		cpu[markPasses[i]] += (markTimes[i + 1] - markTimes[i]) * 1000.0;
+		gpu[markPasses[i]] += (timestamps[i + 1] - timestamps[i]) / 1.0e6;
+	}
+
+	for(i = 0; i < (int)passes.size(); i ++)
+	{
+		addSample(passes[i], cpu[i], gpu[i]);
+	}
+	addSample(frame, (markTimes[numMarks - 1] - markTimes[0]) * 1000.0, (timestamps[numMarks - 1] - timestamps[0]) / 1.0e6);
+
+	numMarks = 0;
+}
+
+void PassTimer::resetStats()
+{
+	unsigned int i;
+
+	for(i = 0; i < passes.size(); i ++)
+	{
+		passes[i].cpuTotal = passes[i].cpuMax = 0.0;
+		passes[i].gpuTotal = passes[i].gpuMax = 0.0;
+		passes[i].numFrames = 0;
+	}
+
+	frame.name = "frame";
+	frame.cpuTotal = frame.cpuMax = 0.0;
+	frame.gpuTotal = frame.gpuMax = 0.0;
+	frame.numFrames = 0;
+}
+
+int PassTimer::getNumPasses()
+{
+	return passes.size();
+}
+
+const PassTimer::PassStats &PassTimer::getPass(int index)
+{
+	return passes[index];
+}
+
+const PassTimer::PassStats &PassTimer::getFrame()
+{
+	return frame;
+}
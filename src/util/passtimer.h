@@ -0,0 +1,68 @@
+#pragma once
+
+#include "GL/glew.h"
+
+#include <string>
+#include <vector>
+
+// per-pass CPU and GPU timings for benchmark runs. Rendering code marks where each pass starts with beginPass(); a pass
+// runs until the next one starts or the frame ends. The CPU side is timed with the GLFW clock, the GPU side with
+// GL_TIMESTAMP queries (which, unlike GL_TIME_ELAPSED ones, can be issued while DynamicResolution is timing the scene).
+//
+// endFrame() waits for the GPU to finish the frame so it can read its timestamps back, which is fine for a benchmark
+// but not for the game, so the timer does nothing at all until it is enabled
+class PassTimer
+{
+public:
+	// everything recorded for one pass since the stats were last reset; times are in milliseconds
+	struct PassStats
+	{
+		std::string name;
+		double cpuTotal;
+		double cpuMax;
+		double gpuTotal;
+		double gpuMax;
+		int numFrames;
+	};
+
+private:
+	static const int MAX_MARKS = 32;			// pass starts we can record in one frame, plus one for the end of the frame
+
+	static PassTimer *instance;					// singleton instance
+
+	bool enabled;
+
+	std::vector<PassStats> passes;				// every pass we've seen, in the order we first saw them
+	PassStats frame;							// the whole frame, from its first pass to endFrame()
+
+	// this frame's marks: the pass that starts at each one, and when
+	int markPasses[MAX_MARKS];
+	double markTimes[MAX_MARKS];
+	GLuint queries[MAX_MARKS];
+	int numMarks;
+
+	PassTimer();								// force use of getInstance()
+
+	int findPass(const char *name);				// index into passes, adding the pass if it's new
+	void mark(int pass);						// -1 marks the end of the frame
+	static void addSample(PassStats &stats, double cpu, double gpu);
+
+public:
+	static PassTimer *getInstance();			// singleton design pattern
+
+	~PassTimer();
+
+	void setEnabled(bool enabled);
+	bool isEnabled();
+
+	void beginFrame();
+	void beginPass(const char *name);			// also ends the previous pass
+	void endFrame();							// ends the last pass and adds this frame's times to the stats
+
+	void resetStats();							// forget everything recorded so far, e.g. after some warm-up frames
+
+	// the stats so far; passes come in the order they were first seen
+	int getNumPasses();
+	const PassStats &getPass(int index);
+	const PassStats &getFrame();
+};
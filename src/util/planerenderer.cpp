@@ -1,28 +1,38 @@
+#include "util/glstate.h"
 #include "util/planerenderer.h"
 #include "util/shader.h"
+#include "util/streambuffer.h"
 
 #include "GL/glew.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/type_ptr.hpp"
 using namespace glm;
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <vector>
 using namespace std;
 
 const int PlaneRenderer::NUM_VERTICES = 4;
+const int PlaneRenderer::MAX_SPRITES_PER_FRAME = 256;
 
 PlaneRenderer *PlaneRenderer::instance = NULL;
 
 PlaneRenderer::PlaneRenderer()
 {
+	modelMatrix = mat4(1.0);
+	color = vec4(1.0);
+
 	setupVBOs();
 	loadShader();
 }
 
 PlaneRenderer::~PlaneRenderer()
 {
-	glDeleteBuffers(1, vbos);
+	glDeleteBuffers(2, vbos);
 	glDeleteVertexArrays(1, &vao);
+	delete spriteStream;
 	delete shader;
 	instance = NULL;
 }
@@ -47,6 +57,7 @@ void PlaneRenderer::setupVBOs()
 							   vec2(0.0, 1.0),
 							   vec2(1.0, 0.0),
 							   vec2(1.0, 1.0)};
+	int i;
 
 	// generate our vertex array object and buffers
 	glGenVertexArrays(1, &vao);
@@ -64,6 +75,25 @@ void PlaneRenderer::setupVBOs()
 	glBufferData(GL_ARRAY_BUFFER, sizeof(vec2) * NUM_VERTICES, TEX_COORDS, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+
+	// each sprite's model matrix and colour come from the stream, once per instance
+	spriteStream = new StreamBuffer(GL_ARRAY_BUFFER, sizeof(Sprite) * MAX_SPRITES_PER_FRAME);
+	setupInstanceAttribs(0);
+	for(i = 2; i <= 6; i ++)
+	{
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
+	}
+}
+
+void PlaneRenderer::setupInstanceAttribs(GLintptr offset)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, spriteStream -> getBuffer());
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Sprite), (GLvoid*)offset);
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Sprite), (GLvoid*)(offset + sizeof(vec4)));
+	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Sprite), (GLvoid*)(offset + sizeof(vec4) * 2));
+	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(Sprite), (GLvoid*)(offset + sizeof(vec4) * 3));
+	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Sprite), (GLvoid*)(offset + sizeof(mat4)));
 }
 
 void PlaneRenderer::loadShader()
@@ -71,7 +101,13 @@ void PlaneRenderer::loadShader()
 	shader = new Shader("../shaders/plane.vert", "../shaders/plane.frag");
 	shader -> bindAttrib("a_Vertex", 0);
 	shader -> bindAttrib("a_TexCoord", 1);
-	shader -> link();
+	shader -> bindAttrib("a_Model", 2);
+	shader -> bindAttrib("a_Color", 6);
+	shader -> startLink();
+}
+
+void PlaneRenderer::finishShader()
+{
 	shader -> bind();
 	shader -> uniform1i("u_Texture", 0);
 	shader -> unbind();
@@ -92,18 +128,64 @@ void PlaneRenderer::setViewMatrix(mat4 &viewMatrix)
 	shader -> uniformMatrix4fv("u_View", 1, value_ptr(viewMatrix));
 }
 
+void PlaneRenderer::addSprite(mat4 &modelMatrix, vec4 &color, GLuint texture)
+{
+	Sprite sprite;
+
+	sprite.modelMatrix = modelMatrix;
+	sprite.color = color;
+	sprite.texture = texture;
+	sprites.push_back(sprite);
+}
+
+void PlaneRenderer::flush()
+{
+	GLState *gl = GLState::getInstance();
+	Sprite *instances;
+	GLintptr offset;
+	int numSprites = spriteStream -> clampCount(std::min((int)sprites.size(), MAX_SPRITES_PER_FRAME), sizeof(Sprite), sizeof(vec4));
+	int first, count;
+
+	if(numSprites == 0)
+	{
+		return;
+	}
+
+	// the instance attributes of every queued sprite go up together (the texture tags along unused)
+	instances = (Sprite*)spriteStream -> allocate(sizeof(Sprite) * numSprites, sizeof(vec4), offset);
+	memcpy(instances, &sprites[0], sizeof(Sprite) * numSprites);
+	spriteStream -> commit();
+
+	gl -> bindVertexArray(vao);
+
+	// then one instanced draw for each run of sprites sharing a texture
+	for(first = 0; first < numSprites; first += count)
+	{
+		for(count = 1; first + count < numSprites && sprites[first + count].texture == sprites[first].texture; count ++);
+
+		if(sprites[first].texture)
+		{
+			gl -> bindTexture(0, sprites[first].texture);
+		}
+		setupInstanceAttribs(offset + sizeof(Sprite) * first);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, NUM_VERTICES, count);
+	}
+
+	sprites.clear();
+}
+
 void PlaneRenderer::setModelMatrix(mat4 &modelMatrix)
 {
-	shader -> uniformMatrix4fv("u_Model", 1, value_ptr(modelMatrix));
+	this -> modelMatrix = modelMatrix;
 }
 
 void PlaneRenderer::setColor(vec4 &color)
 {
-	shader -> uniformVec4("u_Color", color);
+	this -> color = color;
 }
 
 void PlaneRenderer::render()
 {
-	glBindVertexArray(vao);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, NUM_VERTICES);
+	addSprite(modelMatrix, color, 0);
+	flush();
 }
@@ -3,12 +3,24 @@
 #include "GL/glew.h"
 #include "glm/glm.hpp"
 
+#include <vector>
+
 class Shader;
+class StreamBuffer;
 
 class PlaneRenderer
 {
 private:
 	static const int NUM_VERTICES;				// must be known to make GL render calls
+	static const int MAX_SPRITES_PER_FRAME;		// sprites the instance stream has room for each frame
+
+	// per-sprite instance attributes; sizeof() is their stride
+	struct Sprite
+	{
+		glm::mat4 modelMatrix;					// attributes 2 to 5
+		glm::vec4 color;						// attribute 6
+		GLuint texture;							// not sent to the GPU; bound for each run of sprites that share it
+	};
 
 	static PlaneRenderer *instance;				// our singleton instance
 
@@ -16,26 +28,38 @@ private:
 
 	GLuint vao;									// GL render state
 	GLuint vbos[2];								// GL vertex buffer objects for vertex position and tex coords
+	StreamBuffer *spriteStream;					// instance attributes of every sprite flushed this frame
+
+	std::vector<Sprite> sprites;				// sprites added since the last flush, in order
+	glm::mat4 modelMatrix;						// what render() draws with
+	glm::vec4 color;
 
 	PlaneRenderer();							// force use of getInstance()
 
 	// configure our geometry and setup our shader program
 	void setupVBOs();
 	void loadShader();
+	void setupInstanceAttribs(GLintptr offset);
 
 public:
 	static PlaneRenderer *getInstance();		// singleton instance
 
 	~PlaneRenderer();
 
-	// since we'll probably be drawing multiples of certain objects using the PlaneRenderer, we can get extra
-	// performance if we eliminate redundant commands to the GPU by only calling these methods below when we
-	// really need to...instanced rendering would be more efficient but for something small-scale like this,
-	// it's not worth the effort and should be fast enough anyways
+	// the program is only started by getInstance(); this sets its uniforms that never change, once it's linked
+	void finishShader();
+
+	// sprites are drawn instanced: addSprite() just remembers each one's transform, colour, and texture, and flush()
+	// sends them all to the GPU at once and draws each run of consecutive sprites that share a texture with a single
+	// call. Sprites are drawn in the order they were added, so blending comes out the same as drawing them one by one
 	void bindShader();												// should be called first to bind the PlaneRenderer shader
 	void setProjectionMatrix(glm::mat4 &projectionMatrix);			// should only be called once, when the ortho projection is computed
 	void setViewMatrix(glm::mat4 &viewMatrix);						// should only be called once, since the ortho view matrix doesn't change
-	void setModelMatrix(glm::mat4 &modelMatrix);					// should be called multiple times, i.e., once per object we want to render
-	void setColor(glm::vec4 &color);								// can be called whenever, depending on the colours of the objects we draw
-	void render();													// called once per object we want to render
+	void addSprite(glm::mat4 &modelMatrix, glm::vec4 &color, GLuint texture);	// queue one plane; a texture of 0 uses whatever is bound to unit 0
+	void flush();													// draw everything queued; expects bindShader() and leaves the last texture bound
+
+	// drawing a single plane is just a batch of one
+	void setModelMatrix(glm::mat4 &modelMatrix);					// model matrix for render()
+	void setColor(glm::vec4 &color);								// colour for render()
+	void render();													// draw one plane with whatever texture is bound, flushing anything queued before it
 };
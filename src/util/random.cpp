@@ -0,0 +1,61 @@
+#include "util/random.h"
+
+#include "glm/glm.hpp"
+using namespace glm;
+
+#include <stdint.h>
+
+Random::Random()
+{
+	seed(0);
+}
+
+Random::Random(uint64_t seed, uint64_t stream)
+{
+	this -> seed(seed, stream);
+}
+
+void Random::seed(uint64_t seed, uint64_t stream)
+{
+	// reference PCG32 seeding procedure
+	state = 0;
+	increment = (stream << 1) | 1;
+	next();
+	state += seed;
+	next();
+}
+
+uint32_t Random::next()
+{
+	uint64_t oldState = state;
+	uint32_t xorShifted;
+	uint32_t rotation;
+
+	// advance the LCG, then permute the old state into the output (XSH RR variant)
+	state = oldState * 6364136223846793005ULL + increment;
+	xorShifted = (uint32_t)(((oldState >> 18) ^ oldState) >> 27);
+	rotation = (uint32_t)(oldState >> 59);
+
+	return (xorShifted >> rotation) | (xorShifted << ((-rotation) & 31));
+}
+
+float Random::nextFloat()
+{
+	// use the top 24 bits so every value is exactly representable and 1.0 is never returned
+	return (next() >> 8) * (1.0f / 16777216.0f);
+}
+
+float Random::range(float min, float max)
+{
+	return min + (max - min) * nextFloat();
+}
+
+vec3 Random::range(vec3 min, vec3 max)
+{
+	return vec3(range(min.x, max.x), range(min.y, max.y), range(min.z, max.z));
+}
+
+vec4 Random::range(vec4 min, vec4 max)
+{
+	return vec4(range(min.x, max.x), range(min.y, max.y), range(min.z, max.z), range(min.w, max.w));
+}
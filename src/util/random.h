@@ -0,0 +1,28 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <stdint.h>
+
+// small, fast PCG32 generator (http://www.pcg-random.org); unlike rand() each instance carries its own state,
+// so every thread can own one and a fixed seed always reproduces the same sequence
+class Random
+{
+private:
+	uint64_t state;								// internal generator state
+	uint64_t increment;							// selects one of 2^63 independent streams; always odd
+
+public:
+	Random();
+	Random(uint64_t seed, uint64_t stream = 0);
+
+	void seed(uint64_t seed, uint64_t stream = 0);	// restart the sequence
+
+	uint32_t next();							// uniformly distributed 32-bit value
+	float nextFloat();							// uniformly distributed in [0, 1)
+
+	// uniformly distributed between min and max, component-wise for vectors (drop-in for glm::linearRand)
+	float range(float min, float max);
+	glm::vec3 range(glm::vec3 min, glm::vec3 max);
+	glm::vec4 range(glm::vec4 min, glm::vec4 max);
+};
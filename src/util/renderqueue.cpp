@@ -0,0 +1,401 @@
+#include "util/renderqueue.h"
+#include "util/glstate.h"
+#include "util/mesharena.h"
+#include "util/shader.h"
+#include "util/streambuffer.h"
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+using namespace glm;
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <stdint.h>
+#include <vector>
+using namespace std;
+
+const int RenderQueue::MAX_PACKETS = 1024;
+const float RenderQueue::MAX_SORT_DEPTH = 8000.0;
+
+RenderQueue *RenderQueue::instance = NULL;
+
+DrawPacket::DrawPacket()
+{
+	int i;
+
+	pass = RENDER_PASS_OPAQUE;
+	depth = 0.0;
+	shader = NULL;
+	for(i = 0; i < MAX_TEXTURES; i ++)
+	{
+		textures[i] = 0;
+	}
+
+	modelView = mat4(1.0);
+	normal = mat3(1.0);
+
+	vao = 0;
+	instanceCount = 1;
+
+	mode = GL_TRIANGLES;
+	baseVertex = 0;
+	first = 0;
+	count = 0;
+}
+
+RenderQueue::RenderQueue()
+{
+	prepared = false;
+	transformOffset = 0;
+
+	packets.reserve(MAX_PACKETS);
+	keys.reserve(MAX_PACKETS);
+
+	// a non-zero base instance in an indirect command needs ARB_base_instance as well
+	multiDraw = GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+
+	// every sorted packet gets a transform and a command slot, whether or not it ends up using them, so both can be
+	// found by the packet's position in the sorted order
+	transformStream = new StreamBuffer(GL_ARRAY_BUFFER, sizeof(MeshArena::DrawTransform) * MAX_PACKETS);
+	indirectStream = NULL;
+	if(multiDraw)
+	{
+		indirectStream = new StreamBuffer(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsCommand) * MAX_PACKETS);
+	}
+}
+
+RenderQueue::~RenderQueue()
+{
+	delete transformStream;
+	delete indirectStream;
+
+	instance = NULL;
+}
+
+RenderQueue *RenderQueue::getInstance()
+{
+	if(!instance)
+	{
+		instance = new RenderQueue();
+	}
+
+	return instance;
+}
+
+uint64_t RenderQueue::makeKey(const DrawPacket &packet)
+{
+	const uint64_t MAX_SHADER_ID = 0xfff;			// 12 bits
+	const uint64_t MAX_MATERIAL_ID = 0xffff;		// 16 bits
+	const uint64_t MAX_DEPTH = 0xffffff;			// 24 bits
+
+	vector<GLuint> material(packet.textures, packet.textures + DrawPacket::MAX_TEXTURES);
+	int nextID;
+	uint64_t shaderID;
+	uint64_t materialID;
+	uint64_t depth;
+
+	// ids are handed out the first time we see a shader or material, and then stay the same for the rest of the game
+	if(shaderIDs.find(packet.shader) == shaderIDs.end())
+	{
+		nextID = shaderIDs.size();
+		shaderIDs[packet.shader] = nextID;
+	}
+	if(materialIDs.find(material) == materialIDs.end())
+	{
+		nextID = materialIDs.size();
+		materialIDs[material] = nextID;
+	}
+	shaderID = std::min((uint64_t)shaderIDs[packet.shader], MAX_SHADER_ID);
+	materialID = std::min((uint64_t)materialIDs[material], MAX_MATERIAL_ID);
+	depth = (uint64_t)(glm::clamp(packet.depth / MAX_SORT_DEPTH, 0.0f, 1.0f) * MAX_DEPTH);
+
+	// transparent things must be drawn back to front whatever the state changes cost us; everything else is grouped by
+	// state first and only drawn front to back within that, so that at least some of the hidden pixels get rejected
+	if(packet.pass == RENDER_PASS_TRANSPARENT)
+	{
+		return ((uint64_t)packet.pass << 62) | ((MAX_DEPTH - depth) << 38) | (shaderID << 26) | (materialID << 10);
+	}
+	else
+	{
+		return ((uint64_t)packet.pass << 62) | (shaderID << 50) | (materialID << 34) | (depth << 10);
+	}
+}
+
+void RenderQueue::sortPackets()
+{
+	const int RADIX_BITS = 8;
+	const int NUM_BUCKETS = 1 << RADIX_BITS;
+
+	int counts[NUM_BUCKETS];
+	int numPackets = packets.size();
+	int shift;
+	int bucket;
+	int total;
+	int i;
+
+	order.resize(numPackets);
+	sortKeys.resize(numPackets);
+	tempKeys.resize(numPackets);
+	tempOrder.resize(numPackets);
+	for(i = 0; i < numPackets; i ++)
+	{
+		order[i] = i;
+		sortKeys[i] = keys[i];
+	}
+
+	// least significant digit first; each pass is stable, so the order of the lower digits survives the higher ones
+	for(shift = 0; shift < 64; shift += RADIX_BITS)
+	{
+		for(i = 0; i < NUM_BUCKETS; i ++)
+		{
+			counts[i] = 0;
+		}
+		for(i = 0; i < numPackets; i ++)
+		{
+			counts[(sortKeys[i] >> shift) & (NUM_BUCKETS - 1)] ++;
+		}
+
+		// most digits are the same for every packet (unused ids, unused key bits), and those passes would change nothing
+		if(counts[(sortKeys[0] >> shift) & (NUM_BUCKETS - 1)] == numPackets)
+		{
+			continue;
+		}
+
+		// turn the counts into where each bucket starts, then scatter
+		total = 0;
+		for(i = 0; i < NUM_BUCKETS; i ++)
+		{
+			bucket = counts[i];
+			counts[i] = total;
+			total += bucket;
+		}
+		for(i = 0; i < numPackets; i ++)
+		{
+			bucket = (sortKeys[i] >> shift) & (NUM_BUCKETS - 1);
+			tempKeys[counts[bucket]] = sortKeys[i];
+			tempOrder[counts[bucket]] = order[i];
+			counts[bucket] ++;
+		}
+
+		sortKeys.swap(tempKeys);
+		order.swap(tempOrder);
+	}
+}
+
+bool RenderQueue::canBatch(const DrawPacket &first, const DrawPacket &next)
+{
+	int i;
+
+	// only arena meshes share a vertex array, and instanced draws bring their own transforms
+	if(first.vao != 0 || next.vao != 0)
+	{
+		return false;
+	}
+
+	if(first.pass != next.pass || first.shader != next.shader || first.mode != next.mode)
+	{
+		return false;
+	}
+
+	for(i = 0; i < DrawPacket::MAX_TEXTURES; i ++)
+	{
+		if(first.textures[i] != next.textures[i])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void RenderQueue::prepare()
+{
+	MeshArena::DrawTransform *transforms;
+	DrawElementsCommand *commands;
+	GLintptr commandOffset = 0;
+	int numPackets = packets.size();
+	DrawPacket *packet;
+	Batch batch;
+	int i;
+
+	sortPackets();
+
+	// if the streams are short of room, the packets at the back of the order are the ones that go undrawn
+	numPackets = transformStream -> clampCount(numPackets, sizeof(MeshArena::DrawTransform), sizeof(vec4));
+	if(multiDraw)
+	{
+		numPackets = indirectStream -> clampCount(numPackets, sizeof(DrawElementsCommand), sizeof(GLuint));
+	}
+
+	// transforms and commands go into this frame's regions in sorted order, so a batch's are always contiguous
+	transforms = (MeshArena::DrawTransform*)transformStream -> allocate(sizeof(MeshArena::DrawTransform) * numPackets, sizeof(vec4), transformOffset);
+	commands = NULL;
+	if(multiDraw)
+	{
+		commands = (DrawElementsCommand*)indirectStream -> allocate(sizeof(DrawElementsCommand) * numPackets, sizeof(GLuint), commandOffset);
+	}
+
+	batches.clear();
+	for(i = 0; i < numPackets; i ++)
+	{
+		packet = &packets[order[i]];
+
+		transforms[i].modelView = packet -> modelView;
+		transforms[i].normal = packet -> normal;
+		if(commands)
+		{
+			commands[i].count = packet -> count;
+			commands[i].instanceCount = 1;
+			commands[i].firstIndex = packet -> first;
+			commands[i].baseVertex = packet -> baseVertex;
+			commands[i].baseInstance = i;
+		}
+
+		if(!batches.empty() && canBatch(packets[order[batches.back().firstPacket]], *packet))
+		{
+			batches.back().numPackets ++;
+		}
+		else
+		{
+			batch.pass = packet -> pass;
+			batch.firstPacket = i;
+			batch.numPackets = 1;
+			batch.indirectOffset = commandOffset + sizeof(DrawElementsCommand) * i;
+			batches.push_back(batch);
+		}
+	}
+
+	transformStream -> commit();
+	if(multiDraw)
+	{
+		indirectStream -> commit();
+
+		// base instances count from this frame's first transform
+		GLState::getInstance() -> bindVertexArray(MeshArena::getInstance() -> getVAO());
+		MeshArena::getInstance() -> bindTransforms(transformStream -> getBuffer(), transformOffset);
+	}
+
+	prepared = true;
+}
+
+void RenderQueue::setPassState(int pass)
+{
+	GLState *gl = GLState::getInstance();
+
+	// nothing the queue draws is culled
+	gl -> disable(GL_CULL_FACE);
+	gl -> polygonMode(GL_FILL);
+
+	if(pass == RENDER_PASS_OPAQUE)
+	{
+		gl -> disable(GL_BLEND);
+		gl -> depthMask(true);
+	}
+	else
+	{
+		gl -> enable(GL_BLEND);
+		gl -> blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		gl -> depthMask(pass != RENDER_PASS_TRANSPARENT);
+	}
+}
+
+void RenderQueue::drawBatch(Batch &batch)
+{
+	GLState *gl = GLState::getInstance();
+	MeshArena *arena = MeshArena::getInstance();
+	DrawPacket *packet = &packets[order[batch.firstPacket]];
+	int i;
+
+	packet -> shader -> bind();
+	for(i = 0; i < DrawPacket::MAX_TEXTURES; i ++)
+	{
+		if(packet -> textures[i])
+		{
+			gl -> bindTexture(i, packet -> textures[i]);
+		}
+	}
+
+	if(packet -> vao)
+	{
+		gl -> bindVertexArray(packet -> vao);
+		glDrawElementsInstancedBaseVertex(packet -> mode, packet -> count, GL_UNSIGNED_SHORT, (GLvoid*)(sizeof(GLushort) * packet -> first), packet -> instanceCount, packet -> baseVertex);
+	}
+	else if(multiDraw)
+	{
+		// the whole batch in one call; each command's base instance selects its transform
+		gl -> bindVertexArray(arena -> getVAO());
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectStream -> getBuffer());
+		glMultiDrawElementsIndirect(packet -> mode, GL_UNSIGNED_SHORT, (GLvoid*)batch.indirectOffset, batch.numPackets, 0);
+	}
+	else
+	{
+		// still only one bind of the program and textures, but each draw has to point the transform at its own
+		gl -> bindVertexArray(arena -> getVAO());
+		for(i = batch.firstPacket; i < batch.firstPacket + batch.numPackets; i ++)
+		{
+			packet = &packets[order[i]];
+			arena -> bindTransforms(transformStream -> getBuffer(), transformOffset + sizeof(MeshArena::DrawTransform) * i);
+			glDrawElementsBaseVertex(packet -> mode, packet -> count, GL_UNSIGNED_SHORT, (GLvoid*)(sizeof(GLushort) * packet -> first), packet -> baseVertex);
+		}
+	}
+}
+
+void RenderQueue::submit(const DrawPacket &packet)
+{
+	if((int)packets.size() >= MAX_PACKETS)
+	{
+		cerr << "RenderQueue::submit() cannot queue a draw because the maximum of " << MAX_PACKETS << " has been reached" << endl;
+		exit(1);
+	}
+
+	packets.push_back(packet);
+	keys.push_back(makeKey(packet));
+}
+
+void RenderQueue::render(int pass)
+{
+	GLState *gl = GLState::getInstance();
+	bool stateSet = false;
+	unsigned int i;
+
+	if(packets.empty())
+	{
+		return;
+	}
+
+	if(!prepared)
+	{
+		prepare();
+	}
+
+	// batches are sorted by pass, so this one's are all together
+	for(i = 0; i < batches.size(); i ++)
+	{
+		if(batches[i].pass == pass)
+		{
+			if(!stateSet)
+			{
+				setPassState(pass);
+				stateSet = true;
+			}
+
+			drawBatch(batches[i]);
+		}
+	}
+
+	// leave things the way everyone else expects them
+	if(stateSet)
+	{
+		gl -> depthMask(true);
+		gl -> disable(GL_BLEND);
+	}
+}
+
+void RenderQueue::clear()
+{
+	packets.clear();
+	keys.clear();
+	prepared = false;
+}
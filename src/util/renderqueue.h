@@ -0,0 +1,125 @@
+#pragma once
+
+#include "util/mesharena.h"
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+class Shader;
+class StreamBuffer;
+
+// the passes the render queue draws in; each has its own blending and depth-writing state
+enum RenderPass
+{
+	RENDER_PASS_OPAQUE,						// no blending, sorted front to back
+	RENDER_PASS_CUTOUT,						// blended, but still writing depth (the tree leaves)
+	RENDER_PASS_TRANSPARENT,				// blended without depth writes, sorted back to front
+	NUM_RENDER_PASSES
+};
+
+// one draw call's worth of work, as handed to RenderQueue::submit()
+struct DrawPacket
+{
+	static const int MAX_TEXTURES = 4;		// units 0 to 3
+
+	int pass;								// one of RenderPass
+	float depth;							// distance from the camera, for ordering within the pass
+	Shader *shader;							// linked program, with its material uniforms already set
+	GLuint textures[MAX_TEXTURES];			// bound to units 0 to 3; 0 for units we don't use
+
+	// either a mesh in the mesh arena (vao of 0), drawn once with the given transform...
+	glm::mat4 modelView;
+	glm::mat3 normal;
+
+	// ...or a vertex array of our own, whose instances supply their own transforms
+	GLuint vao;
+	int instanceCount;
+
+	// everything is drawn with 16-bit indices from the vertex array's element array buffer
+	GLenum mode;
+	int baseVertex;							// added to every index
+	int first;								// first index to draw
+	int count;								// number of indices to draw
+
+	DrawPacket();
+};
+
+// subsystems submit their draws here rather than drawing straight away; once a frame, the queue sorts them by pass,
+// shader, material, and depth (with a radix sort on a 64-bit key) and draws each pass in that order, so state is only
+// changed when it has to be. Runs of arena meshes that share a shader and material are drawn with a single
+// glMultiDrawElementsIndirect() where the driver supports it, each draw picking its transform with its base instance
+class RenderQueue
+{
+private:
+	static const int MAX_PACKETS;					// draws we can queue per frame
+	static const float MAX_SORT_DEPTH;				// depths beyond this all sort the same
+
+	// consecutive sorted packets that are drawn together
+	struct Batch
+	{
+		int pass;
+		int firstPacket;							// index into order
+		int numPackets;
+		GLintptr indirectOffset;					// where this batch's commands are in the indirect stream
+	};
+
+	// what glMultiDrawElementsIndirect() reads for each draw
+	struct DrawElementsCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	static RenderQueue *instance;					// singleton instance
+
+	std::vector<DrawPacket> packets;				// this frame's packets, in submission order
+	std::vector<uint64_t> keys;						// sort key of each packet
+	std::vector<int> order;							// packet indices, sorted by key
+	std::vector<Batch> batches;						// sorted packets, grouped into draw calls
+	bool prepared;									// have we sorted and batched this frame's packets yet?
+
+	// scratch space for the radix sort
+	std::vector<uint64_t> sortKeys;
+	std::vector<uint64_t> tempKeys;
+	std::vector<int> tempOrder;
+
+	// small ids the sort key is built from, handed out in order of first use
+	std::map<Shader*, int> shaderIDs;
+	std::map<std::vector<GLuint>, int> materialIDs;
+
+	bool multiDraw;									// can we use glMultiDrawElementsIndirect() with base instances?
+	StreamBuffer *transformStream;					// per-draw MeshArena::DrawTransforms of arena packets
+	StreamBuffer *indirectStream;					// per-draw commands for multi-draws; NULL without multi-draw
+	GLintptr transformOffset;						// where this frame's transforms start in transformStream
+
+	RenderQueue();									// force use of getInstance()
+
+	uint64_t makeKey(const DrawPacket &packet);
+	void sortPackets();								// radix sort order by keys
+	bool canBatch(const DrawPacket &first, const DrawPacket &next);
+	void prepare();									// sort, batch, and upload transforms and commands
+
+	void setPassState(int pass);
+	void drawBatch(Batch &batch);
+
+public:
+	static RenderQueue *getInstance();				// singleton design pattern
+
+	~RenderQueue();
+
+	// queue a draw for this frame
+	void submit(const DrawPacket &packet);
+
+	// draw everything queued for the given pass; the first call each frame sorts the queue
+	void render(int pass);
+
+	// forget this frame's packets; called once everything has been rendered
+	void clear();
+};
@@ -1,187 +1,635 @@
 #include "util/shader.h"
+#include "util/framedata.h"
+#include "util/glstate.h"
 
 #include "GL/glew.h"
 #include "glm/glm.hpp"
 using namespace glm;
 
+#include "sys/stat.h"
+
+#include <algorithm>
 #include <fstream>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <sstream>
 #include <string>
+#include <vector>
 using namespace std;
 
-Shader::Shader(string vertex, string frag)
+const char *Shader::BINARY_CACHE_DIR = "../shadercache";
+
+vector<Shader*> Shader::linking;
+map<string, string> Shader::includes;
+
+Shader::Shader(string vertex, string frag, string defines)
 {
-    GLint vertexCompiled;
-    GLint fragCompiled;
+	vertexFile = vertex;
+	fragmentFile = frag;
+	vertexSource = loadSource(vertex);
+	fragmentSource = loadSource(frag);
+	this -> defines = defines;
+	stage = GL_VERTEX_SHADER;
+
+	// nothing is compiled until link(), since we may well find the finished program in the binary cache
+	vertexShader = 0;
+	fragmentShader = 0;
+	program = glCreateProgram();
+	linked = false;
+	linkStarted = false;
+	fromBinary = false;
+}
 
-	char *vertexFile = textFileRead(vertex.c_str());
-	char *fragFile = textFileRead(frag.c_str());
+Shader::Shader(string file, GLenum stage, string defines)
+{
+	// no fragment stage; vertex programs like these only ever run with GL_RASTERIZER_DISCARD enabled, and compute
+	// programs are dispatched rather than drawn with
+	vertexFile = file;
+	vertexSource = loadSource(file);
+	this -> defines = defines;
+	this -> stage = stage;
+
+	vertexShader = 0;
+	fragmentShader = 0;
+	program = glCreateProgram();
+	linked = false;
+	linkStarted = false;
+	fromBinary = false;
+}
 
-	// create our separate vertex and fragment shader program
-	vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+Shader::~Shader()
+{
+	if(linkStarted && !linked)
+	{
+		linking.erase(find(linking.begin(), linking.end(), this));
+	}
+	if(vertexShader)
+	{
+		glDetachShader(program, vertexShader);
+		glDeleteShader(vertexShader);
+	}
+	if(fragmentShader)
+	{
+		glDetachShader(program, fragmentShader);
+		glDeleteShader(fragmentShader);
+	}
+    glDeleteProgram(program);
+}
+
+void Shader::compile()
+{
+	static bool parallelCompileEnabled = false;
+
+	// let the driver use as many threads as it likes; nothing here asks how compiling went, so the stages of this
+	// program (and of every other program started before finishLinks()) are all built side by side
+	if(!parallelCompileEnabled && GLEW_ARB_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsARB(0xffffffff);
+		parallelCompileEnabled = true;
+	}
+
+	vertexShader = glCreateShader(stage);
+	setSource(vertexShader, vertexSource.c_str(), defines);
+	glCompileShader(vertexShader);
+	glAttachShader(program, vertexShader);
 
-    // specify source code for the vertex and shader programs
-	glShaderSource(vertexShader, 1, &vertexFile, NULL);
-	glShaderSource(fragmentShader, 1, &fragFile, NULL);
+	if(!fragmentSource.empty())
+	{
+		fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+		setSource(fragmentShader, fragmentSource.c_str(), defines);
+		glCompileShader(fragmentShader);
+		glAttachShader(program, fragmentShader);
+	}
+}
 
-	// compile the vertex shader and check for errors
-    glCompileShader(vertexShader);
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &vertexCompiled);
-    if(!vertexCompiled)
-    {
-		cout << "Shader::Shader() could not compile vertex shader " << vertex << endl;
+void Shader::checkCompiled()
+{
+	GLint vertexCompiled;
+	GLint fragCompiled;
+
+	// check the vertex shader for errors
+	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &vertexCompiled);
+	if(!vertexCompiled)
+	{
+		cout << "Shader::link() could not compile " << (stage == GL_COMPUTE_SHADER ? "compute" : "vertex") << " shader " << vertexFile << endl;
 		printShaderLogInfo(vertexShader);
 		exit(1);
-    }
-
-    // compile the fragment shader and check for errors
-    glCompileShader(fragmentShader);
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &fragCompiled);
-    if(!fragCompiled)
-    {
-		cout << "Shader::Shader() could not compile fragment shader " << frag << endl;
-		printShaderLogInfo(fragmentShader);
-		exit(1);
-    }
+	}
 
-    // if we compiled successfully, bind them together into our final shader program
-    // that we activate when we want to render with it
-    if(vertexCompiled && fragCompiled)
-    {
-        program = glCreateProgram();
-        glAttachShader(program, vertexShader);
-        glAttachShader(program, fragmentShader);
-    }
+	// and the fragment shader, if there is one
+	if(fragmentShader)
+	{
+		glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &fragCompiled);
+		if(!fragCompiled)
+		{
+			cout << "Shader::link() could not compile fragment shader " << fragmentFile << endl;
+			printShaderLogInfo(fragmentShader);
+			exit(1);
+		}
+	}
 }
 
-Shader::~Shader()
+void Shader::startCompileAndLink()
 {
-	glDetachShader(program, vertexShader);
-	glDetachShader(program, fragmentShader);
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-    glDeleteProgram(program);
+	compile();
+	if(GLEW_ARB_get_program_binary)
+	{
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(program);
 }
 
 void Shader::link()
 {
-	GLint linked = false;
+	startLink();
+	finishLink();
+}
 
-	glLinkProgram(program);
-	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+void Shader::startLink()
+{
+	if(linked || linkStarted)
+	{
+		return;
+	}
 
-	if(!linked)
+	// a program we linked on an earlier run can be loaded straight back, without going anywhere near the compiler;
+	// whether the driver took it is only asked in finishLink()
+	cachePath = getBinaryCachePath();
+	fromBinary = loadBinary(cachePath);
+	if(!fromBinary)
 	{
-		cerr << "Shader::Shader() compiled but could not be linked" << endl;
-		printShaderLogInfo(vertexShader);
-		printShaderLogInfo(fragmentShader);
-		exit(1);
+		startCompileAndLink();
 	}
+
+	linkStarted = true;
+	linking.push_back(this);
+}
+
+void Shader::finishLink()
+{
+	GLint linkStatus = false;
+	GLuint blockIndex;
+
+	if(linked)
+	{
+		return;
+	}
+	startLink();
+	linking.erase(find(linking.begin(), linking.end(), this));
+
+	// drivers are free to turn down binaries (after an update, say), in which case we build the program as usual;
+	// that one miss is then compiled on its own
+	glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+	if(!linkStatus && fromBinary)
+	{
+		fromBinary = false;
+		startCompileAndLink();
+		glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+	}
+
+	if(!fromBinary)
+	{
+		if(!linkStatus)
+		{
+			checkCompiled();
+			cerr << "Shader::link() " << vertexFile << " compiled but could not be linked" << endl;
+			printShaderLogInfo(vertexShader);
+			if(fragmentShader)
+			{
+				printShaderLogInfo(fragmentShader);
+			}
+			exit(1);
+		}
+
+		saveBinary(cachePath);
+	}
+
+	// hook the per-frame uniform block up to where FrameData keeps it, if this program uses it
+	blockIndex = glGetUniformBlockIndex(program, FrameData::BLOCK_NAME);
+	if(blockIndex != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(program, blockIndex, FrameData::BINDING_POINT);
+	}
+
+	cacheUniformLocations();
+	linked = true;
+}
+
+void Shader::finishLinks()
+{
+	// oldest first, since the driver will most likely have got through those already
+	while(!linking.empty())
+	{
+		linking.front() -> finishLink();
+	}
+}
+
+void Shader::setSource(GLuint shader, const char *source, const string &defines)
+{
+	const char *strings[3];
+	GLint lengths[3];
+	const char *firstLine;
+	istringstream symbols(defines);
+	string symbol;
+	string prelude;
+
+	// "#version" has to come before anything else, so the defines go straight after it; the #line puts the
+	// line numbers in compiler errors back to where they are in the file
+	while(symbols >> symbol)
+	{
+		prelude += "#define " + symbol + "\n";
+	}
+	if(prelude.empty())
+	{
+		glShaderSource(shader, 1, &source, NULL);
+		return;
+	}
+	prelude += "#line 2\n";
+
+	firstLine = strchr(source, '\n');
+	if(!firstLine)
+	{
+		firstLine = source + strlen(source);
+	}
+	else
+	{
+		firstLine ++;
+	}
+
+	strings[0] = source;
+	lengths[0] = firstLine - source;
+	strings[1] = prelude.c_str();
+	lengths[1] = prelude.size();
+	strings[2] = firstLine;
+	lengths[2] = strlen(firstLine);
+	glShaderSource(shader, 3, strings, lengths);
+}
+
+string Shader::getBinaryCachePath()
+{
+	const char *DRIVER_STRINGS[3] = {(const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION)};
+
+	uint64_t hash = 14695981039346656037ULL;		// 64-bit FNV-1a
+	string key;
+	char name[32];
+	unsigned int i;
+
+	if(!GLEW_ARB_get_program_binary)
+	{
+		return "";
+	}
+
+	// anything that changes the program, or the driver that built it, has to change the key; the separators keep
+	// "ab" + "c" from hashing the same as "a" + "bc"
+	for(i = 0; i < 3; i ++)
+	{
+		key += (DRIVER_STRINGS[i] ? DRIVER_STRINGS[i] : "");
+		key += '\0';
+	}
+	key += vertexSource + '\0' + fragmentSource + '\0' + defines + '\0' + linkState;
+
+	for(i = 0; i < key.size(); i ++)
+	{
+		hash ^= (unsigned char)key[i];
+		hash *= 1099511628211ULL;
+	}
+
+	snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)hash);
+	return BINARY_CACHE_DIR + string(name);
+}
+
+bool Shader::loadBinary(string &path)
+{
+	ifstream file;
+	GLenum format;
+	GLint length;
+	char *binary;
+
+	if(path.empty())
+	{
+		return false;
+	}
+
+	file.open(path.c_str(), ios::in | ios::binary | ios::ate);
+	if(!file.is_open())
+	{
+		return false;
+	}
+
+	// the file is the binary's format followed by the binary itself
+	length = (GLint)file.tellg() - (GLint)sizeof(format);
+	if(length <= 0)
+	{
+		return false;
+	}
+	binary = new char[length];
+	file.seekg(0);
+	file.read((char*)&format, sizeof(format));
+	file.read(binary, length);
+
+	// whether the driver accepts it is left to finishLink(), since asking would wait for it
+	if(file)
+	{
+		glProgramBinary(program, format, binary, length);
+	}
+
+	delete[] binary;
+	return (bool)file;
+}
+
+void Shader::saveBinary(string &path)
+{
+	ofstream file;
+	string tempPath = path + ".tmp";
+	GLenum format;
+	GLint length = 0;
+	char *binary;
+
+	if(path.empty())
+	{
+		return;
+	}
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0)
+	{
+		return;
+	}
+	binary = new char[length];
+	glGetProgramBinary(program, length, &length, &format, binary);
+
+	// write somewhere else and move it into place, so a run that dies halfway through never leaves a torn binary behind
+	mkdir(BINARY_CACHE_DIR, 0755);
+	file.open(tempPath.c_str(), ios::out | ios::binary | ios::trunc);
+	if(file.is_open())
+	{
+		file.write((char*)&format, sizeof(format));
+		file.write(binary, length);
+		file.close();
+		if(file)
+		{
+			rename(tempPath.c_str(), path.c_str());
+		}
+	}
+
+	delete[] binary;
+}
+
+void Shader::cacheUniformLocations()
+{
+	GLint numUniforms = 0;
+	GLint maxNameLength = 0;
+	GLsizei nameLength;
+	GLint size;
+	GLenum type;
+	GLint loc;
+	char *name;
+	string arrayName;
+	int i;
+
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &numUniforms);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+	name = new char[maxNameLength + 1];
+
+	uniformLocations.clear();
+	for(i = 0; i < numUniforms; i ++)
+	{
+		glGetActiveUniform(program, i, maxNameLength + 1, &nameLength, &size, &type, name);
+
+		// members of uniform blocks don't have locations
+		loc = glGetUniformLocation(program, name);
+		if(loc == -1)
+		{
+			continue;
+		}
+		uniformLocations[name] = loc;
+
+		// arrays are reported as "name[0]", but we set them by their plain name
+		arrayName = name;
+		if(arrayName.size() > 3 && arrayName.compare(arrayName.size() - 3, 3, "[0]") == 0)
+		{
+			uniformLocations[arrayName.substr(0, arrayName.size() - 3)] = loc;
+		}
+	}
+
+	delete[] name;
 }
 
 void Shader::bind()
 {
-	glUseProgram(program);
+	GLState::getInstance() -> useProgram(program);
 }
 
 void Shader::unbind()
 {
-    glUseProgram(0);
+    GLState::getInstance() -> useProgram(0);
 }
 
 void Shader::bindAttrib(const char *var, unsigned int index)
 {
+	ostringstream binding;
+
+	binding << var << "=" << index << ";";
+	linkState += binding.str();
     glBindAttribLocation(program, index, var);
 }
 
+void Shader::transformFeedbackVaryings(const char **varyings, int count)
+{
+	int i;
+
+	for(i = 0; i < count; i ++)
+	{
+		linkState += string("out:") + varyings[i] + ";";
+	}
+	glTransformFeedbackVaryings(program, count, varyings, GL_INTERLEAVED_ATTRIBS);
+}
+
+void Shader::shaderStorageBlockBinding(const char *name, GLuint binding)
+{
+	GLuint index = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, name);
+
+	if(index == GL_INVALID_INDEX)
+	{
+		cerr << "Shader::shaderStorageBlockBinding() no storage block " << name << " in " << vertexFile << endl;
+		exit(1);
+	}
+	glShaderStorageBlockBinding(program, index, binding);
+}
+
 void Shader::uniform1f(const char *var, float val)
 {
-    glUniform1f(getUniLoc(program, var), val);
+    uniform1f(getUniLoc(var), val);
 }
 
 void Shader::uniform1i(const char *var, int val)
 {
-    glUniform1i(getUniLoc(program, var), val);
+    uniform1i(getUniLoc(var), val);
 }
 
 void Shader::uniform1fv(const char *var, int count, float *vals)
 {
-    glUniform1fv(getUniLoc(program, var), count, vals);
+    uniform1fv(getUniLoc(var), count, vals);
 }
 
 void Shader::uniform2f(const char *var, float v1, float v2)
 {
-    glUniform2f(getUniLoc(program, var), v1, v2);
+    uniform2f(getUniLoc(var), v1, v2);
 }
 
 void Shader::uniform2fv(const char *var, int count, float *vals)
 {
-    glUniform2fv(getUniLoc(program, var), count, vals);
+    uniform2fv(getUniLoc(var), count, vals);
 }
 
 void Shader::uniformVec2(const char *var, vec2 v)
 {
-    uniform2f(var, v.x, v.y);
+    uniformVec2(getUniLoc(var), v);
 }
 
 void Shader::uniform3iv(const char *var, int count, int *vals)
 {
-    glUniform3iv(getUniLoc(program, var), count, vals);
+    uniform3iv(getUniLoc(var), count, vals);
 }
 
 void Shader::uniform3fv(const char *var, int count, float *vals)
 {
-    glUniform3fv(getUniLoc(program, var), count, vals);
+    uniform3fv(getUniLoc(var), count, vals);
 }
 
 void Shader::uniform3f(const char *var, const float v1, const float v2, const float v3)
 {
-    glUniform3f(getUniLoc(program, var), v1, v2, v3);
+    uniform3f(getUniLoc(var), v1, v2, v3);
 }
 
 void Shader::uniformVec3(const char *var, vec3 v)
 {
-    uniform3f(var, v.x, v.y, v.z);
+    uniformVec3(getUniLoc(var), v);
 }
 
 void Shader::uniformMatrix3fv(const char *var, GLsizei count, GLfloat *vals, bool transpose)
 {
-    glUniformMatrix3fv(getUniLoc(program, var), count, transpose, vals);
+    uniformMatrix3fv(getUniLoc(var), count, vals, transpose);
 }
 
 void Shader::uniform4iv(const char *var, int count, int *vals)
 {
-    glUniform4iv(getUniLoc(program, var), count, vals);
+    uniform4iv(getUniLoc(var), count, vals);
 }
 
 void Shader::uniform4fv(const char *var, int count, float *vals)
 {
-    glUniform4fv(getUniLoc(program, var), count, vals);
+    uniform4fv(getUniLoc(var), count, vals);
 }
 
 void Shader::uniform4f(const char *var, float v1, float v2, float v3, float v4)
 {
-    glUniform4f(getUniLoc(program, var), v1, v2, v3, v4);
+    uniform4f(getUniLoc(var), v1, v2, v3, v4);
 }
 
 void Shader::uniformVec4(const char *var, vec4 v)
 {
-    uniform4f(var, v.x, v.y, v.z, v.w);
+    uniformVec4(getUniLoc(var), v);
 }
 
 void Shader::uniformMatrix4fv(const char *var, GLsizei count, GLfloat *vals, bool transpose)
 {
-    glUniformMatrix4fv(getUniLoc(program, var), count, transpose, vals);
+    uniformMatrix4fv(getUniLoc(var), count, vals, transpose);
+}
+
+void Shader::uniform1f(GLint loc, float val)
+{
+    glUniform1f(loc, val);
+}
+
+void Shader::uniform1i(GLint loc, int val)
+{
+    glUniform1i(loc, val);
+}
+
+void Shader::uniform1fv(GLint loc, int count, float *vals)
+{
+    glUniform1fv(loc, count, vals);
+}
+
+void Shader::uniform2f(GLint loc, float v1, float v2)
+{
+    glUniform2f(loc, v1, v2);
+}
+
+void Shader::uniform2fv(GLint loc, int count, float *vals)
+{
+    glUniform2fv(loc, count, vals);
+}
+
+void Shader::uniformVec2(GLint loc, vec2 v)
+{
+    uniform2f(loc, v.x, v.y);
+}
+
+void Shader::uniform3iv(GLint loc, int count, int *vals)
+{
+    glUniform3iv(loc, count, vals);
+}
+
+void Shader::uniform3fv(GLint loc, int count, float *vals)
+{
+    glUniform3fv(loc, count, vals);
+}
+
+void Shader::uniform3f(GLint loc, const float v1, const float v2, const float v3)
+{
+    glUniform3f(loc, v1, v2, v3);
+}
+
+void Shader::uniformVec3(GLint loc, vec3 v)
+{
+    uniform3f(loc, v.x, v.y, v.z);
+}
+
+void Shader::uniformMatrix3fv(GLint loc, GLsizei count, GLfloat *vals, bool transpose)
+{
+    glUniformMatrix3fv(loc, count, transpose, vals);
+}
+
+void Shader::uniform4iv(GLint loc, int count, int *vals)
+{
+    glUniform4iv(loc, count, vals);
+}
+
+void Shader::uniform4fv(GLint loc, int count, float *vals)
+{
+    glUniform4fv(loc, count, vals);
+}
+
+void Shader::uniform4f(GLint loc, float v1, float v2, float v3, float v4)
+{
+    glUniform4f(loc, v1, v2, v3, v4);
+}
+
+void Shader::uniformVec4(GLint loc, vec4 v)
+{
+    uniform4f(loc, v.x, v.y, v.z, v.w);
 }
 
-GLint Shader::getUniLoc(GLuint program, const char *name)
+void Shader::uniformMatrix4fv(GLint loc, GLsizei count, GLfloat *vals, bool transpose)
 {
-    GLint loc;
-    loc = glGetUniformLocation(program, name);
+    glUniformMatrix4fv(loc, count, transpose, vals);
+}
+
+GLint Shader::getUniLoc(const char *name)
+{
+	map<string, GLint>::iterator i = uniformLocations.find(name);
+	GLint loc = -1;
 
-	if(loc == -1)
+	if(i != uniformLocations.end())
+	{
+		loc = i -> second;
+	}
+	else
 	{
 		cerr << "Shader::getUniLoc(): uniform '" << name << "' has not been defined" << endl;
 	}
@@ -207,10 +655,55 @@ void Shader::printShaderLogInfo(GLuint obj)
 
 }
 
-char *Shader::textFileRead(const char *fn)
+string Shader::loadSource(const string &file)
+{
+	const string DIRECTIVE = "#include \"";
+
+	string source = textFileRead(file.c_str());
+	string directory = file.substr(0, file.rfind('/') + 1);
+	string result;
+	string includeFile;
+	size_t start = 0;
+	size_t end;
+	size_t close;
+	int line = 1;
+	ostringstream lineDirective;
+
+	while(start < source.size())
+	{
+		end = source.find('\n', start);
+		end = (end == string::npos) ? source.size() : end + 1;
+
+		if(source.compare(start, DIRECTIVE.size(), DIRECTIVE) == 0 && (close = source.find('"', start + DIRECTIVE.size())) < end)
+		{
+			includeFile = directory + source.substr(start + DIRECTIVE.size(), close - start - DIRECTIVE.size());
+			if(includes.find(includeFile) == includes.end())
+			{
+				includes[includeFile] = textFileRead(includeFile.c_str());
+			}
+
+			// the #line puts the line numbers in compiler errors after the included file back to where they are here
+			lineDirective.str("");
+			lineDirective << "\n#line " << line + 1 << "\n";
+			result += includes[includeFile] + lineDirective.str();
+		}
+		else
+		{
+			result.append(source, start, end - start);
+		}
+
+		start = end;
+		line ++;
+	}
+
+	return result;
+}
+
+string Shader::textFileRead(const char *fn)
 {
 	FILE *fp;
 	char *content = NULL;
+	string result;
 
 	int count=0;
 
@@ -228,6 +721,8 @@ char *Shader::textFileRead(const char *fn)
 				content = (char*)malloc(sizeof(char) * (count+1));
 				count = fread(content, sizeof(char), count, fp);
 				content[count] = '\0';
+				result = content;
+				free(content);
 			}
 			fclose(fp);
 		}
@@ -238,5 +733,5 @@ char *Shader::textFileRead(const char *fn)
 		}
 	}
 
-	return content;
+	return result;
 }
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <map>
 #include <string>
+#include <vector>
 
 #include "GL/glew.h"
 #include "glm/glm.hpp"
@@ -9,26 +11,81 @@
 class Shader
 {
 private:
-	GLuint fragmentShader;						// ID for fragment/pixel shader
-	GLuint vertexShader;						// ID for vertex shader
+	static const char *BINARY_CACHE_DIR;		// where linked programs are kept between runs (see link())
+	static std::vector<Shader*> linking;		// programs startLink() has handed to the driver, oldest first
+	static std::map<std::string, std::string> includes;	// files pulled in with #include, read once each
+
+	GLuint fragmentShader;						// ID for fragment/pixel shader; only created if we have to compile
+	GLuint vertexShader;						// ID for vertex shader (or compute shader, see stage); likewise
+	GLenum stage;								// GL_VERTEX_SHADER, or GL_COMPUTE_SHADER for compute programs
 	GLuint program;								// ID for entire damn thing
 
-	GLint getUniLoc(GLuint, const char*);		// used internally when setting uniform variables
+	std::string vertexFile;						// file names, for error messages
+	std::string fragmentFile;
+	std::string vertexSource;					// source held on to until link(), which may not need to compile it at all
+	std::string fragmentSource;					// empty for vertex-only programs
+	std::string defines;						// symbols both stages are compiled with
+	std::string linkState;						// attribute bindings and feedback varyings, which end up in the binary too
+
+	bool linked;								// programs shared through ShaderCache are only linked by whoever asks for them first
+	bool linkStarted;							// has startLink() handed the program to the driver yet?
+	bool fromBinary;							// did startLink() give the driver a cached binary rather than source?
+	std::string cachePath;						// where the binary is cached, from startLink(); empty without binary support
+
+	std::map<std::string, GLint> uniformLocations;	// every active uniform, looked up once when the program is linked
+
+	void compile();								// start compiling both stages and attach them to the program; doesn't wait
+	void checkCompiled();						// report (and exit on) a stage that didn't compile
+	void startCompileAndLink();					// compile() and start linking, asking for a binary we can cache
+	void cacheUniformLocations();				// fills uniformLocations; called by finishLink()
 	void printShaderLogInfo(GLuint);			// used for error reporting/compiler errors
-	char *textFileRead(const char*);			// used to load shader source from file
+	std::string textFileRead(const char*);		// used to load shader source from file
+
+	// read a shader's source, replacing each line that reads #include "name" with the file of that name from the same
+	// directory (which is how every shader gets the one declaration of the FrameData block in framedata.glsl)
+	std::string loadSource(const std::string &file);
+
+	// program binary cache: files are named after a hash of the sources, defines, link state, and driver, so anything
+	// that would change the program (or what the driver makes of it) simply misses
+	std::string getBinaryCachePath();			// empty if the driver can't hand out binaries
+	bool loadBinary(std::string &path);			// true if a binary went to the driver, which may still turn it down
+	void saveBinary(std::string &path);
+
+	// hand source to a shader object, with one #define per name in "defines" slipped in after the #version line
+	static void setSource(GLuint shader, const char *source, const std::string &defines);
 
 public:
 	static void unbind();										// unattach shader from OpenGL context
 
-	Shader(std::string vertexFile, std::string fragmentFile);	// specify vertex and fragment shaders separately and compile them together
+	// specify vertex and fragment shaders separately and compile them together; "defines" is a space-separated list of
+	// preprocessor symbols to compile both stages with, which is how we build variants (see ShaderCache)
+	Shader(std::string vertexFile, std::string fragmentFile, std::string defines = "");
+	// single-stage program: a vertex shader for transform feedback passes, or a compute shader; "defines" as above
+	Shader(std::string file, GLenum stage = GL_VERTEX_SHADER, std::string defines = "");
 	~Shader();
 
 	void bind();								// used to bring shader into current GL context (to render with or specify uniform vars)
-	void link();								// called only once, after attributions have been bound via bindAttrib()
+	// called after attributions have been bound via bindAttrib(); loads the program from the binary cache if it can,
+	// otherwise compiles and links it (and caches the result). Does nothing if already linked
+	void link();
+
+	// link() in two halves, so that many programs can be built at once: startLink() hands the program to the driver
+	// (binary or source) and returns without waiting for it, and finishLink() waits, reports any errors, caches the
+	// binary, and looks up the uniforms. Nothing else may be done with the program in between.
+	// finishLinks() finishes every program that has been started
+	void startLink();
+	void finishLink();
+	static void finishLinks();
 
 	void bindAttrib(const char*, unsigned int);	// specify the locations of the named vertex attributes
+	void transformFeedbackVaryings(const char**, int);	// capture the named outputs (interleaved); call before link()
+	void shaderStorageBlockBinding(const char*, GLuint);	// attach the named shader storage block to a binding point; call after link()
 
-	// various methods for setting uniform variables
+	// location of a uniform, from the table built at link time; hold on to it to set uniforms in per-frame code
+	// without any lookup at all
+	GLint getUniLoc(const char*);
+
+	// various methods for setting uniform variables, by name or by location
 	void uniform1i(const char*, int);
 	void uniform1f(const char*, float);
 	void uniform1fv(const char*, int, float*);
@@ -45,4 +102,21 @@ public:
 	void uniform4f(const char*, float, float, float, float);
 	void uniformVec4(const char*, glm::vec4);
 	void uniformMatrix4fv(const char*, int, GLfloat*, bool = false);
+
+	void uniform1i(GLint, int);
+	void uniform1f(GLint, float);
+	void uniform1fv(GLint, int, float*);
+	void uniform2f(GLint, float, float);
+	void uniform2fv(GLint, int, float*);
+	void uniformVec2(GLint, glm::vec2);
+	void uniform3iv(GLint, int, int*);
+	void uniform3fv(GLint, int, float*);
+	void uniform3f(GLint, const float, const float, const float);
+	void uniformVec3(GLint, glm::vec3);
+	void uniformMatrix3fv(GLint, int, GLfloat*, bool = false);
+	void uniform4iv(GLint, int, int*);
+	void uniform4fv(GLint, int, float*);
+	void uniform4f(GLint, float, float, float, float);
+	void uniformVec4(GLint, glm::vec4);
+	void uniformMatrix4fv(GLint, int, GLfloat*, bool = false);
 };
@@ -0,0 +1,51 @@
+#include "util/shadercache.h"
+#include "util/shader.h"
+
+#include <map>
+#include <string>
+using namespace std;
+
+ShaderCache *ShaderCache::instance = NULL;
+
+ShaderCache::ShaderCache() { }
+
+ShaderCache::~ShaderCache()
+{
+	map<string, Shader*>::iterator i;
+
+	for(i = shaders.begin(); i != shaders.end(); i ++)
+	{
+		delete i -> second;
+	}
+
+	instance = NULL;
+}
+
+ShaderCache *ShaderCache::getInstance()
+{
+	if(!instance)
+	{
+		instance = new ShaderCache();
+	}
+
+	return instance;
+}
+
+Shader *ShaderCache::get(string vertexFile, string fragmentFile, string defines)
+{
+	string key = vertexFile + "|" + fragmentFile + "|" + defines;
+	map<string, Shader*>::iterator i = shaders.find(key);
+	Shader *result;
+
+	if(i != shaders.end())
+	{
+		result = i -> second;
+	}
+	else
+	{
+		result = new Shader(vertexFile, fragmentFile, defines);
+		shaders[key] = result;
+	}
+
+	return result;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+class Shader;
+
+// every shader program the world draws with, keyed by its source files and the preprocessor symbols it was compiled
+// with; each variant is compiled the first time somebody asks for it and then handed out again from here, so switching
+// between variants never touches the compiler. The cache owns the programs; callers must not delete them
+class ShaderCache
+{
+private:
+	static ShaderCache *instance;				// singleton instance
+
+	std::map<std::string, Shader*> shaders;		// every variant built so far, by key
+
+	ShaderCache();								// force use of getInstance()
+
+public:
+	static ShaderCache *getInstance();			// singleton design pattern
+
+	~ShaderCache();								// deletes every program we handed out
+
+	// the program built from the given files with the given (space-separated) symbols defined; the caller still binds
+	// attributes and calls link() as usual, which only does anything for whoever asks for a variant first
+	Shader *get(std::string vertexFile, std::string fragmentFile, std::string defines = "");
+};
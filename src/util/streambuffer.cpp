@@ -0,0 +1,217 @@
+#include "util/streambuffer.h"
+
+#include "GL/glew.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+vector<StreamBuffer*> StreamBuffer::buffers;
+
+StreamBuffer::StreamBuffer(GLenum target, GLsizeiptr bytesPerFrame)
+{
+	const GLbitfield PERSISTENT_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	int i;
+
+	this -> target = target;
+	regionSize = bytesPerFrame;
+
+	region = 0;
+	regionOffset = 0;
+	regionBegun = false;
+	overflowReported = false;
+	mapped = false;
+	persistentMapping = NULL;
+	for(i = 0; i < NUM_REGIONS; i ++)
+	{
+		fences[i] = 0;
+	}
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(target, buffer);
+
+	// immutable storage lets us keep the buffer mapped for its entire life; coherent means no explicit flushes
+	persistent = GLEW_ARB_buffer_storage;
+	if(persistent)
+	{
+		glBufferStorage(target, regionSize * NUM_REGIONS, NULL, PERSISTENT_FLAGS);
+		persistentMapping = (unsigned char*)glMapBufferRange(target, 0, regionSize * NUM_REGIONS, PERSISTENT_FLAGS);
+		if(!persistentMapping)
+		{
+			cerr << "StreamBuffer::StreamBuffer() could not persistently map buffer" << endl;
+			exit(1);
+		}
+	}
+	else
+	{
+		glBufferData(target, regionSize * NUM_REGIONS, NULL, GL_STREAM_DRAW);
+	}
+
+	buffers.push_back(this);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	int i;
+
+	buffers.erase(remove(buffers.begin(), buffers.end(), this), buffers.end());
+
+	for(i = 0; i < NUM_REGIONS; i ++)
+	{
+		if(fences[i])
+		{
+			glDeleteSync(fences[i]);
+		}
+	}
+
+	glBindBuffer(target, buffer);
+	if(persistent || mapped)
+	{
+		glUnmapBuffer(target);
+	}
+	glDeleteBuffers(1, &buffer);
+}
+
+GLuint StreamBuffer::getBuffer()
+{
+	return buffer;
+}
+
+void StreamBuffer::beginRegion()
+{
+	const GLuint64 WAIT_TIMEOUT = 1000000;				// 1 ms per wait; we just keep trying until the region frees up
+	GLenum result;
+
+	if(persistent)
+	{
+		// the GPU might still be reading what we wrote into this region NUM_REGIONS frames ago
+		if(fences[region])
+		{
+			do
+			{
+				result = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT);
+			}
+			while(result == GL_TIMEOUT_EXPIRED);
+
+			glDeleteSync(fences[region]);
+			fences[region] = 0;
+		}
+	}
+	else if(region == 0)
+	{
+		// every time we wrap around, orphan the old storage; the driver hands us fresh memory while the GPU finishes
+		// with the old one, and the regions of a single storage block are never written twice
+		glBindBuffer(target, buffer);
+		glBufferData(target, regionSize * NUM_REGIONS, NULL, GL_STREAM_DRAW);
+	}
+
+	regionOffset = 0;
+	regionBegun = true;
+}
+
+GLsizeiptr StreamBuffer::getAlignedOffset(GLsizeiptr alignment)
+{
+	// a region we haven't begun yet starts out empty, whatever is left over from the last time we wrote to it
+	GLsizeiptr used = regionBegun ? regionOffset : 0;
+	return ((used + alignment - 1) / alignment) * alignment;
+}
+
+void StreamBuffer::reportOverflow(GLsizeiptr bytes, GLsizeiptr start)
+{
+	// once is enough; a stream that overflows usually does so every frame until the scene changes
+	if(!overflowReported)
+	{
+		cerr << "StreamBuffer::allocate() ran out of space (" << bytes << " bytes requested, " << std::max(regionSize - start, (GLsizeiptr)0) << " left this frame); drawing less" << endl;
+		overflowReported = true;
+	}
+}
+
+int StreamBuffer::clampCount(int count, GLsizeiptr bytesEach, GLsizeiptr alignment)
+{
+	GLsizeiptr start = getAlignedOffset(alignment);
+	int result = count;
+
+	if(start + bytesEach * count > regionSize)
+	{
+		reportOverflow(bytesEach * count, start);
+		result = start < regionSize ? (regionSize - start) / bytesEach : 0;
+	}
+
+	return result;
+}
+
+void *StreamBuffer::allocate(GLsizeiptr bytes, GLsizeiptr alignment, GLintptr &offset)
+{
+	GLsizeiptr start;
+	void *result;
+
+	// round up to the requested alignment and make sure it fits in this frame's share; running out halfway through a
+	// frame is no reason to quit the game, so the caller just gets nothing
+	start = getAlignedOffset(alignment);
+	if(start + bytes > regionSize)
+	{
+		reportOverflow(bytes, start);
+		return NULL;
+	}
+
+	if(!regionBegun)
+	{
+		beginRegion();
+	}
+	regionOffset = start + bytes;
+	offset = region * regionSize + start;
+
+	if(persistent)
+	{
+		result = persistentMapping + offset;
+	}
+	else
+	{
+		// nobody else can be using this range (see beginRegion()), so skip any synchronization
+		glBindBuffer(target, buffer);
+		if(mapped)
+		{
+			glUnmapBuffer(target);
+		}
+		result = glMapBufferRange(target, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		mapped = true;
+	}
+
+	return result;
+}
+
+void StreamBuffer::commit()
+{
+	// coherent persistent mappings are visible to the GPU as-is
+	if(mapped)
+	{
+		glBindBuffer(target, buffer);
+		glUnmapBuffer(target);
+		mapped = false;
+	}
+}
+
+void StreamBuffer::endFrame()
+{
+	vector<StreamBuffer*>::iterator i;
+	StreamBuffer *curr;
+
+	for(i = buffers.begin(); i != buffers.end(); ++i)
+	{
+		curr = *i;
+		if(curr -> regionBegun)
+		{
+			curr -> commit();
+
+			// mark the point after which the GPU no longer needs this region, then move on
+			if(curr -> persistent)
+			{
+				curr -> fences[curr -> region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			}
+			curr -> region = (curr -> region + 1) % NUM_REGIONS;
+			curr -> regionBegun = false;
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "GL/glew.h"
+
+#include <vector>
+
+// ring-allocated buffer for data we re-upload every frame (instance matrices, particle attributes, text quads...).
+// The buffer is split into one region per frame in flight; a subsystem allocates out of the current region and writes
+// straight into mapped memory, and a fence guards each region so we never overwrite anything the GPU is still reading.
+// With ARB_buffer_storage the whole buffer stays persistently mapped; otherwise we fall back to orphaning it.
+class StreamBuffer
+{
+private:
+	static const int NUM_REGIONS = 3;					// frames we let the GPU fall behind by before we wait on it
+
+	static std::vector<StreamBuffer*> buffers;			// every live stream buffer, so endFrame() can fence them all
+
+	GLenum target;										// what the buffer is bound to when mapping (GL_ARRAY_BUFFER, etc.)
+	GLuint buffer;										// the GL buffer object itself
+	GLsizeiptr regionSize;								// bytes available to each frame
+
+	bool persistent;									// true if mapped once with ARB_buffer_storage
+	unsigned char *persistentMapping;					// base of the persistent mapping
+	bool mapped;										// fallback path only: is a range currently mapped?
+
+	GLsync fences[NUM_REGIONS];							// one per region; signalled once the GPU is done with that region
+	int region;											// region we're writing to this frame
+	GLsizeiptr regionOffset;							// bytes already handed out from the current region
+	bool regionBegun;									// has anything been allocated this frame?
+	bool overflowReported;								// have we complained about running out of space yet?
+
+	GLsizeiptr getAlignedOffset(GLsizeiptr alignment);	// where the next allocation at this alignment would start
+	void reportOverflow(GLsizeiptr bytes, GLsizeiptr start);
+
+	void beginRegion();									// wait until the current region is safe to write to
+
+public:
+	StreamBuffer(GLenum target, GLsizeiptr bytesPerFrame);
+	~StreamBuffer();
+
+	GLuint getBuffer();
+
+	// hand out bytes of this frame's region, aligned to alignment; offset receives the position within getBuffer()
+	// that the data will be read from. The memory returned is write-only and valid until commit(). Returns NULL if
+	// the frame's region doesn't have that much left, in which case the caller has to skip whatever it was drawing
+	void *allocate(GLsizeiptr bytes, GLsizeiptr alignment, GLintptr &offset);
+
+	// the most of count elements, bytesEach apiece, that a single allocate() at this alignment can still get this
+	// frame; callers whose counts vary clamp to this first, so that they draw fewer things rather than nothing
+	int clampCount(int count, GLsizeiptr bytesEach, GLsizeiptr alignment);
+
+	// finish writing to everything allocate() returned; must be called before drawing from it
+	void commit();
+
+	// called once per frame, after all rendering commands, to fence every buffer's region and move on to the next
+	static void endFrame();
+};
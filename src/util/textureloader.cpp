@@ -0,0 +1,374 @@
+#include "util/textureloader.h"
+#include "util/glstate.h"
+#include "util/ktx.h"
+
+#include "lodepng/lodepng.h"
+
+#include "GL/glew.h"
+
+#include "pthread.h"
+#include "unistd.h"
+#include "sys/stat.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+using namespace std;
+
+TextureLoader *TextureLoader::instance = NULL;
+
+TextureLoader::TextureLoader()
+{
+	long numCores;
+	int i;
+
+	shutdown = false;
+	numUnfinishedJobs = 0;
+
+	immutableStorage = GLEW_ARB_texture_storage;
+	s3tcSupported = GLEW_EXT_texture_compression_s3tc;
+	glGenBuffers(1, &pbo);
+
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&jobReady, NULL);
+	pthread_cond_init(&jobDecoded, NULL);
+
+	// decoding is all CPU work, so one decoder per extra core; the main thread has the world to build meanwhile
+	numCores = sysconf(_SC_NPROCESSORS_ONLN);
+	numDecoders = numCores > 1 ? (int)numCores - 1 : 1;
+	decoders = new pthread_t[numDecoders];
+	for(i = 0; i < numDecoders; i ++)
+	{
+		if(pthread_create(&decoders[i], NULL, invokeDecoderLoop, this) != 0)
+		{
+			cerr << "TextureLoader::TextureLoader() could not create decoder thread" << endl;
+			exit(1);
+		}
+	}
+}
+
+TextureLoader::~TextureLoader()
+{
+	int i;
+
+	// wake everybody up and wait for them to leave
+	pthread_mutex_lock(&mutex);
+	shutdown = true;
+	pthread_cond_broadcast(&jobReady);
+	pthread_mutex_unlock(&mutex);
+
+	for(i = 0; i < numDecoders; i ++)
+	{
+		pthread_join(decoders[i], NULL);
+	}
+	delete[] decoders;
+
+	// anything still in flight is abandoned; its texture keeps the placeholder until whoever owns it deletes it
+	while(!pendingJobs.empty())
+	{
+		delete pendingJobs.front();
+		pendingJobs.pop_front();
+	}
+	while(!decodedJobs.empty())
+	{
+		free(decodedJobs.front() -> pixels);
+		delete decodedJobs.front() -> cooked;
+		delete decodedJobs.front();
+		decodedJobs.pop_front();
+	}
+
+	pthread_cond_destroy(&jobDecoded);
+	pthread_cond_destroy(&jobReady);
+	pthread_mutex_destroy(&mutex);
+
+	glDeleteBuffers(1, &pbo);
+
+	instance = NULL;
+}
+
+TextureLoader *TextureLoader::getInstance()
+{
+	if(!instance)
+	{
+		instance = new TextureLoader();
+	}
+
+	return instance;
+}
+
+GLuint TextureLoader::load(const char *filename, bool highQualityMipmaps)
+{
+	const unsigned char PLACEHOLDER[] = {128, 128, 128, 255};		// mid grey, which also reads as a flat normal map
+
+	Job *job = new Job();
+	GLuint result;
+
+	// the name is handed out now; it's only ever given mutable storage here, so the real image can replace it later
+	glGenTextures(1, &result);
+	GLState::getInstance() -> bindTexture(0, result);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, PLACEHOLDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+	job -> filename = filename;
+	job -> texture = result;
+	job -> highQualityMipmaps = highQualityMipmaps;
+	job -> cooked = NULL;
+	job -> pixels = NULL;
+	job -> width = 0;
+	job -> height = 0;
+
+	pthread_mutex_lock(&mutex);
+	pendingJobs.push_back(job);
+	pthread_cond_signal(&jobReady);
+	pthread_mutex_unlock(&mutex);
+	numUnfinishedJobs ++;
+
+	return result;
+}
+
+void TextureLoader::update()
+{
+	deque<Job*> jobs;
+
+	if(numUnfinishedJobs == 0)
+	{
+		return;
+	}
+
+	// take everything that's ready in one go, so the decoders aren't kept waiting while we upload
+	pthread_mutex_lock(&mutex);
+	jobs.swap(decodedJobs);
+	pthread_mutex_unlock(&mutex);
+
+	while(!jobs.empty())
+	{
+		upload(jobs.front());
+		jobs.pop_front();
+		numUnfinishedJobs --;
+	}
+}
+
+void TextureLoader::finish()
+{
+	update();
+	while(numUnfinishedJobs > 0)
+	{
+		pthread_mutex_lock(&mutex);
+		while(decodedJobs.empty())
+		{
+			pthread_cond_wait(&jobDecoded, &mutex);
+		}
+		pthread_mutex_unlock(&mutex);
+
+		update();
+	}
+}
+
+void TextureLoader::upload(Job *job)
+{
+	if(job -> cooked)
+	{
+		uploadCooked(job);
+	}
+	else
+	{
+		uploadDecoded(job);
+	}
+
+	// later uploads with client memory must not read from our PBO
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// use high-quality mipmaps for this texture?
+	if(job -> highQualityMipmaps)
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	}
+	else
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	}
+
+	delete job -> cooked;
+	delete job;
+}
+
+void TextureLoader::uploadCooked(Job *job)
+{
+	KTXImage *image = job -> cooked;
+	unsigned char *staging;
+	unsigned int width, height;
+	unsigned int i;
+
+	// the blocks go into the PBO exactly as they came off the disk
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, image -> data.size(), NULL, GL_STREAM_DRAW);
+	staging = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, image -> data.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if(!staging)
+	{
+		cerr << "TextureLoader::uploadCooked() could not map pixel buffer for " << job -> filename << endl;
+		exit(1);
+	}
+	memcpy(staging, &image -> data[0], image -> data.size());
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	// every level was built by the cooker, so there's nothing to generate
+	GLState::getInstance() -> bindTexture(0, job -> texture);
+	if(immutableStorage)
+	{
+		glTexStorage2D(GL_TEXTURE_2D, image -> levelSizes.size(), image -> internalFormat, image -> width, image -> height);
+	}
+	for(i = 0; i < image -> levelSizes.size(); i ++)
+	{
+		width = std::max(image -> width >> i, 1u);
+		height = std::max(image -> height >> i, 1u);
+
+		if(immutableStorage)
+		{
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, width, height, image -> internalFormat, image -> levelSizes[i], (GLvoid*)image -> levelOffsets[i]);
+		}
+		else
+		{
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, image -> internalFormat, width, height, 0, image -> levelSizes[i], (GLvoid*)image -> levelOffsets[i]);
+		}
+	}
+}
+
+void TextureLoader::uploadDecoded(Job *job)
+{
+	GLsizeiptr rowSize = job -> width * 4;
+	GLsizeiptr imageSize = rowSize * job -> height;
+	unsigned char *staging;
+	unsigned int size;
+	int numLevels;
+	unsigned int i;
+
+	// make sure the load was successful
+	if(!job -> pixels)
+	{
+		cerr << "TextureLoader::uploadDecoded() could not load " << job -> filename << endl;
+		exit(1);
+	}
+
+	// copy into fresh PBO storage (orphaning whatever the last upload is still reading), bottom row first; this is the
+	// only pass we make over the pixels on the main thread, and it takes care of the flip at the same time
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, imageSize, NULL, GL_STREAM_DRAW);
+	staging = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, imageSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if(!staging)
+	{
+		cerr << "TextureLoader::uploadDecoded() could not map pixel buffer for " << job -> filename << endl;
+		exit(1);
+	}
+	for(i = 0; i < job -> height; i ++)
+	{
+		memcpy(&staging[i * rowSize], &job -> pixels[(job -> height - i - 1) * rowSize], rowSize);
+	}
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	// the decoded pixels aren't needed any more
+	free(job -> pixels);
+
+	// immutable storage for the whole mip chain up front, then the top level is copied out of the PBO by the driver
+	GLState::getInstance() -> bindTexture(0, job -> texture);
+	if(immutableStorage)
+	{
+		numLevels = 1;
+		for(size = std::max(job -> width, job -> height); size > 1; size /= 2)
+		{
+			numLevels ++;
+		}
+		glTexStorage2D(GL_TEXTURE_2D, numLevels, GL_RGBA8, job -> width, job -> height);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, job -> width, job -> height, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0);
+	}
+	else
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, job -> width, job -> height, 0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0);
+	}
+	glGenerateMipmap(GL_TEXTURE_2D);
+}
+
+void *TextureLoader::invokeDecoderLoop(void *arg)
+{
+	TextureLoader *loader = (TextureLoader*)arg;
+	loader -> decoderLoop();
+	return NULL;
+}
+
+void TextureLoader::decoderLoop()
+{
+	Job *job;
+
+	pthread_mutex_lock(&mutex);
+	while(!shutdown)
+	{
+		if(pendingJobs.empty())
+		{
+			pthread_cond_wait(&jobReady, &mutex);
+			continue;
+		}
+
+		job = pendingJobs.front();
+		pendingJobs.pop_front();
+
+		// decode without holding the lock, so the other decoders can get on with their own files
+		pthread_mutex_unlock(&mutex);
+		decode(job);
+		pthread_mutex_lock(&mutex);
+
+		decodedJobs.push_back(job);
+		pthread_cond_broadcast(&jobDecoded);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+void TextureLoader::decode(Job *job)
+{
+	if(loadCooked(job))
+	{
+		return;
+	}
+
+	if(lodepng_decode32_file(&job -> pixels, &job -> width, &job -> height, job -> filename.c_str()) != 0)
+	{
+		free(job -> pixels);
+		job -> pixels = NULL;
+	}
+}
+
+bool TextureLoader::loadCooked(Job *job)
+{
+	string cookedName = getCookedName(job -> filename);
+	struct stat pngInfo;
+	struct stat cookedInfo;
+	GLenum format;
+
+	// a cooked file older than its PNG is stale; the PNG has been edited since texcook last ran
+	if(stat(cookedName.c_str(), &cookedInfo) != 0 || (stat(job -> filename.c_str(), &pngInfo) == 0 && pngInfo.st_mtime > cookedInfo.st_mtime))
+	{
+		return false;
+	}
+
+	job -> cooked = new KTXImage();
+	if(loadKTX(cookedName, *job -> cooked))
+	{
+		format = job -> cooked -> internalFormat;
+		if(format == GL_COMPRESSED_RG_RGTC2 ||
+		   (s3tcSupported && (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)))
+		{
+			return true;
+		}
+	}
+
+	// not something we can use, so fall back on the PNG
+	delete job -> cooked;
+	job -> cooked = NULL;
+	return false;
+}
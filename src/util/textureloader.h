@@ -0,0 +1,76 @@
+#pragma once
+
+#include "GL/glew.h"
+
+#include "pthread.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+struct KTXImage;
+
+// loads PNG textures in the background: load() hands back a texture name straight away, holding a 1x1 placeholder,
+// and a few decoder threads turn the files into pixels in parallel. The main thread then uploads each finished image
+// through a pixel buffer object into immutable storage (flipping it on the way, since PNGs are stored top row first),
+// from update() or finish(). Until then anything drawn with the texture just gets the placeholder.
+// When texcook has left an up-to-date KTX file next to the PNG, that is read instead: its compressed blocks and mip
+// chain go to the GPU as they are, with no decoding, flipping, or mipmap generation at all
+class TextureLoader
+{
+private:
+	// one texture on its way in
+	struct Job
+	{
+		std::string filename;
+		GLuint texture;						// name handed out by load()
+		bool highQualityMipmaps;
+
+		KTXImage *cooked;					// the cooked version, if there is one we can use; NULL otherwise
+		unsigned char *pixels;				// otherwise RGBA, top row first, as decoded; NULL if the file couldn't be decoded
+		unsigned int width;
+		unsigned int height;
+	};
+
+	static TextureLoader *instance;			// singleton instance
+
+	int numDecoders;						// decoder threads we started
+	pthread_t *decoders;
+
+	pthread_mutex_t mutex;					// guards pendingJobs, decodedJobs, and shutdown
+	pthread_cond_t jobReady;				// signalled when there's a file to decode (or on shutdown)
+	pthread_cond_t jobDecoded;				// signalled whenever a decode finishes
+	std::deque<Job*> pendingJobs;			// files waiting for a decoder, in the order they were asked for
+	std::deque<Job*> decodedJobs;			// images waiting to be uploaded
+	bool shutdown;							// tells the decoders to exit
+
+	int numUnfinishedJobs;					// main thread only: load()s not yet uploaded
+	bool immutableStorage;					// can we use glTexStorage2D()?
+	bool s3tcSupported;						// can we use cooked BC1 and BC3 textures? (BC5 is core)
+	GLuint pbo;								// staging buffer each upload goes through
+
+	TextureLoader();						// force use of getInstance()
+
+	static void *invokeDecoderLoop(void *arg);	// arg is expected to be the TextureLoader
+	void decoderLoop();
+	void decode(Job *job);					// fill in either cooked or pixels
+	bool loadCooked(Job *job);				// false if there's no usable cooked file
+
+	void upload(Job *job);
+	void uploadCooked(Job *job);
+	void uploadDecoded(Job *job);
+
+public:
+	static TextureLoader *getInstance();	// singleton design pattern
+
+	~TextureLoader();
+
+	// queue the named PNG and return the texture it will end up in, with the placeholder in it for now
+	GLuint load(const char *filename, bool highQualityMipmaps);
+
+	// upload every image decoded so far; cheap to call once a frame
+	void update();
+
+	// block until every texture queued so far has been uploaded
+	void finish();
+};
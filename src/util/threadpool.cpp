@@ -0,0 +1,189 @@
+#include "util/threadpool.h"
+
+#include "pthread.h"
+#include "unistd.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+using namespace std;
+
+ThreadPool *ThreadPool::instance = NULL;
+
+ThreadPool::ThreadPool(int numWorkers)
+{
+	int i;
+
+	this -> numWorkers = numWorkers;
+
+	task = NULL;
+	context = NULL;
+	numTasks = 0;
+	nextTask = 0;
+	numTasksFinished = 0;
+	numBusyWorkers = 0;
+	generation = 0;
+	shutdown = false;
+
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&workReady, NULL);
+	pthread_cond_init(&workDone, NULL);
+
+	// start up the workers; they go straight to sleep until the first job arrives
+	workers = new pthread_t[numWorkers];
+	for(i = 0; i < numWorkers; i ++)
+	{
+		if(pthread_create(&workers[i], NULL, invokeWorkerLoop, this) != 0)
+		{
+			cerr << "ThreadPool::ThreadPool() could not create worker thread" << endl;
+			exit(1);
+		}
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	int i;
+
+	// wake everybody up and wait for them to leave
+	pthread_mutex_lock(&mutex);
+	shutdown = true;
+	pthread_cond_broadcast(&workReady);
+	pthread_mutex_unlock(&mutex);
+
+	for(i = 0; i < numWorkers; i ++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+	delete[] workers;
+
+	pthread_cond_destroy(&workDone);
+	pthread_cond_destroy(&workReady);
+	pthread_mutex_destroy(&mutex);
+
+	instance = NULL;
+}
+
+ThreadPool *ThreadPool::getInstance()
+{
+	long numCores;
+
+	if(!instance)
+	{
+		// one worker per extra core; the thread calling parallelFor() covers the last one
+		numCores = sysconf(_SC_NPROCESSORS_ONLN);
+		instance = new ThreadPool(numCores > 1 ? (int)numCores - 1 : 0);
+	}
+
+	return instance;
+}
+
+int ThreadPool::getNumThreads()
+{
+	return numWorkers + 1;
+}
+
+void *ThreadPool::invokeWorkerLoop(void *arg)
+{
+	ThreadPool *pool = (ThreadPool*)arg;
+	pool -> workerLoop();
+	return NULL;
+}
+
+void ThreadPool::workerLoop()
+{
+	unsigned int seenGeneration = 0;
+	void (*currTask)(void*, int);
+	void *currContext;
+	int currNumTasks;
+	int numRun;
+
+	pthread_mutex_lock(&mutex);
+	while(true)
+	{
+		// sleep until there's a job we haven't looked at yet
+		while(!shutdown && generation == seenGeneration)
+		{
+			pthread_cond_wait(&workReady, &mutex);
+		}
+		if(shutdown)
+		{
+			break;
+		}
+
+		// take a copy of the job; it can't change while we're counted as busy
+		seenGeneration = generation;
+		currTask = task;
+		currContext = context;
+		currNumTasks = numTasks;
+		numBusyWorkers ++;
+		pthread_mutex_unlock(&mutex);
+
+		numRun = runTasks(currTask, currContext, currNumTasks);
+
+		// report back
+		pthread_mutex_lock(&mutex);
+		numTasksFinished += numRun;
+		numBusyWorkers --;
+		pthread_cond_signal(&workDone);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+int ThreadPool::runTasks(void (*task)(void*, int), void *context, int numTasks)
+{
+	int numRun = 0;
+	int i;
+
+	// keep pulling task indices until they run out; this balances uneven tasks automatically
+	while((i = nextTask.fetch_add(1)) < numTasks)
+	{
+		task(context, i);
+		numRun ++;
+	}
+
+	return numRun;
+}
+
+void ThreadPool::parallelFor(int numTasks, void (*task)(void*, int), void *context)
+{
+	int numRun;
+	int i;
+
+	// not worth waking anybody for a single task
+	if(numWorkers == 0 || numTasks <= 1)
+	{
+		for(i = 0; i < numTasks; i ++)
+		{
+			task(context, i);
+		}
+		return;
+	}
+
+	// post the job, once any straggler that woke up late for the previous one has let go of it
+	pthread_mutex_lock(&mutex);
+	while(numBusyWorkers > 0)
+	{
+		pthread_cond_wait(&workDone, &mutex);
+	}
+	this -> task = task;
+	this -> context = context;
+	this -> numTasks = numTasks;
+	nextTask = 0;
+	numTasksFinished = 0;
+	generation ++;
+	pthread_cond_broadcast(&workReady);
+	pthread_mutex_unlock(&mutex);
+
+	// pitch in ourselves
+	numRun = runTasks(task, context, numTasks);
+
+	// wait until every task is done and no worker is still holding on to this job
+	pthread_mutex_lock(&mutex);
+	numTasksFinished += numRun;
+	while(numTasksFinished < numTasks || numBusyWorkers > 0)
+	{
+		pthread_cond_wait(&workDone, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
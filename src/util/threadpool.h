@@ -0,0 +1,48 @@
+#pragma once
+
+#include "pthread.h"
+
+#include <atomic>
+
+// persistent pool of worker threads for splitting per-frame work (particles, etc.) across every core;
+// the calling thread always takes part, so a single-core machine simply runs everything inline
+class ThreadPool
+{
+private:
+	static ThreadPool *instance;				// singleton instance
+
+	int numWorkers;								// threads we started, not counting the caller
+	pthread_t *workers;
+
+	pthread_mutex_t mutex;						// guards everything below except nextTask
+	pthread_cond_t workReady;					// signalled when a new job is posted (or on shutdown)
+	pthread_cond_t workDone;					// signalled when a worker finishes its share of a job
+
+	// the job currently being run by parallelFor()
+	void (*task)(void *context, int taskIndex);
+	void *context;
+	int numTasks;
+	std::atomic<int> nextTask;					// next task index to hand out; workers grab these without locking
+	int numTasksFinished;
+	int numBusyWorkers;							// workers that have picked up the current job and not yet finished
+	unsigned int generation;					// bumped for each job so sleeping workers know there's something new
+
+	bool shutdown;								// tells workers to exit
+
+	ThreadPool(int numWorkers);					// force use of getInstance()
+
+	static void *invokeWorkerLoop(void *arg);	// arg is expected to be the ThreadPool
+	void workerLoop();
+	int runTasks(void (*task)(void*, int), void *context, int numTasks);
+
+public:
+	static ThreadPool *getInstance();			// singleton design pattern; sized to the number of online cores
+
+	~ThreadPool();
+
+	int getNumThreads();						// workers plus the calling thread
+
+	// run task(context, i) for every i in [0, numTasks), spread across all threads, and return once all are done;
+	// the order tasks run in is unspecified, so anything that must be deterministic should depend only on taskIndex
+	void parallelFor(int numTasks, void (*task)(void *context, int taskIndex), void *context);
+};
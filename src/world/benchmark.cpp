@@ -0,0 +1,320 @@
+#include "world/benchmark.h"
+#include "world/rendersnapshot.h"
+#include "world/world.h"
+
+#include "objects/hud.h"
+
+#include "util/inputstate.h"
+#include "util/passtimer.h"
+#include "util/streambuffer.h"
+#include "util/textureloader.h"
+
+#include "lodepng/lodepng.h"
+
+#include "GL/glew.h"
+
+#include "GLFW/glfw3.h"
+
+#include "glm/glm.hpp"
+using namespace glm;
+
+#include "sys/stat.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+const int Benchmark::NUM_FRAMES = 600;
+const int Benchmark::NUM_WARMUP_FRAMES = 30;
+const float Benchmark::FRAME_INTERVAL = 1.0 / 60.0;
+const int Benchmark::CAPTURE_INTERVAL = 120;
+const int Benchmark::CHANNEL_TOLERANCE = 16;				// enough for llvmpipe and hardware drivers to agree
+const float Benchmark::MAX_DIFFERENT_PIXELS = 0.005;
+
+// a short walk around the starting point: along the grass, up at the sky and the drones, down into the grass, and
+// back round to where we started; the player never goes far enough for the grass to have to wrap around them
+const Benchmark::CameraKey Benchmark::CAMERA_PATH[] = {{0.0, vec2(0.0, 0.0), 0.0, 0.0},
+													   {2.0, vec2(0.0, -15.0), 0.0, 0.5},
+													   {4.0, vec2(10.0, -25.0), 0.3, 1.5},
+													   {6.0, vec2(20.0, -20.0), -0.4, 3.0},
+													   {8.0, vec2(10.0, 0.0), 0.0, 4.5},
+													   {10.0, vec2(0.0, 0.0), 0.0, 6.283}};
+const int Benchmark::NUM_CAMERA_KEYS = sizeof(CAMERA_PATH) / sizeof(CAMERA_PATH[0]);
+
+Benchmark::Benchmark(GLFWwindow *window, World *world, int width, int height, string outputDir, string goldenDir)
+{
+	this -> window = window;
+	this -> world = world;
+	this -> width = width;
+	this -> height = height;
+	this -> outputDir = outputDir;
+	this -> goldenDir = goldenDir;
+
+	origin = world -> getPlayerPos();
+
+	glGenRenderbuffers(2, renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		cerr << "Benchmark::Benchmark() could not create a " << width << "x" << height << " framebuffer" << endl;
+		exit(1);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// the scene is upscaled into it rather than into the window, and the HUD follows
+	world -> setOutputFramebuffer(framebuffer);
+}
+
+Benchmark::~Benchmark()
+{
+	world -> setOutputFramebuffer(0);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(2, renderbuffers);
+}
+
+bool Benchmark::run()
+{
+	PassTimer *timer = PassTimer::getInstance();
+	RenderSnapshot snapshot;
+	InputState input;
+	ofstream report;
+	bool passed = true;
+	float time;
+	int frame;
+	unsigned int i;
+
+	mkdir(outputDir.c_str(), 0755);
+
+	// every run has to draw exactly the same pixels
+	world -> lockResolutionScale(1.0);
+	timer -> setEnabled(true);
+
+	for(frame = 0; frame < NUM_FRAMES; frame ++)
+	{
+		time = frame * FRAME_INTERVAL;
+		hudTime = (int)time;
+
+		if(frame == NUM_WARMUP_FRAMES)
+		{
+			timer -> resetStats();
+		}
+
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		// the hidden window gets no input, so this keeps the player still for the camera path; and everything runs on
+		// this one thread, one step after the other, so the frames don't depend on how the threads were scheduled
+		input.sample(window);
+		input.setProjectionScale(world -> getProjectionScale());
+
+		timer -> beginFrame();
+		timer -> beginPass("update");
+		placeCamera(time);
+		world -> update(FRAME_INTERVAL, input);
+		world -> writeSnapshot(snapshot);
+		TextureLoader::getInstance() -> update();
+		world -> render(snapshot);
+		StreamBuffer::endFrame();
+		timer -> endFrame();
+
+		// read back after the frame has been timed, so the captures don't show up in the timings
+		if((frame + 1) % CAPTURE_INTERVAL == 0)
+		{
+			captures.push_back(captureFrame(frame));
+		}
+
+		// nothing was drawn to the window, so there's nothing to swap
+		glfwPollEvents();
+	}
+
+	for(i = 0; i < captures.size(); i ++)
+	{
+		passed = passed && captures[i].passed;
+	}
+
+	report.open((outputDir + "/report.json").c_str());
+	if(!report.is_open())
+	{
+		cerr << "Benchmark::run() could not write " << outputDir << "/report.json" << endl;
+		exit(1);
+	}
+	writeReport(report);
+	report.close();
+
+	cout << "-- benchmark: " << (timer -> getFrame().cpuTotal / timer -> getFrame().numFrames) << "ms CPU, "
+		 << (timer -> getFrame().gpuTotal / timer -> getFrame().numFrames) << "ms GPU per frame; "
+		 << (passed ? "all captures match" : "some captures DO NOT match") << endl;
+
+	return passed;
+}
+
+void Benchmark::placeCamera(float time)
+{
+	const CameraKey *a, *b;
+	float t;
+	int i;
+
+	// find the keys either side of the given time, and go in a straight line between them
+	for(i = 1; i < NUM_CAMERA_KEYS - 1 && CAMERA_PATH[i].time < time; i ++);
+	a = &CAMERA_PATH[i - 1];
+	b = &CAMERA_PATH[i];
+	t = glm::clamp((time - a -> time) / (b -> time - a -> time), 0.0f, 1.0f);
+
+	world -> placePlayer(origin + vec3(mix(a -> offset.x, b -> offset.x, t), 0.0, mix(a -> offset.y, b -> offset.y, t)),
+						 mix(a -> pitch, b -> pitch, t),
+						 mix(a -> yaw, b -> yaw, t));
+}
+
+Benchmark::Capture Benchmark::captureFrame(int frame)
+{
+	const int ROW_SIZE = width * 4;
+	const int NUM_PIXELS = width * height;
+
+	vector<unsigned char> pixels(ROW_SIZE * height);
+	vector<unsigned char> image(ROW_SIZE * height);
+	vector<unsigned char> golden;
+	vector<unsigned char> diff;
+	unsigned int goldenWidth, goldenHeight;
+	char name[32];
+	Capture capture;
+	int difference;
+	bool different;
+	int i, j;
+
+	// GL hands rows over bottom to top, and PNGs want them top to bottom; alpha is whatever blending left behind, which
+	// nobody ever sees, so that goes
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+	for(i = 0; i < height; i ++)
+	{
+		memcpy(&image[(height - 1 - i) * ROW_SIZE], &pixels[i * ROW_SIZE], ROW_SIZE);
+	}
+	for(i = 0; i < NUM_PIXELS; i ++)
+	{
+		image[i * 4 + 3] = 255;
+	}
+
+	snprintf(name, sizeof(name), "frame-%04d.png", frame);
+	lodepng::encode(outputDir + "/" + name, image, width, height);
+
+	capture.frame = frame;
+	capture.file = name;
+	capture.compared = false;
+	capture.numDifferentPixels = 0;
+	capture.maxDifference = 0;
+	capture.passed = true;
+
+	if(goldenDir.empty())
+	{
+		return capture;
+	}
+
+	// a golden image that's missing or the wrong size can't match
+	capture.compared = true;
+	if(lodepng::decode(golden, goldenWidth, goldenHeight, goldenDir + "/" + name) || (int)goldenWidth != width || (int)goldenHeight != height)
+	{
+		cerr << "Benchmark::captureFrame() no usable golden image " << goldenDir << "/" << name << endl;
+		capture.numDifferentPixels = NUM_PIXELS;
+		capture.maxDifference = 255;
+		capture.passed = false;
+		return capture;
+	}
+
+	// compare colour channels; the diff image shows pixels that are too far off in red, over a faded copy of the frame
+	diff.resize(image.size());
+	for(i = 0; i < NUM_PIXELS; i ++)
+	{
+		different = false;
+		for(j = 0; j < 3; j ++)
+		{
+			difference = abs((int)image[i * 4 + j] - (int)golden[i * 4 + j]);
+			capture.maxDifference = std::max(capture.maxDifference, difference);
+			different = different || difference > CHANNEL_TOLERANCE;
+		}
+
+		if(different)
+		{
+			capture.numDifferentPixels ++;
+			diff[i * 4 + 0] = 255;
+			diff[i * 4 + 1] = 0;
+			diff[i * 4 + 2] = 0;
+		}
+		else
+		{
+			diff[i * 4 + 0] = image[i * 4 + 0] / 4;
+			diff[i * 4 + 1] = image[i * 4 + 1] / 4;
+			diff[i * 4 + 2] = image[i * 4 + 2] / 4;
+		}
+		diff[i * 4 + 3] = 255;
+	}
+
+	capture.passed = capture.numDifferentPixels <= NUM_PIXELS * MAX_DIFFERENT_PIXELS;
+	if(!capture.passed)
+	{
+		snprintf(name, sizeof(name), "frame-%04d-diff.png", frame);
+		lodepng::encode(outputDir + "/" + name, diff, width, height);
+		cerr << "Benchmark::captureFrame() frame " << frame << " differs from its golden image in "
+			 << capture.numDifferentPixels << " pixels; see " << outputDir << "/" << name << endl;
+	}
+
+	return capture;
+}
+
+void Benchmark::writeReport(ostream &out)
+{
+	PassTimer *timer = PassTimer::getInstance();
+	const PassTimer::PassStats *stats;
+	int i;
+
+	out << "{" << endl;
+	out << "\t\"renderer\": \"" << (const char*)glGetString(GL_RENDERER) << "\"," << endl;
+	out << "\t\"version\": \"" << (const char*)glGetString(GL_VERSION) << "\"," << endl;
+	out << "\t\"width\": " << width << "," << endl;
+	out << "\t\"height\": " << height << "," << endl;
+	out << "\t\"frames\": " << NUM_FRAMES << "," << endl;
+	out << "\t\"warmupFrames\": " << NUM_WARMUP_FRAMES << "," << endl;
+
+	// the whole frame first, then each pass; times are in milliseconds
+	out << "\t\"passes\": [" << endl;
+	for(i = -1; i < timer -> getNumPasses(); i ++)
+	{
+		stats = (i < 0) ? &timer -> getFrame() : &timer -> getPass(i);
+		out << "\t\t{\"name\": \"" << stats -> name << "\", "
+			<< "\"cpuMeanMs\": " << (stats -> numFrames ? stats -> cpuTotal / stats -> numFrames : 0.0) << ", "
+			<< "\"cpuMaxMs\": " << stats -> cpuMax << ", "
+			<< "\"gpuMeanMs\": " << (stats -> numFrames ? stats -> gpuTotal / stats -> numFrames : 0.0) << ", "
+			<< "\"gpuMaxMs\": " << stats -> gpuMax << "}"
+			<< (i + 1 < timer -> getNumPasses() ? "," : "") << endl;
+	}
+	out << "\t]," << endl;
+
+	out << "\t\"captures\": [" << endl;
+	for(i = 0; i < (int)captures.size(); i ++)
+	{
+		out << "\t\t{\"frame\": " << captures[i].frame << ", "
+			<< "\"file\": \"" << captures[i].file << "\", "
+			<< "\"compared\": " << (captures[i].compared ? "true" : "false") << ", "
+			<< "\"differentPixels\": " << captures[i].numDifferentPixels << ", "
+			<< "\"maxDifference\": " << captures[i].maxDifference << ", "
+			<< "\"passed\": " << (captures[i].passed ? "true" : "false") << "}"
+			<< (i + 1 < (int)captures.size() ? "," : "") << endl;
+	}
+	out << "\t]" << endl;
+	out << "}" << endl;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "GL/glew.h"
+
+#include "glm/glm.hpp"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+class GLFWwindow;
+class World;
+
+// runs the world for a fixed number of frames with a fixed time step, flying the camera along a fixed path (so, with a
+// fixed random seed, every run draws the same frames) into a framebuffer of its own, and instead of presenting them to
+// anyone:
+//	- saves a few chosen frames as PNGs, and compares them against golden images of the same frames if we have any,
+//	  allowing for the small differences between one GL implementation and the next
+//	- times every render pass on the CPU and the GPU (see PassTimer)
+//	- writes everything it found out to a JSON report
+// Started with --benchmark on the command line; see main()
+class Benchmark
+{
+private:
+	// where the camera is at a given time; positions are relative to where the player starts, and on the ground
+	struct CameraKey
+	{
+		float time;
+		glm::vec2 offset;
+		float pitch;
+		float yaw;
+	};
+
+	// how a captured frame compared with its golden image
+	struct Capture
+	{
+		int frame;
+		std::string file;
+		bool compared;						// false if there was no golden image to compare with
+		int numDifferentPixels;
+		int maxDifference;					// largest difference in any channel of any pixel
+		bool passed;
+	};
+
+	static const int NUM_FRAMES;			// frames in a run
+	static const int NUM_WARMUP_FRAMES;		// frames left out of the timings, while shaders and textures settle in
+	static const float FRAME_INTERVAL;		// the time step every frame is updated with
+	static const int CAPTURE_INTERVAL;		// frames between captures
+	static const int CHANNEL_TOLERANCE;		// channel differences up to this much don't count
+	static const float MAX_DIFFERENT_PIXELS;	// fraction of pixels that may differ by more before a capture fails
+
+	static const CameraKey CAMERA_PATH[];
+	static const int NUM_CAMERA_KEYS;
+
+	GLFWwindow *window;
+	World *world;
+	int width;								// window size, which is what gets captured
+	int height;
+
+	// what every frame is drawn into, HUD and all; the window is hidden, and what its own framebuffer holds is anyone's
+	// guess, so nothing is drawn there
+	GLuint framebuffer;
+	GLuint renderbuffers[2];				// colour, depth
+
+	std::string outputDir;					// where captures, diff images, and the report go
+	std::string goldenDir;					// where golden images come from; empty to just capture
+
+	glm::vec3 origin;						// where the player started out
+	std::vector<Capture> captures;
+
+	void placeCamera(float time);
+	Capture captureFrame(int frame);		// read back the frame, save it, and compare it
+	void writeReport(std::ostream &out);
+
+public:
+	Benchmark(GLFWwindow *window, World *world, int width, int height, std::string outputDir, std::string goldenDir);
+	~Benchmark();
+
+	// run the benchmark; true iff every capture matched its golden image (or there weren't any to match)
+	bool run();
+};
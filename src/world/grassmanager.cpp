@@ -3,9 +3,11 @@
 
 #include "objects/player.h"
 
+#include "util/glstate.h"
 #include "util/shader.h"
 #include "util/math.h"
 #include "util/profiling.h"
+#include "util/streambuffer.h"
 
 #include "GL/glew.h"
 #include "glm/glm.hpp"
@@ -15,9 +17,15 @@
 #include "glm/gtc/noise.hpp"
 using namespace glm;
 
+#include <cstring>
 #include <iostream>
 using namespace std;
 
+const int GrassManager::NUM_BLADES_PER_UPDATE = 2000;		// Low enough that there's not too much data to send to the GPU, but
+															// High enough that so we don't have the blades struggling to catch up with the player
+const int GrassManager::CULL_GROUP_SIZE = 256;
+const float GrassManager::BLADE_RADIUS = 1.0;				// blades are at most 0.8 tall, plus a little for waving
+
 GrassManager::GrassManager(World *world, Player *player, int maxBlades, float grassAreaRadius)
 {
 	this -> world = world;
@@ -35,6 +43,7 @@ GrassManager::GrassManager(World *world, Player *player, int maxBlades, float gr
 	shutdown = false;
 
 	setupVBOs();
+	setupCulling();
 	loadShader();
 	placeGrass();
 }
@@ -47,9 +56,20 @@ GrassManager::~GrassManager()
 	delete[] shadowValues;
 	delete[] modelMats;
 
+	delete updateStream;
 	glDeleteBuffers(5, vbos);
 	glDeleteVertexArrays(1, &vao);
 	delete shader;
+
+	if(gpuCulling)
+	{
+		glDeleteTextures(3, instanceTextures);
+		glDeleteBuffers(3, cullBuffers);
+		glDeleteVertexArrays(1, &culledVAO);
+		delete cullShaders[0];
+		delete cullShaders[1];
+		delete cullShaders[2];
+	}
 }
 
 void GrassManager::beginWrapThread()
@@ -120,21 +140,185 @@ void GrassManager::setupVBOs()
 	glVertexAttribDivisor(5, 1);
 	glVertexAttribDivisor(6, 1);
 	glVertexAttribDivisor(7, 1);
+
+	// each frame's chunk is staged here and then copied into place on the GPU, so we never write to memory being drawn from
+	updateStream = new StreamBuffer(GL_COPY_READ_BUFFER, (sizeof(vec4) + sizeof(float)) * NUM_BLADES_PER_UPDATE);
+}
+
+void GrassManager::setupCulling()
+{
+	const GLuint COMMAND[4] = {3, 0, 0, 0};			// count, instanceCount, first, baseInstance
+
+	GLint maxTextureBufferSize;
+	int i;
+
+	// the culling pass needs compute shaders and storage buffers, which a 3.3 context only has as extensions; the
+	// culled draw reads the blades' model matrices through a buffer texture, which has to be able to hold all of them
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTextureBufferSize);
+	gpuCulling = GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object && GLEW_ARB_program_interface_query &&
+				 GLEW_ARB_shader_image_load_store && GLEW_ARB_draw_indirect && maxTextureBufferSize >= maxBlades * 4;
+	if(!gpuCulling)
+	{
+		return;
+	}
+
+	// the culled blades are drawn from the same vertices and colours, but their per-instance data is just an index
+	glGenVertexArrays(1, &culledVAO);
+	glBindVertexArray(culledVAO);
+	glGenBuffers(3, cullBuffers);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbos[0]);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbos[1]);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+
+	// the command's instance count, the visible indices, and the group counts are only ever written by the culling passes
+	numCullGroups = (maxBlades + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullBuffers[2]);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLint) * numCullGroups, NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cullBuffers[0]);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(COMMAND), COMMAND, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_ARRAY_BUFFER, cullBuffers[1]);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLint) * maxBlades, NULL, GL_DYNAMIC_COPY);
+	glEnableVertexAttribArray(2);
+	glVertexAttribIPointer(2, 1, GL_INT, 0, (GLvoid*)0);
+	glVertexAttribDivisor(2, 1);
+
+	// everything else about a blade is looked up by its index
+	glGenTextures(3, instanceTextures);
+	glBindTexture(GL_TEXTURE_BUFFER, instanceTextures[0]);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, vbos[4]);
+	glBindTexture(GL_TEXTURE_BUFFER, instanceTextures[1]);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, vbos[2]);
+	glBindTexture(GL_TEXTURE_BUFFER, instanceTextures[2]);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, vbos[3]);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	// the two passes over the blades look at the same things; the one in between only sees the group counts
+	cullShaders[0] = new Shader("../shaders/grass-cull.comp", GL_COMPUTE_SHADER, "COUNT");
+	cullShaders[1] = new Shader("../shaders/grass-cull.comp", GL_COMPUTE_SHADER, "SCAN");
+	cullShaders[2] = new Shader("../shaders/grass-cull.comp", GL_COMPUTE_SHADER, "SCATTER");
+	for(i = 0; i < 3; i ++)
+	{
+		cullShaders[i] -> startLink();
+	}
 }
 
 void GrassManager::loadShader()
 {
-	shader = new Shader("../shaders/grass.vert", "../shaders/grass.frag");
-	shader -> bindAttrib("a_Vertex", 0);
-	shader -> bindAttrib("a_Color", 1);
-	shader -> bindAttrib("a_Brightness", 2);
-	shader -> bindAttrib("a_ShadowValue", 3);
-	shader -> bindAttrib("a_InstanceMatrix", 4);
-	shader -> link();
+	if(gpuCulling)
+	{
+		shader = new Shader("../shaders/grass.vert", "../shaders/grass.frag", "CULLED");
+		shader -> bindAttrib("a_Vertex", 0);
+		shader -> bindAttrib("a_Color", 1);
+		shader -> bindAttrib("a_BladeIndex", 2);
+	}
+	else
+	{
+		shader = new Shader("../shaders/grass.vert", "../shaders/grass.frag");
+		shader -> bindAttrib("a_Vertex", 0);
+		shader -> bindAttrib("a_Color", 1);
+		shader -> bindAttrib("a_Brightness", 2);
+		shader -> bindAttrib("a_ShadowValue", 3);
+		shader -> bindAttrib("a_InstanceMatrix", 4);
+	}
+	shader -> startLink();
+}
+
+void GrassManager::finishShaders()
+{
+	int i;
+
 	shader -> bind();
+	if(gpuCulling)
+	{
+		shader -> uniform1i("u_Matrices", 0);
+		shader -> uniform1i("u_Brightness", 1);
+		shader -> uniform1i("u_ShadowValues", 2);
+		shader -> uniform1i("u_NumBlades", maxBlades);
+	}
 	shader -> uniform1f("u_GrassAreaRadius", grassAreaRadius);
 	shader -> uniform1f("u_WaveStrength", 0.025);
 	shader -> unbind();
+
+	if(!gpuCulling)
+	{
+		return;
+	}
+
+	for(i = 0; i < 3; i ++)
+	{
+		cullShaders[i] -> shaderStorageBlockBinding("Groups", 3);
+		cullShaders[i] -> bind();
+		if(i == 1)
+		{
+			cullShaders[i] -> shaderStorageBlockBinding("Command", 1);
+			cullShaders[i] -> uniform1i("u_NumGroups", numCullGroups);
+		}
+		else
+		{
+			cullShaders[i] -> shaderStorageBlockBinding("Matrices", 0);
+			cullShaders[i] -> uniform1i("u_NumBlades", maxBlades);
+			cullShaders[i] -> uniform1f("u_BladeRadius", BLADE_RADIUS);
+		}
+	}
+	cullShaders[2] -> shaderStorageBlockBinding("Visible", 2);
+	Shader::unbind();
+}
+
+void GrassManager::cullBlades(mat4 &projection, mat4 &view)
+{
+	mat4 viewProjection = projection * view;
+	vec4 rows[4];
+	vec4 planes[6];
+	int i;
+
+	// frustum planes straight out of the view-projection matrix, normalised so the shader can compare distances
+	for(i = 0; i < 4; i ++)
+	{
+		rows[i] = vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[3] + rows[2];
+	for(i = 0; i < 5; i ++)
+	{
+		planes[i] /= length(vec3(planes[i]));
+	}
+
+	// the far plane is wherever grass has faded out completely, which is much closer than the camera's
+	planes[5] = vec4(view[0][2], view[1][2], view[2][2], view[3][2] + grassAreaRadius);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, vbos[4]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, cullBuffers[0]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cullBuffers[1]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cullBuffers[2]);
+
+	// count the blades in view in each group, work out where each group's go (which also sets the instance count),
+	// then write them there; each pass reads what the one before it wrote
+	cullShaders[0] -> bind();
+	cullShaders[0] -> uniform4fv("u_Planes", 6, value_ptr(planes[0]));
+	glDispatchCompute(numCullGroups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	cullShaders[1] -> bind();
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	cullShaders[2] -> bind();
+	cullShaders[2] -> uniform4fv("u_Planes", 6, value_ptr(planes[0]));
+	glDispatchCompute(numCullGroups, 1, 1);
+
+	// the draw reads what the passes wrote both as its command and as a vertex attribute
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
 }
 
 void GrassManager::placeGrass()
@@ -275,9 +459,8 @@ void GrassManager::controlGrassWaving(float dt)
 {
 	const float WAVE_SPEED = 1.0 * dt;
 
+	// the shader gets this in render(), which may be running on another thread
 	waveValue += WAVE_SPEED;
-	shader -> bind();
-	shader -> uniform1f("u_WaveTime", waveValue);
 }
 
 void GrassManager::update(float dt)
@@ -285,48 +468,86 @@ void GrassManager::update(float dt)
 	controlGrassWaving(dt);
 }
 
-void GrassManager::render(mat4 &projection, mat4 &view, mat4 &model)
+float GrassManager::getWaveTime()
 {
-	const int NUM_BLADES_PER_UPDATE = 2000;		// Low enough that there's not too much data to send to the GPU, but
-												// High enough that so we don't have the blades struggling to catch up with the player
+	return waveValue;
+}
+
+void GrassManager::render(mat4 &projection, mat4 &view, float waveTime)
+{
+	GLState *gl = GLState::getInstance();
+
 	const int RESET_POINTER_STEPS = maxBlades / NUM_BLADES_PER_UPDATE;
 
-	shader -> bind();
-	shader -> uniformMatrix4fv("u_Projection", 1, value_ptr(projection));
-	shader -> uniformMatrix4fv("u_View", 1, value_ptr(view));
+	unsigned char *staging;
+	GLintptr stagingOffset;
 
 	// Only update a small chunk of the grass items; Picked an appropriate value of NUM_BLADES_PER_UPDATE
-	glBindVertexArray(vao);
 
-	// Update the positions of the grass; we only need to send the position vector
-	glBindBuffer(GL_ARRAY_BUFFER, vbos[4]);
-	glBufferSubData(GL_ARRAY_BUFFER,
-					(sizeof(vec4) * maxBlades * 3) + (sizeof(vec4) * updateChunkIndex * NUM_BLADES_PER_UPDATE),
-					sizeof(vec4) * NUM_BLADES_PER_UPDATE,
-					modelMatUpdateChunk);
+	// Stage the positions (we only need to send the position vector) and shadow intensities of this chunk
+	staging = (unsigned char*)updateStream -> allocate((sizeof(vec4) + sizeof(float)) * NUM_BLADES_PER_UPDATE, sizeof(vec4), stagingOffset);
 
-	// Update the shadow intensities of the grass
-	glBindBuffer(GL_ARRAY_BUFFER, vbos[3]);
-	glBufferSubData(GL_ARRAY_BUFFER,
-					(sizeof(float) * updateChunkIndex * NUM_BLADES_PER_UPDATE),
-					sizeof(float) * NUM_BLADES_PER_UPDATE,
-					shadowValuesUpdateChunk);
-
-	// Prepare to update the next chunk on the next time around
-	modelMatUpdateChunk += NUM_BLADES_PER_UPDATE;
-	shadowValuesUpdateChunk += NUM_BLADES_PER_UPDATE;
-	updateChunkIndex ++;
-
-	// Wrap back around to the first chunk if we need to
-	if(updateChunkIndex >= RESET_POINTER_STEPS)
+	// the stream has room for exactly one chunk, so this only fails if something else went wrong; the chunk then just
+	// waits for the next frame
+	if(staging)
+	{
+		memcpy(staging, modelMatUpdateChunk, sizeof(vec4) * NUM_BLADES_PER_UPDATE);
+		memcpy(staging + sizeof(vec4) * NUM_BLADES_PER_UPDATE, shadowValuesUpdateChunk, sizeof(float) * NUM_BLADES_PER_UPDATE);
+		updateStream -> commit();
+
+		// Copy them into place; this happens in order on the GPU, so the CPU never waits for the previous draw
+		glBindBuffer(GL_COPY_READ_BUFFER, updateStream -> getBuffer());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vbos[4]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+							stagingOffset,
+							(sizeof(vec4) * maxBlades * 3) + (sizeof(vec4) * updateChunkIndex * NUM_BLADES_PER_UPDATE),
+							sizeof(vec4) * NUM_BLADES_PER_UPDATE);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vbos[3]);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+							stagingOffset + sizeof(vec4) * NUM_BLADES_PER_UPDATE,
+							(sizeof(float) * updateChunkIndex * NUM_BLADES_PER_UPDATE),
+							sizeof(float) * NUM_BLADES_PER_UPDATE);
+
+		// Prepare to update the next chunk on the next time around
+		modelMatUpdateChunk += NUM_BLADES_PER_UPDATE;
+		shadowValuesUpdateChunk += NUM_BLADES_PER_UPDATE;
+		updateChunkIndex ++;
+
+		// Wrap back around to the first chunk if we need to
+		if(updateChunkIndex >= RESET_POINTER_STEPS)
+		{
+			modelMatUpdateChunk = &modelMats[maxBlades * 3];
+			shadowValuesUpdateChunk = shadowValues;
+			updateChunkIndex = 0;
+		}
+	}
+
+	// Finally, draw the grass; either just the blades in view, straight from what the culling pass left behind...
+	if(gpuCulling)
 	{
-		modelMatUpdateChunk = &modelMats[maxBlades * 3];
-		shadowValuesUpdateChunk = shadowValues;
-		updateChunkIndex = 0;
+		cullBlades(projection, view);
+
+		shader -> bind();
+		shader -> uniform1f("u_WaveTime", waveTime);
+		gl -> bindVertexArray(culledVAO);
+		gl -> bindTextureBuffer(0, instanceTextures[0]);
+		gl -> bindTextureBuffer(1, instanceTextures[1]);
+		gl -> bindTextureBuffer(2, instanceTextures[2]);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cullBuffers[0]);
+
+		gl -> enable(GL_BLEND);
+		glDrawArraysIndirect(GL_TRIANGLES, (GLvoid*)0);
+		gl -> disable(GL_BLEND);
 	}
+	// ...or all of them
+	else
+	{
+		shader -> bind();
+		shader -> uniform1f("u_WaveTime", waveTime);
+		gl -> bindVertexArray(vao);
 
-	// Finally, draw the grass
-	glEnable(GL_BLEND);
-	glDrawArraysInstanced(GL_TRIANGLES, 0, 3, maxBlades);
-	glDisable(GL_BLEND);
+		gl -> enable(GL_BLEND);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 3, maxBlades);
+		gl -> disable(GL_BLEND);
+	}
 }
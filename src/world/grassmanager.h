@@ -8,10 +8,15 @@
 class World;
 class Player;
 class Shader;
+class StreamBuffer;
 
 class GrassManager
 {
 private:
+	static const int NUM_BLADES_PER_UPDATE;		// how many blades' positions and shadows we send to the GPU every frame
+	static const int CULL_GROUP_SIZE;			// blades per compute work group; must match grass-cull.comp
+	static const float BLADE_RADIUS;			// bounding sphere around a blade, centred this far above its position
+
 	World *world;								// used to get terrain height
 	Player *player;								// used to wrap grass around player when they're moving
 
@@ -28,12 +33,22 @@ private:
 
 	Shader *shader;								// shadow program we use when rendering the grass
 
+	// GPU culling: where compute shaders are available, compute passes write the indices of the blades in view to a
+	// buffer, in order, along with the instance count of an indirect draw that then draws just those (see grass-cull.comp)
+	bool gpuCulling;
+	int numCullGroups;							// work groups it takes to cover every blade
+	Shader *cullShaders[3];						// the compute passes: count, scan, scatter
+	GLuint culledVAO;							// GL rendering state for drawing the culled blades, by index
+	GLuint cullBuffers[3];						// indirect draw command, visible blade indices, per-group counts
+	GLuint instanceTextures[3];					// buffer textures over the model matrix, brightness, and shadow VBOs
+
 	// wrapping all the grass positions around the player is costly, so we do it in another thread
 	pthread_t updateThread;
 	bool shutdown;
 
 	GLuint vao;									// GL rendering state
 	GLuint vbos[5];								// vertex positions, colours, brightness values, shadow values, model matrices
+	StreamBuffer *updateStream;					// staging memory for each frame's chunk of positions and shadows
 
 	static void *invokeWrapLoop(void *arg);		// arg is expected to be the GrassManager, and starts the loop that winds the grass
 
@@ -41,9 +56,13 @@ private:
 
 	// initialization stuff
 	void setupVBOs();
+	void setupCulling();
 	void loadShader();
 	void placeGrass();
 
+	// run the GPU culling pass for this frame's camera
+	void cullBlades(glm::mat4 &projection, glm::mat4 &view);
+
 	// handles a simple wave animation of the grass
 	void controlGrassWaving(float dt);
 
@@ -51,12 +70,17 @@ public:
 	GrassManager(World *world, Player *player, int maxBlades, float grassAreaRadius);
 	~GrassManager();
 
+	// set the uniforms and storage block bindings that never change, once World has linked every program
+	void finishShaders();
+
 	// called once after initialized has taken place
 	void beginWrapThread();
 
 	// handles waving
 	void update(float dt);
+	float getWaveTime();
 
-	// updates a chunk of grass and renders all of the grass
-	void render(glm::mat4 &projection, glm::mat4 &view, glm::mat4 &model);
+	// updates a chunk of grass and renders all of the grass (or, with GPU culling, all of it that's in view), waved as
+	// far as the given wave time
+	void render(glm::mat4 &projection, glm::mat4 &view, float waveTime);
 };
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "objects/player.h"
+#include "objects/dronemanager.h"
+#include "objects/hud.h"
+
+#include "particles/particlemanager.h"
+
+#include "glm/glm.hpp"
+
+// everything World::render() needs from the simulation, copied out of it by World::writeSnapshot() at the end of an
+// update. Rendering only ever reads a snapshot, never the live objects, so the next update can run while this one is
+// drawn (see SimulationThread); the terrain, trees, sign, and sky never change, so they aren't in here
+struct RenderSnapshot
+{
+	// the camera
+	glm::mat4 view;
+	glm::vec3 cameraPos;
+	glm::vec3 cameraSide;
+	glm::vec3 cameraUp;
+	bool fog;
+
+	float grassWaveTime;
+
+	Player::Snapshot player;
+	DroneManager::Snapshot drones;
+	ParticleManager::Snapshot particles;
+	HUD::Snapshot hud;
+};
@@ -0,0 +1,151 @@
+#include "world/simulationthread.h"
+#include "world/rendersnapshot.h"
+#include "world/world.h"
+
+#include "objects/hud.h"
+
+#include "util/inputstate.h"
+
+#include "GL/glew.h"
+
+#include "GLFW/glfw3.h"
+
+#include "pthread.h"
+
+#include <cstdlib>
+
+const double SimulationThread::FRAME_TIME_ALPHA = 0.25;
+const double SimulationThread::FIRST_FRAME_TIME = 0.016665;
+
+SimulationThread::SimulationThread(World *world, InputState &input)
+{
+	this -> world = world;
+	this -> input = input;
+
+	firstReady = 0;
+	numReady = 0;
+	gameDone = false;
+	shutdown = false;
+
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&snapshotReady, NULL);
+	pthread_cond_init(&snapshotFree, NULL);
+
+	pthread_create(&thread, NULL, invokeLoop, this);
+}
+
+SimulationThread::~SimulationThread()
+{
+	// the thread may be waiting for a snapshot to come back, which it never will
+	pthread_mutex_lock(&mutex);
+	shutdown = true;
+	pthread_cond_broadcast(&snapshotFree);
+	pthread_mutex_unlock(&mutex);
+
+	pthread_join(thread, NULL);
+
+	pthread_cond_destroy(&snapshotFree);
+	pthread_cond_destroy(&snapshotReady);
+	pthread_mutex_destroy(&mutex);
+}
+
+void *SimulationThread::invokeLoop(void *arg)
+{
+	SimulationThread *simulation = (SimulationThread*)arg;
+	simulation -> loop();
+	return NULL;
+}
+
+void SimulationThread::loop()
+{
+	InputState frameInput;				// the input this update works from, so the main thread can replace it meanwhile
+	RenderSnapshot *snapshot;			// where this update's results go
+	double currentTime = glfwGetTime();
+	double oldTime;
+	double frameTime = FIRST_FRAME_TIME;
+	bool done = false;
+
+	while(!done)
+	{
+		// wait until the renderer has a snapshot free for us
+		pthread_mutex_lock(&mutex);
+		while(numReady == NUM_SNAPSHOTS && !shutdown)
+		{
+			pthread_cond_wait(&snapshotFree, &mutex);
+		}
+		if(shutdown)
+		{
+			pthread_mutex_unlock(&mutex);
+			break;
+		}
+
+		// releasing the oldest snapshot moves firstReady on by as much as it takes numReady down, so the slot after the
+		// ready ones stays the same while we write to it
+		snapshot = &snapshots[(firstReady + numReady) % NUM_SNAPSHOTS];
+		frameInput = input;
+		pthread_mutex_unlock(&mutex);
+
+		// the time step follows the time between updates, which the renderer paces, with the bumps smoothed out
+		oldTime = currentTime;
+		currentTime = glfwGetTime();
+		frameTime = (frameTime * FRAME_TIME_ALPHA) + ((currentTime - oldTime) * (1.0 - FRAME_TIME_ALPHA));
+		hudTime = currentTime;
+
+		world -> update(frameTime, frameInput);
+		world -> writeSnapshot(*snapshot);
+		done = world -> isGameDone();
+
+		// hand it over
+		pthread_mutex_lock(&mutex);
+		numReady ++;
+		gameDone = done;
+		pthread_cond_signal(&snapshotReady);
+		pthread_mutex_unlock(&mutex);
+	}
+}
+
+void SimulationThread::setInput(InputState &input)
+{
+	pthread_mutex_lock(&mutex);
+	this -> input = input;
+	pthread_mutex_unlock(&mutex);
+}
+
+RenderSnapshot *SimulationThread::acquireSnapshot()
+{
+	RenderSnapshot *result = NULL;
+
+	// once the game is over, nothing more is coming
+	pthread_mutex_lock(&mutex);
+	while(numReady == 0 && !gameDone)
+	{
+		pthread_cond_wait(&snapshotReady, &mutex);
+	}
+	if(numReady > 0)
+	{
+		result = &snapshots[firstReady];
+	}
+	pthread_mutex_unlock(&mutex);
+
+	return result;
+}
+
+void SimulationThread::releaseSnapshot()
+{
+	pthread_mutex_lock(&mutex);
+	firstReady = (firstReady + 1) % NUM_SNAPSHOTS;
+	numReady --;
+	pthread_cond_signal(&snapshotFree);
+	pthread_mutex_unlock(&mutex);
+}
+
+bool SimulationThread::isGameDone()
+{
+	bool result;
+
+	pthread_mutex_lock(&mutex);
+	result = gameDone;
+	pthread_mutex_unlock(&mutex);
+
+	return result;
+}
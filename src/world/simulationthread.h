@@ -0,0 +1,54 @@
+#pragma once
+
+#include "world/rendersnapshot.h"
+
+#include "util/inputstate.h"
+
+#include "pthread.h"
+
+class World;
+
+// runs World::update() on a thread of its own, so the simulation of frame N + 1 happens while the main thread (which
+// owns the GL context and the window's input) draws frame N. Frames are handed over through a small ring of
+// RenderSnapshots: the simulation writes one after every update and waits while they're all taken, and the renderer
+// draws the oldest one and then gives it back. With two of them, the simulation is at most one frame ahead
+class SimulationThread
+{
+private:
+	static const int NUM_SNAPSHOTS = 2;			// snapshots in the ring, counting the one being drawn
+
+	static const double FRAME_TIME_ALPHA;		// degree to which the previous time step is used for the next one
+	static const double FIRST_FRAME_TIME;		// time step we start out assuming
+
+	World *world;
+
+	RenderSnapshot snapshots[NUM_SNAPSHOTS];
+	int firstReady;								// oldest snapshot the renderer hasn't given back yet
+	int numReady;								// snapshots written and not yet given back, including the one being drawn
+
+	InputState input;							// the latest input from the main thread
+	bool gameDone;								// whether the last update ended the game
+	bool shutdown;								// tells the thread to stop
+
+	pthread_t thread;
+	pthread_mutex_t mutex;						// guards everything above except the world and what's inside the snapshots
+	pthread_cond_t snapshotReady;				// signalled when a snapshot has been written
+	pthread_cond_t snapshotFree;				// signalled when the renderer gives one back (or on shutdown)
+
+	static void *invokeLoop(void *arg);			// arg is expected to be the SimulationThread
+	void loop();
+
+public:
+	SimulationThread(World *world, InputState &input);		// starts simulating straight away, with the given input
+	~SimulationThread();									// stops the thread and waits for it
+
+	// hand over the latest input; the next update uses it
+	void setInput(InputState &input);
+
+	// the oldest snapshot the renderer hasn't drawn yet, waiting for one to be written if need be; NULL once the game is
+	// over and everything has been drawn. Every snapshot acquired has to be released once it has been drawn
+	RenderSnapshot *acquireSnapshot();
+	void releaseSnapshot();
+
+	bool isGameDone();
+};
@@ -1,12 +1,12 @@
 #include "world/sky.h"
 
 #include "objects/player.h"
-extern bool fogFlag;
 
+#include "util/glstate.h"
 #include "util/loadtexture.h"
+#include "util/mesh.h"
 #include "util/shader.h"
-
-#include "glmmodel/glmmodel.h"
+#include "util/shadercache.h"
 
 #include "GL/glew.h"
 
@@ -30,27 +30,22 @@ Sky::Sky()
 
 Sky::~Sky()
 {
-	glDeleteBuffers(3, vbos);
+	glDeleteBuffers(1, &vbo);
 	glDeleteVertexArrays(1, &vao);
-	delete shader;
 }
 
 void Sky::loadSkyModel()
 {
-	GLMmodel *geometry;
-
-    // attempt to read the file; glmReadObj() will just quit if we can't
-    geometry = glmReadOBJ((char*)"../mesh/skydome.obj");
-    if(geometry)
-    {
-		glmScale(geometry, 1.0);
-
-		// build our buffer objects and then fill them with the geometry data we loaded
-		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
-		glGenBuffers(3, vbos);
-		glmBuildVBO(geometry, &numVertices, &vao, vbos);
-	}
+	Mesh *geometry;
+
+	// read the file (the mesh will just quit if we can't), then build our buffer objects and fill them with it
+	geometry = new Mesh("../mesh/skydome.obj");
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vbo);
+	geometry -> upload(vao, vbo);
+	firstIndex = geometry -> getFirstIndex();
+	numIndices = geometry -> getNumIndices();
+	delete geometry;
 }
 
 void Sky::loadTextures()
@@ -60,40 +55,35 @@ void Sky::loadTextures()
 
 void Sky::loadShader()
 {
-	shader = new Shader("../shaders/sky.vert", "../shaders/sky.frag");
+	shader = ShaderCache::getInstance() -> get("../shaders/sky.vert", "../shaders/sky.frag", "FOG");
 	shader -> bindAttrib("a_Vertex", 0);
 	shader -> bindAttrib("a_Normal", 1);
 	shader -> bindAttrib("a_TexCoord", 2);
-	shader -> link();
-	shader -> bind();
-	shader -> uniformVec3("fogColor", vec3(0.65, 0.65, 0.65));
-	shader -> uniform1i("fogFlag", fogFlag);
-	shader -> unbind();
+	shader -> startLink();
 }
 
-void Sky::render(mat4 &projection, mat4 &view, vec3 &playerPos)
+void Sky::render(vec3 &playerPos)
 {
+	GLState *gl = GLState::getInstance();
+
 	mat4 modelMat(1.0);
 	modelMat = translate(modelMat, vec3(playerPos.x, -600.0, playerPos.z));
 	modelMat = scale(modelMat, vec3(6000.0));
 
 	// send in the cavalry
 	shader -> bind();
-	shader -> uniformMatrix4fv("u_Projection", 1, value_ptr(projection));
-	shader -> uniformMatrix4fv("u_View", 1, value_ptr(view));
 	shader -> uniformMatrix4fv("u_Model", 1, value_ptr(modelMat));
 
 	// bind the sky texture to the current context
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, skyTexture);
+	gl -> bindTexture(0, skyTexture);
 
 	// we don't want the sky transparent and we don't want it doing depth writes
-	glDisable(GL_BLEND);
-	glDepthMask(GL_FALSE);
+	gl -> disable(GL_BLEND);
+	gl -> depthMask(false);
 
 	// finally, render it
-	glBindVertexArray(vao);
-	glDrawArrays(GL_TRIANGLES, 0, numVertices);
+	gl -> bindVertexArray(vao);
+	glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_SHORT, (GLvoid*)(sizeof(GLushort) * firstIndex));
 
-	glDepthMask(GL_TRUE);
+	gl -> depthMask(true);
 }
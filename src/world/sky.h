@@ -11,11 +11,12 @@ private:
 	Shader *shader;					// used when rendering skydome
 
 	GLuint vao;						// GL rendering state used
-	GLuint vbos[3];					// GL vertex buffer object for vertex positions, tex coords, and normals
+	GLuint vbo;						// GL buffer object for the dome's vertices and indices
 
 	GLuint skyTexture;				// large sky image used for the dome
 
-	int numVertices;				// GL rendering calls require the vertex count
+	int firstIndex;					// GL rendering calls require where the indices are and how many there are
+	int numIndices;
 
 	// load up required resources
 	void loadSkyModel();
@@ -24,7 +25,7 @@ private:
 public:
 	Sky();
 	~Sky();
-	void loadShader();
+	void loadShader();					// only starts linking; World finishes every program together
 
-	void render(glm::mat4 &projection, glm::mat4 &view, glm::vec3 &playerPos);
+	void render(glm::vec3 &playerPos);
 };
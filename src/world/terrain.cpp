@@ -2,9 +2,10 @@
 #include "world/world.h"
 
 #include "objects/player.h"
-extern bool fogFlag;
 
+#include "util/glstate.h"
 #include "util/shader.h"
+#include "util/shadercache.h"
 #include "util/loadtexture.h"
 
 #include "GL/glew.h"
@@ -13,7 +14,9 @@ extern bool fogFlag;
 #include "glm/gtc/matrix_inverse.hpp"
 using namespace glm;
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
 using namespace std;
 
 Terrain::Terrain(World *world, int width, int length, float squareSize, float *heights)
@@ -31,7 +34,6 @@ Terrain::~Terrain()
 
 	glDeleteBuffers(4, vbos);
 	glDeleteVertexArrays(1, &vao);
-	delete shader;
 }
 
 void Terrain::setupVBOs(int width, int length, float squareSize, float *heights)
@@ -189,6 +191,15 @@ void Terrain::setupVBOs(int width, int length, float squareSize, float *heights)
 }
 
 void Terrain::loadShader()
+{
+	shader = ShaderCache::getInstance() -> get("../shaders/terrain.vert", "../shaders/terrain.frag", "FOG");
+	shader -> bindAttrib("a_Vertex", 0);
+	shader -> bindAttrib("a_BaseTexCoord", 1);
+	shader -> bindAttrib("a_Normal", 2);
+	shader -> startLink();
+}
+
+void Terrain::finishShader()
 {
 	const float REGION_1_MIN = -200;
 	const float REGION_1_MAX = 50;
@@ -197,11 +208,6 @@ void Terrain::loadShader()
 	const float REGION_3_MIN = REGION_2_MAX;
 	const float REGION_3_MAX = 650;
 
-	shader = new Shader("../shaders/terrain.vert", "../shaders/terrain.frag");
-	shader -> bindAttrib("a_Vertex", 0);
-	shader -> bindAttrib("a_BaseTexCoord", 1);
-	shader -> bindAttrib("a_Normal", 2);
-	shader -> link();
 	shader -> bind();
 	shader -> uniform1i("u_Region1Tex", 0);
 	shader -> uniform1i("u_Region2Tex", 1);
@@ -213,10 +219,6 @@ void Terrain::loadShader()
 	shader -> uniform1f("u_Region2Range", REGION_2_MAX - REGION_2_MIN);
 	shader -> uniform1f("u_Region3Max", REGION_3_MAX);
 	shader -> uniform1f("u_Region3Range", REGION_3_MAX - REGION_3_MIN);
-	shader -> uniformVec3("fogColor", vec3(0.65, 0.65, 0.65));
-	shader -> uniform1i("fogFlag", fogFlag);
-	
-	shader -> uniformVec3("u_Sun", World::SUN_DIRECTION);
 	shader -> unbind();
 }
 
@@ -227,28 +229,24 @@ void Terrain::loadTextures()
 	region3Texture = loadPNG("../png/snow.png");
 }
 
-void Terrain::render(mat4 &projection, mat4 &model, mat4 &view)
+void Terrain::render(mat4 &model)
 {
+	GLState *gl = GLState::getInstance();
+
 	//mat3 normal = inverseTranspose(mat3(model));
 
 	shader -> bind();
-	shader -> uniformMatrix4fv("u_Projection", 1, value_ptr(projection));
 	shader -> uniformMatrix4fv("u_Model", 1, value_ptr(model));
-	shader -> uniformMatrix4fv("u_View", 1, value_ptr(view));
 	//shader -> uniformMatrix3fv("u_Normal", 1, value_ptr(normal));
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, region1Texture);
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, region2Texture);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, region3Texture);
-	glActiveTexture(GL_TEXTURE3);
-	glBindTexture(GL_TEXTURE_2D, shadowTexture);
+	gl -> bindTexture(0, region1Texture);
+	gl -> bindTexture(1, region2Texture);
+	gl -> bindTexture(2, region3Texture);
+	gl -> bindTexture(3, shadowTexture);
 
-	glDisable(GL_BLEND);
+	gl -> disable(GL_BLEND);
 
-	glBindVertexArray(vao);
+	gl -> bindVertexArray(vao);
 	glDrawElements(GL_TRIANGLES, (width - 1) * (length - 1) * 6, GL_UNSIGNED_INT, NULL);
 }
 
@@ -289,6 +287,53 @@ float Terrain::getHeight(vec3 pos)
 	return result;
 }
 
+void Terrain::getOccluder(int step, vector<vec3> &vertices, vector<GLuint> &indices)
+{
+	const int COARSE_WIDTH = (width - 2) / step + 2;				// coarse vertices along each side, the last on the edge
+	const int COARSE_LENGTH = (length - 2) / step + 2;
+
+	float lowest;
+	int i, j, x, z;
+
+	vertices.clear();
+	indices.clear();
+
+	// the coarse vertex at (i, j) sits over the terrain vertex (i * step, j * step), clamped to the far edges
+	for(i = 0; i < COARSE_LENGTH; i ++)
+	{
+		for(j = 0; j < COARSE_WIDTH; j ++)
+		{
+			// every coarse tile touching this vertex must lie below the terrain it covers, so take the lowest height
+			// under all of them
+			lowest = terrainHeights[std::min(i * step, length - 1) * width + std::min(j * step, width - 1)];
+			for(z = std::max(0, (i - 1) * step); z <= std::min(length - 1, (i + 1) * step); z ++)
+			{
+				for(x = std::max(0, (j - 1) * step); x <= std::min(width - 1, (j + 1) * step); x ++)
+				{
+					lowest = std::min(lowest, terrainHeights[z * width + x]);
+				}
+			}
+
+			vertices.push_back(vec3(std::min(j * step, width - 1) * squareSize, lowest, -(std::min(i * step, length - 1) * squareSize)));
+		}
+	}
+
+	// same triangulation as the real thing
+	for(i = 0; i < COARSE_LENGTH - 1; i ++)
+	{
+		for(j = 0; j < COARSE_WIDTH - 1; j ++)
+		{
+			indices.push_back((i * COARSE_WIDTH) + j);
+			indices.push_back(((i + 1) * COARSE_WIDTH) + j);
+			indices.push_back(((i + 1) * COARSE_WIDTH) + j + 1);
+
+			indices.push_back((i * COARSE_WIDTH) + j);
+			indices.push_back(((i + 1) * COARSE_WIDTH) + j + 1);
+			indices.push_back((i * COARSE_WIDTH) + j + 1);
+		}
+	}
+}
+
 bool Terrain::raycast(vec3 start, vec3 end, vec3 &intersect)
 {
 	const float RAYCAST_PRECISION = 0.01;			// 1cm
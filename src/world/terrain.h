@@ -3,6 +3,8 @@
 #include "GL/glew.h"
 #include "glm/glm.hpp"
 
+#include <vector>
+
 class World;
 class Shader;
 
@@ -35,13 +37,18 @@ public:
 	~Terrain();
 
 	// render the entire terrain in one fell swoop
-	void render(glm::mat4 &projection, glm::mat4 &view, glm::mat4 &model);
-	void loadShader();
+	void render(glm::mat4 &model);
+	void loadShader();					// only starts linking; World finishes every program together
+	void finishShader();				// set the uniforms that never change, once the program is linked
 
 	// interaction with terrain
 	float getHeight(glm::vec3 pos);
 	bool raycast(glm::vec3 start, glm::vec3 end, glm::vec3 &intersect);
 
+	// a coarse copy of the terrain with a vertex every step tiles, for occlusion culling; each vertex takes the lowest
+	// height around it, so the copy never sticks up above the real terrain and can't hide anything it shouldn't
+	void getOccluder(int step, std::vector<glm::vec3> &vertices, std::vector<GLuint> &indices);
+
 	// handle terrain shadow texture, which is built externally by the World object
 	void setShadowTexture(GLuint shadowTexture);
 };
@@ -1,4 +1,5 @@
 #include "world/world.h"
+#include "world/rendersnapshot.h"
 #include "world/sky.h"
 #include "world/terrain.h"
 #include "world/grassmanager.h"
@@ -20,10 +21,22 @@
 #include "particles/particleconfig.h"
 #include "particles/particlemanager.h"
 
+#include "util/dynamicresolution.h"
+#include "util/framedata.h"
+#include "util/glstate.h"
 #include "util/math.h"
 #include "util/image.h"
+#include "util/inputstate.h"
+#include "util/mesharena.h"
+#include "util/occlusionculler.h"
+#include "util/passtimer.h"
 #include "util/planerenderer.h"
+#include "util/renderqueue.h"
 #include "util/profiling.h"
+#include "util/shader.h"
+#include "util/shadercache.h"
+#include "util/textureloader.h"
+#include "util/threadpool.h"
 
 #include "lodepng/lodepng.h"					// for world file loading
 
@@ -43,19 +56,27 @@ using namespace glm;
 using namespace std;
 
 const vec3 World::SUN_DIRECTION(normalize(vec3(0.288, 1.2, 2.2)));			// where the sun comes from
+const vec3 World::FOG_COLOR(0.65, 0.65, 0.65);								// what distant things fade into
 
 const float World::BULLET_RANGE = 500.0;									// how far a bullet should fire
 
 const int World::SHADOW_MAP_SIZE = 2048;									// size of terrain shadow map, in pixels
+const int World::OCCLUDER_STEP = 4;											// occluder vertices are 40m apart
 
 World::World(GLFWwindow *window, vec2 windowSize, string worldFile)
 {
 	preparePerspectiveCamera(windowSize);
 	prepareOrthoCamera(windowSize);
 
+	// shaders pick up the per-frame uniform block when they're linked, so it has to exist before anything loads them
+	frameData = new FrameData(SUN_DIRECTION, FOG_COLOR);
+
 	createPlayer(window, windowSize);
 	createWorld(worldFile);
 
+	// the scene starts out at full resolution, and gives some up whenever the GPU falls behind
+	resolution = new DynamicResolution(windowSize.x, windowSize.y);
+
 	deathTimer = 0.0;
 	gameDone = false;
 
@@ -93,7 +114,8 @@ void World::createWorld(string worldFile)
 
 	const float DRONE_MIN_DIST = 50.0;								// minimum drone starting 2D distance from player
 
-	const int MAX_PARTICLES = 5000;									// maximum number of particles we want in the world
+	const int MAX_PARTICLES = 5000;									// maximum number of CPU particles we want in the world
+	const int MAX_PARTICLE_BURSTS_PER_CONFIG = 1024;				// live analytic bursts we keep for each particle type
 
 	const int NUM_DRONES = 150;										// how many drones to insert into the world
 
@@ -116,6 +138,9 @@ void World::createWorld(string worldFile)
     vector<vec3> treeList;
     vector<vec3>::iterator v;
 
+    vector<vec3> occluderVertices;
+    vector<GLuint> occluderIndices;
+
 	// construct our terrain object from file
 	lodepng_decode32_file(&data, &width, &length, worldFile.c_str());
 
@@ -156,6 +181,10 @@ void World::createWorld(string worldFile)
 	// construct our terrain object now that we know the heights of every single vertex
 	terrain = new Terrain(this, width, length, TERRAIN_TILE_SIZE, heights);
 
+	// the hills hide a lot of what's behind them, so a rough copy of the terrain is used to cull trees and drones
+	terrain -> getOccluder(OCCLUDER_STEP, occluderVertices, occluderIndices);
+	occlusion = new OcclusionCuller(occluderVertices, occluderIndices);
+
 	// now insert the trees we recorded
 	trees = new TreeManager(this, treeList.size());
 	for(v = treeList.begin(); v != treeList.end(); v ++) {
@@ -174,7 +203,7 @@ void World::createWorld(string worldFile)
 	sky = new Sky();
 
 	// start up the particle manager
-	particles = new ParticleManager(MAX_PARTICLES);
+	particles = new ParticleManager(MAX_PARTICLES, MAX_PARTICLE_BURSTS_PER_CONFIG);
 
 	// create the no drone sign
 	signPos = vec3(SIGN_POS.x, getTerrainHeight(SIGN_POS), SIGN_POS.z);
@@ -193,14 +222,30 @@ void World::createWorld(string worldFile)
 
 	// create the list of particle configurations we'll be using
 	initParticleList();
-
-	// start the ambient meadow sound effect
-	ambience = SoundManager::getInstance() -> loadWAV("../wav/ambience.wav");
-	SoundManager::getInstance() -> loopSound(ambience);
+	particles -> reserveGPUParticles(trailSmoke);
+	particles -> reserveGPUParticles(trailFire);
+
+	// everything above only started its shader programs, so the driver has been building them side by side all this
+	// time (or loading them from the binary cache); wait for them together, then let their owners set them up
+	Shader::finishLinks();
+	player -> finishShader();
+	hud -> finishShaders(orthoProjection, orthoView);
+	terrain -> finishShader();
+	trees -> finishShaders();
+	grass -> finishShaders();
+	particles -> finishShaders();
+	sign -> finishShader();
+	drones -> finishShader();
+
+	// start the ambient meadow sound effect; it's long, so it plays straight from disk
+	ambience = SoundManager::getInstance() -> streamSound("../wav/ambience.wav", true);
 
 	// the grass manager can now start up the thread that wraps the grass around the player as they move
 	grass -> beginWrapThread();
 
+	// sound effects have been decoding in the background all this time; make sure they're all in before we start
+	SoundManager::getInstance() -> waitForLoads();
+
 	// we can now free up the memory we used for our initialization
 	delete heights;
 	delete[] data;
@@ -210,7 +255,7 @@ void World::createPlayer(GLFWwindow *window, vec2 windowSize)
 {
 	const vec3 STARTING_POS(2560.0, 0.0, -2560.0);
 	player = new Player(window, this, STARTING_POS);
-	hud = new HUD(player, orthoProjection, orthoView, windowSize);
+	hud = new HUD(player, windowSize);
 }
 
 void World::controlCamera()
@@ -254,28 +299,43 @@ World::~World()
 	delete hud;
 	delete player;
 	delete drones;
+	delete occlusion;
+	delete resolution;
+	delete frameData;
 
 	// shut down singleton instances
 	delete SoundManager::getInstance();
 	delete PlaneRenderer::getInstance();
+	delete RenderQueue::getInstance();
+	delete MeshArena::getInstance();
+	delete ShaderCache::getInstance();
+	delete TextureLoader::getInstance();
+	delete GLState::getInstance();
+	delete PassTimer::getInstance();
+	delete ThreadPool::getInstance();
 }
 
-void World::update(float dt)
+void World::update(float dt, InputState &input)
 {
 
 	// remove anything that needs removal
 	flushGarbage();
 
 	// update the objects in the world
-	player -> update(dt);
+	player -> update(dt, input);
 	grass -> update(dt);
 	drones -> update(dt);
 
 	// has something caused the player to die? if yes, deal with that
 	controlPlayerDeath(dt);
 
-	// remove any expired particles, and update any existing ones
-	particles -> recycle();
+	// let the particle system judge how big effects will appear at the resolution the scene is drawn at; the renderer
+	// changes that as it goes and hands it over with the input, so it may be a frame out of date, which makes no
+	// difference here
+	particles -> setProjectionScale(input.getProjectionScale());
+
+	// update all particles (this also removes any that expired)
+	particles -> setViewerPos(player -> getPos());
 	particles -> update(dt);
 
 	// if the player collided with anything, see that it's dealt with
@@ -287,49 +347,83 @@ void World::update(float dt)
 	player -> computeGunPosition();
 	player -> computeArgonPosition();
 
+	// now that everything that makes noise has moved, give the real audio sources to the sounds that matter most
+	SoundManager::getInstance() -> update(dt);
 
 	// re-build our perspective view (our projection stays the same, of course)
 	controlCamera();
 }
 
-bool notEntered = true;
 extern bool fogFlag;
 
-void World::render()
+void World::writeSnapshot(RenderSnapshot &snapshot)
+{
+	snapshot.view = perspectiveView;
+	snapshot.cameraPos = player -> getPos();
+	snapshot.cameraSide = player -> getCameraSide();
+	snapshot.cameraUp = player -> getCameraUp();
+	snapshot.fog = fogFlag;
+
+	snapshot.grassWaveTime = grass -> getWaveTime();
+
+	player -> snapshot(snapshot.player);
+	drones -> snapshot(snapshot.drones);
+	particles -> snapshot(snapshot.particles);
+	hud -> snapshot(snapshot.hud);
+}
+
+void World::render(RenderSnapshot &snapshot)
 {
 	mat4 modelMat = mat4(1.0);
-	vec3 cameraSide = player -> getCameraSide();
-	vec3 cameraUp = player -> getCameraUp();
-	vec3 playerPos = player -> getPos();
+	RenderQueue *renderQueue = RenderQueue::getInstance();
+	PassTimer *timer = PassTimer::getInstance();
 
-	// Call shaders when needed to enable or diable fog 
-	if(fogFlag && notEntered) {
-		terrain -> loadShader();
-		sky -> loadShader();
-		drones -> loadShader();
-		trees -> loadShaders();
-		notEntered = false;
-	}
+	// start counting state changes afresh
+	GLState::getInstance() -> beginFrame();
 
-	if(!fogFlag && !notEntered) {
-		terrain -> loadShader();
-		sky -> loadShader();
-		drones -> loadShader();
-		trees -> loadShaders();
-		notEntered = true;
-	}
+	// everything below reads the camera, sun, and fog from here; toggling fog is just a change to this block, since the
+	// shaders that can be fogged were built with fog compiled in
+	frameData -> update(perspectiveProjection, snapshot.view, snapshot.cameraPos, snapshot.fog);
+
+	// work out what the terrain hides before anything writes its instance data
+	timer -> beginPass("occlusion");
+	occlusion -> render(perspectiveProjection, snapshot.view);
+
+	// the scene goes to the offscreen target...
+	resolution -> beginScene();
 
 	// A whole bunch of rendering here
-	sky -> render(perspectiveProjection, perspectiveView, playerPos);
-	terrain -> render(perspectiveProjection, perspectiveView, modelMat);
-	trees -> render(perspectiveProjection, perspectiveView, modelMat);
-	grass -> render(perspectiveProjection, perspectiveView, modelMat);
-	player -> renderGun(perspectiveProjection, perspectiveView);
-	player -> renderArgon(perspectiveProjection, perspectiveView);
-	sign -> render(perspectiveProjection, perspectiveView);
-	drones -> render(perspectiveProjection, perspectiveView);
-	particles -> render(perspectiveProjection, perspectiveView, cameraSide, cameraUp);
-	hud -> render();
+	timer -> beginPass("sky");
+	sky -> render(snapshot.cameraPos);
+	timer -> beginPass("terrain");
+	terrain -> render(modelMat);
+
+	// these only queue their draws; the render queue sorts them and draws them a pass at a time
+	timer -> beginPass("queue");
+	trees -> render(occlusion);
+	player -> renderGun(snapshot.player, snapshot.view);
+	player -> renderArgon(snapshot.player, snapshot.view);
+	sign -> render(snapshot.view);
+	drones -> render(snapshot.drones, occlusion);
+
+	timer -> beginPass("opaque");
+	renderQueue -> render(RENDER_PASS_OPAQUE);
+	timer -> beginPass("cutout");
+	renderQueue -> render(RENDER_PASS_CUTOUT);
+	timer -> beginPass("grass");
+	grass -> render(perspectiveProjection, snapshot.view, snapshot.grassWaveTime);
+	timer -> beginPass("transparent");
+	renderQueue -> render(RENDER_PASS_TRANSPARENT);
+	timer -> beginPass("particles");
+	particles -> render(snapshot.particles, snapshot.cameraSide, snapshot.cameraUp);
+
+	// ...and the HUD goes on top of it once it's been scaled up to the window, at full resolution
+	timer -> beginPass("upscale");
+	resolution -> endScene();
+	timer -> beginPass("hud");
+	hud -> render(snapshot.hud);
+
+	renderQueue -> clear();
 }
 
 void World::addGarbageItem()
@@ -419,6 +513,11 @@ void World::addParticle(ParticleConfig *config, vec3 pos, float lifeFactor)
 	particles -> add(config, pos, lifeFactor);
 }
 
+void World::addParticleBurst(ParticleConfig *config, vec3 pos, int count, float lifeFactor)
+{
+	particles -> addBurst(config, pos, count, lifeFactor);
+}
+
 void World::updateRayCollidablesInCylinder(vec3 &p1, vec3 &p2, float lengthSquared, float radiusSquared)
 {
 	vector<Object*>::iterator i;
@@ -489,12 +588,12 @@ void World::fireBullet(vec3 bulletStart, vec3 bulletDir)
 		addParticle(impactFlare, impactPoint);
 
 		// and then add some smoke and dirt, too
+		if(terrainCollision)
+		{
+			addParticleBurst(dirtSpray, impactPoint, 10);
+		}
 		for(int i = 0; i < 10; i ++)
 		{
-			if(terrainCollision)
-			{
-				addParticle(dirtSpray, impactPoint);
-			}
 			addParticle(smoke, impactPoint);
 		}
 
@@ -672,3 +771,30 @@ bool World::isGameDone()
 {
 	return gameDone;
 }
+
+float World::getResolutionScale()
+{
+	return resolution -> getScale();
+}
+
+float World::getProjectionScale()
+{
+	return perspectiveProjection[1][1] * resolution -> getHeight() * 0.5f;
+}
+
+void World::placePlayer(vec3 pos, float pitch, float yaw)
+{
+	pos.y = getTerrainHeight(pos) + Player::PLAYER_HEIGHT;
+	player -> setPos(pos);
+	player -> setLookAngles(pitch, yaw);
+}
+
+void World::lockResolutionScale(float scale)
+{
+	resolution -> lockScale(scale);
+}
+
+void World::setOutputFramebuffer(GLuint framebuffer)
+{
+	resolution -> setOutput(framebuffer);
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "GL/glew.h"
+
 #include "AL/al.h"
 
 #include "glm/glm.hpp"
@@ -25,10 +27,17 @@ class AABBCollider;
 class CylinderCollider;
 
 class Image;
+class InputState;
+class FrameData;
+class OcclusionCuller;
+class DynamicResolution;
+
+struct RenderSnapshot;
 
 class World {
 private:
 	static const int SHADOW_MAP_SIZE;						// how big we want the terrain static shadow map to be
+	static const int OCCLUDER_STEP;							// terrain tiles between the vertices of the occlusion culling terrain
 
 	static const float BULLET_RANGE;						// how far should the player's bullet travel
 
@@ -56,7 +65,7 @@ private:
 	std::vector<AABBCollider*> aabbs;						// list of axis-aligned bounding boxes we can collide with
 	std::vector<CylinderCollider*> cylinders;				// list of upwards-facing cylinders we can collide with
 
-	ALuint ambience;										// OpenAL buffer object for meadow ambience
+	ALuint ambience;										// OpenAL source streaming the meadow ambience
 
 	glm::mat4 perspectiveProjection;						// 4x4 mat describing a perspective projection (for the player's view)
 	glm::mat4 perspectiveView;								// 4x4 mat describing how the perspective camera is oriented
@@ -64,6 +73,10 @@ private:
 	glm::mat4 orthoProjection;								// 4x4 mat describing an orthographic projection (for the HUD)
 	glm::mat4 orthoView;									// 4x4 mat describing how the orthographic camera is oriented
 
+	FrameData *frameData;									// uniform buffer every world shader reads the camera, sun, and fog from
+	OcclusionCuller *occlusion;								// decides which trees and drones the terrain hides each frame
+	DynamicResolution *resolution;							// offscreen target the 3D scene is drawn into, at whatever size the GPU keeps up with
+
 	// initialize the world based on the given file, and the player, too
 	void createWorld(std::string worldFile);
 	void createPlayer(GLFWwindow *window, glm::vec2 windowSize);
@@ -98,19 +111,23 @@ private:
 
 public:
 	static const glm::vec3 SUN_DIRECTION;
+	static const glm::vec3 FOG_COLOR;
 
 	World(GLFWwindow *window, glm::vec2 windowSize, std::string worldFile);
 	~World();
 
-	// main updating and rendering
-	void update(float dt);
-	void render();
+	// main updating and rendering; update() and writeSnapshot() only touch the simulation, and render() only touches GL
+	// and the snapshot it is given, so an update can run on one thread while the last snapshot is drawn on another
+	void update(float dt, InputState &input);
+	void writeSnapshot(RenderSnapshot &snapshot);
+	void render(RenderSnapshot &snapshot);
 
 	void addGarbageItem();					// indicate we want something removed
 	void flushGarbage();					// take out the trash! are there any objects we need to get rid of?
 
 	// create a particle of the given type and add it to the particle system the world owns
 	void addParticle(ParticleConfig *config, glm::vec3 pos, float lifeFactor = 1.0);
+	void addParticleBurst(ParticleConfig *config, glm::vec3 pos, int count, float lifeFactor = 1.0);
 
 	// bullet control and interaction with the environment
 	void fireBullet(glm::vec3 pos, glm::vec3 direction);
@@ -137,4 +154,17 @@ public:
 
 	// allows main loop to quit
 	bool isGameDone();
+
+	// fraction of the window size the 3D scene is currently drawn at
+	float getResolutionScale();
+
+	// projection[1][1] * scene height / 2, for the particle LOD; only the thread that renders may ask, and it passes
+	// the answer to update() through the InputState
+	float getProjectionScale();
+
+	// used by the benchmark to fly the camera along a fixed path at a fixed resolution; pos is on the ground, and the
+	// player's camera goes on top of it
+	void placePlayer(glm::vec3 pos, float pitch, float yaw);
+	void lockResolutionScale(float scale);
+	void setOutputFramebuffer(GLuint framebuffer);	// draw every frame into this instead of the window (0 for the window)
 };